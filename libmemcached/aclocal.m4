@@ -1210,6 +1210,7 @@ m4_include([m4/pandora_have_gcc_atomics.m4])
 m4_include([m4/pandora_have_libevent.m4])
 m4_include([m4/pandora_have_libgtest.m4])
 m4_include([m4/pandora_have_libinnodb.m4])
+m4_include([m4/pandora_have_libvbucket.m4])
 m4_include([m4/pandora_header_assert.m4])
 m4_include([m4/pandora_header_stdcxx_98.m4])
 m4_include([m4/pandora_libtool.m4])
@@ -90,6 +90,8 @@ static struct option long_options[]=
     OPT_TPS                },
   { (OPTIONSTRING)"rep_write",      required_argument,            NULL,
     OPT_REP_WRITE_SRV      },
+  { (OPTIONSTRING)"fixed_rate",     no_argument,                  NULL,
+    OPT_FIXED_RATE         },
   { (OPTIONSTRING)"verbose",        no_argument,                  NULL,
     OPT_VERBOSE            },
   { (OPTIONSTRING)"help",           no_argument,                  NULL,
@@ -154,7 +156,7 @@ static void ms_sync_lock_destroy()
   pthread_mutex_destroy(&ms_global.quit_mutex);
   pthread_mutex_destroy(&ms_global.seq_mutex);
 
-  if (ms_setting.stat_freq > 0)
+  if ((ms_setting.stat_freq > 0) || ms_setting.fixed_rate)
   {
     pthread_mutex_destroy(&ms_statistic.stat_mutex);
   }
@@ -290,6 +292,12 @@ static const char *ms_lookup_help(ms_options_t option)
   case OPT_REP_WRITE_SRV:
     return "The first nth servers can write data, e.g.: --rep_write=2.";
 
+  case OPT_FIXED_RATE:
+    return
+      "Schedule requests at the fixed rate of --tps and measure response\n"
+      "        time from when each request was due, so time spent waiting\n"
+      "        behind a slow response is counted, e.g.: --tps=10k --fixed_rate.";
+
   default:
     return "Forgot to document this option :)";
   } /* switch */
@@ -416,7 +424,7 @@ static void ms_options_parse(int argc, char *argv[])
   int option_index= 0;
   int option_rv;
 
-  while ((option_rv= getopt_long(argc, argv, "VhURbaBs:x:T:c:X:v:d:"
+  while ((option_rv= getopt_long(argc, argv, "VhURbaBLs:x:T:c:X:v:d:"
                                              "t:S:F:w:e:o:n:P:p:",
                                  long_options, &option_index)) != -1)
   {
@@ -619,6 +627,10 @@ static void ms_options_parse(int argc, char *argv[])
       }
       break;
 
+    case OPT_FIXED_RATE:       /* --fixed_rate or -L */
+      ms_setting.fixed_rate= true;
+      break;
+
     case '?':
       /* getopt_long already printed an error message. */
       exit(1);
@@ -659,6 +671,13 @@ static int ms_check_para()
     return -1;
   }
 
+  if (ms_setting.fixed_rate && (ms_setting.expected_tps <= 0))
+  {
+    fprintf(stderr, "Fixed rate mode needs the expected throughput, "
+                    "e.g.: --tps=10k.\n\n");
+    return -1;
+  }
+
   return 0;
 } /* ms_check_para */
 
@@ -677,7 +696,7 @@ static void ms_statistic_init()
 static void ms_stats_init()
 {
   memset(&ms_stats, 0, sizeof(ms_stats_t));
-  if (ms_setting.stat_freq > 0)
+  if ((ms_setting.stat_freq > 0) || ms_setting.fixed_rate)
   {
     ms_statistic_init();
   }
@@ -771,7 +790,7 @@ static void ms_print_memslap_stats(struct timeval *start_time,
                    (unsigned long)ms_stats.udp_timeout);
   }
 
-  if (ms_setting.stat_freq > 0)
+  if ((ms_setting.stat_freq > 0) || ms_setting.fixed_rate)
   {
     ms_dump_stats(&ms_statistic.get_stat);
     ms_dump_stats(&ms_statistic.set_stat);
@@ -790,7 +809,7 @@ static void ms_print_memslap_stats(struct timeval *start_time,
                           ms_stats.bytes_written
                           + ms_stats.bytes_read) / 1024 / 1024
                  / ((double)time_diff / 1000000));
-  assert(pos <= buf);
+  assert(pos <= buf + sizeof(buf));
 
   fprintf(stdout, "%s", buf);
   fflush(stdout);
@@ -134,7 +134,9 @@ static bool ms_update_event(ms_conn_t *c, const int new_flags);
 static uint32_t ms_get_rep_sock_index(ms_conn_t *c, int cmd);
 static uint32_t ms_get_next_sock_index(ms_conn_t *c);
 static int ms_update_conn_sock_event(ms_conn_t *c);
+static int64_t ms_sched_due_time(ms_conn_t *c);
 static bool ms_need_yield(ms_conn_t *c);
+static bool ms_wait_schedule(ms_conn_t *c);
 static void ms_update_start_time(ms_conn_t *c);
 
 
@@ -349,6 +351,9 @@ static int ms_conn_init(ms_conn_t *c,
   c->readval= false;
   c->change_sfd= false;
 
+  c->sched_start= 0;
+  c->sched_ops= 0;
+
   c->precmd.cmd= c->currcmd.cmd= CMD_NULL;
   c->precmd.isfinish= true;         /* default the previous command finished */
   c->currcmd.isfinish= false;
@@ -1300,6 +1305,11 @@ void ms_reset_conn(ms_conn_t *c, bool timeout)
   ms_conn_set_state(c, conn_write);
   memcpy(&c->precmd, &c->currcmd, sizeof(ms_cmdstat_t));    /* replicate command state */
 
+  if (ms_setting.fixed_rate)
+  {
+    gettimeofday(&c->end_time, NULL);
+  }
+
   if (timeout)
   {
     ms_drive_machine(c);
@@ -2443,6 +2453,26 @@ static bool ms_update_event(ms_conn_t *c, const int new_flags)
 } /* ms_update_event */
 
 
+/**
+ * In fixed rate mode each concurrency is due to send its share of
+ * the expected throughput at fixed intervals. The schedule counts
+ * from its start instead of from the previous operation, so a slow
+ * response doesn't push the following operations back, it makes
+ * them late. A concurrency still waits for each response before it
+ * sends again.
+ *
+ * @param c, pointer of the concurrency
+ *
+ * @return int64_t, when the next operation is due, in us
+ */
+static int64_t ms_sched_due_time(ms_conn_t *c)
+{
+  double interval= 1000000.0 * ms_setting.nconns / ms_setting.expected_tps;
+
+  return c->sched_start + (int64_t)((double)c->sched_ops * interval);
+} /* ms_sched_due_time */
+
+
 /**
  * If user want to get the expected throughput, we could limit
  * the performance of memslap. we could give up some work and
@@ -2461,6 +2491,26 @@ static bool ms_need_yield(ms_conn_t *c)
   struct timeval curr_time;
   ms_task_t *task= &c->curr_task;
 
+  if (ms_setting.fixed_rate)
+  {
+    int64_t now;
+
+    /* warming up the server isn't part of the schedule */
+    if (! ms_global.finish_warmup)
+    {
+      return false;
+    }
+
+    gettimeofday(&curr_time, NULL);
+    now= (int64_t)curr_time.tv_sec * 1000000 + curr_time.tv_usec;
+    if (c->sched_start == 0)
+    {
+      c->sched_start= now;
+    }
+
+    return ms_sched_due_time(c) > now;
+  }
+
   if (ms_setting.expected_tps > 0)
   {
     gettimeofday(&curr_time, NULL);
@@ -2480,6 +2530,55 @@ static bool ms_need_yield(ms_conn_t *c)
 } /* ms_need_yield */
 
 
+/**
+ * In fixed rate mode a concurrency that is ahead of its schedule
+ * doesn't spin on write events, it waits on a timer that fires when
+ * its next operation is due.
+ *
+ * @param c, pointer of the concurrency
+ *
+ * @return bool, if success, return true, else return false
+ */
+static bool ms_wait_schedule(ms_conn_t *c)
+{
+  struct event_base *base= c->event.ev_base;
+  struct timeval curr_time;
+  struct timeval wait_time;
+  int64_t delay;
+
+  gettimeofday(&curr_time, NULL);
+  delay= ms_sched_due_time(c)
+         - ((int64_t)curr_time.tv_sec * 1000000 + curr_time.tv_usec);
+  if (delay < 0)
+  {
+    delay= 0;
+  }
+  wait_time.tv_sec= (time_t)(delay / 1000000);
+  wait_time.tv_usec= (suseconds_t)(delay % 1000000);
+
+  if (event_del(&c->event) == -1)
+  {
+    /* try to delete the event again */
+    if (event_del(&c->event) == -1)
+    {
+      return false;
+    }
+  }
+
+  /* no io flags, only the timeout */
+  event_set(&c->event, c->sfd, 0, ms_event_handler, (void *)c);
+  event_base_set(base, &c->event);
+  c->ev_flags= 0;
+
+  if (event_add(&c->event, &wait_time) == -1)
+  {
+    return false;
+  }
+
+  return true;
+} /* ms_wait_schedule */
+
+
 /**
  * used to update the start time of each operation
  *
@@ -2489,7 +2588,7 @@ static void ms_update_start_time(ms_conn_t *c)
 {
   ms_task_item_t *item= c->curr_task.item;
 
-  if ((ms_setting.stat_freq > 0) || c->udp
+  if ((ms_setting.stat_freq > 0) || ms_setting.fixed_rate || c->udp
       || ((c->currcmd.cmd == CMD_SET) && (item->exp_time > 0)))
   {
     gettimeofday(&c->start_time, NULL);
@@ -2499,6 +2598,23 @@ static void ms_update_start_time(ms_conn_t *c)
       item->client_time= c->start_time.tv_sec;
     }
   }
+
+  /* a resend on another socket keeps the slot it was due in */
+  if (ms_setting.fixed_rate && ! c->ctnwrite)
+  {
+    if (c->sched_start > 0)
+    {
+      int64_t due_time= ms_sched_due_time(c);
+
+      c->intended_time.tv_sec= (time_t)(due_time / 1000000);
+      c->intended_time.tv_usec= (suseconds_t)(due_time % 1000000);
+      c->sched_ops++;
+    }
+    else
+    {
+      c->intended_time= c->start_time;
+    }
+  }
 } /* ms_update_start_time */
 
 
@@ -2556,11 +2672,32 @@ static void ms_drive_machine(ms_conn_t *c)
       ms_conn_set_state(c, conn_write);
       memcpy(&c->precmd, &c->currcmd, sizeof(ms_cmdstat_t));        /* replicate command state */
 
+      /**
+       * In fixed rate mode the next command may wait for its turn
+       * before this one is accounted, so stop the clock now.
+       */
+      if (ms_setting.fixed_rate)
+      {
+        gettimeofday(&c->end_time, NULL);
+      }
+
       break;
 
     case conn_write:
       if (! c->ctnwrite && ms_need_yield(c))
       {
+        if (ms_setting.fixed_rate)
+        {
+          if (! ms_wait_schedule(c))
+          {
+            fprintf(stderr, "Couldn't update event.\n");
+            ms_conn_set_state(c, conn_closing);
+            break;
+          }
+          stop= true;
+          break;
+        }
+
         usleep(10);
 
         if (! ms_update_event(c, EV_WRITE | EV_PERSIST))
@@ -193,6 +193,11 @@ typedef struct conn
   struct timeval start_time;        /* start time of current operation(s) */
   struct timeval end_time;          /* end time of current operation(s) */
 
+  /* request schedule of fixed rate mode */
+  int64_t sched_start;              /* when the schedule starts, in us */
+  uint64_t sched_ops;               /* how many operations have been scheduled */
+  struct timeval intended_time;     /* when current operation(s) were due to start */
+
   /* Binary protocol stuff */
   protocol_binary_response_header binary_header;    /* local temporary binary header */
   enum protocol protocol;                           /* which protocol this connection speaks */
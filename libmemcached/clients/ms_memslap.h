@@ -56,6 +56,7 @@ typedef enum
   OPT_OVERWRITE= 'o',
   OPT_TPS= 'P',
   OPT_REP_WRITE_SRV= 'p',
+  OPT_FIXED_RATE= 'L',
 } ms_options_t;
 
 /* global statistic of response time */
@@ -886,6 +886,7 @@ static void ms_setting_slapmode_init_pre()
   ms_setting.cfg_file= NULL;
   ms_setting.sock_per_conn= DEFAULT_SOCK_PER_CONN;
   ms_setting.expected_tps= 0;
+  ms_setting.fixed_rate= false;
   ms_setting.rep_write_srv= 0;
 } /* ms_setting_slapmode_init_pre */
 
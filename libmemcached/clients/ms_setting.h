@@ -155,6 +155,7 @@ typedef struct setting
   uint32_t sock_per_conn;                    /* number of socks per connection structure */
   bool binary_prot;                     /* whether it use binary protocol */
   int expected_tps;                     /* expected throughput */
+  bool fixed_rate;                      /* whether it measures response time from a fixed rate schedule */
   uint32_t rep_write_srv;                    /* which servers are used to do replication writing */
 } ms_setting_st;
 
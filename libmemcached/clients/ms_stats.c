@@ -17,6 +17,11 @@
 #define array_size(x)    (sizeof(x) / sizeof((x)[0]))
 
 static int ms_local_log2(uint64_t value);
+static uint32_t ms_hist_index(uint64_t value);
+static uint64_t ms_hist_value(uint32_t index);
+static uint64_t ms_hist_percentile(ms_stat_t *stat,
+                                   uint64_t events,
+                                   double percentile);
 static uint64_t ms_get_events(ms_stat_t *stat);
 
 
@@ -40,6 +45,96 @@ static int ms_local_log2(uint64_t value)
 } /* ms_local_log2 */
 
 
+/**
+ * get the index of the histogram bucket a value falls in
+ *
+ * @param value, response time in us
+ *
+ * @return return the index of the histogram bucket
+ */
+static uint32_t ms_hist_index(uint64_t value)
+{
+  uint32_t shift= 0;
+
+  if (value < MS_HIST_SUB_BUCKETS)
+  {
+    return (uint32_t)value;
+  }
+
+  while ((value >> shift) >= MS_HIST_SUB_BUCKETS)
+  {
+    shift++;
+  }
+
+  /* value >> shift is in [MS_HIST_HALF_BUCKETS, MS_HIST_SUB_BUCKETS) */
+  return MS_HIST_SUB_BUCKETS + (shift - 1) * MS_HIST_HALF_BUCKETS
+         + (uint32_t)(value >> shift) - MS_HIST_HALF_BUCKETS;
+} /* ms_hist_index */
+
+
+/**
+ * get the highest value a histogram bucket stands for
+ *
+ * @param index, index of the histogram bucket
+ *
+ * @return return the highest value of the bucket
+ */
+static uint64_t ms_hist_value(uint32_t index)
+{
+  uint32_t shift;
+  uint64_t sub;
+
+  if (index < MS_HIST_SUB_BUCKETS)
+  {
+    return index;
+  }
+
+  shift= (index - MS_HIST_SUB_BUCKETS) / MS_HIST_HALF_BUCKETS + 1;
+  sub= (index - MS_HIST_SUB_BUCKETS) % MS_HIST_HALF_BUCKETS
+       + MS_HIST_HALF_BUCKETS;
+
+  /* wraps to the largest uint64_t for the topmost bucket */
+  return ((sub + 1) << shift) - 1;
+} /* ms_hist_value */
+
+
+/**
+ * get the response time below which the given percent of the
+ * events fall
+ *
+ * @param stat, pointer of the statistic structure
+ * @param events, total events recorded
+ * @param percentile, percent of the events, e.g.: 99.9
+ *
+ * @return return the response time in us
+ */
+static uint64_t ms_hist_percentile(ms_stat_t *stat,
+                                   uint64_t events,
+                                   double percentile)
+{
+  uint64_t target= (uint64_t)ceil((double)events * percentile / 100);
+  uint64_t count= 0;
+
+  if (target == 0)
+  {
+    target= 1;
+  }
+
+  for (uint32_t i= 0; i < MS_HIST_BUCKETS; i++)
+  {
+    count+= stat->hist[i];
+    if (count >= target)
+    {
+      uint64_t value= ms_hist_value(i);
+
+      return value < stat->max_time ? value : stat->max_time;
+    }
+  }
+
+  return stat->max_time;
+} /* ms_hist_percentile */
+
+
 /**
  * initialize statistic structure
  *
@@ -104,6 +199,7 @@ void ms_record_event(ms_stat_t *stat, uint64_t total_time, int get_miss)
   }
 
   stat->dist[ms_local_log2(total_time)]++;
+  stat->hist[ms_hist_index(total_time)]++;
   stat->squares+= (double)(total_time * total_time);
 
   if (total_time != 0)
@@ -172,6 +268,14 @@ void ms_dump_stats(ms_stat_t *stat)
            sqrt((stat->squares - (double)events * average
                  * average) / ((double)events - 1)));
   }
+  printf("   P50:  %8lld\n",
+         (long long)ms_hist_percentile(stat, events, 50));
+  printf("   P99:  %8lld\n",
+         (long long)ms_hist_percentile(stat, events, 99));
+  printf("   P99.9:  %6lld\n",
+         (long long)ms_hist_percentile(stat, events, 99.9));
+  printf("   P99.99: %6lld\n",
+         (long long)ms_hist_percentile(stat, events, 99.99));
   printf("   Log2 Dist:");
 
   for (int i= 0; i <= max_non_zero - 4; i+= 4)
@@ -284,7 +388,7 @@ void ms_dump_format_stats(ms_stat_t *stat,
     period_log);
 
   printf(
-    "%-8s %-8d %-12llu %-12lld %-10.1f %-10lld %-8lld %-10lld %-10lld %-10.2f %.2f\n\n",
+    "%-8s %-8d %-12llu %-12lld %-10.1f %-10lld %-8lld %-10lld %-10lld %-10.2f %.2f\n",
     "Global",
     run_time,
     (long long)events,
@@ -297,6 +401,20 @@ void ms_dump_format_stats(ms_stat_t *stat,
     global_std,
     global_log);
 
+  printf("%-8s %-10s %-10s %-10s %-10s\n",
+         "",
+         "P50(us)",
+         "P99(us)",
+         "P99.9(us)",
+         "P99.99(us)");
+
+  printf("%-8s %-10lld %-10lld %-10lld %-10lld\n\n",
+         "Global",
+         (long long)ms_hist_percentile(stat, events, 50),
+         (long long)ms_hist_percentile(stat, events, 99),
+         (long long)ms_hist_percentile(stat, events, 99.9),
+         (long long)ms_hist_percentile(stat, events, 99.99));
+
   stat->pre_events= events;
   stat->pre_squares= (uint64_t)stat->squares;
   stat->pre_total_time= stat->total_time;
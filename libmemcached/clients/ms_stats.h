@@ -22,6 +22,18 @@
 extern "C" {
 #endif
 
+/**
+ * The response time histogram keeps MS_HIST_SUB_BUCKETS linear
+ * buckets below MS_HIST_SUB_BUCKETS us and MS_HIST_HALF_BUCKETS
+ * linear buckets for each power of two above it, the way
+ * HdrHistogram does, so every value is kept within 1/64 of itself.
+ */
+#define MS_HIST_SUB_BITS        7
+#define MS_HIST_SUB_BUCKETS     (1 << MS_HIST_SUB_BITS)
+#define MS_HIST_HALF_BUCKETS    (MS_HIST_SUB_BUCKETS / 2)
+#define MS_HIST_BUCKETS         (MS_HIST_SUB_BUCKETS \
+                                 + (64 - MS_HIST_SUB_BITS) * MS_HIST_HALF_BUCKETS)
+
 /* statistic structure of response time */
 typedef struct
 {
@@ -31,6 +43,7 @@ typedef struct
   uint64_t max_time;
   uint64_t get_miss;
   uint64_t dist[65];
+  uint64_t hist[MS_HIST_BUCKETS];
   double squares;
   double log_product;
 
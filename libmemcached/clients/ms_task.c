@@ -974,8 +974,19 @@ static void ms_update_stat_result(ms_conn_t *c)
   }
   assert(c != NULL);
 
-  gettimeofday(&c->end_time, NULL);
-  uint64_t time_diff= (uint64_t)ms_time_diff(&c->start_time, &c->end_time);
+  if (! ms_setting.fixed_rate)
+  {
+    gettimeofday(&c->end_time, NULL);
+  }
+
+  /**
+   * In fixed rate mode the time a request waited for its turn behind
+   * a slow response counts too, so measure from when it was due.
+   */
+  uint64_t time_diff=
+    (uint64_t)ms_time_diff(ms_setting.fixed_rate ? &c->intended_time
+                                                 : &c->start_time,
+                           &c->end_time);
 
   pthread_mutex_lock(&ms_statistic.stat_mutex);
 
@@ -1028,7 +1039,7 @@ static void ms_update_task_result(ms_conn_t *c)
 
   ms_update_set_result(c, item);
 
-  if ((ms_setting.stat_freq > 0)
+  if (((ms_setting.stat_freq > 0) || ms_setting.fixed_rate)
       && ((c->precmd.cmd == CMD_SET) || (c->precmd.cmd == CMD_GET)))
   {
     ms_update_stat_result(c);
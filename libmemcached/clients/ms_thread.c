@@ -301,6 +301,16 @@ static void ms_create_worker(void *(*func)(void *), void *arg)
 /* initialize threads */
 void ms_thread_init()
 {
+  /**
+   * The fixed rate schedule runs on event timeouts, which libevent 2.1
+   * rounds to whole milliseconds unless it is asked for precise
+   * timers. Older releases ignore the variable.
+   */
+  if (ms_setting.fixed_rate)
+  {
+    setenv("EVENT_PRECISE_TIMER", "1", 0);
+  }
+
   ms_thread_ctx=
     (ms_thread_ctx_t *)malloc(
       sizeof(ms_thread_ctx_t) * (size_t)ms_setting.nthreads);
@@ -169,6 +169,15 @@ uint32_t hashkit_jenkins(const char *key, size_t length, void *context)
     /*--------------- all but the last block: affect some 32 bits of (a,b,c) */
     while (length > 12)
     {
+#ifndef WORDS_BIGENDIAN
+      /* Same little endian words as below, the compiler turns these into
+         plain loads where unaligned access is allowed */
+      uint32_t w[3];
+      memcpy(w, k, sizeof(w));
+      a += w[0];
+      b += w[1];
+      c += w[2];
+#else
       a += k[0];
       a += ((uint32_t)k[1])<<8;
       a += ((uint32_t)k[2])<<16;
@@ -181,6 +190,7 @@ uint32_t hashkit_jenkins(const char *key, size_t length, void *context)
       c += ((uint32_t)k[9])<<8;
       c += ((uint32_t)k[10])<<16;
       c += ((uint32_t)k[11])<<24;
+#endif
       mix(a,b,c);
       length -= 12;
       k += 12;
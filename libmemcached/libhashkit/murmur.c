@@ -4,8 +4,7 @@
 
   Note - This code makes a few assumptions about how your machine behaves -
 
-  1. We can read a 4-byte value from any address without crashing
-  2. sizeof(int) == 4
+  1. sizeof(int) == 4
 
   And it has a few limitations -
   1. It will not work incrementally.
@@ -40,7 +39,9 @@ uint32_t hashkit_murmur(const char *key, size_t length, void *context)
 
   while(length >= 4)
   {
-    unsigned int k = *(unsigned int *)data;
+    unsigned int k;
+
+    memcpy(&k, data, sizeof(k));
 
     k *= m;
     k ^= k >> r;
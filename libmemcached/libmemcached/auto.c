@@ -88,14 +88,15 @@ static memcached_return_t binary_incr_decr(memcached_st *ptr, uint8_t cmd,
                                            uint64_t *value)
 {
   uint32_t server_key;
+  uint16_t vbucket;
+  uint32_t retries= 0;
   memcached_server_write_instance_st instance;
   bool no_reply= ptr->flags.no_reply;
 
   unlikely (memcached_server_count(ptr) == 0)
     return MEMCACHED_NO_SERVERS;
 
-  server_key= memcached_generate_hash_with_redistribution(ptr, master_key, master_key_length);
-  instance= memcached_server_instance_fetch(ptr, server_key);
+  vbucket= memcached_generate_vbucket(ptr, master_key, master_key_length);
 
   if (no_reply)
   {
@@ -111,6 +112,8 @@ static memcached_return_t binary_incr_decr(memcached_st *ptr, uint8_t cmd,
   request.message.header.request.keylen= htons((uint16_t)(key_length + ptr->prefix_key_length));
   request.message.header.request.extlen= 20;
   request.message.header.request.datatype= PROTOCOL_BINARY_RAW_BYTES;
+  request.message.header.request.reserved= htons(vbucket);
+  request.message.header.request.opaque= htonl(vbucket);
   request.message.header.request.bodylen= htonl((uint32_t)(key_length + ptr->prefix_key_length +  request.message.header.request.extlen));
   request.message.body.delta= htonll(offset);
   request.message.body.initial= htonll(initial);
@@ -124,15 +127,24 @@ static memcached_return_t binary_incr_decr(memcached_st *ptr, uint8_t cmd,
   };
 
   memcached_return_t rc;
-  if ((rc= memcached_vdo(instance, vector, 3, true)) != MEMCACHED_SUCCESS)
+  do
   {
-    memcached_io_reset(instance);
-    return (rc == MEMCACHED_SUCCESS) ? MEMCACHED_WRITE_FAILURE : rc;
-  }
+    server_key= memcached_generate_hash_with_redistribution(ptr, master_key, master_key_length);
+    instance= memcached_server_instance_fetch(ptr, server_key);
 
-  if (no_reply)
-    return MEMCACHED_SUCCESS;
-  return memcached_response(instance, (char*)value, sizeof(*value), NULL);
+    if ((rc= memcached_vdo(instance, vector, 3, true)) != MEMCACHED_SUCCESS)
+    {
+      memcached_io_reset(instance);
+      return (rc == MEMCACHED_SUCCESS) ? MEMCACHED_WRITE_FAILURE : rc;
+    }
+
+    if (no_reply)
+      return MEMCACHED_SUCCESS;
+
+    rc= memcached_response(instance, (char*)value, sizeof(*value), NULL);
+  } while (memcached_vbucket_retry(ptr, rc, &retries));
+
+  return rc;
 }
 
 memcached_return_t memcached_increment(memcached_st *ptr,
@@ -175,6 +175,9 @@ memcached_return_t memcached_behavior_set(memcached_st *ptr,
       srandom((uint32_t) time(NULL));
       ptr->flags.randomize_replica_read= set_flag(data);
       break;
+  case MEMCACHED_BEHAVIOR_REPLICA_READ_DEADLINE:
+    ptr->replica_read_deadline= (int32_t)data;
+    break;
   case MEMCACHED_BEHAVIOR_CORK:
       {
         memcached_server_write_instance_st instance;
@@ -378,6 +381,8 @@ uint64_t memcached_behavior_get(memcached_st *ptr,
     return ptr->flags.auto_eject_hosts;
   case MEMCACHED_BEHAVIOR_RANDOMIZE_REPLICA_READ:
     return ptr->flags.randomize_replica_read;
+  case MEMCACHED_BEHAVIOR_REPLICA_READ_DEADLINE:
+    return (uint64_t)ptr->replica_read_deadline;
   case MEMCACHED_BEHAVIOR_CORK:
     return ptr->flags.cork;
   case MEMCACHED_BEHAVIOR_TCP_KEEPALIVE:
@@ -394,6 +399,10 @@ uint64_t memcached_behavior_get(memcached_st *ptr,
 
 memcached_return_t memcached_behavior_set_distribution(memcached_st *ptr, memcached_server_distribution_t type)
 {
+  /* The vbucket map comes from memcached_set_vbucket_config() */
+  if (type == MEMCACHED_DISTRIBUTION_VBUCKET && ptr->vbucket.config == NULL)
+    return MEMCACHED_FAILURE;
+
   if (type < MEMCACHED_DISTRIBUTION_CONSISTENT_MAX)
   {
     ptr->distribution= type;
@@ -164,6 +164,18 @@ static inline memcached_return_t memcached_validate_key_length(size_t key_length
   return MEMCACHED_SUCCESS;
 }
 
+/*
+  A server answered NOT_MY_VBUCKET and the vbucket map has been corrected,
+  so the command can go out again. Give every server one chance.
+*/
+static inline bool memcached_vbucket_retry(const memcached_st *ptr, memcached_return_t rc, uint32_t *retries)
+{
+  if (rc != MEMCACHED_NOT_MY_VBUCKET || ptr->distribution != MEMCACHED_DISTRIBUTION_VBUCKET)
+    return false;
+
+  return (*retries)++ < memcached_server_count(ptr);
+}
+
 #ifdef TCP_CORK
   #define CORK TCP_CORK
 #elif defined TCP_NOPUSH
@@ -73,6 +73,7 @@ typedef enum {
   MEMCACHED_AUTH_PROBLEM,
   MEMCACHED_AUTH_FAILURE,
   MEMCACHED_AUTH_CONTINUE,
+  MEMCACHED_NOT_MY_VBUCKET,
   MEMCACHED_MAXIMUM_RETURN /* Always add new error code before */
 } memcached_return_t;
 
@@ -83,6 +84,7 @@ typedef enum {
   MEMCACHED_DISTRIBUTION_CONSISTENT_KETAMA,
   MEMCACHED_DISTRIBUTION_RANDOM,
   MEMCACHED_DISTRIBUTION_CONSISTENT_KETAMA_SPY,
+  MEMCACHED_DISTRIBUTION_VBUCKET,
   MEMCACHED_DISTRIBUTION_CONSISTENT_MAX
 } memcached_server_distribution_t;
 
@@ -121,6 +123,7 @@ typedef enum {
   MEMCACHED_BEHAVIOR_CORK,
   MEMCACHED_BEHAVIOR_TCP_KEEPALIVE,
   MEMCACHED_BEHAVIOR_TCP_KEEPIDLE,
+  MEMCACHED_BEHAVIOR_REPLICA_READ_DEADLINE,
   MEMCACHED_BEHAVIOR_MAX
 } memcached_behavior_t;
 
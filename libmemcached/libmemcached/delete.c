@@ -10,6 +10,7 @@ memcached_return_t memcached_delete(memcached_st *ptr, const char *key, size_t k
 
 static inline memcached_return_t binary_delete(memcached_st *ptr,
                                                uint32_t server_key,
+                                               uint16_t vbucket,
                                                const char *key,
                                                size_t key_length,
                                                bool flush);
@@ -23,6 +24,7 @@ memcached_return_t memcached_delete_by_key(memcached_st *ptr,
   memcached_return_t rc;
   char buffer[MEMCACHED_DEFAULT_COMMAND_SIZE];
   uint32_t server_key;
+  uint32_t retries= 0;
   memcached_server_write_instance_st instance;
 
   LIBMEMCACHED_MEMCACHED_DELETE_START();
@@ -35,6 +37,7 @@ memcached_return_t memcached_delete_by_key(memcached_st *ptr,
   unlikely (memcached_server_count(ptr) == 0)
     return MEMCACHED_NO_SERVERS;
 
+retry:
   server_key= memcached_generate_hash_with_redistribution(ptr, master_key, master_key_length);
   instance= memcached_server_instance_fetch(ptr, server_key);
 
@@ -46,7 +49,9 @@ memcached_return_t memcached_delete_by_key(memcached_st *ptr,
   {
     likely (! expiration)
     {
-      rc= binary_delete(ptr, server_key, key, key_length, to_write);
+      rc= binary_delete(ptr, server_key,
+                        memcached_generate_vbucket(ptr, master_key, master_key_length),
+                        key, key_length, to_write);
     }
     else
     {
@@ -137,6 +142,8 @@ memcached_return_t memcached_delete_by_key(memcached_st *ptr,
     rc= memcached_response(instance, buffer, MEMCACHED_DEFAULT_COMMAND_SIZE, NULL);
     if (rc == MEMCACHED_DELETED)
       rc= MEMCACHED_SUCCESS;
+    else if (memcached_vbucket_retry(ptr, rc, &retries))
+      goto retry;
   }
 
   if (rc == MEMCACHED_SUCCESS && ptr->delete_trigger)
@@ -149,6 +156,7 @@ error:
 
 static inline memcached_return_t binary_delete(memcached_st *ptr,
                                                uint32_t server_key,
+                                               uint16_t vbucket,
                                                const char *key,
                                                size_t key_length,
                                                bool flush)
@@ -165,6 +173,8 @@ static inline memcached_return_t binary_delete(memcached_st *ptr,
     request.message.header.request.opcode= PROTOCOL_BINARY_CMD_DELETE;
   request.message.header.request.keylen= htons((uint16_t)(key_length + ptr->prefix_key_length));
   request.message.header.request.datatype= PROTOCOL_BINARY_RAW_BYTES;
+  request.message.header.request.reserved= htons(vbucket);
+  request.message.header.request.opaque= htonl(vbucket);
   request.message.header.request.bodylen= htonl((uint32_t)(key_length + ptr->prefix_key_length));
 
   if (ptr->flags.use_udp && ! flush)
@@ -191,7 +201,9 @@ static inline memcached_return_t binary_delete(memcached_st *ptr,
     rc= (rc == MEMCACHED_SUCCESS) ? MEMCACHED_WRITE_FAILURE : rc;
   }
 
-  unlikely (ptr->number_of_replicas > 0)
+  /* With vbuckets the servers do their own replication */
+  unlikely (ptr->number_of_replicas > 0 &&
+            ptr->distribution != MEMCACHED_DISTRIBUTION_VBUCKET)
   {
     request.message.header.request.opcode= PROTOCOL_BINARY_CMD_DELETEQ;
 
@@ -67,7 +67,7 @@ memcached_result_st *memcached_fetch_result(memcached_st *ptr,
       return result;
     else if (*error == MEMCACHED_END)
       memcached_server_response_reset(server);
-    else if (*error != MEMCACHED_NOTFOUND)
+    else if (*error != MEMCACHED_NOTFOUND && *error != MEMCACHED_NOT_MY_VBUCKET)
       break;
   }
 
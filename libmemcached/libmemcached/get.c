@@ -44,6 +44,7 @@ char *memcached_get_by_key(memcached_st *ptr,
   size_t dummy_length;
   uint32_t dummy_flags;
   memcached_return_t dummy_error;
+  uint32_t retries= 0;
 
   unlikely (ptr->flags.use_udp)
   {
@@ -51,13 +52,24 @@ char *memcached_get_by_key(memcached_st *ptr,
     return NULL;
   }
 
-  /* Request the key */
-  *error= memcached_mget_by_key_real(ptr, master_key, master_key_length,
-                                     (const char * const *)&key,
-                                     &key_length, 1, false);
+  /*
+    A NOT_MY_VBUCKET reply reads as a miss, but the vbucket map has been
+    corrected by the time we get here, so ask the new master.
+  */
+  do
+  {
+    ptr->state.is_not_my_vbucket= false;
+
+    /* Request the key */
+    *error= memcached_mget_by_key_real(ptr, master_key, master_key_length,
+                                       (const char * const *)&key,
+                                       &key_length, 1, false);
+
+    value= memcached_fetch(ptr, NULL, NULL,
+                           value_length, flags, error);
+  } while (value == NULL && ptr->state.is_not_my_vbucket &&
+           memcached_vbucket_retry(ptr, MEMCACHED_NOT_MY_VBUCKET, &retries));
 
-  value= memcached_fetch(ptr, NULL, NULL,
-                         value_length, flags, error);
   /* This is for historical reasons */
   if (*error == MEMCACHED_END)
     *error= MEMCACHED_NOTFOUND;
@@ -130,6 +142,7 @@ memcached_return_t memcached_mget(memcached_st *ptr,
 
 static memcached_return_t binary_mget_by_key(memcached_st *ptr,
                                              uint32_t master_server_key,
+                                             uint16_t master_vbucket,
                                              bool is_master_key_set,
                                              const char * const *keys,
                                              const size_t *key_length,
@@ -148,6 +161,7 @@ static memcached_return_t memcached_mget_by_key_real(memcached_st *ptr,
   const char *get_command= "get ";
   uint8_t get_command_length= 4;
   unsigned int master_server_key= (unsigned int)-1; /* 0 is a valid server id! */
+  uint16_t master_vbucket= 0;
   bool is_master_key_set= false;
 
   unlikely (ptr->flags.use_udp)
@@ -169,6 +183,7 @@ static memcached_return_t memcached_mget_by_key_real(memcached_st *ptr,
     if (ptr->flags.verify_key && (memcached_key_test((const char * const *)&master_key, &master_key_length, 1) == MEMCACHED_BAD_KEY_PROVIDED))
       return MEMCACHED_BAD_KEY_PROVIDED;
     master_server_key= memcached_generate_hash_with_redistribution(ptr, master_key, master_key_length);
+    master_vbucket= memcached_generate_vbucket(ptr, master_key, master_key_length);
     is_master_key_set= true;
   }
 
@@ -197,7 +212,7 @@ static memcached_return_t memcached_mget_by_key_real(memcached_st *ptr,
 
   if (ptr->flags.binary_protocol)
   {
-    return binary_mget_by_key(ptr, master_server_key, is_master_key_set, keys,
+    return binary_mget_by_key(ptr, master_server_key, master_vbucket, is_master_key_set, keys,
                               key_length, number_of_keys, mget_mode);
   }
 
@@ -367,6 +382,7 @@ memcached_return_t memcached_mget_execute_by_key(memcached_st *ptr,
 
 static memcached_return_t simple_binary_mget(memcached_st *ptr,
                                              uint32_t master_server_key,
+                                             uint16_t master_vbucket,
                                              bool is_master_key_set,
                                              const char * const *keys,
                                              const size_t *key_length,
@@ -383,15 +399,18 @@ static memcached_return_t simple_binary_mget(memcached_st *ptr,
   for (uint32_t x= 0; x < number_of_keys; ++x)
   {
     uint32_t server_key;
+    uint16_t vbucket;
     memcached_server_write_instance_st instance;
 
     if (is_master_key_set)
     {
       server_key= master_server_key;
+      vbucket= master_vbucket;
     }
     else
     {
       server_key= memcached_generate_hash_with_redistribution(ptr, keys[x], key_length[x]);
+      vbucket= memcached_generate_vbucket(ptr, keys[x], key_length[x]);
     }
 
     instance= memcached_server_instance_fetch(ptr, server_key);
@@ -425,6 +444,8 @@ static memcached_return_t simple_binary_mget(memcached_st *ptr,
 
     request.message.header.request.keylen= htons((uint16_t)(key_length[x] + ptr->prefix_key_length));
     request.message.header.request.datatype= PROTOCOL_BINARY_RAW_BYTES;
+    request.message.header.request.reserved= htons(vbucket);
+    request.message.header.request.opaque= htonl(vbucket);
     request.message.header.request.bodylen= htonl((uint32_t)( key_length[x] + ptr->prefix_key_length));
 
     struct libmemcached_io_vector_st vector[]=
@@ -489,6 +510,257 @@ static memcached_return_t simple_binary_mget(memcached_st *ptr,
   return rc;
 }
 
+/*
+  Where each key of a replicated mget went, so that the keys a slow server
+  is sitting on can be asked for again from the next replica once the
+  deadline passes. The key index travels in the opaque.
+*/
+struct memcached_replica_read_key_st {
+  uint32_t server_key;
+  uint32_t hops;
+  bool is_answered;
+  size_t key_length;
+  size_t key_offset;
+};
+
+struct memcached_replica_read_st {
+  bool is_active;
+  struct timeval deadline;
+  size_t number_of_keys;
+  size_t keys_allocated;
+  struct memcached_replica_read_key_st *keys;
+  size_t data_allocated;
+  char *data;
+};
+
+static void replica_read_arm(memcached_st *ptr)
+{
+  struct memcached_replica_read_st *replica_read= ptr->replica_read;
+
+  gettimeofday(&replica_read->deadline, NULL);
+  replica_read->deadline.tv_sec+= ptr->replica_read_deadline / 1000;
+  replica_read->deadline.tv_usec+= (ptr->replica_read_deadline % 1000) * 1000;
+  if (replica_read->deadline.tv_usec >= 1000000)
+  {
+    replica_read->deadline.tv_sec++;
+    replica_read->deadline.tv_usec-= 1000000;
+  }
+
+  replica_read->is_active= true;
+}
+
+/*
+  Keep a copy of the keys, the caller's array is only ours until mget
+  returns. The buffers are kept from one mget to the next.
+*/
+static memcached_return_t replica_read_start(memcached_st *ptr,
+                                             const char * const *keys,
+                                             const size_t *key_length,
+                                             size_t number_of_keys)
+{
+  struct memcached_replica_read_st *replica_read= ptr->replica_read;
+  size_t data_length= 0;
+
+  if (replica_read == NULL)
+  {
+    replica_read= libmemcached_calloc(ptr, 1, sizeof(struct memcached_replica_read_st));
+    if (replica_read == NULL)
+      return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+    ptr->replica_read= replica_read;
+  }
+
+  for (size_t x= 0; x < number_of_keys; x++)
+    data_length+= key_length[x];
+
+  if (number_of_keys > replica_read->keys_allocated)
+  {
+    struct memcached_replica_read_key_st *new_keys;
+
+    new_keys= libmemcached_realloc(ptr, replica_read->keys,
+                                   sizeof(struct memcached_replica_read_key_st) * number_of_keys);
+    if (new_keys == NULL)
+      return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+
+    replica_read->keys= new_keys;
+    replica_read->keys_allocated= number_of_keys;
+  }
+
+  if (data_length > replica_read->data_allocated)
+  {
+    char *new_data= libmemcached_realloc(ptr, replica_read->data, data_length);
+
+    if (new_data == NULL)
+      return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+
+    replica_read->data= new_data;
+    replica_read->data_allocated= data_length;
+  }
+
+  data_length= 0;
+  for (size_t x= 0; x < number_of_keys; x++)
+  {
+    struct memcached_replica_read_key_st *key= &replica_read->keys[x];
+
+    key->server_key= 0;
+    key->hops= 0;
+    key->is_answered= true; /* Until it is actually sent */
+    key->key_length= key_length[x];
+    key->key_offset= data_length;
+    memcpy(replica_read->data + data_length, keys[x], key_length[x]);
+    data_length+= key_length[x];
+  }
+  replica_read->number_of_keys= number_of_keys;
+
+  return MEMCACHED_SUCCESS;
+}
+
+int memcached_replica_read_timeout(const memcached_st *ptr)
+{
+  const struct memcached_replica_read_st *replica_read= ptr->replica_read;
+  struct timeval now;
+  int64_t remaining;
+
+  if (replica_read == NULL || ! replica_read->is_active)
+    return -1;
+
+  gettimeofday(&now, NULL);
+  remaining= (int64_t)(replica_read->deadline.tv_sec - now.tv_sec) * 1000 +
+             (replica_read->deadline.tv_usec - now.tv_usec) / 1000;
+
+  if (remaining < 0)
+    return 0;
+
+  return (int)remaining;
+}
+
+void memcached_replica_read_answered(memcached_st *ptr, uint32_t opaque)
+{
+  struct memcached_replica_read_st *replica_read= ptr->replica_read;
+
+  if (replica_read == NULL || ! replica_read->is_active)
+    return;
+
+  if (opaque < replica_read->number_of_keys)
+    replica_read->keys[opaque].is_answered= true;
+}
+
+/*
+  The deadline passed: drop the connections to the servers that still owe
+  us keys, so their late replies can't be mistaken for new ones, and ask
+  the next replica for those keys instead.
+*/
+bool memcached_replica_read_fallback(memcached_st *ptr)
+{
+  struct memcached_replica_read_st *replica_read= ptr->replica_read;
+  bool resent= false;
+
+  if (replica_read == NULL || ! replica_read->is_active)
+    return false;
+
+  replica_read->is_active= false;
+
+  for (size_t x= 0; x < replica_read->number_of_keys; x++)
+  {
+    struct memcached_replica_read_key_st *key= &replica_read->keys[x];
+
+    if (key->is_answered == false && key->hops < ptr->number_of_replicas)
+    {
+      memcached_server_write_instance_st instance=
+        memcached_server_instance_fetch(ptr, key->server_key);
+
+      if (memcached_server_response_count(instance))
+        memcached_io_reset(instance);
+    }
+  }
+
+  for (size_t x= 0; x < replica_read->number_of_keys; x++)
+  {
+    struct memcached_replica_read_key_st *key= &replica_read->keys[x];
+
+    if (key->is_answered || key->hops >= ptr->number_of_replicas)
+      continue;
+
+    while (key->hops < ptr->number_of_replicas)
+    {
+      memcached_server_write_instance_st instance;
+
+      key->hops++;
+      key->server_key++;
+      if (key->server_key >= memcached_server_count(ptr))
+        key->server_key= 0;
+
+      instance= memcached_server_instance_fetch(ptr, key->server_key);
+
+      if (memcached_server_response_count(instance) == 0 &&
+          memcached_connect(instance) != MEMCACHED_SUCCESS)
+      {
+        memcached_io_reset(instance);
+        continue;
+      }
+
+      protocol_binary_request_getk request= {
+        .message.header.request= {
+          .magic= PROTOCOL_BINARY_REQ,
+          .opcode= PROTOCOL_BINARY_CMD_GETK,
+          .keylen= htons((uint16_t)(key->key_length + ptr->prefix_key_length)),
+          .datatype= PROTOCOL_BINARY_RAW_BYTES,
+          .bodylen= htonl((uint32_t)(key->key_length + ptr->prefix_key_length)),
+          .opaque= htonl((uint32_t)x)
+        }
+      };
+
+      struct libmemcached_io_vector_st vector[]=
+      {
+        { .length= sizeof(request.bytes), .buffer= request.bytes },
+        { .length= ptr->prefix_key_length, .buffer= ptr->prefix_key },
+        { .length= key->key_length, .buffer= replica_read->data + key->key_offset }
+      };
+
+      if (memcached_io_writev(instance, vector, 3, false) == -1)
+      {
+        memcached_io_reset(instance);
+        continue;
+      }
+
+      memcached_server_response_increment(instance);
+      resent= true;
+      break;
+    }
+  }
+
+  if (resent == false)
+    return false;
+
+  for (uint32_t x= 0; x < memcached_server_count(ptr); x++)
+  {
+    memcached_server_write_instance_st instance=
+      memcached_server_instance_fetch(ptr, x);
+
+    if (memcached_server_response_count(instance) &&
+        memcached_io_write(instance, NULL, 0, true) == -1)
+    {
+      memcached_io_reset(instance);
+    }
+  }
+
+  replica_read_arm(ptr);
+
+  return true;
+}
+
+void memcached_replica_read_free(memcached_st *ptr)
+{
+  struct memcached_replica_read_st *replica_read= ptr->replica_read;
+
+  if (replica_read == NULL)
+    return;
+
+  libmemcached_free(ptr, replica_read->keys);
+  libmemcached_free(ptr, replica_read->data);
+  libmemcached_free(ptr, replica_read);
+  ptr->replica_read= NULL;
+}
+
 static memcached_return_t replication_binary_mget(memcached_st *ptr,
                                                   uint32_t* hash,
                                                   bool* dead_servers,
@@ -499,6 +771,13 @@ static memcached_return_t replication_binary_mget(memcached_st *ptr,
   memcached_return_t rc= MEMCACHED_NOTFOUND;
   uint32_t start= 0;
   uint64_t randomize_read= memcached_behavior_get(ptr, MEMCACHED_BEHAVIOR_RANDOMIZE_REPLICA_READ);
+  bool with_deadline= false;
+
+  if (ptr->replica_read_deadline > 0 &&
+      replica_read_start(ptr, keys, key_length, number_of_keys) == MEMCACHED_SUCCESS)
+  {
+    with_deadline= true;
+  }
 
   if (randomize_read)
     start= (uint32_t)random() % (uint32_t)(ptr->number_of_replicas + 1);
@@ -547,7 +826,8 @@ static memcached_return_t replication_binary_mget(memcached_st *ptr,
           .opcode= PROTOCOL_BINARY_CMD_GETK,
           .keylen= htons((uint16_t)(key_length[x] + ptr->prefix_key_length)),
           .datatype= PROTOCOL_BINARY_RAW_BYTES,
-          .bodylen= htonl((uint32_t)(key_length[x] + ptr->prefix_key_length))
+          .bodylen= htonl((uint32_t)(key_length[x] + ptr->prefix_key_length)),
+          .opaque= htonl(x)
         }
       };
 
@@ -578,17 +858,27 @@ static memcached_return_t replication_binary_mget(memcached_st *ptr,
 
       memcached_server_response_increment(instance);
       hash[x]= memcached_server_count(ptr);
+
+      if (with_deadline)
+      {
+        ptr->replica_read->keys[x].server_key= server;
+        ptr->replica_read->keys[x].is_answered= false;
+      }
     }
 
     if (success)
       break;
   }
 
+  if (with_deadline)
+    replica_read_arm(ptr);
+
   return rc;
 }
 
 static memcached_return_t binary_mget_by_key(memcached_st *ptr,
                                              uint32_t master_server_key,
+                                             uint16_t master_vbucket,
                                              bool is_master_key_set,
                                              const char * const *keys,
                                              const size_t *key_length,
@@ -597,9 +887,14 @@ static memcached_return_t binary_mget_by_key(memcached_st *ptr,
 {
   memcached_return_t rc;
 
-  if (ptr->number_of_replicas == 0)
+  /* Whatever the last mget left behind is not ours to chase anymore */
+  if (ptr->replica_read)
+    ptr->replica_read->is_active= false;
+
+  /* With vbuckets the replicas are not ours to read from */
+  if (ptr->number_of_replicas == 0 || ptr->distribution == MEMCACHED_DISTRIBUTION_VBUCKET)
   {
-    rc= simple_binary_mget(ptr, master_server_key, is_master_key_set,
+    rc= simple_binary_mget(ptr, master_server_key, master_vbucket, is_master_key_set,
                            keys, key_length, number_of_keys, mget_mode);
   }
   else
@@ -79,6 +79,18 @@ memcached_return_t memcached_mget_execute_by_key(memcached_st *ptr,
                                                  void *context,
                                                  const uint32_t number_of_callbacks);
 
+LIBMEMCACHED_LOCAL
+int memcached_replica_read_timeout(const memcached_st *ptr);
+
+LIBMEMCACHED_LOCAL
+bool memcached_replica_read_fallback(memcached_st *ptr);
+
+LIBMEMCACHED_LOCAL
+void memcached_replica_read_answered(memcached_st *ptr, uint32_t opaque);
+
+LIBMEMCACHED_LOCAL
+void memcached_replica_read_free(memcached_st *ptr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,6 +19,11 @@ uint32_t memcached_generate_hash_value(const char *key, size_t key_length, memca
 
 static inline uint32_t generate_hash(const memcached_st *ptr, const char *key, size_t key_length)
 {
+#ifdef LIBMEMCACHED_WITH_VBUCKET_SUPPORT
+  if (ptr->distribution == MEMCACHED_DISTRIBUTION_VBUCKET)
+    return (uint32_t)vbucket_get_vbucket_by_key(ptr->vbucket.config, key, key_length);
+#endif
+
   return hashkit_digest(&ptr->hashkit, key, key_length);
 }
 
@@ -54,6 +59,17 @@ static uint32_t dispatch_host(const memcached_st *ptr, uint32_t hash)
     return hash % memcached_server_count(ptr);
   case MEMCACHED_DISTRIBUTION_RANDOM:
     return (uint32_t) random() % memcached_server_count(ptr);
+  case MEMCACHED_DISTRIBUTION_VBUCKET:
+    {
+      /* For vbuckets the hash is the vbucket id */
+      int master= -1;
+#ifdef LIBMEMCACHED_WITH_VBUCKET_SUPPORT
+      master= vbucket_get_master(ptr->vbucket.config, (int)hash);
+#endif
+      if (master < 0 || (uint32_t)master >= memcached_server_count(ptr))
+        return 0;
+      return (uint32_t)master;
+    }
   case MEMCACHED_DISTRIBUTION_CONSISTENT_MAX:
   default:
     WATCHPOINT_ASSERT(0); /* We have added a distribution without extending the logic */
@@ -69,10 +85,10 @@ static inline uint32_t _generate_hash_wrapper(const memcached_st *ptr, const cha
 {
   WATCHPOINT_ASSERT(memcached_server_count(ptr));
 
-  if (memcached_server_count(ptr) == 1)
+  if (memcached_server_count(ptr) == 1 && ptr->distribution != MEMCACHED_DISTRIBUTION_VBUCKET)
     return 0;
 
-  if (ptr->flags.hash_with_prefix_key)
+  if (ptr->flags.hash_with_prefix_key || ptr->distribution == MEMCACHED_DISTRIBUTION_VBUCKET)
   {
     size_t temp_length= ptr->prefix_key_length + key_length;
     char temp[temp_length];
@@ -124,6 +140,14 @@ uint32_t memcached_generate_hash(const memcached_st *ptr, const char *key, size_
   return dispatch_host(ptr, _generate_hash_wrapper(ptr, key, key_length));
 }
 
+uint16_t memcached_generate_vbucket(const memcached_st *ptr, const char *key, size_t key_length)
+{
+  if (ptr->distribution != MEMCACHED_DISTRIBUTION_VBUCKET)
+    return 0;
+
+  return (uint16_t)_generate_hash_wrapper(ptr, key, key_length);
+}
+
 const hashkit_st *memcached_get_hashkit(const memcached_st *ptr)
 {
   return &ptr->hashkit;
@@ -32,6 +32,9 @@ uint32_t memcached_generate_hash(const memcached_st *ptr, const char *key, size_
 LIBMEMCACHED_LOCAL
 uint32_t memcached_generate_hash_with_redistribution(memcached_st *ptr, const char *key, size_t key_length);
 
+LIBMEMCACHED_LOCAL
+uint16_t memcached_generate_vbucket(const memcached_st *ptr, const char *key, size_t key_length);
+
 LIBMEMCACHED_API
 void memcached_autoeject(memcached_st *ptr);
 
@@ -50,7 +50,8 @@ static void sort_hosts(memcached_st *ptr)
 
 memcached_return_t run_distribution(memcached_st *ptr)
 {
-  if (ptr->flags.use_sort_hosts)
+  /* The vbucket map refers to servers by their position in the config */
+  if (ptr->flags.use_sort_hosts && ptr->distribution != MEMCACHED_DISTRIBUTION_VBUCKET)
     sort_hosts(ptr);
 
   switch (ptr->distribution)
@@ -64,6 +65,8 @@ memcached_return_t run_distribution(memcached_st *ptr)
   case MEMCACHED_DISTRIBUTION_RANDOM:
     srandom((uint32_t) time(NULL));
     break;
+  case MEMCACHED_DISTRIBUTION_VBUCKET:
+    break;
   case MEMCACHED_DISTRIBUTION_CONSISTENT_MAX:
   default:
     WATCHPOINT_ASSERT(0); /* We have added a distribution without extending the logic */
@@ -500,69 +500,75 @@ memcached_server_write_instance_st memcached_io_get_readable_server(memcached_st
 {
 #define MAX_SERVERS_TO_POLL 100
   struct pollfd fds[MAX_SERVERS_TO_POLL];
-  unsigned int host_index= 0;
+  uint32_t servers[MAX_SERVERS_TO_POLL];
 
-  for (uint32_t x= 0;
-       x< memcached_server_count(memc) && host_index < MAX_SERVERS_TO_POLL;
-       ++x)
+  while (1)
   {
-    memcached_server_write_instance_st instance=
-      memcached_server_instance_fetch(memc, x);
+    unsigned int host_index= 0;
+    int deadline= memcached_replica_read_timeout(memc);
+    int timeout= memc->poll_timeout;
 
-    if (instance->read_buffer_length > 0) /* I have data in the buffer */
-      return instance;
-
-    if (memcached_server_response_count(instance) > 0)
-    {
-      fds[host_index].events = POLLIN;
-      fds[host_index].revents = 0;
-      fds[host_index].fd = instance->fd;
-      ++host_index;
-    }
-  }
-
-  if (host_index < 2)
-  {
-    /* We have 0 or 1 server with pending events.. */
-    for (uint32_t x= 0; x< memcached_server_count(memc); ++x)
+    for (uint32_t x= 0;
+         x< memcached_server_count(memc) && host_index < MAX_SERVERS_TO_POLL;
+         ++x)
     {
       memcached_server_write_instance_st instance=
         memcached_server_instance_fetch(memc, x);
 
+      if (instance->read_buffer_length > 0) /* I have data in the buffer */
+        return instance;
+
       if (memcached_server_response_count(instance) > 0)
       {
-        return instance;
+        fds[host_index].events = POLLIN;
+        fds[host_index].revents = 0;
+        fds[host_index].fd = instance->fd;
+        servers[host_index]= x;
+        ++host_index;
       }
     }
 
-    return NULL;
-  }
+    if (host_index == 0)
+      return NULL;
 
-  int err= poll(fds, host_index, memc->poll_timeout);
-  switch (err) {
-  case -1:
-    memc->cached_errno = get_socket_errno();
-    /* FALLTHROUGH */
-  case 0:
-    break;
-  default:
-    for (size_t x= 0; x < host_index; ++x)
-    {
-      if (fds[x].revents & POLLIN)
-      {
-        for (uint32_t y= 0; y < memcached_server_count(memc); ++y)
-        {
-          memcached_server_write_instance_st instance=
-            memcached_server_instance_fetch(memc, y);
+    /*
+      A single pending server can simply be read from, unless a replica read
+      deadline is running; then we have to watch the clock too.
+    */
+    if (host_index == 1 && deadline == -1)
+      return memcached_server_instance_fetch(memc, servers[0]);
 
-          if (instance->fd == fds[x].fd)
-            return instance;
-        }
+    /*
+      While a replica read deadline runs it replaces the poll timeout, even
+      a shorter one, so the slow servers' keys still get their fallback.
+      The replicas are then waited on with the poll timeout as usual.
+    */
+    if (deadline != -1)
+      timeout= deadline;
+
+    int err= poll(fds, host_index, timeout);
+    switch (err) {
+    case -1:
+      memc->cached_errno = get_socket_errno();
+      break;
+    case 0:
+      /* Move the slow servers' keys along to their replicas, and go on */
+      if (deadline != -1)
+      {
+        (void)memcached_replica_read_fallback(memc);
+        continue;
+      }
+      break;
+    default:
+      for (size_t x= 0; x < host_index; ++x)
+      {
+        if (fds[x].revents & POLLIN)
+          return memcached_server_instance_fetch(memc, servers[x]);
       }
     }
-  }
 
-  return NULL;
+    return NULL;
+  }
 }
 
 static ssize_t io_flush(memcached_server_write_instance_st ptr,
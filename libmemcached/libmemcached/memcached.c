@@ -16,6 +16,7 @@ static const memcached_st global_copy= {
     .is_purging= false,
     .is_processing_input= false,
     .is_time_for_rebuild= false,
+    .is_not_my_vbucket= false,
   },
   .flags= {
     .auto_eject_hosts= false,
@@ -80,6 +81,8 @@ static inline bool _memcached_init(memcached_st *self)
   self->next_distribution_rebuild= 0;
   self->prefix_key_length= 0;
   self->number_of_replicas= 0;
+  self->replica_read_deadline= 0;
+  self->replica_read= NULL;
   hash_ptr= hashkit_create(&self->distribution_hashkit);
   if (! hash_ptr)
     return false;
@@ -94,6 +97,8 @@ static inline bool _memcached_init(memcached_st *self)
   self->callbacks= NULL;
   self->sasl.callbacks= NULL;
   self->sasl.is_allocated= false;
+  self->vbucket.config= NULL;
+  self->vbucket.json= NULL;
 
   return true;
 }
@@ -177,6 +182,8 @@ void memcached_free(memcached_st *ptr)
   if (ptr->continuum)
     libmemcached_free(ptr, ptr->continuum);
 
+  memcached_replica_read_free(ptr);
+
   if (ptr->sasl.callbacks)
   {
 #ifdef LIBMEMCACHED_WITH_SASL_SUPPORT
@@ -184,6 +191,10 @@ void memcached_free(memcached_st *ptr)
 #endif
   }
 
+#ifdef LIBMEMCACHED_WITH_VBUCKET_SUPPORT
+  memcached_destroy_vbucket_config(ptr);
+#endif
+
   if (memcached_is_allocated(ptr))
   {
     libmemcached_free(ptr, ptr);
@@ -254,6 +265,7 @@ memcached_st *memcached_clone(memcached_st *clone, const memcached_st *source)
   new_clone->io_bytes_watermark= source->io_bytes_watermark;
   new_clone->io_key_prefetch= source->io_key_prefetch;
   new_clone->number_of_replicas= source->number_of_replicas;
+  new_clone->replica_read_deadline= source->replica_read_deadline;
   new_clone->tcp_keepidle= source->tcp_keepidle;
 
   if (memcached_server_count(source))
@@ -284,6 +296,14 @@ memcached_st *memcached_clone(memcached_st *clone, const memcached_st *source)
   }
 #endif
 
+#ifdef LIBMEMCACHED_WITH_VBUCKET_SUPPORT
+  if (memcached_clone_vbucket(new_clone, source) != MEMCACHED_SUCCESS)
+  {
+    memcached_free(new_clone);
+    return NULL;
+  }
+#endif
+
   rc= run_distribution(new_clone);
 
   if (rc != MEMCACHED_SUCCESS)
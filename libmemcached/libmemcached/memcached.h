@@ -53,6 +53,7 @@
 #include <libmemcached/verbosity.h>
 #include <libmemcached/version.h>
 #include <libmemcached/sasl.h>
+#include <libmemcached/vbucket.h>
 
 struct memcached_st {
   /**
@@ -62,6 +63,7 @@ struct memcached_st {
     bool is_purging:1;
     bool is_processing_input:1;
     bool is_time_for_rebuild:1;
+    bool is_not_my_vbucket:1;
   } state;
   struct {
     // Everything below here is pretty static.
@@ -107,6 +109,7 @@ struct memcached_st {
   time_t next_distribution_rebuild; // Ketama
   size_t prefix_key_length;
   uint32_t number_of_replicas;
+  int32_t replica_read_deadline;
   hashkit_st distribution_hashkit;
   memcached_result_st result;
   memcached_continuum_item_st *continuum; // Ketama
@@ -125,6 +128,8 @@ struct memcached_st {
   memcached_trigger_delete_key_fn delete_trigger;
   memcached_callback_st *callbacks;
   struct memcached_sasl_st sasl;
+  struct memcached_vbucket_st vbucket;
+  struct memcached_replica_read_st *replica_read;
   char prefix_key[MEMCACHED_PREFIX_KEY_MAX_SIZE];
   struct {
     bool is_allocated:1;
@@ -362,6 +362,25 @@ static memcached_return_t binary_read_one_response(memcached_server_write_instan
   header.response.cas= ntohll(header.response.cas);
   uint32_t bodylen= header.response.bodylen;
 
+  unlikely (header.response.status == PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET)
+  {
+    /*
+      We sent the vbucket in the opaque, so the map can be corrected here,
+      even for the quiet commands whose errors we throw away below.
+    */
+    memcached_st *root= (memcached_st *)ptr->root;
+
+    root->state.is_not_my_vbucket= true;
+#ifdef LIBMEMCACHED_WITH_VBUCKET_SUPPORT
+    memcached_vbucket_found_incorrect_master(root, ntohl(header.response.opaque),
+                                             (uint32_t)(ptr - memcached_server_list(root)));
+#endif
+  }
+
+  /* A replicated mget sends the key's index along, hit or miss it is done */
+  if (header.response.opcode == PROTOCOL_BINARY_CMD_GETK)
+    memcached_replica_read_answered((memcached_st *)ptr->root, ntohl(header.response.opaque));
+
   if (header.response.status == PROTOCOL_BINARY_RESPONSE_SUCCESS ||
       header.response.status == PROTOCOL_BINARY_RESPONSE_AUTH_CONTINUE)
   {
@@ -572,6 +591,9 @@ static memcached_return_t binary_read_one_response(memcached_server_write_instan
     case PROTOCOL_BINARY_RESPONSE_AUTH_ERROR:
       rc= MEMCACHED_AUTH_FAILURE;
       break;
+    case PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET:
+      rc= MEMCACHED_NOT_MY_VBUCKET;
+      break;
     case PROTOCOL_BINARY_RESPONSE_EINVAL:
     case PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND:
     default:
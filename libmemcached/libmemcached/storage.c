@@ -47,6 +47,7 @@ static inline const char *storage_op_string(memcached_storage_action_t verb)
 static memcached_return_t memcached_send_binary(memcached_st *ptr,
                                                 memcached_server_write_instance_st server,
                                                 uint32_t server_key,
+                                                uint16_t vbucket,
                                                 const char *key,
                                                 size_t key_length,
                                                 const char *value,
@@ -92,10 +93,23 @@ static inline memcached_return_t memcached_send(memcached_st *ptr,
 
   if (ptr->flags.binary_protocol)
   {
-    rc= memcached_send_binary(ptr, instance, server_key,
-                              key, key_length,
-                              value, value_length, expiration,
-                              flags, cas, verb);
+    uint16_t vbucket= memcached_generate_vbucket(ptr, master_key, master_key_length);
+    uint32_t retries= 0;
+
+    do
+    {
+      if (retries)
+      {
+        server_key= memcached_generate_hash_with_redistribution(ptr, master_key, master_key_length);
+        instance= memcached_server_instance_fetch(ptr, server_key);
+      }
+
+      rc= memcached_send_binary(ptr, instance, server_key, vbucket,
+                                key, key_length,
+                                value, value_length, expiration,
+                                flags, cas, verb);
+    } while (memcached_vbucket_retry(ptr, rc, &retries));
+
     WATCHPOINT_IF_LABELED_NUMBER(instance->io_wait_count.read > 2, "read IO_WAIT", instance->io_wait_count.read);
     WATCHPOINT_IF_LABELED_NUMBER(instance->io_wait_count.write > 2, "write_IO_WAIT", instance->io_wait_count.write);
   }
@@ -462,6 +476,7 @@ static inline uint8_t get_com_code(memcached_storage_action_t verb, bool noreply
 static memcached_return_t memcached_send_binary(memcached_st *ptr,
                                                 memcached_server_write_instance_st server,
                                                 uint32_t server_key,
+                                                uint16_t vbucket,
                                                 const char *key,
                                                 size_t key_length,
                                                 const char *value,
@@ -481,6 +496,8 @@ static memcached_return_t memcached_send_binary(memcached_st *ptr,
   request.message.header.request.opcode= get_com_code(verb, noreply);
   request.message.header.request.keylen= htons((uint16_t)(key_length + ptr->prefix_key_length));
   request.message.header.request.datatype= PROTOCOL_BINARY_RAW_BYTES;
+  request.message.header.request.reserved= htons(vbucket);
+  request.message.header.request.opaque= htonl(vbucket);
   if (verb == APPEND_OP || verb == PREPEND_OP)
     send_length -= 8; /* append & prepend does not contain extras! */
   else
@@ -528,7 +545,9 @@ static memcached_return_t memcached_send_binary(memcached_st *ptr,
     return (rc == MEMCACHED_SUCCESS) ? MEMCACHED_WRITE_FAILURE : rc;
   }
 
-  if (verb == SET_OP && ptr->number_of_replicas > 0)
+  /* With vbuckets the servers do their own replication */
+  if (verb == SET_OP && ptr->number_of_replicas > 0 &&
+      ptr->distribution != MEMCACHED_DISTRIBUTION_VBUCKET)
   {
     request.message.header.request.opcode= PROTOCOL_BINARY_CMD_SETQ;
     WATCHPOINT_STRING("replicating");
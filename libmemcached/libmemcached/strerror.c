@@ -91,6 +91,8 @@ const char *memcached_strerror(memcached_st *ptr, memcached_return_t rc)
     return "AUTHENTICATION FAILURE";
   case MEMCACHED_AUTH_CONTINUE:
     return "CONTINUE AUTHENTICATION";
+  case MEMCACHED_NOT_MY_VBUCKET:
+    return "SERVER IS NOT THE MASTER FOR THE KEY'S VBUCKET";
   case MEMCACHED_MAXIMUM_RETURN:
     return "Gibberish returned!";
   default:
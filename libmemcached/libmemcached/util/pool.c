@@ -16,18 +16,104 @@
 #include <errno.h>
 #include <pthread.h>
 
+/*
+  The idle connections live in a fixed array of slots. pop and push claim a
+  slot with a compare and swap, and "available" counts the handles sitting
+  in the slots, so that a pop which reserved one is sure to find it.
+  The mutex is only taken to grow the pool, to wait for a handle, or to
+  bring a handle up to date with the master.
+*/
 struct memcached_pool_st
 {
   pthread_mutex_t mutex;
   pthread_cond_t cond;
   memcached_st *master;
   memcached_st **mmc;
-  int firstfree;
   uint32_t size;
   uint32_t current_size;
+  uint32_t available;
+  uint32_t waiters;
   char *version;
+  memcached_pool_stats_st stats;
 };
 
+#ifdef HAVE_GCC_ATOMIC_BUILTINS
+static inline bool pool_cas_handle(memcached_pool_st *pool, memcached_st **slot,
+                                   memcached_st *old_mmc, memcached_st *new_mmc)
+{
+  (void)pool;
+  return __sync_bool_compare_and_swap(slot, old_mmc, new_mmc);
+}
+
+static inline bool pool_cas_count(memcached_pool_st *pool, uint32_t *count,
+                                  uint32_t old_count, uint32_t new_count)
+{
+  (void)pool;
+  return __sync_bool_compare_and_swap(count, old_count, new_count);
+}
+
+static inline uint32_t pool_read_count(uint32_t *count)
+{
+  return __sync_fetch_and_add(count, 0);
+}
+#else
+static pthread_mutex_t pool_atomic_mutex= PTHREAD_MUTEX_INITIALIZER;
+
+static inline bool pool_cas_handle(memcached_pool_st *pool, memcached_st **slot,
+                                   memcached_st *old_mmc, memcached_st *new_mmc)
+{
+  bool swapped= false;
+
+  (void)pool;
+  pthread_mutex_lock(&pool_atomic_mutex);
+  if (*slot == old_mmc)
+  {
+    *slot= new_mmc;
+    swapped= true;
+  }
+  pthread_mutex_unlock(&pool_atomic_mutex);
+
+  return swapped;
+}
+
+static inline bool pool_cas_count(memcached_pool_st *pool, uint32_t *count,
+                                  uint32_t old_count, uint32_t new_count)
+{
+  bool swapped= false;
+
+  (void)pool;
+  pthread_mutex_lock(&pool_atomic_mutex);
+  if (*count == old_count)
+  {
+    *count= new_count;
+    swapped= true;
+  }
+  pthread_mutex_unlock(&pool_atomic_mutex);
+
+  return swapped;
+}
+
+static inline uint32_t pool_read_count(uint32_t *count)
+{
+  uint32_t value;
+
+  pthread_mutex_lock(&pool_atomic_mutex);
+  value= *count;
+  pthread_mutex_unlock(&pool_atomic_mutex);
+
+  return value;
+}
+#endif
+
+static inline void pool_add_count(memcached_pool_st *pool, uint32_t *count, int32_t delta)
+{
+  uint32_t value;
+
+  do
+    value= pool_read_count(count);
+  while (! pool_cas_count(pool, count, value, value + (uint32_t)delta));
+}
+
 static memcached_return_t mutex_enter(pthread_mutex_t *mutex)
 {
   int ret;
@@ -48,27 +134,113 @@ static memcached_return_t mutex_exit(pthread_mutex_t *mutex)
   return (ret == -1) ? MEMCACHED_ERRNO : MEMCACHED_SUCCESS;
 }
 
+/*
+  Threads start their slot scans at different places, so that they mostly
+  keep out of each other's way, and tend to get their own handle back.
+*/
+static inline uint32_t slot_hint(const memcached_pool_st *pool)
+{
+  uintptr_t self= (uintptr_t)pthread_self();
+
+  return (uint32_t)((self >> 4) % pool->size);
+}
+
+/**
+ * Put a handle in a free slot. There always is one, since there are never
+ * more handles than slots.
+ */
+static void slot_put(memcached_pool_st *pool, memcached_st *mmc)
+{
+  uint32_t x= slot_hint(pool);
+
+  while (! pool_cas_handle(pool, &pool->mmc[x], NULL, mmc))
+  {
+    if (++x == pool->size)
+      x= 0;
+  }
+
+  pool_add_count(pool, &pool->available, 1);
+}
+
+/**
+ * Take a handle out of the slots, or return NULL if none are available.
+ */
+static memcached_st *slot_take(memcached_pool_st *pool)
+{
+  uint32_t available;
+
+  do
+  {
+    available= pool_read_count(&pool->available);
+    if (available == 0)
+      return NULL;
+  }
+  while (! pool_cas_count(pool, &pool->available, available, available - 1));
+
+  /* We own one of the handles now, go find it */
+  for (uint32_t x= slot_hint(pool);; )
+  {
+    memcached_st *mmc= pool->mmc[x];
+
+    if (mmc != NULL && pool_cas_handle(pool, &pool->mmc[x], mmc, NULL))
+      return mmc;
+
+    if (++x == pool->size)
+      x= 0;
+  }
+}
+
 /**
  * Grow the connection pool by creating a connection structure and clone the
- * original memcached handle.
+ * original memcached handle. Must be called with the mutex held.
  */
-static int grow_pool(memcached_pool_st* pool)
+static memcached_st *grow_pool(memcached_pool_st* pool)
 {
-  memcached_st *obj= calloc(1, sizeof(*obj));
+  memcached_st *obj;
 
+  if (pool->current_size == pool->size)
+    return NULL;
+
+  obj= calloc(1, sizeof(*obj));
   if (obj == NULL)
-    return -1;
+    return NULL;
 
   if (memcached_clone(obj, pool->master) == NULL)
   {
     free(obj);
-    return -1;
+    return NULL;
   }
 
-  pool->mmc[++pool->firstfree] = obj;
-  pool->current_size++;
+  pool_add_count(pool, &pool->current_size, 1);
 
-  return 0;
+  return obj;
+}
+
+/**
+ * Bring a handle up to date with the behaviors set on the pool since it
+ * was last in it. Must be called with the mutex held.
+ */
+static memcached_return_t refresh_handle(memcached_pool_st *pool, memcached_st *mmc)
+{
+  if (memcached_get_user_data(mmc) == pool->version)
+    return MEMCACHED_SUCCESS;
+
+  memcached_free(mmc);
+  memset(mmc, 0, sizeof(*mmc));
+  if (memcached_clone(mmc, pool->master) == NULL)
+    return MEMCACHED_SOME_ERRORS;
+
+  return MEMCACHED_SUCCESS;
+}
+
+static inline uint64_t elapsed_usec(const struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+
+  return (uint64_t)((now.tv_sec - start->tv_sec) * 1000000 +
+                    (now.tv_usec - start->tv_usec));
 }
 
 memcached_pool_st *memcached_pool_create(memcached_st* mmc,
@@ -79,9 +251,16 @@ memcached_pool_st *memcached_pool_create(memcached_st* mmc,
     .cond = PTHREAD_COND_INITIALIZER,
     .master = mmc,
     .mmc = calloc(max, sizeof(memcached_st*)),
-    .firstfree = -1,
     .size = max,
-    .current_size = 0 };
+    .current_size = 0,
+    .available = 0,
+    .waiters = 0 };
+
+  if (max == 0)
+  {
+    free(object.mmc);
+    return NULL;
+  }
 
   if (object.mmc != NULL)
   {
@@ -100,8 +279,12 @@ memcached_pool_st *memcached_pool_create(memcached_st* mmc,
     */
     for (unsigned int ii= 0; ii < initial; ++ii)
     {
-      if (grow_pool(ret) == -1)
+      memcached_st *obj= grow_pool(ret);
+
+      if (obj == NULL)
         break;
+
+      slot_put(ret, obj);
     }
   }
 
@@ -112,8 +295,11 @@ memcached_st*  memcached_pool_destroy(memcached_pool_st* pool)
 {
   memcached_st *ret = pool->master;
 
-  for (int xx= 0; xx <= pool->firstfree; ++xx)
+  for (uint32_t xx= 0; xx < pool->size; ++xx)
   {
+    if (pool->mmc[xx] == NULL)
+      continue;
+
     memcached_free(pool->mmc[xx]);
     free(pool->mmc[xx]);
     pool->mmc[xx] = NULL;
@@ -131,40 +317,84 @@ memcached_st* memcached_pool_pop(memcached_pool_st* pool,
                                  bool block,
                                  memcached_return_t *rc)
 {
-  memcached_st *ret= NULL;
+  memcached_st *ret= slot_take(pool);
+  struct timeval start= { .tv_sec= 0 };
+  bool waited= false;
+
+  *rc= MEMCACHED_SUCCESS;
+
+  /* The fast path: an idle handle that nobody changed behind its back */
+  if (ret != NULL && memcached_get_user_data(ret) == pool->version)
+    return ret;
+
   if ((*rc= mutex_enter(&pool->mutex)) != MEMCACHED_SUCCESS)
+  {
+    if (ret != NULL)
+      slot_put(pool, ret);
     return NULL;
+  }
 
-  do
+  while (ret == NULL)
   {
-    if (pool->firstfree > -1)
-      ret= pool->mmc[pool->firstfree--];
-    else if (pool->current_size == pool->size)
+    if ((ret= slot_take(pool)) != NULL)
+      break;
+
+    if ((ret= grow_pool(pool)) != NULL)
+      break;
+
+    if (pool->current_size < pool->size)
     {
-      if (!block)
-      {
-        *rc= mutex_exit(&pool->mutex);
-        return NULL;
-      }
-
-      if (pthread_cond_wait(&pool->cond, &pool->mutex) == -1)
-      {
-        int err = errno;
-        mutex_exit(&pool->mutex);
-        errno = err;
-        *rc= MEMCACHED_ERRNO;
-        return NULL;
-      }
+      /* We may grow, we just failed to allocate */
+      *rc= mutex_exit(&pool->mutex);
+      return NULL;
     }
-    else if (grow_pool(pool) == -1)
+
+    if (waited == false)
+    {
+      pool->stats.exhausted++;
+      gettimeofday(&start, NULL);
+    }
+
+    if (!block)
     {
       *rc= mutex_exit(&pool->mutex);
       return NULL;
     }
+
+    /*
+      Check again once we are counted as a waiter: a push that did not see
+      us has already put its handle in a slot.
+    */
+    pool_add_count(pool, &pool->waiters, 1);
+    if ((ret= slot_take(pool)) == NULL &&
+        pthread_cond_wait(&pool->cond, &pool->mutex) == -1)
+    {
+      int err = errno;
+      pool_add_count(pool, &pool->waiters, -1);
+      mutex_exit(&pool->mutex);
+      errno = err;
+      *rc= MEMCACHED_ERRNO;
+      return NULL;
+    }
+    pool_add_count(pool, &pool->waiters, -1);
+    waited= true;
   }
-  while (ret == NULL);
 
-  *rc= mutex_exit(&pool->mutex);
+  if (waited)
+  {
+    uint64_t wait_time= elapsed_usec(&start);
+
+    pool->stats.waits++;
+    pool->stats.wait_time+= wait_time;
+    if (wait_time > pool->stats.max_wait_time)
+      pool->stats.max_wait_time= wait_time;
+  }
+
+  *rc= refresh_handle(pool, ret);
+
+  memcached_return_t rval= mutex_exit(&pool->mutex);
+  if (*rc == MEMCACHED_SUCCESS)
+    *rc= rval;
 
   return ret;
 }
@@ -172,36 +402,38 @@ memcached_st* memcached_pool_pop(memcached_pool_st* pool,
 memcached_return_t memcached_pool_push(memcached_pool_st* pool,
                                        memcached_st *mmc)
 {
-  memcached_return_t rc= mutex_enter(&pool->mutex);
+  memcached_return_t rc= MEMCACHED_SUCCESS;
 
-  if (rc != MEMCACHED_SUCCESS)
-    return rc;
-
-  char* version= memcached_get_user_data(mmc);
   /* Someone updated the behavior on the object.. */
-  if (version != pool->version)
+  if (memcached_get_user_data(mmc) != pool->version)
   {
-    memcached_free(mmc);
-    memset(mmc, 0, sizeof(*mmc));
-    if (memcached_clone(mmc, pool->master) == NULL)
-    {
-      rc= MEMCACHED_SOME_ERRORS;
-    }
+    if ((rc= mutex_enter(&pool->mutex)) != MEMCACHED_SUCCESS)
+      return rc;
+
+    rc= refresh_handle(pool, mmc);
+
+    memcached_return_t rval= mutex_exit(&pool->mutex);
+    if (rc == MEMCACHED_SUCCESS)
+      rc= rval;
   }
 
-  pool->mmc[++pool->firstfree]= mmc;
+  slot_put(pool, mmc);
 
-  if (pool->firstfree == 0 && pool->current_size == pool->size)
+  if (pool_read_count(&pool->waiters) > 0)
   {
     /* we might have people waiting for a connection.. wake them up :-) */
-    pthread_cond_broadcast(&pool->cond);
-  }
+    memcached_return_t rval= mutex_enter(&pool->mutex);
+    if (rval == MEMCACHED_SUCCESS)
+    {
+      pthread_cond_signal(&pool->cond);
+      rval= mutex_exit(&pool->mutex);
+    }
 
-  memcached_return_t rval= mutex_exit(&pool->mutex);
-  if (rc == MEMCACHED_SOME_ERRORS)
-    return rc;
+    if (rc == MEMCACHED_SUCCESS)
+      rc= rval;
+  }
 
-  return rval;
+  return rc;
 }
 
 
@@ -224,29 +456,45 @@ memcached_return_t memcached_pool_behavior_set(memcached_pool_st *pool,
 
   ++pool->version;
   memcached_set_user_data(pool->master, pool->version);
+
+  /*
+    Take the idle handles out of the slots while we update them, pop will
+    find none and queue up on the mutex. Handles that are out on loan get
+    cloned again when they are pushed back (or popped, if they race us).
+  */
+  memcached_st **idle= calloc(pool->size + 1, sizeof(memcached_st*));
+  uint32_t number_of_idle= 0;
+
+  if (idle != NULL)
+  {
+    while ((idle[number_of_idle]= slot_take(pool)) != NULL)
+      ++number_of_idle;
+  }
+
   /* update the clones */
-  for (int xx= 0; xx <= pool->firstfree; ++xx)
+  for (uint32_t xx= 0; xx < number_of_idle; ++xx)
   {
-    rc= memcached_behavior_set(pool->mmc[xx], flag, data);
+    rc= memcached_behavior_set(idle[xx], flag, data);
     if (rc == MEMCACHED_SUCCESS)
-      memcached_set_user_data(pool->mmc[xx], pool->version);
-    else
+      memcached_set_user_data(idle[xx], pool->version);
+    else if (refresh_handle(pool, idle[xx]) != MEMCACHED_SUCCESS)
     {
-      memcached_free(pool->mmc[xx]);
-      memset(pool->mmc[xx], 0, sizeof(*pool->mmc[xx]));
-      if (memcached_clone(pool->mmc[xx], pool->master) == NULL)
-      {
-        /* I'm not sure what to do in this case.. this would happen
-          if we fail to push the server list inside the client..
-          I should add a testcase for this, but I believe the following
-          would work, except that you would add a hole in the pool list..
-          in theory you could end up with an empty pool....
-        */
-        free(pool->mmc[xx]);
-        pool->mmc[xx]= NULL;
-      }
+      /* I'm not sure what to do in this case.. this would happen
+        if we fail to push the server list inside the client..
+        The pool just has one handle less to hand out.
+      */
+      free(idle[xx]);
+      idle[xx]= NULL;
+      pool_add_count(pool, &pool->current_size, -1);
     }
+
+    if (idle[xx] != NULL)
+      slot_put(pool, idle[xx]);
   }
+  free(idle);
+
+  if (pool_read_count(&pool->waiters) > 0)
+    pthread_cond_broadcast(&pool->cond);
 
   return mutex_exit(&pool->mutex);
 }
@@ -266,3 +514,21 @@ memcached_return_t memcached_pool_behavior_get(memcached_pool_st *pool,
 
   return mutex_exit(&pool->mutex);
 }
+
+memcached_return_t memcached_pool_stats(memcached_pool_st *pool,
+                                        memcached_pool_stats_st *stats)
+{
+  memcached_return_t rc= mutex_enter(&pool->mutex);
+
+  if (rc != MEMCACHED_SUCCESS)
+  {
+    return rc;
+  }
+
+  *stats= pool->stats;
+  stats->size= pool->size;
+  stats->current_size= pool_read_count(&pool->current_size);
+  stats->available= pool_read_count(&pool->available);
+
+  return mutex_exit(&pool->mutex);
+}
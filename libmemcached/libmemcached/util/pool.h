@@ -22,6 +22,18 @@ extern "C" {
 struct memcached_pool_st;
 typedef struct memcached_pool_st memcached_pool_st;
 
+struct memcached_pool_stats_st
+{
+  uint32_t size;           /* The most handles the pool will create */
+  uint32_t current_size;   /* Handles created so far */
+  uint32_t available;      /* Handles sitting idle in the pool */
+  uint64_t exhausted;      /* Pops that found no handle to hand out */
+  uint64_t waits;          /* Pops that blocked until a handle came back */
+  uint64_t wait_time;      /* Microseconds spent blocked, all pops together */
+  uint64_t max_wait_time;  /* The longest single wait, in microseconds */
+};
+typedef struct memcached_pool_stats_st memcached_pool_stats_st;
+
 LIBMEMCACHED_API
 memcached_pool_st *memcached_pool_create(memcached_st* mmc, uint32_t initial,
                                          uint32_t max);
@@ -44,6 +56,10 @@ memcached_return_t memcached_pool_behavior_get(memcached_pool_st *ptr,
                                                memcached_behavior_t flag,
                                                uint64_t *value);
 
+LIBMEMCACHED_API
+memcached_return_t memcached_pool_stats(memcached_pool_st *ptr,
+                                        memcached_pool_stats_st *stats);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
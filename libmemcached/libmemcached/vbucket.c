@@ -0,0 +1,203 @@
+/* LibMemcached
+ * Copyright (C) 2010 NorthScale
+ * All rights reserved.
+ *
+ * Use and distribution licensed under the BSD license.  See
+ * the COPYING file in the parent directory for full text.
+ *
+ * Summary: vbucket distribution backed by libvbucket
+ *
+ */
+#include "common.h"
+
+/*
+  Split a libvbucket "host:port" server name.
+*/
+static bool vbucket_split_server(const char *server,
+                                 char *hostname, in_port_t *port)
+{
+  const char *colon= strrchr(server, ':');
+  size_t length;
+
+  if (colon == NULL)
+    return false;
+
+  length= (size_t)(colon - server);
+  if (length == 0 || length >= NI_MAXHOST)
+    return false;
+
+  memcpy(hostname, server, length);
+  hostname[length]= 0;
+  *port= (in_port_t)atoi(colon + 1);
+
+  return *port != 0;
+}
+
+static bool vbucket_valid_servers(VBUCKET_CONFIG_HANDLE config)
+{
+  int count= vbucket_config_get_num_servers(config);
+
+  if (count <= 0)
+    return false;
+
+  for (int x= 0; x < count; x++)
+  {
+    char hostname[NI_MAXHOST];
+    in_port_t port;
+
+    if (! vbucket_split_server(vbucket_config_get_server(config, x), hostname, &port))
+      return false;
+  }
+
+  return true;
+}
+
+/*
+  The server indexes in the vbucket map are positions in the config's
+  server list, so ours has to match it entry for entry.
+*/
+static bool vbucket_same_servers(memcached_st *ptr, VBUCKET_CONFIG_HANDLE config)
+{
+  uint32_t count= (uint32_t)vbucket_config_get_num_servers(config);
+
+  if (count != memcached_server_count(ptr))
+    return false;
+
+  for (uint32_t x= 0; x < count; x++)
+  {
+    memcached_server_instance_st instance= memcached_server_instance_by_position(ptr, x);
+    char hostname[NI_MAXHOST];
+    in_port_t port;
+
+    (void)vbucket_split_server(vbucket_config_get_server(config, (int)x), hostname, &port);
+
+    if (strcmp(hostname, instance->hostname) != 0 || port != instance->port)
+      return false;
+  }
+
+  return true;
+}
+
+static memcached_return_t vbucket_push_servers(memcached_st *ptr, VBUCKET_CONFIG_HANDLE config)
+{
+  int count= vbucket_config_get_num_servers(config);
+
+  memcached_servers_reset(ptr);
+
+  for (int x= 0; x < count; x++)
+  {
+    char hostname[NI_MAXHOST];
+    in_port_t port;
+    memcached_return_t rc;
+
+    (void)vbucket_split_server(vbucket_config_get_server(config, x), hostname, &port);
+
+    rc= memcached_server_add(ptr, hostname, port);
+    if (rc != MEMCACHED_SUCCESS)
+      return rc;
+  }
+
+  return MEMCACHED_SUCCESS;
+}
+
+memcached_return_t memcached_set_vbucket_config(memcached_st *ptr,
+                                                const char *config)
+{
+  VBUCKET_CONFIG_HANDLE handle;
+  char *json;
+
+  if (config == NULL)
+    return MEMCACHED_INVALID_ARGUMENTS;
+
+  if (ptr->flags.use_udp)
+    return MEMCACHED_INVALID_HOST_PROTOCOL;
+
+  handle= vbucket_config_parse_string(config);
+  if (handle == NULL)
+    return MEMCACHED_INVALID_ARGUMENTS;
+
+  if (! vbucket_valid_servers(handle))
+  {
+    vbucket_config_destroy(handle);
+    return MEMCACHED_INVALID_ARGUMENTS;
+  }
+
+  json= libmemcached_malloc(ptr, strlen(config) + 1);
+  if (json == NULL)
+  {
+    vbucket_config_destroy(handle);
+    return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+  }
+  strcpy(json, config);
+
+  /* vbuckets only travel in the binary protocol */
+  if (! ptr->flags.binary_protocol)
+    (void)memcached_behavior_set(ptr, MEMCACHED_BEHAVIOR_BINARY_PROTOCOL, 1);
+
+  memcached_destroy_vbucket_config(ptr);
+  ptr->vbucket.config= handle;
+  ptr->vbucket.json= json;
+  ptr->distribution= MEMCACHED_DISTRIBUTION_VBUCKET;
+
+  /*
+    A live update that only moves vbuckets keeps the server list, and
+    with it the open connections.
+  */
+  if (vbucket_same_servers(ptr, handle))
+    return MEMCACHED_SUCCESS;
+
+  return vbucket_push_servers(ptr, handle);
+}
+
+void memcached_destroy_vbucket_config(memcached_st *ptr)
+{
+  if (ptr->vbucket.config)
+    vbucket_config_destroy(ptr->vbucket.config);
+
+  if (ptr->vbucket.json)
+    libmemcached_free(ptr, ptr->vbucket.json);
+
+  ptr->vbucket.config= NULL;
+  ptr->vbucket.json= NULL;
+}
+
+memcached_return_t memcached_clone_vbucket(memcached_st *clone, const memcached_st *source)
+{
+  VBUCKET_CONFIG_HANDLE handle;
+  char *json;
+
+  if (source->vbucket.json == NULL)
+    return MEMCACHED_SUCCESS;
+
+  handle= vbucket_config_parse_string(source->vbucket.json);
+  if (handle == NULL)
+    return MEMCACHED_FAILURE;
+
+  json= libmemcached_malloc(clone, strlen(source->vbucket.json) + 1);
+  if (json == NULL)
+  {
+    vbucket_config_destroy(handle);
+    return MEMCACHED_MEMORY_ALLOCATION_FAILURE;
+  }
+  strcpy(json, source->vbucket.json);
+
+  clone->vbucket.config= handle;
+  clone->vbucket.json= json;
+
+  return MEMCACHED_SUCCESS;
+}
+
+void memcached_vbucket_found_incorrect_master(memcached_st *ptr,
+                                              uint32_t vbucket,
+                                              uint32_t server_key)
+{
+  if (ptr->vbucket.config == NULL)
+    return;
+
+  /* The vbucket comes back to us in the opaque, don't trust it blindly */
+  if (vbucket >= (uint32_t)vbucket_config_get_num_vbuckets(ptr->vbucket.config))
+    return;
+
+  (void)vbucket_found_incorrect_master(ptr->vbucket.config,
+                                       (int)vbucket, (int)server_key);
+}
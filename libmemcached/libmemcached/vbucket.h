@@ -0,0 +1,55 @@
+/* LibMemcached
+ * Copyright (C) 2010 NorthScale
+ * All rights reserved.
+ *
+ * Use and distribution licensed under the BSD license.  See
+ * the COPYING file in the parent directory for full text.
+ *
+ * Summary: vbucket distribution backed by libvbucket
+ *
+ */
+#ifndef LIBMEMCACHED_MEMCACHED_VBUCKET_H
+#define LIBMEMCACHED_MEMCACHED_VBUCKET_H
+
+#ifdef LIBMEMCACHED_WITH_VBUCKET_SUPPORT
+#include <libvbucket/vbucket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+LIBMEMCACHED_API
+memcached_return_t memcached_set_vbucket_config(memcached_st *ptr,
+                                                const char *config);
+
+LIBMEMCACHED_LOCAL
+void memcached_destroy_vbucket_config(memcached_st *ptr);
+
+LIBMEMCACHED_LOCAL
+memcached_return_t memcached_clone_vbucket(memcached_st *clone, const memcached_st *source);
+
+LIBMEMCACHED_LOCAL
+void memcached_vbucket_found_incorrect_master(memcached_st *ptr,
+                                              uint32_t vbucket,
+                                              uint32_t server_key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBMEMCACHED_WITH_VBUCKET_SUPPORT */
+
+struct memcached_vbucket_st {
+#ifdef LIBMEMCACHED_WITH_VBUCKET_SUPPORT
+  VBUCKET_CONFIG_HANDLE config;
+#else
+  void *config;
+#endif
+  /*
+  ** The config as it was handed to us, so that clones can parse their
+  ** own copy.
+  */
+  char *json;
+};
+
+#endif /* LIBMEMCACHED_MEMCACHED_VBUCKET_H */
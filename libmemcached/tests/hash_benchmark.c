@@ -0,0 +1,121 @@
+/* libHashKit hash benchmark
+ * Copyright (C) 2010 NorthScale
+ * All rights reserved.
+ *
+ * Use and distribution licensed under the BSD license.  See
+ * the COPYING file in the parent directory for full text.
+ *
+ * Summary: time every libhashkit hash over keys of typical lengths
+ *
+ * usage: hashbench [rounds]
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <libhashkit/hashkit.h>
+
+#define NUMBER_OF_KEYS 4096
+
+static const struct {
+  const char *name;
+  hashkit_hash_algorithm_t algorithm;
+} hashes[]= {
+  { "one_at_a_time", HASHKIT_HASH_DEFAULT },
+  { "md5", HASHKIT_HASH_MD5 },
+  { "crc", HASHKIT_HASH_CRC },
+  { "fnv1_64", HASHKIT_HASH_FNV1_64 },
+  { "fnv1a_64", HASHKIT_HASH_FNV1A_64 },
+  { "fnv1_32", HASHKIT_HASH_FNV1_32 },
+  { "fnv1a_32", HASHKIT_HASH_FNV1A_32 },
+#ifdef HAVE_HSIEH_HASH
+  { "hsieh", HASHKIT_HASH_HSIEH },
+#endif
+#ifdef HAVE_MURMUR_HASH
+  { "murmur", HASHKIT_HASH_MURMUR },
+#endif
+  { "jenkins", HASHKIT_HASH_JENKINS },
+};
+
+static const size_t key_lengths[]= { 8, 16, 32, 64, 128, 250 };
+
+#define NUMBER_OF_HASHES (sizeof(hashes) / sizeof(hashes[0]))
+#define NUMBER_OF_LENGTHS (sizeof(key_lengths) / sizeof(key_lengths[0]))
+
+/*
+  Keys are laid out back to back at odd offsets, so that the unaligned
+  code paths get their share of the work.
+*/
+static char *make_keys(size_t key_length)
+{
+  char *keys= malloc(NUMBER_OF_KEYS * (key_length + 1));
+
+  if (keys == NULL)
+    return NULL;
+
+  for (size_t x= 0; x < NUMBER_OF_KEYS * (key_length + 1); x++)
+    keys[x]= (char)('a' + (random() % 26));
+
+  return keys;
+}
+
+static double elapsed_ns(const struct timeval *start, const struct timeval *end)
+{
+  return (double)(end->tv_sec - start->tv_sec) * 1e9 +
+         (double)(end->tv_usec - start->tv_usec) * 1e3;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned long rounds= 200;
+  volatile uint32_t sink= 0; /* keeps the hashing from being optimized away */
+
+  if (argc > 1)
+    rounds= strtoul(argv[1], NULL, 10);
+
+  if (rounds == 0)
+    rounds= 1;
+
+  printf("%-14s", "ns/key");
+  for (size_t y= 0; y < NUMBER_OF_LENGTHS; y++)
+    printf(" %8zu", key_lengths[y]);
+  printf("\n");
+
+  for (size_t x= 0; x < NUMBER_OF_HASHES; x++)
+  {
+    printf("%-14s", hashes[x].name);
+
+    for (size_t y= 0; y < NUMBER_OF_LENGTHS; y++)
+    {
+      size_t key_length= key_lengths[y];
+      char *keys= make_keys(key_length);
+      struct timeval start, end;
+
+      if (keys == NULL)
+      {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+      }
+
+      gettimeofday(&start, NULL);
+      for (unsigned long round= 0; round < rounds; round++)
+      {
+        for (size_t key= 0; key < NUMBER_OF_KEYS; key++)
+          sink+= libhashkit_digest(keys + key * (key_length + 1), key_length,
+                                   hashes[x].algorithm);
+      }
+      gettimeofday(&end, NULL);
+
+      printf(" %8.1f", elapsed_ns(&start, &end) / ((double)rounds * NUMBER_OF_KEYS));
+      free(keys);
+    }
+
+    printf("\n");
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -301,6 +301,102 @@ static test_return_t jenkins_run (hashkit_st *hashk)
   return TEST_SUCCESS;
 }
 
+/*
+  The hashes read several bytes at a time where they can. For every length
+  and alignment they have to agree with a plain byte at a time reading of
+  the key, or keys would move to other servers.
+*/
+#define COMPAT_MAX_LENGTH 300
+
+static void compat_fill(char *buffer, size_t length)
+{
+  uint32_t seed= 0x9e3779b9;
+
+  for (size_t x= 0; x < length; x++)
+  {
+    seed= seed * 1103515245 + 12345;
+    buffer[x]= (char)(seed >> 16);
+  }
+}
+
+static uint32_t bitwise_crc32(const char *key, size_t length)
+{
+  uint32_t crc= UINT32_MAX;
+
+  for (size_t x= 0; x < length; x++)
+  {
+    crc^= (uint8_t)key[x];
+    for (int bit= 0; bit < 8; bit++)
+      crc= (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+
+  return ((~crc) >> 16) & 0x7fff;
+}
+
+static test_return_t crc_compat_run(hashkit_st *hashk)
+{
+  char key[COMPAT_MAX_LENGTH];
+  union {
+    uint64_t align;
+    char bytes[COMPAT_MAX_LENGTH + 8];
+  } buffer;
+  (void)hashk;
+
+  compat_fill(key, sizeof(key));
+
+  for (size_t offset= 0; offset < 8; offset++)
+  {
+    memcpy(buffer.bytes + offset, key, sizeof(key));
+
+    for (size_t length= 0; length <= COMPAT_MAX_LENGTH; length++)
+    {
+      test_true(libhashkit_crc32(buffer.bytes + offset, length) == bitwise_crc32(key, length));
+    }
+  }
+
+  return TEST_SUCCESS;
+}
+
+static test_return_t alignment_compat_run(hashkit_st *hashk)
+{
+  char key[COMPAT_MAX_LENGTH];
+  union {
+    uint64_t align;
+    char bytes[COMPAT_MAX_LENGTH + 8];
+  } buffer;
+  uint32_t jenkins[COMPAT_MAX_LENGTH + 1];
+#ifdef HAVE_MURMUR_HASH
+  uint32_t murmur[COMPAT_MAX_LENGTH + 1];
+#endif
+  (void)hashk;
+
+  compat_fill(key, sizeof(key));
+
+  for (size_t offset= 0; offset < 8; offset++)
+  {
+    memcpy(buffer.bytes + offset, key, sizeof(key));
+
+    for (size_t length= 0; length <= COMPAT_MAX_LENGTH; length++)
+    {
+      uint32_t hash_val= libhashkit_jenkins(buffer.bytes + offset, length);
+
+      if (offset == 0)
+        jenkins[length]= hash_val;
+      test_true(jenkins[length] == hash_val);
+
+#ifdef HAVE_MURMUR_HASH
+      hash_val= libhashkit_murmur(buffer.bytes + offset, length);
+
+      if (offset == 0)
+        murmur[length]= hash_val;
+      test_true(murmur[length] == hash_val);
+#endif
+    }
+  }
+
+  return TEST_SUCCESS;
+}
+
 
 
 
@@ -535,6 +631,8 @@ test_st hash_tests[] ={
   {"hsieh", 0, (test_callback_fn)hsieh_run },
   {"murmur", 0, (test_callback_fn)murmur_run },
   {"jenkis", 0, (test_callback_fn)jenkins_run },
+  {"crc_compat", 0, (test_callback_fn)crc_compat_run },
+  {"alignment_compat", 0, (test_callback_fn)alignment_compat_run },
   {0, 0, (test_callback_fn)0}
 };
 
@@ -410,10 +410,10 @@ static test_return_t error_test(memcached_st *memc)
                         2300930706U, 2943759320U, 674306647U, 2400528935U,
                         54481931U, 4186304426U, 1741088401U, 2979625118U,
                         4159057246U, 3425930182U, 2593724503U,  1868899624U,
-                        1769812374U, 2302537950U, 1110330676U };
+                        1769812374U, 2302537950U, 1110330676U, 853496668U };
 
   // You have updated the memcache_error messages but not updated docs/tests.
-  test_true(MEMCACHED_MAXIMUM_RETURN == 43);
+  test_true(MEMCACHED_MAXIMUM_RETURN == 44);
   for (rc= MEMCACHED_SUCCESS; rc < MEMCACHED_MAXIMUM_RETURN; rc++)
   {
     uint32_t hash_val;
@@ -1694,6 +1694,10 @@ static test_return_t mget_execute(memcached_st *memc)
   if (memcached_behavior_get(memc, MEMCACHED_BEHAVIOR_BINARY_PROTOCOL) != 0)
     binary= true;
 
+  /* A vbucket map can't follow the server list shrinking under it */
+  if (memcached_behavior_get(memc, MEMCACHED_BEHAVIOR_DISTRIBUTION) == MEMCACHED_DISTRIBUTION_VBUCKET)
+    return TEST_SKIPPED;
+
   /*
    * I only want to hit _one_ server so I know the number of requests I'm
    * sending in the pipeline.
@@ -3842,6 +3846,123 @@ static test_return_t pre_sasl(memcached_st *memc)
   return rc == MEMCACHED_SUCCESS ? TEST_SUCCESS : TEST_SKIPPED;
 }
 
+#ifdef LIBMEMCACHED_WITH_VBUCKET_SUPPORT
+#define VBUCKET_TEST_COUNT 64
+
+/*
+  Build a vbucket config over the servers memc already has, dealing the
+  vbuckets out round robin starting at server offset.
+*/
+static void vbucket_config_for(memcached_st *memc, uint32_t offset,
+                               char *config, size_t length)
+{
+  size_t used;
+  uint32_t count= memcached_server_count(memc);
+
+  used= (size_t)snprintf(config, length,
+                         "{\"hashAlgorithm\":\"CRC\",\"numReplicas\":0,\"serverList\":[");
+  for (uint32_t x= 0; x < count; x++)
+  {
+    memcached_server_instance_st instance=
+      memcached_server_instance_by_position(memc, x);
+
+    used+= (size_t)snprintf(config + used, length - used, "%s\"%s:%u\"",
+                            x ? "," : "",
+                            memcached_server_name(instance),
+                            (uint32_t)memcached_server_port(instance));
+  }
+
+  used+= (size_t)snprintf(config + used, length - used, "],\"vBucketMap\":[");
+  for (uint32_t x= 0; x < VBUCKET_TEST_COUNT; x++)
+  {
+    used+= (size_t)snprintf(config + used, length - used, "%s[%u]",
+                            x ? "," : "", (x + offset) % count);
+  }
+
+  (void)snprintf(config + used, length - used, "]}");
+}
+
+/*
+  The test servers only serve vbucket 0 until told otherwise, with the
+  engine's SET_VBUCKET command that libmemcached itself never sends.
+*/
+static test_return_t vbucket_set_state(memcached_st *memc, uint32_t server_key,
+                                       uint16_t vbucket, uint32_t state)
+{
+  memcached_server_instance_st instance=
+    memcached_server_instance_by_position(memc, server_key);
+  protocol_binary_request_no_extras request= {.bytes= {0}};
+  protocol_binary_response_header response;
+  struct addrinfo hints, *ai;
+  char port[NI_MAXSERV];
+  int fd;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family= AF_UNSPEC;
+  hints.ai_socktype= SOCK_STREAM;
+  snprintf(port, sizeof(port), "%u", (uint32_t)memcached_server_port(instance));
+  test_true(getaddrinfo(memcached_server_name(instance), port, &hints, &ai) == 0);
+  fd= socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+  test_true(fd != -1);
+  test_true(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0);
+  freeaddrinfo(ai);
+
+  request.message.header.request.magic= PROTOCOL_BINARY_REQ;
+  request.message.header.request.opcode= 0x3d; /* SET_VBUCKET */
+  request.message.header.request.reserved= htons(vbucket);
+  request.message.header.request.bodylen= htonl((uint32_t)sizeof(state));
+  state= htonl(state);
+
+  test_true(write(fd, request.bytes, sizeof(request.bytes)) == sizeof(request.bytes));
+  test_true(write(fd, &state, sizeof(state)) == sizeof(state));
+  test_true(read(fd, response.bytes, sizeof(response.bytes)) == sizeof(response.bytes));
+  test_true(response.response.status == 0);
+  close(fd);
+
+  return TEST_SUCCESS;
+}
+#endif
+
+static test_return_t pre_vbucket(memcached_st *memc)
+{
+#ifdef LIBMEMCACHED_WITH_VBUCKET_SUPPORT
+  char config[4096];
+
+  vbucket_config_for(memc, 0, config, sizeof(config));
+  test_true(memcached_set_vbucket_config(memc, config) == MEMCACHED_SUCCESS);
+
+  /* Only the master serves a vbucket, active is 1 and dead is 4 */
+  for (uint32_t x= 0; x < VBUCKET_TEST_COUNT; x++)
+  {
+    for (uint32_t y= 0; y < memcached_server_count(memc); y++)
+    {
+      uint32_t state= (x % memcached_server_count(memc) == y) ? 1 : 4;
+      test_true(vbucket_set_state(memc, y, (uint16_t)x, state) == TEST_SUCCESS);
+    }
+  }
+
+  return TEST_SUCCESS;
+#else
+  (void)memc;
+  return TEST_SKIPPED;
+#endif
+}
+
+/* Put vbucket 0 back on every server for the collections that follow */
+static test_return_t post_vbucket(memcached_st *memc)
+{
+#ifdef LIBMEMCACHED_WITH_VBUCKET_SUPPORT
+  for (uint32_t x= 0; x < memcached_server_count(memc); x++)
+  {
+    test_true(vbucket_set_state(memc, x, 0, 1) == TEST_SUCCESS);
+  }
+#else
+  (void)memc;
+#endif
+
+  return TEST_SUCCESS;
+}
+
 static test_return_t pre_replication(memcached_st *memc)
 {
   test_return_t test_rc;
@@ -4444,6 +4565,14 @@ static test_return_t connection_pool_test(memcached_st *memc)
   test_true(memcached_pool_pop(pool, false, &rc) == NULL);
   test_true(rc == MEMCACHED_SUCCESS);
 
+  memcached_pool_stats_st stats;
+  test_true(memcached_pool_stats(pool, &stats) == MEMCACHED_SUCCESS);
+  test_true(stats.size == POOL_SIZE);
+  test_true(stats.current_size == POOL_SIZE);
+  test_true(stats.available == 0);
+  test_true(stats.exhausted == 1);
+  test_true(stats.waits == 0);
+
   pthread_t tid;
   struct {
     memcached_pool_st* pool;
@@ -4454,6 +4583,11 @@ static test_return_t connection_pool_test(memcached_st *memc)
   test_true(rc == MEMCACHED_SUCCESS);
   pthread_join(tid, NULL);
   test_true(mmc[9] == item.mmc);
+
+  test_true(memcached_pool_stats(pool, &stats) == MEMCACHED_SUCCESS);
+  test_true(stats.exhausted == 2);
+  test_true(stats.waits == 1);
+  test_true(stats.max_wait_time <= stats.wait_time);
   const char *key= "key";
   size_t keylen= strlen(key);
 
@@ -4497,6 +4631,60 @@ static test_return_t connection_pool_test(memcached_st *memc)
   test_true(memcached_behavior_get(mmc[0], MEMCACHED_BEHAVIOR_IO_MSG_WATERMARK) == 9999);
   test_true(memcached_pool_push(pool, mmc[0]) == MEMCACHED_SUCCESS);
 
+  test_true(memcached_pool_stats(pool, &stats) == MEMCACHED_SUCCESS);
+  test_true(stats.available == stats.current_size);
+
+  test_true(memcached_pool_destroy(pool) == memc);
+
+  return TEST_SUCCESS;
+}
+
+#define POOL_THREADS 8
+#define POOL_ROUNDS 2000
+static void* connection_pool_worker(void *arg)
+{
+  memcached_pool_st* pool= arg;
+
+  for (size_t x= 0; x < POOL_ROUNDS; ++x)
+  {
+    memcached_return_t rc;
+    memcached_st *mmc= memcached_pool_pop(pool, true, &rc);
+
+    if (mmc == NULL || rc != MEMCACHED_SUCCESS)
+      return NULL;
+
+    if (memcached_pool_push(pool, mmc) != MEMCACHED_SUCCESS)
+      return NULL;
+  }
+
+  return arg;
+}
+
+/*
+  More threads than handles hammering pop and push: every pop has to come
+  back with a handle, and they all have to end up back in the pool.
+*/
+static test_return_t connection_pool_threads_test(memcached_st *memc)
+{
+  memcached_pool_st* pool= memcached_pool_create(memc, 1, POOL_THREADS / 2);
+  test_true(pool != NULL);
+  pthread_t tid[POOL_THREADS];
+
+  for (size_t x= 0; x < POOL_THREADS; ++x)
+    test_true(pthread_create(&tid[x], NULL, connection_pool_worker, pool) == 0);
+
+  for (size_t x= 0; x < POOL_THREADS; ++x)
+  {
+    void *ret;
+    test_true(pthread_join(tid[x], &ret) == 0);
+    test_true(ret == pool);
+  }
+
+  memcached_pool_stats_st stats;
+  test_true(memcached_pool_stats(pool, &stats) == MEMCACHED_SUCCESS);
+  test_true(stats.current_size <= POOL_THREADS / 2);
+  test_true(stats.available == stats.current_size);
+
   test_true(memcached_pool_destroy(pool) == memc);
 
   return TEST_SUCCESS;
@@ -4766,6 +4954,94 @@ static test_return_t replication_randomize_mget_test(memcached_st *memc)
   return TEST_SUCCESS;
 }
 
+/*
+  A server that accepts connections but never answers stands in for a slow
+  one: the mget has to get its keys from the replicas once the deadline
+  passes, instead of sitting out the poll timeout. That has to hold even
+  when the poll timeout is the shorter of the two.
+*/
+static test_return_t replication_deadline_mget(memcached_st *memc,
+                                               uint64_t poll_timeout,
+                                               uint64_t deadline)
+{
+  memcached_result_st result_obj;
+  memcached_return_t rc;
+  struct sockaddr_in sin= { .sin_family= AF_INET };
+  socklen_t sin_length= sizeof(sin);
+  int fd;
+
+  const char *keys[]= { "key1", "key2", "key3", "key4", "key5", "key6", "key7" };
+  size_t len[]= { 4, 4, 4, 4, 4, 4, 4 };
+
+  for (size_t x= 0; x< 7; ++x)
+  {
+    rc= memcached_set(memc, keys[x], len[x], "1", 1, 0, 0);
+    test_true(rc == MEMCACHED_SUCCESS);
+  }
+
+  memcached_quit(memc);
+
+  sin.sin_addr.s_addr= htonl(INADDR_LOOPBACK);
+  fd= socket(AF_INET, SOCK_STREAM, 0);
+  test_true(fd != -1);
+  test_true(bind(fd, (struct sockaddr *)&sin, sizeof(sin)) == 0);
+  test_true(listen(fd, 16) == 0);
+  test_true(getsockname(fd, (struct sockaddr *)&sin, &sin_length) == 0);
+
+  /*
+   * Don't do the following in your code. I am abusing the internal details
+   * within the library, and this is not a supported interface.
+   * This is to verify correct behavior in the library
+   */
+  for (uint32_t host= 0; host < memcached_server_count(memc); host++)
+  {
+    struct timeval start, end;
+    memcached_st *memc_clone= memcached_clone(NULL, memc);
+    memcached_server_write_instance_st instance=
+      (memcached_server_write_instance_st)memcached_server_instance_by_position(memc_clone, host);
+
+    strcpy(instance->hostname, "127.0.0.1");
+    instance->port= ntohs(sin.sin_port);
+
+    memcached_behavior_set(memc_clone, MEMCACHED_BEHAVIOR_POLL_TIMEOUT, poll_timeout);
+    memcached_behavior_set(memc_clone, MEMCACHED_BEHAVIOR_REPLICA_READ_DEADLINE, deadline);
+    test_true(memcached_behavior_get(memc_clone, MEMCACHED_BEHAVIOR_REPLICA_READ_DEADLINE) == deadline);
+
+    gettimeofday(&start, NULL);
+    rc= memcached_mget(memc_clone, keys, len, 7);
+    test_true(rc == MEMCACHED_SUCCESS);
+
+    memcached_result_st *results= memcached_result_create(memc_clone, &result_obj);
+    test_true(results);
+
+    int hits= 0;
+    while ((results= memcached_fetch_result(memc_clone, &result_obj, &rc)) != NULL)
+    {
+      ++hits;
+    }
+    gettimeofday(&end, NULL);
+
+    test_true(hits == 7);
+    test_true(end.tv_sec - start.tv_sec < 3);
+    memcached_result_free(&result_obj);
+    memcached_free(memc_clone);
+  }
+
+  close(fd);
+
+  return TEST_SUCCESS;
+}
+
+static test_return_t replication_deadline_mget_test(memcached_st *memc)
+{
+  return replication_deadline_mget(memc, 5000, 100);
+}
+
+static test_return_t replication_deadline_poll_timeout_mget_test(memcached_st *memc)
+{
+  return replication_deadline_mget(memc, 50, 300);
+}
+
 static test_return_t replication_delete_test(memcached_st *memc)
 {
   memcached_return_t rc;
@@ -6266,6 +6542,91 @@ static test_return_t sasl_auth_test(memcached_st *memc)
 #endif
 }
 
+static test_return_t vbucket_routing_test(memcached_st *memc)
+{
+#ifdef LIBMEMCACHED_WITH_VBUCKET_SUPPORT
+  char config[4096];
+  char wrong_config[4096];
+  memcached_return_t rc;
+  uint32_t count= memcached_server_count(memc);
+  memcached_server_instance_st first= memcached_server_instance_by_position(memc, 0);
+
+  /* Without a map there is nothing to route with */
+  test_true(memcached_behavior_set_distribution(memc, MEMCACHED_DISTRIBUTION_VBUCKET) == MEMCACHED_FAILURE);
+  test_true(memcached_set_vbucket_config(memc, "not json") == MEMCACHED_INVALID_ARGUMENTS);
+  test_true(memcached_server_count(memc) == count);
+
+  test_true(pre_vbucket(memc) == TEST_SUCCESS);
+  test_true(memcached_server_count(memc) == count);
+  test_true(memcached_behavior_get(memc, MEMCACHED_BEHAVIOR_DISTRIBUTION) == MEMCACHED_DISTRIBUTION_VBUCKET);
+  test_true(memcached_behavior_get(memc, MEMCACHED_BEHAVIOR_BINARY_PROTOCOL));
+
+  vbucket_config_for(memc, 0, config, sizeof(config));
+  VBUCKET_CONFIG_HANDLE handle= vbucket_config_parse_string(config);
+  test_true(handle != NULL);
+
+  /*
+    Every vbucket in this map is one server off, so each command has to
+    go through NOT_MY_VBUCKET once before it finds the right server.
+  */
+  vbucket_config_for(memc, count - 1, wrong_config, sizeof(wrong_config));
+
+  for (uint32_t step= 0; step < 4; step++)
+  {
+    /* A live update over the same servers keeps them */
+    test_true(memcached_set_vbucket_config(memc, wrong_config) == MEMCACHED_SUCCESS);
+    test_true(memcached_server_instance_by_position(memc, 0) == first);
+
+    for (uint32_t x= 0; x < 100; x++)
+    {
+      char key[32];
+      size_t key_length= (size_t)snprintf(key, sizeof(key), "vbucket%u", x);
+      size_t value_length;
+      uint32_t flags;
+      uint64_t number;
+      char *value;
+
+      switch (step)
+      {
+      case 0:
+        rc= memcached_set(memc, key, key_length, "1", 1, 0, 0);
+        break;
+      case 1:
+        value= memcached_get(memc, key, key_length, &value_length, &flags, &rc);
+        test_true(value && value_length == 1 && value[0] == '1');
+        free(value);
+        break;
+      case 2:
+        rc= memcached_increment(memc, key, key_length, 1, &number);
+        test_true(rc != MEMCACHED_SUCCESS || number == 2);
+        break;
+      default:
+        rc= memcached_delete(memc, key, key_length, 0);
+        break;
+      }
+      test_true_got(rc == MEMCACHED_SUCCESS, memcached_strerror(NULL, rc));
+
+      /* The map has been corrected on the way */
+      int vbucket= vbucket_get_vbucket_by_key(handle, key, key_length);
+      test_true(memcached_generate_hash(memc, key, key_length) == (uint32_t)vbucket_get_master(handle, vbucket));
+    }
+  }
+
+  vbucket_config_destroy(handle);
+
+  /* Clones route the same way */
+  memcached_st *memc_clone= memcached_clone(NULL, memc);
+  test_true(memc_clone != NULL);
+  test_true(memcached_behavior_get(memc_clone, MEMCACHED_BEHAVIOR_DISTRIBUTION) == MEMCACHED_DISTRIBUTION_VBUCKET);
+  memcached_free(memc_clone);
+
+  return TEST_SUCCESS;
+#else
+  (void)memc;
+  return TEST_SKIPPED;
+#endif
+}
+
 /* Clean the server before beginning testing */
 test_st tests[] ={
   {"util_version", 1, (test_callback_fn)util_version_test },
@@ -6323,6 +6684,7 @@ test_st tests[] ={
   {"analyzer", 1, (test_callback_fn)analyzer_test},
 #ifdef HAVE_LIBMEMCACHEDUTIL
   {"connectionpool", 1, (test_callback_fn)connection_pool_test },
+  {"connectionpool_threads", 1, (test_callback_fn)connection_pool_threads_test },
   {"ping", 1, (test_callback_fn)ping_test },
 #endif
   {"test_get_last_disconnect", 1, (test_callback_fn)test_get_last_disconnect},
@@ -6419,6 +6781,8 @@ test_st replication_tests[]= {
   {"mget", 0, (test_callback_fn)replication_mget_test },
   {"delete", 0, (test_callback_fn)replication_delete_test },
   {"rand_mget", 0, (test_callback_fn)replication_randomize_mget_test },
+  {"deadline_mget", 0, (test_callback_fn)replication_deadline_mget_test },
+  {"deadline_poll_timeout_mget", 0, (test_callback_fn)replication_deadline_poll_timeout_mget_test },
   {0, 0, (test_callback_fn)0}
 };
 
@@ -6447,6 +6811,11 @@ test_st sasl_auth_tests[]= {
   {0, 0, (test_callback_fn)0}
 };
 
+test_st vbucket_tests[]= {
+  {"vbucket_routing", 1, (test_callback_fn)vbucket_routing_test },
+  {0, 0, (test_callback_fn)0}
+};
+
 test_st ketama_compatibility[]= {
   {"libmemcached", 1, (test_callback_fn)ketama_compatibility_libmemcached },
   {"spymemcached", 1, (test_callback_fn)ketama_compatibility_spymemcached },
@@ -6568,6 +6937,8 @@ collection_st collection[] ={
   {"prefix", (test_callback_fn)set_prefix, 0, tests},
   {"sasl_auth", (test_callback_fn)pre_sasl, 0, sasl_auth_tests },
   {"sasl", (test_callback_fn)pre_sasl, 0, tests },
+  {"vbucket_routing", 0, (test_callback_fn)post_vbucket, vbucket_tests },
+  {"vbucket", (test_callback_fn)pre_vbucket, (test_callback_fn)post_vbucket, tests },
   {"version_1_2_3", (test_callback_fn)check_for_1_2_3, 0, version_1_2_3},
   {"string", 0, 0, string_tests},
   {"result", 0, 0, result_tests},
@@ -107,6 +107,33 @@ extern "C" {
     LIBVBUCKET_PUBLIC_API
     VBUCKET_CONFIG_HANDLE vbucket_config_parse_string(const char *data);
 
+    /**
+     * Create an instance of vbucket config from the compact binary
+     * format created by vbucket_config_serialize. This is a lot
+     * cheaper than parsing the JSON. vbucket_config_parse_file
+     * recognizes the binary format as well.
+     *
+     * @param data the serialized config
+     * @param len the size of the serialized config
+     */
+    LIBVBUCKET_PUBLIC_API
+    VBUCKET_CONFIG_HANDLE vbucket_config_parse_binary(const void *data,
+                                                      size_t len);
+
+    /**
+     * Serialize a vbucket config in the compact binary format.
+     *
+     * @param h the vbucket config handle
+     * @param buf where to store the serialized config
+     * @param len the size of buf
+     *
+     * @return the size of the serialized config. If it's bigger than
+     *         len nothing is written. 0 if the config can't be serialized.
+     */
+    LIBVBUCKET_PUBLIC_API
+    size_t vbucket_config_serialize(VBUCKET_CONFIG_HANDLE h,
+                                    void *buf, size_t len);
+
     /**
      * Destroy a vbucket config.
      *
@@ -136,7 +163,10 @@ extern "C" {
      * Tell libvbucket it told you the wrong server ID.
      *
      * This will cause libvbucket to do whatever is necessary to try
-     * to figure out a better answer.
+     * to figure out a better answer. While a rebalance is running
+     * (the config has a fast forward map) the vbucket is routed back
+     * and forth between its current master and the fast forward
+     * master; otherwise the next server is tried.
      *
      * @param h the vbucket config handle.
      * @param vbucket the vbucket ID
@@ -200,6 +230,18 @@ extern "C" {
     LIBVBUCKET_PUBLIC_API
     const char *vbucket_config_get_server(VBUCKET_CONFIG_HANDLE h, int i);
 
+    /**
+     * Get the index of a server (a hash lookup, not a scan of the list).
+     *
+     * @param h the vbucket config handle
+     * @param server the server in the form of hostname:port
+     *
+     * @return the server index, or -1 if the server isn't in the config
+     */
+    LIBVBUCKET_PUBLIC_API
+    int vbucket_config_get_server_index(VBUCKET_CONFIG_HANDLE h,
+                                        const char *server);
+
     /**
      * @}
      */
@@ -245,6 +287,40 @@ extern "C" {
     LIBVBUCKET_PUBLIC_API
     int vbucket_get_replica(VBUCKET_CONFIG_HANDLE h, int id, int n);
 
+    /**
+     * Check if the config has a fast forward map (the vbucket map
+     * the cluster will have once the running rebalance is done).
+     *
+     * @param h the vbucket config
+     *
+     * @return true if there is a fast forward map
+     */
+    LIBVBUCKET_PUBLIC_API
+    bool vbucket_config_has_fast_forward_map(VBUCKET_CONFIG_HANDLE h);
+
+    /**
+     * Get the master server for the given vbucket in the fast forward map.
+     *
+     * @param h the vbucket config
+     * @param id the vbucket identifier
+     *
+     * @return the server index, or -1 if there is no fast forward map
+     */
+    LIBVBUCKET_PUBLIC_API
+    int vbucket_get_fast_forward_master(VBUCKET_CONFIG_HANDLE h, int id);
+
+    /**
+     * Get a given replica for a vbucket in the fast forward map.
+     *
+     * @param h the vbucket config
+     * @param id the vbucket id
+     * @param n the replica number
+     *
+     * @return the server ID, or -1 if there is no fast forward map
+     */
+    LIBVBUCKET_PUBLIC_API
+    int vbucket_get_fast_forward_replica(VBUCKET_CONFIG_HANDLE h, int id, int n);
+
     /**
      * @}
      */
@@ -266,6 +342,25 @@ extern "C" {
     VBUCKET_CONFIG_DIFF* vbucket_compare(VBUCKET_CONFIG_HANDLE from,
                                          VBUCKET_CONFIG_HANDLE to);
 
+    /**
+     * Find the vbuckets whose master or replicas moved to another
+     * server. The servers are compared by name, so this works even if
+     * the server list was reordered.
+     *
+     * @param from the source vbucket config
+     * @param to the destination vbucket config
+     * @param vbuckets where to store the ids of the vbuckets that
+     *        changed (in ascending order). It must have room for
+     *        vbucket_config_get_num_vbuckets(to) entries.
+     *
+     * @return the number of vbuckets that changed, or -1 if the
+     *         configs don't have the same number of vbuckets
+     */
+    LIBVBUCKET_PUBLIC_API
+    int vbucket_get_changed_vbuckets(VBUCKET_CONFIG_HANDLE from,
+                                     VBUCKET_CONFIG_HANDLE to,
+                                     int *vbuckets);
+
     /**
      * Free a vbucket diff.
      *
@@ -48,29 +48,47 @@ struct vbucket_config_st {
     char *user;
     char *password;
     char **servers;
+    /* Open addressing hash of the server names, holding the server id + 1 */
+    int *server_index;
+    int server_index_mask;
+    /* The fast forward map: where the vbuckets go once a rebalance is done */
     struct vbucket_st *fvbuckets;
+    /* The vbuckets we route by the fast forward map (because the old
+     * master told us it's not there anymore) */
+    bool *forwarded;
     struct vbucket_st vbuckets[];
 };
 
+/*
+ * The compact binary format starts with a NUL so it can't be
+ * mistaken for JSON. The last byte of the magic is the version.
+ */
+static const char binary_magic[4] = { 0, 'V', 'B', 1 };
+#define BINARY_HEADER_SIZE 16
+#define BINARY_HAS_FORWARD_MAP 0x01
+#define BINARY_NULL_STRING 0xffff
+
 static char *errstr = NULL;
 
 const char *vbucket_get_error() {
     return errstr;
 }
 
+static const char * const hashes[HASHKIT_HASH_MAX] = {
+    [HASHKIT_HASH_DEFAULT] = "default",
+    [HASHKIT_HASH_MD5] = "md5",
+    [HASHKIT_HASH_CRC] = "crc",
+    [HASHKIT_HASH_FNV1_64] = "fnv1_64",
+    [HASHKIT_HASH_FNV1A_64] = "fnv1a_64",
+    [HASHKIT_HASH_FNV1_32] = "fnv1_32",
+    [HASHKIT_HASH_FNV1A_32] = "fnv1a_32",
+    [HASHKIT_HASH_HSIEH] = "hsieh",
+    [HASHKIT_HASH_MURMUR] = "murmur",
+    [HASHKIT_HASH_JENKINS] = "jenkins"
+};
+
 static hashkit_hash_algorithm_t lookup_hash_algorithm(const char *s) {
-    static char *hashes[HASHKIT_HASH_MAX];
-    hashes[HASHKIT_HASH_DEFAULT] = "default";
-    hashes[HASHKIT_HASH_MD5] = "md5";
-    hashes[HASHKIT_HASH_CRC] = "crc";
-    hashes[HASHKIT_HASH_FNV1_64] = "fnv1_64";
-    hashes[HASHKIT_HASH_FNV1A_64] = "fnv1a_64";
-    hashes[HASHKIT_HASH_FNV1_32] = "fnv1_32";
-    hashes[HASHKIT_HASH_FNV1A_32] = "fnv1a_32";
-    hashes[HASHKIT_HASH_HSIEH] = "hsieh";
-    hashes[HASHKIT_HASH_MURMUR] = "murmur";
-    hashes[HASHKIT_HASH_JENKINS] = "jenkins";
-    for (unsigned int i = 0; i < sizeof(hashes); ++i) {
+    for (unsigned int i = 0; i < HASHKIT_HASH_MAX; ++i) {
         if (hashes[i] != NULL && strcasecmp(s, hashes[i]) == 0) {
             return i;
         }
@@ -92,12 +110,12 @@ static void set_password(struct vbucket_config_st *vbc, const char *password)
     }
 }
 
-static struct vbucket_config_st *config_create(char *hash_algorithm,
+static struct vbucket_config_st *config_create(const char *hash_algorithm,
                                                int num_servers,
                                                int num_vbuckets,
                                                int num_replicas,
-                                               char *user,
-                                               char *password) {
+                                               const char *user,
+                                               const char *password) {
     hashkit_hash_algorithm_t ha = lookup_hash_algorithm(hash_algorithm);
     if (ha == HASHKIT_HASH_MAX) {
         errstr = "Bogus hash algorithm specified";
@@ -134,9 +152,11 @@ void vbucket_config_destroy(VBUCKET_CONFIG_HANDLE vb) {
         free(vb->servers[i]);
     }
     free(vb->servers);
+    free(vb->server_index);
     free(vb->user);
     free(vb->password);
     free(vb->fvbuckets);
+    free(vb->forwarded);
     memset(vb, 0xff, sizeof(vb));
     free(vb);
 }
@@ -158,15 +178,61 @@ static int populate_servers(struct vbucket_config_st *vb, cJSON *c) {
     return 0;
 }
 
+static uint32_t server_hash(const char *server) {
+    return libhashkit_digest(server, strlen(server), HASHKIT_HASH_FNV1A_32);
+}
+
+/*
+ * Index the server names so that clients can map a name back to its
+ * id without walking the list (and so comparing configs with lots of
+ * servers doesn't go quadratic).
+ */
+static int build_server_index(struct vbucket_config_st *vb) {
+    int size = 8;
+    while (size < vb->num_servers * 2) {
+        size <<= 1;
+    }
+
+    vb->server_index = calloc(size, sizeof(int));
+    if (vb->server_index == NULL) {
+        errstr = "Failed to allocate server index";
+        return -1;
+    }
+    vb->server_index_mask = size - 1;
+
+    for (int i = 0; i < vb->num_servers; ++i) {
+        uint32_t slot = server_hash(vb->servers[i]) & vb->server_index_mask;
+        int id;
+        while ((id = vb->server_index[slot]) != 0) {
+            if (strcmp(vb->servers[id - 1], vb->servers[i]) == 0) {
+                // Listed twice, the first one wins
+                break;
+            }
+            slot = (slot + 1) & vb->server_index_mask;
+        }
+        if (id == 0) {
+            vb->server_index[slot] = i + 1;
+        }
+    }
+    return 0;
+}
+
+static int alloc_forward_map(struct vbucket_config_st *vb) {
+    vb->fvbuckets = malloc(vb->num_vbuckets * sizeof(struct vbucket_st));
+    vb->forwarded = calloc(vb->num_vbuckets, sizeof(bool));
+    if (vb->fvbuckets == NULL || vb->forwarded == NULL) {
+        errstr = "Failed to allocate storage for forward vbucket map";
+        return -1;
+    }
+    return 0;
+}
+
 static int populate_buckets(struct vbucket_config_st *vb, cJSON *c, int is_ft) {
 
     struct vbucket_st *vbucket_map = NULL;
 
-    if (is_ft) {
-        if (!(vb->fvbuckets = malloc(vb->num_vbuckets * sizeof(struct vbucket_st)))) {
-            errstr = "Failed to allocate storage for forward vbucket map";
-            return -1;
-        }
+    if (is_ft && alloc_forward_map(vb) != 0) {
+        return -1;
     }
 
     vbucket_map = (is_ft ? vb->fvbuckets : vb->vbuckets);
@@ -245,8 +311,8 @@ static VBUCKET_CONFIG_HANDLE parse_cjson(cJSON *c) {
 
     /* this could possibly be null */
     cJSON *jBucketsForward = cJSON_GetObjectItem(c, "vBucketMapForward");
-    if (jBuckets && jBuckets->type != cJSON_Array) {
-        errstr = "Expected array for vBucketMap";
+    if (jBucketsForward && jBucketsForward->type != cJSON_Array) {
+        errstr = "Expected array for vBucketMapForward";
         return NULL;
     }
 
@@ -265,7 +331,7 @@ static VBUCKET_CONFIG_HANDLE parse_cjson(cJSON *c) {
         return NULL;
     }
 
-    if (populate_servers(vb, jServers) != 0) {
+    if (populate_servers(vb, jServers) != 0 || build_server_index(vb) != 0) {
         vbucket_config_destroy(vb);
         return NULL;
     }
@@ -324,11 +390,268 @@ VBUCKET_CONFIG_HANDLE vbucket_config_parse_file(const char *filename) {
         errstr = "Failed to read entire file";
         return NULL;
     }
-    VBUCKET_CONFIG_HANDLE h = vbucket_config_parse_string(data);
+    VBUCKET_CONFIG_HANDLE h;
+    if (nread >= sizeof(binary_magic) &&
+        memcmp(data, binary_magic, sizeof(binary_magic)) == 0) {
+        h = vbucket_config_parse_binary(data, nread);
+    } else {
+        h = vbucket_config_parse_string(data);
+    }
     free(data);
     return h;
 }
 
+static char *put16(char *ptr, uint16_t val) {
+    ptr[0] = (char)(val >> 8);
+    ptr[1] = (char)val;
+    return ptr + 2;
+}
+
+static char *put32(char *ptr, uint32_t val) {
+    ptr = put16(ptr, (uint16_t)(val >> 16));
+    return put16(ptr, (uint16_t)val);
+}
+
+static uint16_t get16(const unsigned char *ptr) {
+    return (uint16_t)((ptr[0] << 8) | ptr[1]);
+}
+
+static uint32_t get32(const unsigned char *ptr) {
+    return ((uint32_t)get16(ptr) << 16) | get16(ptr + 2);
+}
+
+static char *put_string(char *ptr, const char *str) {
+    if (str == NULL) {
+        return put16(ptr, BINARY_NULL_STRING);
+    }
+    size_t len = strlen(str);
+    ptr = put16(ptr, (uint16_t)len);
+    memcpy(ptr, str, len);
+    return ptr + len;
+}
+
+static size_t string_size(const char *str) {
+    return 2 + (str == NULL ? 0 : strlen(str));
+}
+
+/*
+ * The server ids in the maps take a single byte unless there are too
+ * many servers for that
+ */
+static size_t server_id_size(int num_servers) {
+    return num_servers < 128 ? 1 : 2;
+}
+
+static char *put_map(char *ptr, struct vbucket_config_st *vb,
+                     struct vbucket_st *map) {
+    size_t width = server_id_size(vb->num_servers);
+    for (int i = 0; i < vb->num_vbuckets; ++i) {
+        for (int j = 0; j <= vb->num_replicas; ++j) {
+            if (width == 1) {
+                *ptr++ = (char)map[i].servers[j];
+            } else {
+                ptr = put16(ptr, (uint16_t)map[i].servers[j]);
+            }
+        }
+    }
+    return ptr;
+}
+
+size_t vbucket_config_serialize(VBUCKET_CONFIG_HANDLE vb, void *buf, size_t len) {
+    size_t needed = BINARY_HEADER_SIZE;
+    const char *hash = hashes[vb->hk_algorithm];
+
+    needed += string_size(hash) + string_size(vb->user) + string_size(vb->password);
+    for (int i = 0; i < vb->num_servers; ++i) {
+        if (strlen(vb->servers[i]) >= BINARY_NULL_STRING) {
+            errstr = "Server name too long for the binary format";
+            return 0;
+        }
+        needed += string_size(vb->servers[i]);
+    }
+    if ((vb->user != NULL && strlen(vb->user) >= BINARY_NULL_STRING) ||
+        (vb->password != NULL && strlen(vb->password) >= BINARY_NULL_STRING)) {
+        errstr = "Credentials too long for the binary format";
+        return 0;
+    }
+
+    size_t map_size = (size_t)vb->num_vbuckets * (vb->num_replicas + 1) *
+        server_id_size(vb->num_servers);
+    needed += map_size;
+    if (vb->fvbuckets) {
+        needed += map_size;
+    }
+
+    if (needed > len) {
+        return needed;
+    }
+
+    char *ptr = buf;
+    memcpy(ptr, binary_magic, sizeof(binary_magic));
+    ptr += sizeof(binary_magic);
+    *ptr++ = (char)vb->num_replicas;
+    *ptr++ = vb->fvbuckets ? BINARY_HAS_FORWARD_MAP : 0;
+    ptr = put16(ptr, 0);
+    ptr = put32(ptr, (uint32_t)vb->num_servers);
+    ptr = put32(ptr, (uint32_t)vb->num_vbuckets);
+
+    ptr = put_string(ptr, hash);
+    ptr = put_string(ptr, vb->user);
+    ptr = put_string(ptr, vb->password);
+    for (int i = 0; i < vb->num_servers; ++i) {
+        ptr = put_string(ptr, vb->servers[i]);
+    }
+
+    ptr = put_map(ptr, vb, vb->vbuckets);
+    if (vb->fvbuckets) {
+        ptr = put_map(ptr, vb, vb->fvbuckets);
+    }
+    assert((size_t)(ptr - (char*)buf) == needed);
+
+    return needed;
+}
+
+/*
+ * Pull a string out of the binary config, copying it into buf (which
+ * can hold at least BINARY_NULL_STRING bytes)
+ */
+static const unsigned char *get_string(const unsigned char *ptr,
+                                       const unsigned char *end,
+                                       char *buf, char **str) {
+    if (end - ptr < 2) {
+        return NULL;
+    }
+    uint16_t len = get16(ptr);
+    ptr += 2;
+    if (len == BINARY_NULL_STRING) {
+        *str = NULL;
+        return ptr;
+    }
+    if (end - ptr < len) {
+        return NULL;
+    }
+    memcpy(buf, ptr, len);
+    buf[len] = '\0';
+    *str = buf;
+    return ptr + len;
+}
+
+static const unsigned char *get_map(const unsigned char *ptr,
+                                    struct vbucket_config_st *vb,
+                                    struct vbucket_st *map) {
+    size_t width = server_id_size(vb->num_servers);
+    for (int i = 0; i < vb->num_vbuckets; ++i) {
+        for (int j = 0; j <= vb->num_replicas; ++j) {
+            int id = (width == 1) ? (int8_t)*ptr : (int16_t)get16(ptr);
+            ptr += width;
+            if (id < -1 || id >= vb->num_servers) {
+                errstr = "Server ID must be >= -1 and < num_servers";
+                return NULL;
+            }
+            map[i].servers[j] = id;
+        }
+    }
+    return ptr;
+}
+
+VBUCKET_CONFIG_HANDLE vbucket_config_parse_binary(const void *data, size_t len) {
+    const unsigned char *ptr = data;
+    const unsigned char *end = ptr + len;
+
+    if (len < BINARY_HEADER_SIZE ||
+        memcmp(ptr, binary_magic, sizeof(binary_magic)) != 0) {
+        errstr = "Not a binary vbucket config";
+        return NULL;
+    }
+
+    int num_replicas = ptr[4];
+    int flags = ptr[5];
+    uint32_t num_servers = get32(ptr + 8);
+    uint32_t num_vbuckets = get32(ptr + 12);
+    ptr += BINARY_HEADER_SIZE;
+
+    if (num_replicas > MAX_REPLICAS) {
+        errstr = "Expected number <= " STRINGIFY(MAX_REPLICAS) " for numReplicas";
+        return NULL;
+    }
+    if (num_servers == 0 || num_servers > len) {
+        errstr = "Invalid number of servers";
+        return NULL;
+    }
+    if (num_vbuckets == 0 || num_vbuckets > MAX_BUCKETS ||
+        (num_vbuckets & (num_vbuckets - 1)) != 0) {
+        errstr = "Number of buckets must be a power of two > 0 and <= " STRINGIFY(MAX_BUCKETS);
+        return NULL;
+    }
+
+    char *buffer = malloc(3 * BINARY_NULL_STRING);
+    if (buffer == NULL) {
+        errstr = "Failed to allocate buffer";
+        return NULL;
+    }
+
+    char *hash, *user, *password;
+    if ((ptr = get_string(ptr, end, buffer, &hash)) == NULL ||
+        (ptr = get_string(ptr, end, buffer + BINARY_NULL_STRING, &user)) == NULL ||
+        (ptr = get_string(ptr, end, buffer + 2 * BINARY_NULL_STRING, &password)) == NULL ||
+        hash == NULL) {
+        free(buffer);
+        errstr = "Truncated binary vbucket config";
+        return NULL;
+    }
+
+    struct vbucket_config_st *vb = config_create(hash, (int)num_servers,
+                                                 (int)num_vbuckets, num_replicas,
+                                                 user, password);
+    free(buffer);
+    if (vb == NULL) {
+        return NULL;
+    }
+
+    for (int i = 0; i < vb->num_servers; ++i) {
+        if (end - ptr < 2 || get16(ptr) == BINARY_NULL_STRING ||
+            end - ptr - 2 < get16(ptr)) {
+            errstr = "Truncated binary vbucket config";
+            vbucket_config_destroy(vb);
+            return NULL;
+        }
+        uint16_t slen = get16(ptr);
+        if ((vb->servers[i] = malloc(slen + 1)) == NULL) {
+            errstr = "Failed to allocate storage for server string";
+            vbucket_config_destroy(vb);
+            return NULL;
+        }
+        memcpy(vb->servers[i], ptr + 2, slen);
+        vb->servers[i][slen] = '\0';
+        ptr += 2 + slen;
+    }
+
+    size_t map_size = (size_t)num_vbuckets * (num_replicas + 1) *
+        server_id_size(vb->num_servers);
+    size_t maps = (flags & BINARY_HAS_FORWARD_MAP) ? 2 : 1;
+    if ((size_t)(end - ptr) != maps * map_size) {
+        errstr = "Truncated binary vbucket config";
+        vbucket_config_destroy(vb);
+        return NULL;
+    }
+
+    if (build_server_index(vb) != 0 ||
+        (ptr = get_map(ptr, vb, vb->vbuckets)) == NULL) {
+        vbucket_config_destroy(vb);
+        return NULL;
+    }
+
+    if (maps == 2) {
+        if (alloc_forward_map(vb) != 0 ||
+            get_map(ptr, vb, vb->fvbuckets) == NULL) {
+            vbucket_config_destroy(vb);
+            return NULL;
+        }
+    }
+
+    return vb;
+}
+
 int vbucket_config_get_num_replicas(VBUCKET_CONFIG_HANDLE vb) {
     return vb->num_replicas;
 }
@@ -345,6 +668,18 @@ const char *vbucket_config_get_server(VBUCKET_CONFIG_HANDLE vb, int i) {
     return vb->servers[i];
 }
 
+int vbucket_config_get_server_index(VBUCKET_CONFIG_HANDLE vb, const char *server) {
+    uint32_t slot = server_hash(server) & vb->server_index_mask;
+    int id;
+    while ((id = vb->server_index[slot]) != 0) {
+        if (strcmp(vb->servers[id - 1], server) == 0) {
+            return id - 1;
+        }
+        slot = (slot + 1) & vb->server_index_mask;
+    }
+    return -1;
+}
+
 const char *vbucket_config_get_user(VBUCKET_CONFIG_HANDLE vb) {
     return vb->user;
 }
@@ -358,34 +693,70 @@ int vbucket_get_vbucket_by_key(VBUCKET_CONFIG_HANDLE vb, const void *key, size_t
     return digest & vb->mask;
 }
 
+/*
+ * Get the servers we currently route a vbucket to
+ */
+static struct vbucket_st *get_route(VBUCKET_CONFIG_HANDLE vb, int vbucket) {
+    if (vb->forwarded != NULL && vb->forwarded[vbucket]) {
+        return &vb->fvbuckets[vbucket];
+    }
+    return &vb->vbuckets[vbucket];
+}
+
 int vbucket_get_master(VBUCKET_CONFIG_HANDLE vb, int vbucket) {
-    return vb->vbuckets[vbucket].servers[0];
+    return get_route(vb, vbucket)->servers[0];
 }
 
 int vbucket_get_replica(VBUCKET_CONFIG_HANDLE vb, int vbucket, int i) {
-    return vb->vbuckets[vbucket].servers[i+1];
+    return get_route(vb, vbucket)->servers[i+1];
+}
+
+bool vbucket_config_has_fast_forward_map(VBUCKET_CONFIG_HANDLE vb) {
+    return vb->fvbuckets != NULL;
+}
+
+int vbucket_get_fast_forward_master(VBUCKET_CONFIG_HANDLE vb, int vbucket) {
+    if (vb->fvbuckets == NULL) {
+        return -1;
+    }
+    return vb->fvbuckets[vbucket].servers[0];
+}
+
+int vbucket_get_fast_forward_replica(VBUCKET_CONFIG_HANDLE vb, int vbucket, int i) {
+    if (vb->fvbuckets == NULL) {
+        return -1;
+    }
+    return vb->fvbuckets[vbucket].servers[i+1];
 }
 
 int vbucket_found_incorrect_master(VBUCKET_CONFIG_HANDLE vb, int vbucket,
                                    int wrongserver) {
-    int mappedServer = vb->vbuckets[vbucket].servers[0];
+    int mappedServer = vbucket_get_master(vb, vbucket);
     int rv = mappedServer;
+
+    if (mappedServer != wrongserver) {
+        // We already moved on
+        return rv;
+    }
+
     /*
-     * if a forward table exists, then return the vbucket id from the forward table
-     * and update that information in the current table. We also need to Update the
-     * replica information for that vbucket
+     * During a rebalance the vbucket lives on either its old master
+     * or the one in the fast forward map, so bounce between the two
+     * (taking the replicas along).
      */
     if (vb->fvbuckets) {
-        int i = 0;
-        rv = vb->vbuckets[vbucket].servers[0] = vb->fvbuckets[vbucket].servers[0];
-        for (i = 0; i < vb->num_replicas; i++) {
-            vb->vbuckets[vbucket].servers[i+1] = vb->fvbuckets[vbucket].servers[i+1];
+        int other = vb->forwarded[vbucket] ? vb->vbuckets[vbucket].servers[0] :
+            vb->fvbuckets[vbucket].servers[0];
+        if (other != -1 && other != wrongserver) {
+            vb->forwarded[vbucket] = !vb->forwarded[vbucket];
+            return other;
         }
-    } else if (mappedServer == wrongserver) {
-        rv = (rv + 1) % vb->num_servers;
-        vb->vbuckets[vbucket].servers[0] = rv;
+        vb->forwarded[vbucket] = false;
     }
 
+    rv = (rv + 1) % vb->num_servers;
+    vb->vbuckets[vbucket].servers[0] = rv;
+
     return rv;
 }
 
@@ -394,13 +765,8 @@ static void compute_vb_list_diff(VBUCKET_CONFIG_HANDLE from,
                                  char **out) {
     int offset = 0;
     for (int i = 0; i < to->num_servers; i++) {
-        bool found = false;
         const char *sn = vbucket_config_get_server(to, i);
-        for (int j = 0; !found && j < from->num_servers; j++) {
-            const char *sn2 = vbucket_config_get_server(from, j);
-            found |= (strcmp(sn2, sn) == 0);
-        }
-        if (!found) {
+        if (vbucket_config_get_server_index(from, sn) == -1) {
             out[offset] = strdup(sn);
             assert(out[offset]);
             ++offset;
@@ -462,6 +828,47 @@ VBUCKET_CONFIG_DIFF* vbucket_compare(VBUCKET_CONFIG_HANDLE from,
     return rv;
 }
 
+int vbucket_get_changed_vbuckets(VBUCKET_CONFIG_HANDLE from,
+                                 VBUCKET_CONFIG_HANDLE to,
+                                 int *vbuckets) {
+    if (from->num_vbuckets != to->num_vbuckets) {
+        errstr = "The configs have a different number of vbuckets";
+        return -1;
+    }
+
+    /* Where each of the "from" servers is in the "to" config (-2 if gone) */
+    int *ids = malloc(from->num_servers * sizeof(int));
+    if (ids == NULL) {
+        errstr = "Failed to allocate server id map";
+        return -1;
+    }
+    for (int i = 0; i < from->num_servers; ++i) {
+        int id = vbucket_config_get_server_index(to, from->servers[i]);
+        ids[i] = (id == -1) ? -2 : id;
+    }
+
+    int num_replicas = from->num_replicas > to->num_replicas ?
+        from->num_replicas : to->num_replicas;
+    int count = 0;
+
+    for (int i = 0; i < to->num_vbuckets; ++i) {
+        for (int j = 0; j <= num_replicas; ++j) {
+            int was = j <= from->num_replicas ? from->vbuckets[i].servers[j] : -1;
+            int is = j <= to->num_replicas ? to->vbuckets[i].servers[j] : -1;
+            if (was != -1) {
+                was = ids[was];
+            }
+            if (was != is) {
+                vbuckets[count++] = i;
+                break;
+            }
+        }
+    }
+
+    free(ids);
+    return count;
+}
+
 static void free_array_helper(char **l) {
     for (int i = 0; l[i]; i++) {
         free(l[i]);
@@ -217,9 +217,57 @@ static void testWrongServerFFT(const char *c) {
         rv = vbucket_get_master(vb, i);
         assert(rv != vbucket_found_incorrect_master(vb, i, rv));
     }
-    // the ideal test case should be that we check that the vbucket
-    // and the fvbucket map are identical at this point. TODO untill
-    // we have a vbucketlib function that diffs vbuckets and fvbuckets
+    // ...and we should route by the fast forward map
+    for (i = 0; i < nvb; i++) {
+        int r;
+        assert(vbucket_get_master(vb, i) ==
+               vbucket_get_fast_forward_master(vb, i));
+        for (r = 0; r < vbucket_config_get_num_replicas(vb); r++) {
+            assert(vbucket_get_replica(vb, i, r) ==
+                   vbucket_get_fast_forward_replica(vb, i, r));
+        }
+    }
+    vbucket_config_destroy(vb);
+}
+
+static void testFastForward(void) {
+    VBUCKET_CONFIG_HANDLE vb = vbucket_config_parse_string(configInEnvelopeFFT);
+    assert(vb);
+    assert(vbucket_config_has_fast_forward_map(vb));
+
+    assert(vbucket_get_master(vb, 0) == 0);
+    assert(vbucket_get_replica(vb, 0, 0) == 1);
+    assert(vbucket_get_fast_forward_master(vb, 0) == 3);
+    assert(vbucket_get_fast_forward_replica(vb, 0, 0) == 0);
+
+    // A stale report doesn't change anything
+    assert(vbucket_found_incorrect_master(vb, 0, 3) == 0);
+    assert(vbucket_get_master(vb, 0) == 0);
+
+    // The vbucket moved: go straight to the new master
+    assert(vbucket_found_incorrect_master(vb, 0, 0) == 3);
+    assert(vbucket_get_master(vb, 0) == 3);
+    assert(vbucket_get_replica(vb, 0, 0) == 0);
+    assert(vbucket_get_replica(vb, 0, 1) == 0);
+
+    // It didn't arrive yet: back to the old master
+    assert(vbucket_found_incorrect_master(vb, 0, 3) == 0);
+    assert(vbucket_get_master(vb, 0) == 0);
+    assert(vbucket_get_replica(vb, 0, 0) == 1);
+
+    // The fast forward map itself never changes
+    assert(vbucket_get_fast_forward_master(vb, 0) == 3);
+
+    // The other vbuckets are left alone
+    assert(vbucket_get_master(vb, 1) == 1);
+    assert(vbucket_get_master(vb, 3) == 1);
+    vbucket_config_destroy(vb);
+
+    vb = vbucket_config_parse_string(config);
+    assert(vb);
+    assert(!vbucket_config_has_fast_forward_map(vb));
+    assert(vbucket_get_fast_forward_master(vb, 0) == -1);
+    assert(vbucket_get_fast_forward_replica(vb, 0, 0) == -1);
     vbucket_config_destroy(vb);
 }
 
@@ -382,6 +430,158 @@ static void testConfigUserPassword(void) {
     vbucket_config_destroy(vb2);
 }
 
+static void testServerIndex(void) {
+    VBUCKET_CONFIG_HANDLE vb = vbucket_config_parse_string(config);
+    assert(vb);
+
+    for (int i = 0; i < 3; ++i) {
+        assert(vbucket_config_get_server_index(vb, servers[i]) == i);
+    }
+    assert(vbucket_config_get_server_index(vb, "server4:11211") == -1);
+    assert(vbucket_config_get_server_index(vb, "server1:11210") == -1);
+
+    vbucket_config_destroy(vb);
+}
+
+static void assertSameConfig(VBUCKET_CONFIG_HANDLE a, VBUCKET_CONFIG_HANDLE b) {
+    int num_replicas = vbucket_config_get_num_replicas(a);
+    assert(num_replicas == vbucket_config_get_num_replicas(b));
+    assert(vbucket_config_get_num_vbuckets(a) == vbucket_config_get_num_vbuckets(b));
+    assert(vbucket_config_get_num_servers(a) == vbucket_config_get_num_servers(b));
+
+    for (int i = 0; i < vbucket_config_get_num_servers(a); ++i) {
+        assert(strcmp(vbucket_config_get_server(a, i),
+                      vbucket_config_get_server(b, i)) == 0);
+        assert(vbucket_config_get_server_index(b, vbucket_config_get_server(a, i)) == i);
+    }
+
+    for (int i = 0; i < vbucket_config_get_num_vbuckets(a); ++i) {
+        assert(vbucket_get_master(a, i) == vbucket_get_master(b, i));
+        for (int j = 0; j < num_replicas; ++j) {
+            assert(vbucket_get_replica(a, i, j) == vbucket_get_replica(b, i, j));
+        }
+    }
+
+    const struct key_st *k;
+    for (k = keys; k->key != NULL; ++k) {
+        assert(vbucket_get_vbucket_by_key(a, k->key, strlen(k->key)) ==
+               vbucket_get_vbucket_by_key(b, k->key, strlen(k->key)));
+    }
+
+    if (vbucket_config_get_user(a) == NULL) {
+        assert(vbucket_config_get_user(b) == NULL);
+    } else {
+        assert(strcmp(vbucket_config_get_user(a), vbucket_config_get_user(b)) == 0);
+    }
+    if (vbucket_config_get_password(a) == NULL) {
+        assert(vbucket_config_get_password(b) == NULL);
+    } else {
+        assert(strcmp(vbucket_config_get_password(a),
+                      vbucket_config_get_password(b)) == 0);
+    }
+}
+
+static void testBinaryConfig(const char *c) {
+    VBUCKET_CONFIG_HANDLE vb = vbucket_config_parse_string(c);
+    assert(vb);
+
+    size_t len = vbucket_config_serialize(vb, NULL, 0);
+    assert(len > 0);
+    char *buf = malloc(len);
+    assert(buf);
+    assert(vbucket_config_serialize(vb, buf, len) == len);
+
+    VBUCKET_CONFIG_HANDLE vb2 = vbucket_config_parse_binary(buf, len);
+    if (vb2 == NULL) {
+        fprintf(stderr, "vbucket_config_parse_binary error: %s\n", vbucket_get_error());
+        abort();
+    }
+    assertSameConfig(vb, vb2);
+
+    // The forward map (if any) came along
+    for (int i = 0; i < vbucket_config_get_num_vbuckets(vb); ++i) {
+        int master = vbucket_get_master(vb, i);
+        assert(vbucket_found_incorrect_master(vb, i, master) ==
+               vbucket_found_incorrect_master(vb2, i, master));
+    }
+    vbucket_config_destroy(vb2);
+
+    // Anything truncated or garbled is rejected
+    for (size_t ii = 0; ii < len; ++ii) {
+        assert(vbucket_config_parse_binary(buf, ii) == NULL);
+    }
+    buf[0] = '{';
+    assert(vbucket_config_parse_binary(buf, len) == NULL);
+    assert(vbucket_config_parse_string("\0VB") == NULL);
+
+    free(buf);
+    vbucket_config_destroy(vb);
+}
+
+static void testChangedVBuckets(void) {
+    const char *cfg1 = "{\n"
+        "  \"hashAlgorithm\": \"CRC\",\n"
+        "  \"numReplicas\": 1,\n"
+        "  \"serverList\": [\"server1:11211\", \"server2:11210\", \"server3:11211\"],\n"
+        "  \"vBucketMap\":\n"
+        "    [\n"
+        "      [0, 1],\n"
+        "      [1, 2],\n"
+        "      [2, 0],\n"
+        "      [0, 2]\n"
+        "    ]\n"
+        "}";
+    // Same servers in another order, only vbucket 2 moved
+    const char *cfg2 = "{\n"
+        "  \"hashAlgorithm\": \"CRC\",\n"
+        "  \"numReplicas\": 1,\n"
+        "  \"serverList\": [\"server3:11211\", \"server1:11211\", \"server2:11210\"],\n"
+        "  \"vBucketMap\":\n"
+        "    [\n"
+        "      [1, 2],\n"
+        "      [2, 0],\n"
+        "      [1, 0],\n"
+        "      [1, 0]\n"
+        "    ]\n"
+        "}";
+
+    VBUCKET_CONFIG_HANDLE vb1 = vbucket_config_parse_string(cfg1);
+    assert(vb1);
+    VBUCKET_CONFIG_HANDLE vb2 = vbucket_config_parse_string(cfg2);
+    assert(vb2);
+
+    int changed[4];
+    assert(vbucket_get_changed_vbuckets(vb1, vb1, changed) == 0);
+    assert(vbucket_get_changed_vbuckets(vb1, vb2, changed) == 1);
+    assert(changed[0] == 2);
+    assert(vbucket_get_changed_vbuckets(vb2, vb1, changed) == 1);
+    assert(changed[0] == 2);
+
+    vbucket_config_destroy(vb2);
+
+    // A server leaving changes every vbucket it was on
+    vb2 = vbucket_config_parse_string(config);
+    assert(vb2);
+    assert(vbucket_get_changed_vbuckets(vb1, vb2, changed) == 4);
+    for (int i = 0; i < 4; ++i) {
+        assert(changed[i] == i);
+    }
+    vbucket_config_destroy(vb2);
+
+    // ...and a different number of vbuckets can't be compared
+    vb2 = vbucket_config_parse_string("{\n"
+        "  \"hashAlgorithm\": \"CRC\",\n"
+        "  \"numReplicas\": 1,\n"
+        "  \"serverList\": [\"server1:11211\", \"server2:11210\"],\n"
+        "  \"vBucketMap\": [[0, 1], [1, 0]]\n"
+        "}");
+    assert(vb2);
+    assert(vbucket_get_changed_vbuckets(vb1, vb2, changed) == -1);
+    vbucket_config_destroy(vb2);
+
+    vbucket_config_destroy(vb1);
+}
+
 int main(void) {
   testConfig(config);
   testConfig(configFlat);
@@ -390,9 +590,15 @@ int main(void) {
   testConfig(configInEnvelopeFFT);
   testWrongServer(config);
   testWrongServerFFT(configInEnvelopeFFT);
+  testFastForward();
   testConfigDiff();
   testConfigDiffSame();
   testConfigUserPassword();
+  testServerIndex();
+  testBinaryConfig(config);
+  testBinaryConfig(configInEnvelopeFFT);
+  testBinaryConfig(configInEnvelope2);
+  testChangedVBuckets();
 }
 
 
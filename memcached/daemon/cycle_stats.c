@@ -0,0 +1,209 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+#include "config.h"
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+#include <memcached/protocol_binary.h>
+#include "cycle_stats.h"
+#include "vbucket_stats.h"
+
+/* See vbucket_stats.c */
+#ifdef __GNUC__
+#define CYCLES_LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define CYCLES_ADD(ptr, val) \
+    __atomic_store_n(ptr, __atomic_load_n(ptr, __ATOMIC_RELAXED) + (val), \
+                     __ATOMIC_RELAXED)
+#else
+#define CYCLES_LOAD(ptr) (*(volatile uint64_t *)(ptr))
+#define CYCLES_ADD(ptr, val) (*(volatile uint64_t *)(ptr) += (val))
+#endif
+
+static const char *ascii_commands[] = {
+#define CYCLES_ASCII_NAME(name) #name,
+    CYCLES_ASCII_COMMANDS(CYCLES_ASCII_NAME)
+#undef CYCLES_ASCII_NAME
+};
+
+static const char *binary_commands[CYCLES_ASCII_BASE] = {
+    [PROTOCOL_BINARY_CMD_GET] = "get",
+    [PROTOCOL_BINARY_CMD_SET] = "set",
+    [PROTOCOL_BINARY_CMD_ADD] = "add",
+    [PROTOCOL_BINARY_CMD_REPLACE] = "replace",
+    [PROTOCOL_BINARY_CMD_DELETE] = "delete",
+    [PROTOCOL_BINARY_CMD_INCREMENT] = "incr",
+    [PROTOCOL_BINARY_CMD_DECREMENT] = "decr",
+    [PROTOCOL_BINARY_CMD_QUIT] = "quit",
+    [PROTOCOL_BINARY_CMD_FLUSH] = "flush",
+    [PROTOCOL_BINARY_CMD_GETQ] = "getq",
+    [PROTOCOL_BINARY_CMD_NOOP] = "noop",
+    [PROTOCOL_BINARY_CMD_VERSION] = "version",
+    [PROTOCOL_BINARY_CMD_GETK] = "getk",
+    [PROTOCOL_BINARY_CMD_GETKQ] = "getkq",
+    [PROTOCOL_BINARY_CMD_APPEND] = "append",
+    [PROTOCOL_BINARY_CMD_PREPEND] = "prepend",
+    [PROTOCOL_BINARY_CMD_STAT] = "stat",
+    [PROTOCOL_BINARY_CMD_SETQ] = "setq",
+    [PROTOCOL_BINARY_CMD_ADDQ] = "addq",
+    [PROTOCOL_BINARY_CMD_REPLACEQ] = "replaceq",
+    [PROTOCOL_BINARY_CMD_DELETEQ] = "deleteq",
+    [PROTOCOL_BINARY_CMD_INCREMENTQ] = "incrq",
+    [PROTOCOL_BINARY_CMD_DECREMENTQ] = "decrq",
+    [PROTOCOL_BINARY_CMD_QUITQ] = "quitq",
+    [PROTOCOL_BINARY_CMD_FLUSHQ] = "flushq",
+    [PROTOCOL_BINARY_CMD_APPENDQ] = "appendq",
+    [PROTOCOL_BINARY_CMD_PREPENDQ] = "prependq",
+    [PROTOCOL_BINARY_CMD_VERBOSITY] = "verbosity",
+    [PROTOCOL_BINARY_CMD_TOUCH] = "touch",
+    [PROTOCOL_BINARY_CMD_GAT] = "gat",
+    [PROTOCOL_BINARY_CMD_GATQ] = "gatq",
+    [PROTOCOL_BINARY_CMD_HELLO] = "hello",
+    [PROTOCOL_BINARY_CMD_SASL_LIST_MECHS] = "sasl_list_mechs",
+    [PROTOCOL_BINARY_CMD_SASL_AUTH] = "sasl_auth",
+    [PROTOCOL_BINARY_CMD_SASL_STEP] = "sasl_step",
+    [PROTOCOL_BINARY_CMD_TAP_CONNECT] = "tap_connect",
+    [PROTOCOL_BINARY_CMD_TAP_MUTATION] = "tap_mutation",
+    [PROTOCOL_BINARY_CMD_TAP_DELETE] = "tap_delete",
+    [PROTOCOL_BINARY_CMD_TAP_FLUSH] = "tap_flush",
+    [PROTOCOL_BINARY_CMD_TAP_OPAQUE] = "tap_opaque",
+    [PROTOCOL_BINARY_CMD_TAP_VBUCKET_SET] = "tap_vbucket_set",
+    [PROTOCOL_BINARY_CMD_TAP_CHECKPOINT_START] = "tap_checkpoint_start",
+    [PROTOCOL_BINARY_CMD_TAP_CHECKPOINT_END] = "tap_checkpoint_end"
+};
+
+cycle_stats_t *cycle_stats_init(int nthreads) {
+    assert(nthreads > 0);
+    cycle_stats_t *cs = calloc(sizeof(cycle_stats_t), 1);
+    if (cs == NULL) {
+        return NULL;
+    }
+
+    cs->nthreads = nthreads;
+    cs->stats = calloc((size_t)nthreads * CYCLES_NCOMMANDS,
+                       sizeof(struct cycle_counters));
+    cs->baseline = calloc(CYCLES_NCOMMANDS, sizeof(struct cycle_counters));
+    if (cs->stats == NULL || cs->baseline == NULL) {
+        free(cs->stats);
+        free(cs->baseline);
+        free(cs);
+        return NULL;
+    }
+    pthread_mutex_init(&cs->mutex, NULL);
+    cs->start_cycles = cycle_stats_now();
+    cs->start_nsec = vbucket_stats_now();
+    return cs;
+}
+
+void cycle_stats_free(cycle_stats_t *cs) {
+    pthread_mutex_destroy(&cs->mutex);
+    free(cs->stats);
+    free(cs->baseline);
+    free(cs);
+}
+
+uint16_t cycle_stats_ascii_command(const char *command) {
+    for (int ii = 0; ii < CYCLES_ASCII_other; ++ii) {
+        if (strcmp(command, ascii_commands[ii]) == 0) {
+            return CYCLES_ASCII_BASE + ii;
+        }
+    }
+    if (strcmp(command, "bget") == 0) {
+        return CYCLES_ASCII_BASE + CYCLES_ASCII_get;
+    }
+    return CYCLES_ASCII_BASE + CYCLES_ASCII_other;
+}
+
+void cycle_stats_record(cycle_stats_t *cs, int thread, struct cycle_op *op) {
+    assert(thread >= 0 && thread < cs->nthreads);
+    assert(op->command < CYCLES_NCOMMANDS);
+
+    cycle_op_pause(op);
+    op->active = false;
+
+    struct cycle_counters *s;
+    s = cs->stats + (size_t)thread * CYCLES_NCOMMANDS + op->command;
+    CYCLES_ADD(&s->count, 1);
+    for (int ii = 0; ii < CYCLES_NPHASES; ++ii) {
+        CYCLES_ADD(&s->cycles[ii], op->cycles[ii]);
+    }
+}
+
+/* Sum the rows of all of the threads for a command */
+static void cycle_stats_merge(cycle_stats_t *cs, int command,
+                              struct cycle_counters *out) {
+    memset(out, 0, sizeof(*out));
+    for (int ii = 0; ii < cs->nthreads; ++ii) {
+        struct cycle_counters *s;
+        s = cs->stats + (size_t)ii * CYCLES_NCOMMANDS + command;
+        out->count += CYCLES_LOAD(&s->count);
+        for (int jj = 0; jj < CYCLES_NPHASES; ++jj) {
+            out->cycles[jj] += CYCLES_LOAD(&s->cycles[jj]);
+        }
+    }
+}
+
+void cycle_stats_reset(cycle_stats_t *cs) {
+    pthread_mutex_lock(&cs->mutex);
+    for (int ii = 0; ii < CYCLES_NCOMMANDS; ++ii) {
+        cycle_stats_merge(cs, ii, &cs->baseline[ii]);
+    }
+    pthread_mutex_unlock(&cs->mutex);
+}
+
+static void append_stat(const void *cookie, const char *command,
+                        const char *name, uint64_t value, ADD_STAT add_stat) {
+    char key[64];
+    char val[32];
+    int klen = snprintf(key, sizeof(key), "%s:%s", command, name);
+    int vlen = snprintf(val, sizeof(val), "%"PRIu64, value);
+    add_stat(key, klen, val, vlen, cookie);
+}
+
+ENGINE_ERROR_CODE cycle_stats_details(cycle_stats_t *cs, const void *cookie,
+                                      ADD_STAT add_stat) {
+    char val[32];
+    int vlen;
+
+    /* Cycles per microsecond since we started, to convert the counters */
+    uint64_t usec = (vbucket_stats_now() - cs->start_nsec) / 1000;
+    uint64_t cycles = cycle_stats_now() - cs->start_cycles;
+    vlen = snprintf(val, sizeof(val), "%"PRIu64,
+                    usec == 0 ? 0 : cycles / usec);
+    add_stat("cycles_per_usec", 15, val, vlen, cookie);
+
+    pthread_mutex_lock(&cs->mutex);
+    for (int ii = 0; ii < CYCLES_NCOMMANDS; ++ii) {
+        struct cycle_counters total;
+        struct cycle_counters *base = &cs->baseline[ii];
+        cycle_stats_merge(cs, ii, &total);
+        if (total.count == base->count) {
+            continue;
+        }
+
+        char name[64];
+        if (ii >= CYCLES_ASCII_BASE) {
+            snprintf(name, sizeof(name), "ascii_%s",
+                     ascii_commands[ii - CYCLES_ASCII_BASE]);
+        } else if (binary_commands[ii] != NULL) {
+            snprintf(name, sizeof(name), "bin_%s", binary_commands[ii]);
+        } else {
+            snprintf(name, sizeof(name), "bin_0x%02x", ii);
+        }
+
+        append_stat(cookie, name, "count", total.count - base->count,
+                    add_stat);
+        append_stat(cookie, name, "parse_cycles",
+                    total.cycles[CYCLES_PARSE] - base->cycles[CYCLES_PARSE],
+                    add_stat);
+        append_stat(cookie, name, "engine_cycles",
+                    total.cycles[CYCLES_ENGINE] - base->cycles[CYCLES_ENGINE],
+                    add_stat);
+        append_stat(cookie, name, "response_cycles",
+                    total.cycles[CYCLES_RESPONSE] -
+                    base->cycles[CYCLES_RESPONSE], add_stat);
+    }
+    pthread_mutex_unlock(&cs->mutex);
+    return ENGINE_SUCCESS;
+}
@@ -0,0 +1,135 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+#ifndef CYCLE_STATS_H
+#define CYCLE_STATS_H 1
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <memcached/engine.h>
+
+/*
+ * Per-command CPU cycle accounting ("stats cycles").
+ *
+ * A command is split in three phases: parsing the request (including
+ * reading its body), executing it in the engine, and sending the
+ * response. The cycles are counted with the time stamp counter while
+ * the worker thread runs the command, and the clock is stopped while the
+ * command waits for the network or the engine. Like the vbucket stats
+ * every worker thread owns one row of counters.
+ */
+
+enum cycle_phase {
+    CYCLES_PARSE,
+    CYCLES_ENGINE,
+    CYCLES_RESPONSE,
+    CYCLES_NPHASES
+};
+
+/* The binary commands are indexed by opcode, the ascii ones follow */
+#define CYCLES_ASCII_COMMANDS(C) C(get) C(gets) C(set) C(add) C(replace) \
+    C(append) C(prepend) C(cas) C(incr) C(decr) C(delete) C(stats)         \
+    C(flush_all) C(version) C(quit) C(verbosity) C(cycles) C(other)
+
+enum cycle_ascii_command {
+#define CYCLES_ASCII_ENUM(name) CYCLES_ASCII_##name,
+    CYCLES_ASCII_COMMANDS(CYCLES_ASCII_ENUM)
+#undef CYCLES_ASCII_ENUM
+    CYCLES_ASCII_NCOMMANDS
+};
+
+#define CYCLES_ASCII_BASE 256
+#define CYCLES_NCOMMANDS (CYCLES_ASCII_BASE + CYCLES_ASCII_NCOMMANDS)
+
+struct cycle_counters {
+    uint64_t count;
+    uint64_t cycles[CYCLES_NPHASES];
+};
+
+typedef struct cycle_stats {
+    int nthreads;
+    /* nthreads rows of CYCLES_NCOMMANDS entries */
+    struct cycle_counters *stats;
+    /* Protects the reset baseline (readers and resets only) */
+    pthread_mutex_t mutex;
+    struct cycle_counters *baseline;
+    /* Used to tell the rate of the counter */
+    uint64_t start_cycles;
+    uint64_t start_nsec;
+} cycle_stats_t;
+
+/* The command a connection is currently accounting */
+struct cycle_op {
+    uint64_t mark;              /* when the current phase (re)started */
+    uint64_t cycles[CYCLES_NPHASES];
+    uint16_t command;
+    uint8_t phase;
+    bool paused;
+    bool active;
+};
+
+static inline uint64_t cycle_stats_now(void) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static inline void cycle_op_begin(struct cycle_op *op, uint16_t command) {
+    op->mark = cycle_stats_now();
+    op->cycles[CYCLES_PARSE] = 0;
+    op->cycles[CYCLES_ENGINE] = 0;
+    op->cycles[CYCLES_RESPONSE] = 0;
+    op->command = command;
+    op->phase = CYCLES_PARSE;
+    op->paused = false;
+    op->active = true;
+}
+
+/* Charge the cycles so far to the current phase and enter a new one */
+static inline void cycle_op_phase(struct cycle_op *op, enum cycle_phase phase) {
+    if (op->active) {
+        uint64_t now = cycle_stats_now();
+        if (!op->paused) {
+            op->cycles[op->phase] += now - op->mark;
+        }
+        op->mark = now;
+        op->phase = (uint8_t)phase;
+        op->paused = false;
+    }
+}
+
+/* The command waits for the network or the engine */
+static inline void cycle_op_pause(struct cycle_op *op) {
+    if (op->active && !op->paused) {
+        op->cycles[op->phase] += cycle_stats_now() - op->mark;
+        op->paused = true;
+    }
+}
+
+static inline void cycle_op_resume(struct cycle_op *op) {
+    if (op->active && op->paused) {
+        op->mark = cycle_stats_now();
+        op->paused = false;
+    }
+}
+
+cycle_stats_t *cycle_stats_init(int nthreads);
+void cycle_stats_free(cycle_stats_t *cs);
+
+/* Map the command token of an ascii command to its command index */
+uint16_t cycle_stats_ascii_command(const char *command);
+
+/* Account a completed command (called by the thread owning the row) */
+void cycle_stats_record(cycle_stats_t *cs, int thread, struct cycle_op *op);
+
+void cycle_stats_reset(cycle_stats_t *cs);
+ENGINE_ERROR_CODE cycle_stats_details(cycle_stats_t *cs, const void *cookie,
+                                      ADD_STAT add_stat);
+
+#endif
@@ -17,6 +17,8 @@
 #include "memcached.h"
 #include "memcached/extension_loggers.h"
 #include "utilities/engine_loader.h"
+#include "tokenizer.h"
+#include "uring.h"
 
 #include <signal.h>
 #include <getopt.h>
@@ -149,13 +151,13 @@ static void process_stat_settings(ADD_STAT add_stats, void *c);
 static void settings_init(void);
 
 /* event handling, network IO */
-static void event_handler(const int fd, const short which, void *arg);
 static void complete_nread(conn *c);
 static char *process_command(conn *c, char *command);
 static void write_and_free(conn *c, char *buf, int bytes);
 static int ensure_iov_space(conn *c);
 static int add_iov(conn *c, const void *buf, int len);
 static int add_msghdr(conn *c);
+static void unordered_release(conn *c);
 
 
 /* time handling */
@@ -172,6 +174,8 @@ static time_t process_started;     /* when the process was started */
 static conn *listen_conn = NULL;
 static struct event_base *main_base;
 static struct independent_stats *default_independent_stats;
+static cycle_stats_t *cycle_stats;
+static const tokenizer_t *ascii_tokenizer;
 
 static struct engine_event_handler *engine_event_handlers[MAX_ENGINE_EVENT_TYPE + 1];
 
@@ -196,6 +200,50 @@ static void perform_callbacks(ENGINE_EVENT_TYPE type,
     }
 }
 
+/*
+ * Start accounting the command in the per-vbucket stats. A command the
+ * engine blocked is accounted from the first attempt, so its latency
+ * includes the time spent waiting for the engine.
+ */
+static inline void vbucket_op_begin(conn *c, uint16_t vbucket, size_t nbytes) {
+    if (settings.vbucket_stats > 0 && !c->vbop.active) {
+        c->vbop.active = true;
+        c->vbop.vbucket = vbucket;
+        c->vbop.start = vbucket_stats_now();
+        c->vbop.bytes_in = nbytes;
+        c->vbop.bytes_out = 0;
+        c->vbop.misses = 0;
+    }
+}
+
+/* The response for the command is sent, account it */
+static inline void vbucket_op_end(conn *c) {
+    if (c->vbop.active) {
+        c->vbop.active = false;
+        vbucket_stats_t *vs = get_independent_stats(c)->vbucket_stats;
+        if (vs != NULL) {
+            vbucket_stats_record(vs, c->thread->index, &c->vbop,
+                                 vbucket_stats_now());
+        }
+    }
+}
+
+/*
+ * Start accounting the cycles of a command. The ascii commands are only
+ * known once they're tokenized (see process_command).
+ */
+static inline void cycles_begin(conn *c, uint16_t command) {
+    if (settings.cycle_stats && !c->cycles.active) {
+        cycle_op_begin(&c->cycles, command);
+    }
+}
+
+static inline void cycles_end(conn *c) {
+    if (c->cycles.active) {
+        cycle_stats_record(cycle_stats, c->thread->index, &c->cycles);
+    }
+}
+
 /*
  * given time value that's either unix time or delta from current unix time,
  * return unix time. Use the fact that delta can't exceed one month
@@ -245,6 +293,10 @@ static void stats_reset(const void *cookie) {
     stats_prefix_clear();
     STATS_UNLOCK();
     threadlocal_stats_reset(get_independent_stats(conn)->thread_stats);
+    if (get_independent_stats(conn)->vbucket_stats != NULL) {
+        vbucket_stats_reset(get_independent_stats(conn)->vbucket_stats);
+    }
+    cycle_stats_reset(cycle_stats);
     settings.engine.v1->reset_stats(settings.engine.v0, cookie);
 }
 
@@ -273,6 +325,9 @@ static void settings_init(void) {
     settings.binding_protocol = negotiating_prot;
     settings.item_size_max = 1024 * 1024; /* The famous 1MB upper limit. */
     settings.topkeys = 0;
+    settings.vbucket_stats = 0;
+    settings.cycle_stats = false;
+    settings.io_uring = false;
     settings.require_sasl = false;
     settings.extensions.logger = get_stderr_logger();
     settings.thread_affinity = false;
@@ -548,6 +603,31 @@ static void conn_destructor(void *buffer, void *unused) {
     STATS_UNLOCK();
 }
 
+static void line_cache_reset(conn *c) {
+    c->lines.scanned = 0;
+    c->lines.next = c->lines.count = 0;
+}
+
+/*
+ * The unparsed data at rcurr is about to be moved "distance" bytes towards
+ * the start of rbuf. Keep what we know about line terminators in it.
+ */
+static void line_cache_shift(conn *c, uint32_t distance) {
+    if (c->lines.scanned < distance) {
+        line_cache_reset(c);
+        return;
+    }
+
+    c->lines.scanned -= distance;
+    while (c->lines.next < c->lines.count &&
+           c->lines.eol[c->lines.next] < distance) {
+        ++c->lines.next;
+    }
+    for (int ii = c->lines.next; ii < c->lines.count; ++ii) {
+        c->lines.eol[ii] -= distance;
+    }
+}
+
 conn *conn_new(const SOCKET sfd, STATE_FUNC init_state,
                const int event_flags,
                const int read_buffer_size, enum network_transport transport,
@@ -615,6 +695,7 @@ conn *conn_new(const SOCKET sfd, STATE_FUNC init_state,
     c->rbytes = c->wbytes = 0;
     c->wcurr = c->wbuf;
     c->rcurr = c->rbuf;
+    line_cache_reset(c);
     c->ritem = 0;
     c->icurr = c->ilist;
     c->suffixcurr = c->suffixlist;
@@ -631,6 +712,8 @@ conn *conn_new(const SOCKET sfd, STATE_FUNC init_state,
     c->item = 0;
 
     c->noreply = false;
+    c->unordered = NULL;
+    c->parked = NULL;
 
     event_set(&c->event, sfd, event_flags, event_handler, (void *)c);
     event_base_set(base, &c->event);
@@ -649,6 +732,8 @@ conn *conn_new(const SOCKET sfd, STATE_FUNC init_state,
     c->aiostat = ENGINE_SUCCESS;
     c->ewouldblock = false;
     c->refcount = 1;
+    c->vbop.active = false;
+    c->cycles.active = false;
 
     MEMCACHED_CONN_ALLOCATE(c->sfd);
 
@@ -687,6 +772,8 @@ static void conn_cleanup(conn *c) {
         c->sasl_conn = NULL;
     }
 
+    unordered_release(c);
+
     c->engine_storage = NULL;
     c->tap_iterator = NULL;
     c->thread = NULL;
@@ -694,6 +781,8 @@ static void conn_cleanup(conn *c) {
     c->ascii_cmd = NULL;
     c->sfd = INVALID_SOCKET;
     c->tap_nack_mode = false;
+    c->vbop.active = false;
+    c->cycles.active = false;
 }
 
 void conn_close(conn *c) {
@@ -744,8 +833,10 @@ static void conn_shrink(conn *c) {
     if (c->rsize > READ_BUFFER_HIGHWAT && c->rbytes < DATA_BUFFER_SIZE) {
         char *newbuf;
 
-        if (c->rcurr != c->rbuf)
+        if (c->rcurr != c->rbuf) {
+            line_cache_shift(c, c->rcurr - c->rbuf);
             memmove(c->rbuf, c->rcurr, (size_t)c->rbytes);
+        }
 
         newbuf = (char *)realloc((void *)c->rbuf, DATA_BUFFER_SIZE);
 
@@ -858,6 +949,10 @@ void conn_set_state(conn *c, STATE_FUNC state) {
 
         if (state == conn_write || state == conn_mwrite) {
             MEMCACHED_PROCESS_COMMAND_END(c->sfd, c->wbuf, c->wbytes);
+            cycle_op_phase(&c->cycles, CYCLES_RESPONSE);
+        } else if (state == conn_nread) {
+            /* Reading the body is part of parsing the command */
+            cycle_op_phase(&c->cycles, CYCLES_PARSE);
         }
     }
 }
@@ -1360,55 +1455,59 @@ static protocol_binary_response_status engine_error_2_protocol_error(ENGINE_ERRO
     return ret;
 }
 
-static void write_bin_packet(conn *c, protocol_binary_response_status err, int swallow) {
+/*
+ * Format the message for an error response (and whatever extra error
+ * information the engine has for the cookie) into buffer.
+ */
+static ssize_t bin_error_message(conn *c, protocol_binary_response_status err,
+                                 char *buffer, size_t size) {
     ssize_t len;
-    char buffer[1024] = { [sizeof(buffer) - 1] = '\0' };
 
     switch (err) {
     case PROTOCOL_BINARY_RESPONSE_SUCCESS:
         len = 0;
         break;
     case PROTOCOL_BINARY_RESPONSE_ENOMEM:
-        len = snprintf(buffer, sizeof(buffer), "Out of memory");
+        len = snprintf(buffer, size, "Out of memory");
         break;
     case PROTOCOL_BINARY_RESPONSE_ETMPFAIL:
-        len = snprintf(buffer, sizeof(buffer), "Temporary failure");
+        len = snprintf(buffer, size, "Temporary failure");
         break;
     case PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND:
-        len = snprintf(buffer, sizeof(buffer), "Unknown command");
+        len = snprintf(buffer, size, "Unknown command");
         break;
     case PROTOCOL_BINARY_RESPONSE_KEY_ENOENT:
-        len = snprintf(buffer, sizeof(buffer), "Not found");
+        len = snprintf(buffer, size, "Not found");
         break;
     case PROTOCOL_BINARY_RESPONSE_EINVAL:
-        len = snprintf(buffer, sizeof(buffer), "Invalid arguments");
+        len = snprintf(buffer, size, "Invalid arguments");
         break;
     case PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS:
-        len = snprintf(buffer, sizeof(buffer), "Data exists for key");
+        len = snprintf(buffer, size, "Data exists for key");
         break;
     case PROTOCOL_BINARY_RESPONSE_E2BIG:
-        len = snprintf(buffer, sizeof(buffer), "Too large");
+        len = snprintf(buffer, size, "Too large");
         break;
     case PROTOCOL_BINARY_RESPONSE_DELTA_BADVAL:
-        len = snprintf(buffer, sizeof(buffer),
+        len = snprintf(buffer, size,
                        "Non-numeric server-side value for incr or decr");
         break;
     case PROTOCOL_BINARY_RESPONSE_NOT_STORED:
-        len = snprintf(buffer, sizeof(buffer), "Not stored");
+        len = snprintf(buffer, size, "Not stored");
         break;
     case PROTOCOL_BINARY_RESPONSE_AUTH_ERROR:
-        len = snprintf(buffer, sizeof(buffer), "Auth failure");
+        len = snprintf(buffer, size, "Auth failure");
         break;
     case PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED:
-        len = snprintf(buffer, sizeof(buffer), "Not supported");
+        len = snprintf(buffer, size, "Not supported");
         break;
     case PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET:
-        len = snprintf(buffer, sizeof(buffer),
+        len = snprintf(buffer, size,
                        "I'm not responsible for this vbucket");
         break;
 
     default:
-        len = snprintf(buffer, sizeof(buffer), "UNHANDLED ERROR (%d)", err);
+        len = snprintf(buffer, size, "UNHANDLED ERROR (%d)", err);
         settings.extensions.logger->log(EXTENSION_LOG_WARNING, c,
                                         ">%d UNHANDLED ERROR: %d\n", c->sfd, err);
     }
@@ -1416,7 +1515,7 @@ static void write_bin_packet(conn *c, protocol_binary_response_status err, int s
     /* Allow the engine to pass extra error information */
     if (settings.engine.v1->errinfo != NULL) {
         size_t elen = settings.engine.v1->errinfo(settings.engine.v0, c, buffer + len + 2,
-                                                  sizeof(buffer) - len - 3);
+                                                  size - len - 3);
 
         if (elen > 0) {
             memcpy(buffer + len, ": ", 2);
@@ -1424,6 +1523,13 @@ static void write_bin_packet(conn *c, protocol_binary_response_status err, int s
         }
     }
 
+    return len;
+}
+
+static void write_bin_packet(conn *c, protocol_binary_response_status err, int swallow) {
+    char buffer[1024] = { [sizeof(buffer) - 1] = '\0' };
+    ssize_t len = bin_error_message(c, err, buffer, sizeof(buffer));
+
     if (err != PROTOCOL_BINARY_RESPONSE_SUCCESS && settings.verbose > 1) {
         settings.extensions.logger->log(EXTENSION_LOG_DEBUG, c,
                                         ">%d Writing an error: %s\n", c->sfd,
@@ -1523,6 +1629,7 @@ static void complete_incr_bin(conn *c) {
         } else {
             STATS_INCR(c, decr_misses, key, nkey);
         }
+        ++c->vbop.misses;
         break;
     case ENGINE_ENOMEM:
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
@@ -1651,6 +1758,7 @@ static void complete_update_bin(conn *c) {
             break;
         case ENGINE_KEY_ENOENT:
             STATS_NOKEY(c, cas_misses);
+            ++c->vbop.misses;
             break;
         default:
             ;
@@ -1666,6 +1774,381 @@ static void complete_update_bin(conn *c) {
     }
 }
 
+/*
+ * Unordered execution (see struct unordered in memcached.h). The parked
+ * requests are only touched by the thread serving the connection, except
+ * for the status and ready fields which the engine's notification sets
+ * while holding the thread lock.
+ */
+
+/* The connection a cookie belongs to (NULL if it's closed) */
+static conn *cookie_conn(const void *cookie) {
+    struct unordered_req *req = cookie_parked(cookie);
+    return req != NULL ? req->c : (conn *)cookie;
+}
+
+static struct unordered_req *unordered_req_alloc(conn *c) {
+    struct unordered *u = c->unordered;
+    struct unordered_req *req = u->free_reqs;
+
+    if (req != NULL) {
+        u->free_reqs = req->next;
+        --u->nfree_reqs;
+    } else if ((req = calloc(1, sizeof(*req))) == NULL) {
+        return NULL;
+    }
+
+    req->parked = req;
+    req->engine_storage = c->engine_storage;
+    req->sfd = c->sfd;
+    req->next = NULL;
+    req->c = c;
+    req->thread = c->thread;
+    req->status = ENGINE_SUCCESS;
+    req->ready = false;
+    return req;
+}
+
+/* The request completed, hand what the engine stored back to the connection */
+static void unordered_req_release(conn *c, struct unordered_req *req) {
+    struct unordered *u = c->unordered;
+    c->engine_storage = req->engine_storage;
+    if (u->nfree_reqs < UNORDERED_MAX_PARKED) {
+        req->next = u->free_reqs;
+        u->free_reqs = req;
+        ++u->nfree_reqs;
+    } else {
+        free(req);
+    }
+}
+
+/*
+ * Park the get request the engine returned EWOULDBLOCK for. Called with
+ * the thread lock held.
+ */
+static void unordered_park(conn *c, struct unordered_req *req) {
+    struct unordered *u = c->unordered;
+
+    req->opcode = c->binary_header.request.opcode;
+    req->cmd = c->cmd;
+    req->noreply = c->noreply;
+    req->vbucket = c->binary_header.request.vbucket;
+    req->opaque = c->opaque;
+    req->nkey = c->binary_header.request.keylen;
+    memcpy(req->key, binary_get_key(c), req->nkey);
+
+    req->next = u->parked;
+    u->parked = req;
+    ++u->nparked;
+
+    conn_set_state(c, conn_new_cmd);
+}
+
+static bool unordered_grow_output(struct unordered *u, size_t needed) {
+    size_t nsize = u->output.size == 0 ? 1024 : u->output.size;
+
+    while (nsize - u->output.offset < needed) {
+        nsize <<= 1;
+    }
+
+    if (nsize != u->output.size) {
+        char *ptr = realloc(u->output.buffer, nsize);
+        if (ptr == NULL) {
+            return false;
+        }
+        u->output.buffer = ptr;
+        u->output.size = nsize;
+    }
+    return true;
+}
+
+static void unordered_add_response(conn *c, struct unordered_req *req,
+                                   uint16_t status, uint64_t cas,
+                                   const void *ext, uint8_t extlen,
+                                   const void *key, uint16_t nkey,
+                                   const void *data, uint32_t ndata) {
+    struct unordered *u = c->unordered;
+    protocol_binary_response_header header = {
+        .response.magic = (uint8_t)PROTOCOL_BINARY_RES,
+        .response.opcode = req->opcode,
+        .response.keylen = (uint16_t)htons(nkey),
+        .response.extlen = extlen,
+        .response.datatype = (uint8_t)PROTOCOL_BINARY_RAW_BYTES,
+        .response.status = (uint16_t)htons(status),
+        .response.bodylen = htonl(extlen + nkey + ndata),
+        .response.opaque = req->opaque,
+        .response.cas = htonll(cas)
+    };
+    size_t needed = sizeof(header.response) + extlen + nkey + ndata;
+
+    if (!unordered_grow_output(u, needed)) {
+        /* We can't drop a response, so drop the connection */
+        settings.extensions.logger->log(EXTENSION_LOG_WARNING, c,
+                                        "%d: Failed to allocate memory for "
+                                        "an unordered response\n", c->sfd);
+        u->disconnect = true;
+        return;
+    }
+
+    char *ptr = u->output.buffer + u->output.offset;
+    memcpy(ptr, header.bytes, sizeof(header.response));
+    ptr += sizeof(header.response);
+    memcpy(ptr, ext, extlen);
+    ptr += extlen;
+    memcpy(ptr, key, nkey);
+    ptr += nkey;
+    memcpy(ptr, data, ndata);
+    u->output.offset += needed;
+}
+
+/*
+ * Run a parked request again after the engine notified its cookie.
+ * Returns false if the engine would still block.
+ */
+static bool unordered_retry(conn *c, struct unordered_req *req) {
+    struct unordered *u = c->unordered;
+    const void *cookie = req;
+    ENGINE_ERROR_CODE ret = req->status;
+    item *it = NULL;
+
+    if (ret == ENGINE_SUCCESS) {
+        ret = settings.engine.v1->get(settings.engine.v0, cookie, &it,
+                                      req->key, req->nkey, req->vbucket);
+        if (ret == ENGINE_EWOULDBLOCK) {
+            return false;
+        }
+    }
+
+    item_info info = { .nvalue = 1 };
+    char buffer[1024] = { [sizeof(buffer) - 1] = '\0' };
+    protocol_binary_response_status status;
+    ssize_t len;
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        if (!settings.engine.v1->get_item_info(settings.engine.v0, cookie,
+                                               it, &info)) {
+            settings.engine.v1->release(settings.engine.v0, cookie, it);
+            settings.extensions.logger->log(EXTENSION_LOG_WARNING, c,
+                                            "%d: Failed to get item info\n",
+                                            c->sfd);
+            len = bin_error_message(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL,
+                                    buffer, sizeof(buffer));
+            unordered_add_response(c, req, PROTOCOL_BINARY_RESPONSE_EINTERNAL,
+                                   0, NULL, 0, NULL, 0, buffer, len);
+            break;
+        }
+        STATS_HIT(c, get, req->key, req->nkey);
+        unordered_add_response(c, req, PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                               info.cas, &info.flags, sizeof(info.flags),
+                               req->key,
+                               req->cmd == PROTOCOL_BINARY_CMD_GETK ?
+                               req->nkey : 0,
+                               info.value[0].iov_base,
+                               info.value[0].iov_len);
+        settings.engine.v1->release(settings.engine.v0, cookie, it);
+        break;
+    case ENGINE_KEY_ENOENT:
+        STATS_MISS(c, get, req->key, req->nkey);
+        if (req->noreply) {
+            break;
+        }
+        if (req->cmd == PROTOCOL_BINARY_CMD_GETK) {
+            unordered_add_response(c, req, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT,
+                                   0, NULL, 0, req->key, req->nkey, NULL, 0);
+            break;
+        }
+        /* FALLTHROUGH */
+    default:
+        if (ret == ENGINE_DISCONNECT) {
+            u->disconnect = true;
+            break;
+        }
+        status = engine_error_2_protocol_error(ret);
+        len = bin_error_message(c, status, buffer, sizeof(buffer));
+        unordered_add_response(c, req, status, 0, NULL, 0, NULL, 0,
+                               buffer, len);
+    }
+
+    if (settings.detail_enabled) {
+        stats_prefix_record_get(req->key, req->nkey, ret == ENGINE_SUCCESS);
+    }
+    return true;
+}
+
+/*
+ * Called by the thread when a connection using unordered execution is
+ * on the list of pending io. Completes the parked requests the engine
+ * notified, and returns true if the connection itself was notified and
+ * should continue running its state machine.
+ */
+bool unordered_resume(conn *c) {
+    struct unordered *u = c->unordered;
+    struct unordered_req *ready[UNORDERED_MAX_PARKED];
+    int nready = 0;
+
+    LOCK_THREAD(c->thread);
+    u->notified = false;
+    for (struct unordered_req *req = u->parked; req != NULL; req = req->next) {
+        if (req->ready) {
+            req->ready = false;
+            ready[nready++] = req;
+        }
+    }
+    UNLOCK_THREAD(c->thread);
+
+    for (int ii = 0; ii < nready; ++ii) {
+        if (unordered_retry(c, ready[ii])) {
+            struct unordered_req **prev = &u->parked;
+            while (*prev != ready[ii]) {
+                prev = &(*prev)->next;
+            }
+            *prev = ready[ii]->next;
+            --u->nparked;
+            unordered_req_release(c, ready[ii]);
+        }
+    }
+
+    if (c->ewouldblock) {
+        if (!u->barrier) {
+            return true;
+        }
+        if (u->nparked > 0) {
+            return false;
+        }
+        /* Everything before the request at the barrier completed */
+        u->barrier = false;
+        c->ewouldblock = false;
+        conn_set_state(c, conn_new_cmd);
+        return true;
+    }
+
+    /* Wake up an idle connection to send the responses */
+    if ((u->output.offset > 0 || u->disconnect) &&
+        (c->state == conn_read || c->state == conn_waiting)) {
+        conn_set_state(c, conn_new_cmd);
+        c->nevents = 1;
+        while (c->state(c)) {
+            /* empty */
+        }
+    }
+    return false;
+}
+
+/*
+ * Every request but the gets has to wait until the parked requests
+ * completed.
+ */
+static bool unordered_barrier(conn *c) {
+    struct unordered *u = c->unordered;
+    if (u == NULL || u->nparked == 0) {
+        return false;
+    }
+
+    if (u->nparked < UNORDERED_MAX_PARKED && !u->disconnect) {
+        switch (c->binary_header.request.opcode) {
+        case PROTOCOL_BINARY_CMD_GET:
+        case PROTOCOL_BINARY_CMD_GETQ:
+        case PROTOCOL_BINARY_CMD_GETK:
+        case PROTOCOL_BINARY_CMD_GETKQ:
+            return false;
+        default:
+            ;
+        }
+    }
+
+    u->barrier = true;
+    return true;
+}
+
+static void unordered_flush(conn *c) {
+    struct unordered *u = c->unordered;
+
+    c->msgcurr = 0;
+    c->msgused = 0;
+    c->iovused = 0;
+    if (add_msghdr(c) != 0) {
+        conn_set_state(c, conn_closing);
+        return;
+    }
+
+    write_and_free(c, u->output.buffer, u->output.offset);
+    u->output.buffer = NULL;
+    u->output.size = u->output.offset = 0;
+}
+
+static void unordered_free(struct unordered *u) {
+    struct unordered_req *req;
+    while ((req = u->free_reqs) != NULL) {
+        u->free_reqs = req->next;
+        free(req);
+    }
+    free(u->output.buffer);
+    free(u);
+}
+
+static void unordered_release(conn *c) {
+    struct unordered *u = c->unordered;
+    if (u == NULL) {
+        return;
+    }
+
+    /*
+     * The engine still owns the cookies of the requests it didn't
+     * notify yet, and they're freed when it does.
+     */
+    LOCK_THREAD(c->thread);
+    struct unordered_req *req = u->parked;
+    while (req != NULL) {
+        struct unordered_req *next = req->next;
+        if (req->ready) {
+            free(req);
+        } else {
+            req->c = NULL;
+        }
+        req = next;
+    }
+    c->unordered = NULL;
+    UNLOCK_THREAD(c->thread);
+
+    unordered_free(u);
+}
+
+static void process_bin_hello(conn *c) {
+    char *packet = c->rcurr - (c->binary_header.request.bodylen +
+                               sizeof(c->binary_header));
+    uint16_t keylen = c->binary_header.request.keylen;
+    uint32_t nfeatures = (c->binary_header.request.bodylen - keylen) / 2;
+    const char *features = packet + sizeof(c->binary_header) + keylen;
+    bool unordered = false;
+
+    for (uint32_t ii = 0; ii < nfeatures; ++ii) {
+        uint16_t feature;
+        memcpy(&feature, features + ii * 2, sizeof(feature));
+        if (ntohs(feature) == PROTOCOL_BINARY_FEATURE_UNORDERED_EXECUTION &&
+            !IS_UDP(c->transport)) {
+            unordered = true;
+        }
+    }
+
+    if (unordered && c->unordered == NULL) {
+        c->unordered = calloc(1, sizeof(struct unordered));
+        unordered = c->unordered != NULL;
+    } else if (!unordered && c->unordered != NULL) {
+        /* HELLO is a barrier, so there are no parked requests */
+        assert(c->unordered->nparked == 0);
+        unordered_free(c->unordered);
+        c->unordered = NULL;
+    }
+
+    char *ofs = c->wbuf + sizeof(protocol_binary_response_header);
+    if (unordered) {
+        uint16_t feature = htons(PROTOCOL_BINARY_FEATURE_UNORDERED_EXECUTION);
+        memcpy(ofs, &feature, sizeof(feature));
+    }
+    write_bin_response(c, ofs, 0, 0, unordered ? sizeof(uint16_t) : 0);
+}
+
 static void process_bin_get(conn *c) {
     item *it;
 
@@ -1684,7 +2167,21 @@ static void process_bin_get(conn *c) {
 
     ENGINE_ERROR_CODE ret = c->aiostat;
     c->aiostat = ENGINE_SUCCESS;
-    if (ret == ENGINE_SUCCESS) {
+    if (ret == ENGINE_SUCCESS && c->unordered != NULL) {
+        struct unordered_req *req = unordered_req_alloc(c);
+        if (req == NULL) {
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
+            return;
+        }
+        ret = settings.engine.v1->get(settings.engine.v0, req, &it,
+                                      key, nkey,
+                                      c->binary_header.request.vbucket);
+        if (ret == ENGINE_EWOULDBLOCK) {
+            unordered_park(c, req);
+            return;
+        }
+        unordered_req_release(c, req);
+    } else if (ret == ENGINE_SUCCESS) {
         ret = settings.engine.v1->get(settings.engine.v0, c, &it, key, nkey,
                                       c->binary_header.request.vbucket);
     }
@@ -1731,6 +2228,7 @@ static void process_bin_get(conn *c) {
         break;
     case ENGINE_KEY_ENOENT:
         STATS_MISS(c, get, key, nkey);
+        ++c->vbop.misses;
 
         MEMCACHED_COMMAND_GET(c->sfd, key, nkey, -1, 0);
 
@@ -1954,6 +2452,14 @@ static void process_bin_stat(conn *c) {
                 write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
                 return;
             }
+        } else if (nkey == 6 && strncmp(subcommand, "cycles", 6) == 0) {
+            ret = cycle_stats_details(cycle_stats, c, append_stats);
+        } else if (nkey == 15 &&
+                   strncmp(subcommand, "vbucket-details", 15) == 0 &&
+                   get_independent_stats(c)->vbucket_stats != NULL) {
+            /* Without the daemon's stats the engine may provide them */
+            ret = vbucket_stats_details(get_independent_stats(c)->vbucket_stats,
+                                        c, append_stats);
         } else {
             ret = settings.engine.v1->get_stats(settings.engine.v0, c,
                                                 subcommand, nkey,
@@ -2077,8 +2583,8 @@ static void init_sasl_conn(conn *c) {
 }
 
 static void get_auth_data(const void *cookie, auth_data_t *data) {
-    conn *c = (conn*)cookie;
-    if (c->sasl_conn) {
+    conn *c = cookie_conn(cookie);
+    if (c != NULL && c->sasl_conn) {
         sasl_getprop(c->sasl_conn, SASL_USERNAME, (void*)&data->username);
 #ifdef ENABLE_ISASL
         sasl_getprop(c->sasl_conn, ISASL_CONFIG, (void*)&data->config);
@@ -2829,6 +3335,9 @@ static void process_bin_packet(conn *c) {
     case PROTOCOL_BINARY_CMD_VERBOSITY:
         process_bin_verbosity(c);
         break;
+    case PROTOCOL_BINARY_CMD_HELLO:
+        process_bin_hello(c);
+        break;
     default:
         process_bin_unknown_packet(c);
     }
@@ -2866,6 +3375,9 @@ static void dispatch_bin_command(conn *c) {
     }
 
     MEMCACHED_PROCESS_COMMAND_START(c->sfd, c->rcurr, c->rbytes);
+    vbucket_op_begin(c, c->binary_header.request.vbucket,
+                     sizeof(c->binary_header) + bodylen);
+    cycles_begin(c, c->binary_header.request.opcode);
     c->noreply = true;
 
     /* binprot supports 16bit keys, but internals are still 8bit */
@@ -3043,6 +3555,15 @@ static void dispatch_bin_command(conn *c) {
                 protocol_error = 1;
             }
             break;
+        case PROTOCOL_BINARY_CMD_HELLO:
+            if (extlen == 0 && bodylen >= keylen &&
+                ((bodylen - keylen) % 2) == 0) {
+                bin_read_chunk(c, bin_reading_packet,
+                               c->binary_header.request.bodylen);
+            } else {
+                protocol_error = 1;
+            }
+            break;
         default:
             if (settings.engine.v1->unknown_command == NULL) {
                 write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND,
@@ -3325,6 +3846,7 @@ static void process_bin_delete(conn *c) {
     case ENGINE_KEY_ENOENT:
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
         STATS_INCR(c, delete_misses, key, nkey);
+        ++c->vbop.misses;
         break;
     case ENGINE_NOT_MY_VBUCKET:
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET, 0);
@@ -3466,6 +3988,8 @@ static void complete_nread(conn *c) {
     assert(c->protocol == ascii_prot
            || c->protocol == binary_prot);
 
+    cycle_op_phase(&c->cycles, CYCLES_ENGINE);
+
     if (c->protocol == ascii_prot) {
         complete_nread_ascii(c);
     } else if (c->protocol == binary_prot) {
@@ -3497,41 +4021,7 @@ static void complete_nread(conn *c) {
  *   }
  */
 static size_t tokenize_command(char *command, token_t *tokens, const size_t max_tokens) {
-    char *s, *e;
-    size_t ntokens = 0;
-
-    assert(command != NULL && tokens != NULL && max_tokens > 1);
-
-    for (s = e = command; ntokens < max_tokens - 1; ++e) {
-        if (*e == ' ') {
-            if (s != e) {
-                tokens[ntokens].value = s;
-                tokens[ntokens].length = e - s;
-                ntokens++;
-                *e = '\0';
-            }
-            s = e + 1;
-        }
-        else if (*e == '\0') {
-            if (s != e) {
-                tokens[ntokens].value = s;
-                tokens[ntokens].length = e - s;
-                ntokens++;
-            }
-
-            break; /* string end */
-        }
-    }
-
-    /*
-     * If we scanned the whole string, the terminal value pointer is null,
-     * otherwise it is the first unprocessed character.
-     */
-    tokens[ntokens].value =  *e == '\0' ? NULL : e;
-    tokens[ntokens].length = 0;
-    ntokens++;
-
-    return ntokens;
+    return ascii_tokenizer->tokenize(command, tokens, max_tokens);
 }
 
 static void detokenize(token_t *tokens, int ntokens, char **out, int *nbytes) {
@@ -3819,6 +4309,10 @@ static void process_stat_settings(ADD_STAT add_stats, void *c) {
     APPEND_STAT("auth_required_sasl", "%s", settings.require_sasl ? "yes" : "no");
     APPEND_STAT("item_size_max", "%d", settings.item_size_max);
     APPEND_STAT("topkeys", "%d", settings.topkeys);
+    APPEND_STAT("vbucket_stats", "%d", settings.vbucket_stats);
+    APPEND_STAT("cycle_stats", "%s", settings.cycle_stats ? "on" : "off");
+    APPEND_STAT("ascii_tokenizer", "%s", ascii_tokenizer->name);
+    APPEND_STAT("io_backend", "%s", settings.io_uring ? "io_uring" : "libevent");
 
     for (EXTENSION_DAEMON_DESCRIPTOR *ptr = settings.extensions.daemons;
          ptr != NULL;
@@ -3902,6 +4396,13 @@ static char *process_stat(conn *c, token_t *tokens, const size_t ntokens) {
             out_string(c, "ERROR");
             return NULL;
         }
+    } else if (strcmp(subcommand, "cycles") == 0) {
+        cycle_stats_details(cycle_stats, c, append_stats);
+    } else if (strcmp(subcommand, "vbucket-details") == 0 &&
+               get_independent_stats(c)->vbucket_stats != NULL) {
+        /* Without the daemon's stats the engine may provide them */
+        vbucket_stats_details(get_independent_stats(c)->vbucket_stats,
+                              c, append_stats);
     } else {
         /* getting here means that the subcommand is either engine specific or
            is invalid. query the engine and see. */
@@ -4426,6 +4927,34 @@ static void process_verbosity_command(conn *c, token_t *tokens, const size_t nto
     }
 }
 
+/*
+ * "cycles on" starts accounting the cycles spent per command from
+ * scratch, "cycles off" stops it (the stats are kept).
+ */
+static void process_cycles_command(conn *c, token_t *tokens, const size_t ntokens) {
+    assert(c != NULL);
+
+    set_noreply_maybe(c, tokens, ntokens);
+    if (c->noreply && ntokens == 3) {
+        c->noreply = false;
+        out_string(c, "ERROR");
+        return;
+    }
+
+    if (strcmp(tokens[1].value, "on") == 0) {
+        if (!settings.cycle_stats) {
+            cycle_stats_reset(cycle_stats);
+            settings.cycle_stats = true;
+        }
+        out_string(c, "OK");
+    } else if (strcmp(tokens[1].value, "off") == 0) {
+        settings.cycle_stats = false;
+        out_string(c, "OK");
+    } else {
+        out_string(c, "ERROR");
+    }
+}
+
 static char* process_command(conn *c, char *command) {
 
     token_t tokens[MAX_TOKENS];
@@ -4464,6 +4993,11 @@ static char* process_command(conn *c, char *command) {
     }
 
     ntokens = tokenize_command(command, tokens, MAX_TOKENS);
+    if (c->cycles.active && tokens[COMMAND_TOKEN].value != NULL) {
+        c->cycles.command = cycle_stats_ascii_command(tokens[COMMAND_TOKEN].value);
+        cycle_op_phase(&c->cycles, CYCLES_ENGINE);
+    }
+
     if (ntokens >= 3 &&
         ((strcmp(tokens[COMMAND_TOKEN].value, "get") == 0) ||
          (strcmp(tokens[COMMAND_TOKEN].value, "bget") == 0))) {
@@ -4554,6 +5088,8 @@ static char* process_command(conn *c, char *command) {
 
     } else if ((ntokens == 3 || ntokens == 4) && (strcmp(tokens[COMMAND_TOKEN].value, "verbosity") == 0)) {
         process_verbosity_command(c, tokens, ntokens);
+    } else if ((ntokens == 3 || ntokens == 4) && (strcmp(tokens[COMMAND_TOKEN].value, "cycles") == 0)) {
+        process_cycles_command(c, tokens, ntokens);
     } else if (settings.extensions.ascii != NULL) {
         EXTENSION_ASCII_PROTOCOL_DESCRIPTOR *cmd;
         size_t nbytes = 0;
@@ -4612,6 +5148,52 @@ static char* process_command(conn *c, char *command) {
     return ret;
 }
 
+/*
+ * Locate the end of the command line starting at rcurr. The terminators
+ * are searched for in batches over everything we have buffered, so a
+ * pipeline of commands is scanned in a single pass and the part of a
+ * partially received line we've already looked at isn't searched again
+ * when more data arrives.
+ */
+static char *find_line_end(conn *c) {
+    uint32_t start = c->rcurr - c->rbuf;
+    uint32_t end = start + c->rbytes;
+
+    if (c->lines.scanned < start) {
+        /* We've consumed past everything we know about (item data) */
+        c->lines.scanned = start;
+        c->lines.next = c->lines.count = 0;
+    }
+
+    while (c->lines.next < c->lines.count) {
+        uint32_t eol = c->lines.eol[c->lines.next];
+        if (eol >= start) {
+            return c->rbuf + eol;
+        }
+        ++c->lines.next;
+    }
+
+    if (c->lines.scanned < end) {
+        size_t nscanned;
+        size_t count = ascii_tokenizer->find_lines(c->rbuf + c->lines.scanned,
+                                                   end - c->lines.scanned,
+                                                   c->lines.eol,
+                                                   LINE_CACHE_SIZE,
+                                                   &nscanned);
+        for (size_t ii = 0; ii < count; ++ii) {
+            c->lines.eol[ii] += c->lines.scanned;
+        }
+        c->lines.scanned += nscanned;
+        c->lines.next = 0;
+        c->lines.count = count;
+        if (count > 0) {
+            return c->rbuf + c->lines.eol[0];
+        }
+    }
+
+    return NULL;
+}
+
 /*
  * if we have a complete line in the buffer, process it.
  */
@@ -4694,6 +5276,13 @@ static int try_read_command(conn *c) {
                 return -1;
             }
 
+            if (unordered_barrier(c)) {
+                /* Leave the request in the buffer until we may run it */
+                c->ewouldblock = true;
+                unregister_event(c);
+                return 1;
+            }
+
             c->msgcurr = 0;
             c->msgused = 0;
             c->iovused = 0;
@@ -4720,7 +5309,7 @@ static int try_read_command(conn *c) {
             return 0;
         }
 
-        el = memchr(c->rcurr, '\n', c->rbytes);
+        el = find_line_end(c);
         if (!el) {
             if (c->rbytes > 1024) {
                 /*
@@ -4751,6 +5340,8 @@ static int try_read_command(conn *c) {
 
         assert(cont <= (c->rcurr + c->rbytes));
 
+        cycles_begin(c, CYCLES_ASCII_BASE + CYCLES_ASCII_other);
+
         LIBEVENT_THREAD *thread = c->thread;
         LOCK_THREAD(thread);
         left = process_command(c, c->rcurr);
@@ -4826,11 +5417,31 @@ static enum try_read_result try_read_udp(conn *c) {
 
         c->rbytes += res;
         c->rcurr = c->rbuf;
+        line_cache_reset(c);
         return READ_DATA_RECEIVED;
     }
     return READ_NO_DATA_RECEIVED;
 }
 
+/*
+ * Socket I/O for a connection. Connections served by the io_uring backend
+ * read from the data the ring received for them and queue their writes in
+ * the ring, with the same semantics as the non-blocking calls.
+ */
+static ssize_t conn_recv(conn *c, void *buf, size_t len) {
+    if (c->uring != NULL) {
+        return uring_conn_recv(c, buf, len);
+    }
+    return recv(c->sfd, buf, len, 0);
+}
+
+static ssize_t conn_sendmsg(conn *c, struct msghdr *m) {
+    if (c->uring != NULL) {
+        return uring_conn_sendmsg(c, m);
+    }
+    return sendmsg(c->sfd, m, 0);
+}
+
 /*
  * read from network as much as we can, handle buffer overflow and connection
  * close.
@@ -4850,6 +5461,7 @@ static enum try_read_result try_read_network(conn *c) {
     assert(c != NULL);
 
     if (c->rcurr != c->rbuf) {
+        line_cache_shift(c, c->rcurr - c->rbuf);
         if (c->rbytes != 0) /* otherwise there's nothing to copy */
             memmove(c->rbuf, c->rcurr, c->rbytes);
         c->rcurr = c->rbuf;
@@ -4877,7 +5489,7 @@ static enum try_read_result try_read_network(conn *c) {
         }
 
         int avail = c->rsize - c->rbytes;
-        res = recv(c->sfd, c->rbuf + c->rbytes, avail, 0);
+        res = conn_recv(c, c->rbuf + c->rbytes, avail);
         if (res > 0) {
             STATS_ADD(c, bytes_read, res);
             gotdata = READ_DATA_RECEIVED;
@@ -4903,6 +5515,13 @@ static enum try_read_result try_read_network(conn *c) {
 
 bool register_event(conn *c, struct timeval *timeout) {
     assert(!c->registered_in_libevent);
+    cycle_op_resume(&c->cycles);
+
+    if (c->uring != NULL) {
+        c->registered_in_libevent = true;
+        uring_conn_poll(c);
+        return true;
+    }
 
     if (event_add(&c->event, timeout) == -1) {
         settings.extensions.logger->log(EXTENSION_LOG_WARNING,
@@ -4920,7 +5539,10 @@ bool register_event(conn *c, struct timeval *timeout) {
 bool unregister_event(conn *c) {
     assert(c->registered_in_libevent);
 
-    if (event_del(&c->event) == -1) {
+    /* Waiting for the engine doesn't count */
+    cycle_op_pause(&c->cycles);
+
+    if (c->uring == NULL && event_del(&c->event) == -1) {
         return false;
     }
 
@@ -4942,6 +5564,12 @@ bool update_event(conn *c, const int new_flags) {
                                     c->sfd, (new_flags & EV_READ ? "yes" : "no"),
                                     (new_flags & EV_WRITE ? "yes" : "no"));
 
+    if (c->uring != NULL) {
+        c->ev_flags = new_flags;
+        uring_conn_poll(c);
+        return true;
+    }
+
     if (!unregister_event(c)) {
         return false;
     }
@@ -4974,9 +5602,10 @@ static enum transmit_result transmit(conn *c) {
         ssize_t res;
         struct msghdr *m = &c->msglist[c->msgcurr];
 
-        res = sendmsg(c->sfd, m, 0);
+        res = conn_sendmsg(c, m);
         if (res > 0) {
             STATS_ADD(c, bytes_written, res);
+            c->vbop.bytes_out += res;
 
             /* We've written some of the data. Remove the completed
                iovec entries from the list of pending writes. */
@@ -5184,6 +5813,20 @@ bool conn_parse_cmd(conn *c) {
 }
 
 bool conn_new_cmd(conn *c) {
+    vbucket_op_end(c);
+    cycles_end(c);
+
+    if (c->unordered != NULL) {
+        if (c->unordered->disconnect) {
+            conn_set_state(c, conn_closing);
+            return true;
+        }
+        if (c->unordered->output.offset > 0) {
+            unordered_flush(c);
+            return true;
+        }
+    }
+
     /* Only process nreqs at a time to avoid starving other connections */
     --c->nevents;
     if (c->nevents >= 0) {
@@ -5231,7 +5874,7 @@ bool conn_swallow(conn *c) {
     }
 
     /*  now try reading from the socket */
-    res = recv(c->sfd, c->rbuf, c->rsize > c->sbytes ? c->sbytes : c->rsize, 0);
+    res = conn_recv(c, c->rbuf, c->rsize > c->sbytes ? c->sbytes : c->rsize);
     if (res > 0) {
         STATS_ADD(c, bytes_read, res);
         c->sbytes -= res;
@@ -5250,6 +5893,7 @@ bool conn_swallow(conn *c) {
             conn_set_state(c, conn_closing);
             return true;
         }
+        cycle_op_pause(&c->cycles);
         return false;
     }
 
@@ -5302,7 +5946,7 @@ bool conn_nread(conn *c) {
     }
 
     /*  now try reading from the socket */
-    res = recv(c->sfd, c->ritem, c->rlbytes, 0);
+    res = conn_recv(c, c->ritem, c->rlbytes);
     if (res > 0) {
         STATS_ADD(c, bytes_read, res);
         if (c->rcurr == c->ritem) {
@@ -5326,6 +5970,7 @@ bool conn_nread(conn *c) {
             conn_set_state(c, conn_closing);
             return true;
         }
+        cycle_op_pause(&c->cycles);
         return false;
     }
 
@@ -5414,6 +6059,7 @@ bool conn_mwrite(conn *c) {
         break;                   /* Continue in state machine. */
 
     case TRANSMIT_SOFT_ERROR:
+        cycle_op_pause(&c->cycles);
         return false;
     }
 
@@ -5463,6 +6109,7 @@ bool conn_closing(conn *c) {
 
     // We don't want any network notifications anymore..
     unregister_event(c);
+    uring_conn_detach(c);
     safe_close(c->sfd);
     c->sfd = INVALID_SOCKET;
 
@@ -5474,6 +6121,40 @@ bool conn_closing(conn *c) {
     return true;
 }
 
+/*
+ * The tap thread reads the socket directly, so move whatever the io_uring
+ * backend received for the connection into the read buffer (behind the
+ * data we haven't parsed yet) before releasing it from the ring.
+ */
+static void conn_leave_uring(conn *c) {
+    uring_conn_quiesce(c);
+
+    size_t pending = uring_conn_pending(c);
+    if (pending > 0) {
+        size_t offset = c->rcurr - c->rbuf;
+        size_t needed = offset + c->rbytes + pending;
+        if (needed > c->rsize) {
+            char *ptr = realloc(c->rbuf, needed);
+            if (ptr == NULL) {
+                settings.extensions.logger->log(EXTENSION_LOG_WARNING, c,
+                                                "Couldn't realloc input buffer, "
+                                                "dropping %lu bytes of input\n",
+                                                (unsigned long)pending);
+                uring_conn_detach(c);
+                return;
+            }
+            c->rbuf = ptr;
+            c->rcurr = ptr + offset;
+            c->rsize = needed;
+        }
+        ssize_t nr = uring_conn_recv(c, c->rcurr + c->rbytes, pending);
+        assert(nr == (ssize_t)pending);
+        c->rbytes += nr;
+    }
+
+    uring_conn_detach(c);
+}
+
 bool conn_add_tap_client(conn *c) {
     LIBEVENT_THREAD *tp = tap_thread;
     LIBEVENT_THREAD *orig_thread = c->thread;
@@ -5484,6 +6165,9 @@ bool conn_add_tap_client(conn *c) {
     c->ewouldblock = true;
 
     unregister_event(c);
+    if (c->uring != NULL) {
+        conn_leave_uring(c);
+    }
 
     LOCK_THREAD(orig_thread);
     /* Clean out the lists */
@@ -5528,6 +6212,7 @@ void event_handler(const int fd, const short which, void *arg) {
     }
 
     c->which = which;
+    cycle_op_resume(&c->cycles);
 
     /* sanity */
     if (fd != c->sfd) {
@@ -6273,34 +6958,57 @@ static const char* get_server_version(void) {
 
 static void store_engine_specific(const void *cookie,
                                   void *engine_data) {
-    conn *c = (conn*)cookie;
-    c->engine_storage = engine_data;
+    struct unordered_req *req = cookie_parked(cookie);
+    if (req != NULL) {
+        req->engine_storage = engine_data;
+    } else {
+        conn *c = (conn*)cookie;
+        c->engine_storage = engine_data;
+    }
 }
 
 static void *get_engine_specific(const void *cookie) {
+    struct unordered_req *req = cookie_parked(cookie);
+    if (req != NULL) {
+        return req->engine_storage;
+    }
     conn *c = (conn*)cookie;
     return c->engine_storage;
 }
 
 static int get_socket_fd(const void *cookie) {
+    struct unordered_req *req = cookie_parked(cookie);
+    if (req != NULL) {
+        return req->sfd;
+    }
     conn *c = (conn *)cookie;
     return c->sfd;
 }
 
 static void set_tap_nack_mode(const void *cookie, bool enable) {
-    conn *c = (conn *)cookie;
-    c->tap_nack_mode = enable;
+    conn *c = cookie_conn(cookie);
+    if (c != NULL) {
+        c->tap_nack_mode = enable;
+    }
 }
 
+/*
+ * The private cookie of a parked request lives until the engine notifies
+ * it, so there's nothing to reserve.
+ */
 static ENGINE_ERROR_CODE reserve_cookie(const void *cookie) {
-    conn *c = (conn *)cookie;
-    ++c->refcount;
+    if (cookie_parked(cookie) == NULL) {
+        conn *c = (conn *)cookie;
+        ++c->refcount;
+    }
     return ENGINE_SUCCESS;
 }
 
 static ENGINE_ERROR_CODE release_cookie(const void *cookie) {
-    conn *c = (conn *)cookie;
-    --c->refcount;
+    if (cookie_parked(cookie) == NULL) {
+        conn *c = (conn *)cookie;
+        --c->refcount;
+    }
     return ENGINE_SUCCESS;
 }
 
@@ -6314,6 +7022,9 @@ static void *new_independent_stats(void) {
     struct independent_stats *independent_stats = calloc(sizeof(independent_stats) + sizeof(struct thread_stats) * nrecords, 1);
     if (settings.topkeys > 0)
         independent_stats->topkeys = topkeys_init(settings.topkeys);
+    if (settings.vbucket_stats > 0)
+        independent_stats->vbucket_stats =
+            vbucket_stats_init(settings.vbucket_stats, nrecords);
     for (ii = 0; ii < nrecords; ii++)
         pthread_mutex_init(&independent_stats->thread_stats[ii].mutex, NULL);
     return independent_stats;
@@ -6325,6 +7036,8 @@ static void release_independent_stats(void *stats) {
     struct independent_stats *independent_stats = stats;
     if (independent_stats->topkeys)
         topkeys_free(independent_stats->topkeys);
+    if (independent_stats->vbucket_stats)
+        vbucket_stats_free(independent_stats->vbucket_stats);
     for (ii = 0; ii < nrecords; ii++)
         pthread_mutex_destroy(&independent_stats->thread_stats[ii].mutex);
     free(independent_stats);
@@ -7161,6 +7874,19 @@ int main (int argc, char **argv) {
         settings.reqs_per_tap_event = DEFAULT_REQS_PER_TAP_EVENT;
     }
 
+    if (getenv("MEMCACHED_IO_URING") != NULL) {
+        settings.io_uring = atoi(getenv("MEMCACHED_IO_URING")) != 0;
+    }
+
+    const char *tokenizer_env = getenv("MEMCACHED_TOKENIZER");
+    ascii_tokenizer = tokenizer_select(tokenizer_env);
+    if (tokenizer_env != NULL &&
+        strcmp(tokenizer_env, ascii_tokenizer->name) != 0) {
+        settings.extensions.logger->log(EXTENSION_LOG_WARNING, NULL,
+                "Tokenizer \"%s\" is not supported, using \"%s\"\n",
+                tokenizer_env, ascii_tokenizer->name);
+    }
+
 
     if (install_sigterm_handler() != 0) {
         settings.extensions.logger->log(EXTENSION_LOG_WARNING, NULL,
@@ -7176,6 +7902,16 @@ int main (int argc, char **argv) {
         }
     }
 
+    char *vbucket_stats_env = getenv("MEMCACHED_VBUCKET_STATS");
+    if (vbucket_stats_env != NULL) {
+        settings.vbucket_stats = atoi(vbucket_stats_env);
+        if (settings.vbucket_stats < 0) {
+            settings.vbucket_stats = 0;
+        } else if (settings.vbucket_stats > 65536) {
+            settings.vbucket_stats = 65536;
+        }
+    }
+
     if (settings.require_sasl) {
         if (!protocol_specified) {
             settings.binding_protocol = binary_prot;
@@ -7378,6 +8114,14 @@ int main (int argc, char **argv) {
 
     default_independent_stats = new_independent_stats();
 
+    /* The tap thread has a row of its own, like in the thread stats */
+    cycle_stats = cycle_stats_init(settings.num_threads + 1);
+    if (cycle_stats == NULL) {
+        settings.extensions.logger->log(EXTENSION_LOG_WARNING, NULL,
+                                        "Failed to allocate cycle stats\n");
+        exit(EXIT_FAILURE);
+    }
+
 #ifndef __WIN32__
     /*
      * ignore SIGPIPE signals; we can use errno == EPIPE if we
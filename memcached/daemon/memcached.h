@@ -15,6 +15,8 @@
 
 #include "cache.h"
 #include "topkeys.h"
+#include "vbucket_stats.h"
+#include "cycle_stats.h"
 
 #include "sasl_defs.h"
 
@@ -45,6 +47,9 @@
 /** Initial number of sendmsg() argument structures to allocate. */
 #define MSG_LIST_INITIAL 10
 
+/** Number of ascii command line terminators remembered per buffer scan */
+#define LINE_CACHE_SIZE 32
+
 /** High water marks for buffer shrinking */
 #define READ_BUFFER_HIGHWAT 8192
 #define ITEM_LIST_HIGHWAT 400
@@ -150,6 +155,7 @@ struct thread_stats {
  */
 struct independent_stats {
     topkeys_t *topkeys;
+    vbucket_stats_t *vbucket_stats;
     struct thread_stats thread_stats[];
 };
 
@@ -202,6 +208,9 @@ struct settings {
     bool sasl;              /* SASL on/off */
     bool require_sasl;      /* require SASL auth */
     int topkeys;            /* Number of top keys to track */
+    int vbucket_stats;      /* Number of vbuckets to keep op stats for */
+    bool cycle_stats;       /* Account the cycles spent per command */
+    bool io_uring;          /* Use the io_uring backend in the worker threads */
     union {
         ENGINE_HANDLE *v0;
         ENGINE_HANDLE_V1 *v1;
@@ -243,6 +252,7 @@ typedef struct {
 
     rel_time_t last_checked;
     struct conn *pending_close; /* list of connections close at a later time */
+    struct uring *ring;         /* io_uring backend (NULL when using libevent) */
 } LIBEVENT_THREAD;
 
 #define LOCK_THREAD(t)                          \
@@ -272,6 +282,12 @@ typedef bool (*STATE_FUNC)(conn *);
  * The structure representing a connection into memcached.
  */
 struct conn {
+    /**
+     * Always NULL. The private cookies of the parked requests start with
+     * the same field, so the cookies the engine gets can be told apart
+     * (see cookie_parked).
+     */
+    struct unordered_req *parked;
     SOCKET sfd;
     int nevents;
     sasl_conn_t *sasl_conn;
@@ -281,12 +297,27 @@ struct conn {
     struct event event;
     short  ev_flags;
     short  which;   /** which events were just triggered */
+    /** State in the thread's io_uring backend (NULL if driven by libevent) */
+    struct uring_conn *uring;
 
     char   *rbuf;   /** buffer to read commands into */
     char   *rcurr;  /** but if we parsed some already, this is where we stopped */
     uint32_t rsize;   /** total allocated size of rbuf */
     uint32_t rbytes;  /** how much data, starting from rcur, do we have unparsed */
 
+    /**
+     * Ascii command line terminators located by the last scan of rbuf
+     * (as offsets from rbuf). Everything in front of the offset
+     * "scanned" has been searched, so neither pipelined commands nor a
+     * partially received line is searched more than once.
+     */
+    struct {
+        uint32_t scanned;
+        uint32_t eol[LINE_CACHE_SIZE];
+        int next;
+        int count;
+    } lines;
+
     char   *wbuf;
     char   *wcurr;
     uint32_t wsize;
@@ -377,6 +408,74 @@ struct conn {
     bool ewouldblock;
     bool tap_nack_mode;
     TAP_ITERATOR tap_iterator;
+
+    /** The operation being accounted in the per-vbucket stats */
+    struct vbucket_op vbop;
+
+    /** The command being accounted in the cycle stats */
+    struct cycle_op cycles;
+
+    /** Unordered execution state (if negotiated with HELLO) */
+    struct unordered *unordered;
+};
+
+/* Max number of requests parked on a connection at the same time */
+#define UNORDERED_MAX_PARKED 64
+
+/**
+ * A get request on a connection using unordered execution, parked while
+ * the engine completes it in the background. Every get on such a
+ * connection uses the request as its private cookie, as the engine may
+ * only have a single operation pending per cookie (and the connection
+ * may go away before the engine notifies the cookie). The server API
+ * calls made with the cookie go to the connection it belongs to, except
+ * for the engine specific data which is kept with the request while it's
+ * parked and handed back to the connection when it completes.
+ */
+struct unordered_req {
+    struct unordered_req *parked; /* points to itself, like conn.parked */
+    void *engine_storage;        /* the engine's data for the cookie */
+    SOCKET sfd;                  /* the connection's socket */
+    struct unordered_req *next;
+    conn *c;                     /* the connection (NULL once it's closed) */
+    LIBEVENT_THREAD *thread;     /* the thread serving the connection */
+    ENGINE_ERROR_CODE status;    /* the status the engine notified */
+    bool ready;                  /* the engine notified the cookie */
+    bool noreply;
+    uint8_t opcode;              /* the opcode received */
+    uint8_t cmd;                 /* GET or GETK */
+    uint16_t vbucket;
+    uint32_t opaque;
+    uint16_t nkey;
+    char key[KEY_MAX_LENGTH];
+};
+
+/**
+ * Unordered execution lets the get requests on a binary connection
+ * continue while the ones before them wait for the engine (ep-engine
+ * fetching a value from disk), and the responses are matched to the
+ * requests by the client using the opaque field. Every other command is
+ * a barrier: it waits until all of the parked requests completed, so
+ * the NOOP terminating a batch of quiet gets is still the last response.
+ */
+struct unordered {
+    struct unordered_req *parked;
+    int nparked;
+    /* A request is waiting for the parked requests to complete */
+    bool barrier;
+    /* The engine asked us to disconnect while completing a request */
+    bool disconnect;
+    /* The connection is on the thread's list of pending io */
+    bool notified;
+    /* Private cookies ready for reuse */
+    struct unordered_req *free_reqs;
+    int nfree_reqs;
+    /* The responses to the completed requests */
+    struct {
+        char *buffer;
+        size_t size;
+        size_t offset;
+    } output;
 };
 
 /* States for the connection list_state */
@@ -405,6 +504,7 @@ extern int daemonize(int nochdir, int noclose);
 bool register_event(conn *c, struct timeval *timeout);
 bool unregister_event(conn *c);
 bool update_event(conn *c, const int new_flags);
+void event_handler(const int fd, const short which, void *arg);
 
 /*
  * Functions such as the libevent-related calls that need to do cross-thread
@@ -438,7 +538,16 @@ void slab_stats_aggregate(struct thread_stats *stats, struct slab_stats *out);
 void append_stat(const char *name, ADD_STAT add_stats, conn *c,
                  const char *fmt, ...);
 
+/**
+ * The parked request if the cookie is the private cookie of one, or NULL
+ * if it's a connection.
+ */
+static inline struct unordered_req *cookie_parked(const void *cookie) {
+    return *(struct unordered_req * const *)cookie;
+}
+
 void notify_io_complete(const void *cookie, ENGINE_ERROR_CODE status);
+bool unordered_resume(conn *c);
 void conn_set_state(conn *c, STATE_FUNC state);
 const char *state_text(STATE_FUNC state);
 void safe_close(SOCKET sfd);
@@ -4,6 +4,7 @@
  */
 #include "config.h"
 #include "memcached.h"
+#include "uring.h"
 #include <assert.h>
 #include <stdio.h>
 #include <errno.h>
@@ -269,6 +270,35 @@ static void setup_dispatcher(struct event_base *main_base,
     }
 }
 
+/*
+ * Give every worker thread an io_uring, or none of them, so that all of
+ * the connections are served by the backend "stats settings" reports.
+ * Called before the threads are started.
+ */
+static void setup_rings(void) {
+    int i;
+
+    for (i = 0; i < nthreads; i++) {
+        if (threads[i].type == TAP) {
+            continue;
+        }
+        threads[i].ring = uring_create(threads[i].base);
+        if (threads[i].ring == NULL) {
+            settings.extensions.logger->log(EXTENSION_LOG_WARNING, NULL,
+                                            "Can't use io_uring (%s), using libevent\n",
+                                            strerror(errno));
+            while (--i >= 0) {
+                if (threads[i].ring != NULL) {
+                    uring_destroy(threads[i].ring);
+                    threads[i].ring = NULL;
+                }
+            }
+            settings.io_uring = false;
+            return;
+        }
+    }
+}
+
 /*
  * Set up a thread's information.
  */
@@ -390,6 +420,11 @@ static void thread_libevent_process(int fd, short which, void *arg) {
         } else {
             assert(c->thread == NULL);
             c->thread = me;
+            if (me->ring != NULL && !IS_UDP(item->transport) &&
+                !uring_conn_attach(me->ring, c)) {
+                settings.extensions.logger->log(EXTENSION_LOG_WARNING, c,
+                                                "Failed to add connection to io_uring, using libevent\n");
+            }
         }
         cqi_free(item);
     }
@@ -403,6 +438,9 @@ static void thread_libevent_process(int fd, short which, void *arg) {
         assert(me == c->thread);
         pending = pending->next;
         c->next = NULL;
+        if (c->unordered != NULL && !unordered_resume(c)) {
+            continue;
+        }
         register_event(c, 0);
         /*
          * We don't want the thread to keep on serving all of the data
@@ -599,6 +637,42 @@ static bool is_thread_me(LIBEVENT_THREAD *thr) {
 #endif
 }
 
+/*
+ * The engine completed the get of a parked request (see unordered_resume)
+ */
+static void notify_parked_request(struct unordered_req *req,
+                                  ENGINE_ERROR_CODE status)
+{
+    LIBEVENT_THREAD *thr = req->thread;
+    int notify = 0;
+
+    LOCK_THREAD(thr);
+    conn *c = req->c;
+    if (c == NULL) {
+        /* The connection is gone, and nobody else refers the request */
+        UNLOCK_THREAD(thr);
+        free(req);
+        return;
+    }
+
+    req->status = status;
+    req->ready = true;
+    if (c->sfd != INVALID_SOCKET && !c->unordered->notified &&
+        number_of_pending(c, thr->pending_io) +
+        number_of_pending(c, thr->pending_close) == 0) {
+        c->unordered->notified = true;
+        if (thr->pending_io == NULL) {
+            notify = 1;
+        }
+        enlist_conn(c, &thr->pending_io);
+    }
+    UNLOCK_THREAD(thr);
+
+    if (notify) {
+        notify_thread(thr);
+    }
+}
+
 void notify_io_complete(const void *cookie, ENGINE_ERROR_CODE status)
 {
     if (cookie == NULL) {
@@ -608,6 +682,11 @@ void notify_io_complete(const void *cookie, ENGINE_ERROR_CODE status)
         return ;
     }
 
+    if (cookie_parked(cookie) != NULL) {
+        notify_parked_request(cookie_parked(cookie), status);
+        return;
+    }
+
     struct conn *conn = (struct conn *)cookie;
 
     settings.extensions.logger->log(EXTENSION_LOG_DEBUG, NULL,
@@ -895,6 +974,10 @@ void thread_init(int nthr, struct event_base *main_base,
         setup_thread(&threads[i], i == (nthreads - 1));
     }
 
+    if (settings.io_uring) {
+        setup_rings();
+    }
+
     /* Create threads after we've done all the libevent setup. */
     for (i = 0; i < nthreads; i++) {
         create_worker(worker_libevent, &threads[i], &thread_ids[i]);
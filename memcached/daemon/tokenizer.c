@@ -0,0 +1,239 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Ascii protocol scanning: locating line terminators in the read buffer
+ * and splitting a command line into tokens. A portable implementation is
+ * always available, and an SSE2 version which looks at 16 bytes at a time
+ * is used when the compiler and CPU support it.
+ */
+#include "config.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "tokenizer.h"
+
+static size_t scalar_find_lines(const char *buf, size_t len,
+                                uint32_t *offsets, size_t max,
+                                size_t *nscanned) {
+    const char *end = buf + len;
+    const char *ptr = buf;
+    size_t n = 0;
+
+    assert(max > 0);
+    while (ptr < end && (ptr = memchr(ptr, '\n', end - ptr)) != NULL) {
+        offsets[n++] = (uint32_t)(ptr - buf);
+        ++ptr;
+        if (n == max) {
+            *nscanned = ptr - buf;
+            return n;
+        }
+    }
+
+    *nscanned = len;
+    return n;
+}
+
+static size_t scalar_tokenize(char *command, token_t *tokens,
+                              const size_t max_tokens) {
+    char *s, *e;
+    size_t ntokens = 0;
+
+    assert(command != NULL && tokens != NULL && max_tokens > 1);
+
+    for (s = e = command; ntokens < max_tokens - 1; ++e) {
+        if (*e == ' ') {
+            if (s != e) {
+                tokens[ntokens].value = s;
+                tokens[ntokens].length = e - s;
+                ntokens++;
+                *e = '\0';
+            }
+            s = e + 1;
+        }
+        else if (*e == '\0') {
+            if (s != e) {
+                tokens[ntokens].value = s;
+                tokens[ntokens].length = e - s;
+                ntokens++;
+            }
+
+            break; /* string end */
+        }
+    }
+
+    /*
+     * If we scanned the whole string, the terminal value pointer is null,
+     * otherwise it is the first unprocessed character.
+     */
+    tokens[ntokens].value =  *e == '\0' ? NULL : e;
+    tokens[ntokens].length = 0;
+    ntokens++;
+
+    return ntokens;
+}
+
+static const tokenizer_t scalar_tokenizer = {
+    .name = "scalar",
+    .find_lines = scalar_find_lines,
+    .tokenize = scalar_tokenize
+};
+
+#ifdef __SSE2__
+static size_t sse2_find_lines(const char *buf, size_t len,
+                              uint32_t *offsets, size_t max,
+                              size_t *nscanned) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t n = 0;
+    size_t ii = 0;
+
+    assert(max > 0);
+    for (; ii + 16 <= len; ii += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(buf + ii));
+        unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        while (mask != 0) {
+            size_t pos = ii + __builtin_ctz(mask);
+            mask &= mask - 1;
+            offsets[n++] = (uint32_t)pos;
+            if (n == max) {
+                *nscanned = pos + 1;
+                return n;
+            }
+        }
+    }
+
+    for (; ii < len; ++ii) {
+        if (buf[ii] == '\n') {
+            offsets[n++] = (uint32_t)ii;
+            if (n == max) {
+                *nscanned = ii + 1;
+                return n;
+            }
+        }
+    }
+
+    *nscanned = len;
+    return n;
+}
+
+/*
+ * The command is nul-terminated but we don't know its length, so walk it
+ * in aligned 16 byte blocks. An aligned load never crosses a page
+ * boundary, so reading the bytes following the terminator in the last
+ * block is safe (the same trick used by strlen implementations).
+ */
+static size_t sse2_tokenize(char *command, token_t *tokens,
+                            const size_t max_tokens) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i zero = _mm_setzero_si128();
+    char *block = (char *)((uintptr_t)command & ~(uintptr_t)15);
+    unsigned int skip = (unsigned int)(command - block);
+    char *s = command;
+    char *e;
+    size_t ntokens = 0;
+
+    assert(command != NULL && tokens != NULL && max_tokens > 1);
+
+    for (;;) {
+        __m128i data = _mm_load_si128((const __m128i *)block);
+        unsigned int spaces = _mm_movemask_epi8(_mm_cmpeq_epi8(data, space));
+        unsigned int nul = _mm_movemask_epi8(_mm_cmpeq_epi8(data, zero));
+
+        /* Ignore the bytes in front of the command in the first block */
+        spaces = (spaces >> skip) << skip;
+        nul = (nul >> skip) << skip;
+        skip = 0;
+
+        if (nul != 0) {
+            /* only the spaces in front of the terminator count */
+            spaces &= (nul & -nul) - 1;
+        }
+
+        while (spaces != 0) {
+            char *p = block + __builtin_ctz(spaces);
+            spaces &= spaces - 1;
+            if (s != p) {
+                tokens[ntokens].value = s;
+                tokens[ntokens].length = p - s;
+                ntokens++;
+                *p = '\0';
+            }
+            s = p + 1;
+            if (ntokens == max_tokens - 1) {
+                e = s;
+                goto done;
+            }
+        }
+
+        if (nul != 0) {
+            e = block + __builtin_ctz(nul);
+            if (s != e) {
+                tokens[ntokens].value = s;
+                tokens[ntokens].length = e - s;
+                ntokens++;
+            }
+            goto done;
+        }
+
+        block += 16;
+    }
+
+ done:
+    tokens[ntokens].value =  *e == '\0' ? NULL : e;
+    tokens[ntokens].length = 0;
+    ntokens++;
+
+    return ntokens;
+}
+
+static const tokenizer_t sse2_tokenizer = {
+    .name = "sse2",
+    .find_lines = sse2_find_lines,
+    .tokenize = sse2_tokenize
+};
+
+static bool cpu_has_sse2(void) {
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2") != 0;
+#else
+    /* The compiler was told to generate SSE2 code for us anyway */
+    return true;
+#endif
+}
+#endif
+
+const tokenizer_t *tokenizer_lookup(const char *name) {
+    assert(name != NULL);
+
+    if (strcmp(name, scalar_tokenizer.name) == 0) {
+        return &scalar_tokenizer;
+    }
+#ifdef __SSE2__
+    if (strcmp(name, sse2_tokenizer.name) == 0 && cpu_has_sse2()) {
+        return &sse2_tokenizer;
+    }
+#endif
+    return NULL;
+}
+
+const tokenizer_t *tokenizer_select(const char *preferred) {
+    const tokenizer_t *ret = NULL;
+
+    if (preferred != NULL) {
+        ret = tokenizer_lookup(preferred);
+    }
+
+#ifdef __SSE2__
+    if (ret == NULL && cpu_has_sse2()) {
+        ret = &sse2_tokenizer;
+    }
+#endif
+
+    return ret ? ret : &scalar_tokenizer;
+}
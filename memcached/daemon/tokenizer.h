@@ -0,0 +1,65 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <memcached/extension.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The ascii protocol scanner. The daemon selects one implementation at
+ * startup (the fastest one the CPU supports, unless overridden) and uses
+ * it for locating command lines in the read buffer and for splitting
+ * each line into tokens.
+ */
+typedef struct {
+    /** Name of the implementation (reported in "stats settings") */
+    const char *name;
+
+    /**
+     * Locate the line terminators ('\n') in a buffer in one pass.
+     *
+     * @param buf the data to search
+     * @param len number of bytes in buf
+     * @param offsets where to store the offset (from buf) of each '\n'
+     * @param max capacity of offsets
+     * @param nscanned set to the number of bytes searched. This is len
+     *                 unless we ran out of space in offsets, in which
+     *                 case it is the position right after the last hit.
+     * @return the number of line terminators stored in offsets
+     */
+    size_t (*find_lines)(const char *buf, size_t len,
+                         uint32_t *offsets, size_t max, size_t *nscanned);
+
+    /**
+     * Tokenize a nul-terminated command by replacing spaces with '\0'.
+     * See tokenize_command() in memcached.c for the contract, which all
+     * implementations must honour byte for byte.
+     */
+    size_t (*tokenize)(char *command, token_t *tokens, size_t max_tokens);
+} tokenizer_t;
+
+/**
+ * Look up a tokenizer implementation by name ("scalar", "sse2").
+ *
+ * @return the implementation, or NULL if it is unknown or not supported
+ *         by this CPU/build
+ */
+const tokenizer_t *tokenizer_lookup(const char *name);
+
+/**
+ * Select the tokenizer to use. If preferred is NULL (or not available)
+ * the fastest implementation supported by the CPU is returned.
+ */
+const tokenizer_t *tokenizer_select(const char *preferred);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1205 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * io_uring network backend for the worker threads. See uring.h for an
+ * overview.
+ *
+ * We talk to the kernel through the raw system calls so that we don't
+ * need liburing. The receive side uses a ring of provided buffers: the
+ * kernel picks a buffer for each chunk of data it receives, and the
+ * connection holds on to it until the state machine has read the data
+ * (straight into its own buffers). Only a connection that sits on more
+ * than its share of the buffers gets its data copied to an inbox, so
+ * the buffer can go back to the kernel.
+ *
+ * Small responses are copied to an outbox so that the responses to a
+ * batch of pipelined requests go out in one send. Larger ones are sent
+ * straight from the connection's iovecs.
+ */
+#include "config.h"
+#include "memcached.h"
+#include "uring.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+#define ENABLE_IO_URING 1
+#endif
+#endif
+
+#ifdef ENABLE_IO_URING
+
+extern volatile sig_atomic_t memcached_shutdown;
+
+#define URING_ENTRIES 1024
+#define URING_BUFFERS 256 /* must be a power of two */
+#define URING_BUFFER_SIZE 4096
+#define URING_BGID 0
+/* Number of reap/drive/submit cycles to run before yielding to libevent */
+#define URING_MAX_ROUNDS 8
+/* Number of receive buffers a connection may hold (a power of two) */
+#define URING_CONN_SEGMENTS 16
+/* Receive buffers that are never held, so the ring can't run dry */
+#define URING_BUFFER_RESERVE (URING_BUFFERS / 4)
+/*
+ * Messages larger than this are sent without copying them. A connection
+ * waits for such a send to complete before it serves the next request,
+ * so smaller responses are batched in the outbox instead.
+ */
+#define URING_SEND_COPY_MAX (64 * 1024)
+
+/*
+ * Stop receiving when this much data is waiting for the connection to
+ * read it, and resume once it drops below the low watermark.
+ */
+#define INBOX_HIGHWAT (1024 * 1024)
+#define INBOX_LOWWAT (64 * 1024)
+/* The connection isn't writable while this much output is queued */
+#define OUTBOX_HIGHWAT (256 * 1024)
+/* Buffers larger than this are released when the slot is freed */
+#define BUFFER_KEEP (16 * 1024)
+
+#define GEN_MASK 0xffffff
+
+enum uring_op {
+    URING_RECV = 1,
+    URING_SEND,
+    URING_SENDMSG,
+    URING_CANCEL
+};
+
+/* The unread part of a receive buffer held by a connection */
+struct uring_segment {
+    uint16_t bid;
+    uint16_t offset;
+    uint16_t len;
+};
+
+struct uring_conn {
+    struct uring *ring;
+    conn *c;
+    uint32_t slot;
+    /* Bumped every time the slot is reused so stale completions are ignored */
+    uint32_t gen;
+    /* Set while the slot is on the ready list */
+    bool queued;
+
+    /*
+     * The data received for the connection: the receive buffers it
+     * holds, followed by the data copied to the inbox (which is only
+     * used when the connection can't hold any more buffers).
+     */
+    struct uring_segment segments[URING_CONN_SEGMENTS];
+    unsigned seg_head;
+    unsigned seg_count;
+    size_t pending;
+
+    char *inbox;
+    size_t inbox_size;
+    size_t inbox_offset;
+    size_t inbox_len;
+
+    bool recv_armed;
+    bool recv_cancelled;
+    bool recv_paused;
+    bool quiesced;
+    bool eof;
+    int error;
+
+    /*
+     * Responses are copied to the outbox, which is handed to the kernel
+     * (and becomes the "sending" buffer) when no other send is in flight.
+     */
+    char *outbox;
+    size_t outbox_size;
+    size_t outbox_len;
+    char *sending;
+    size_t sending_size;
+    size_t sending_len;
+    size_t sending_offset;
+    bool send_inflight;
+    enum uring_op send_op;
+    bool flush_queued;
+    int send_error;
+
+    /*
+     * A large message is sent from the caller's iovecs. The state
+     * machine retries the same message (getting EAGAIN) until the send
+     * completes, and then gets its result.
+     */
+    struct msghdr *direct_msg;
+    bool direct_done;
+    ssize_t direct_result;
+};
+
+struct uring {
+    int fd;
+    struct event_base *base;
+    struct event event;
+    bool in_handler;
+    bool kicked;
+    bool multishot;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;
+    unsigned sq_submitted;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    struct io_uring_buf_ring *br;
+    size_t br_size;
+    uint16_t br_tail;
+    char *buffers;
+    /* The number of receive buffers held by connections */
+    unsigned held;
+
+    struct uring_conn **slots;
+    uint32_t nslots;
+    uint32_t *free_slots;
+    uint32_t nfree;
+
+    /* Connections to drive (slot and generation of each) */
+    uint64_t *ready;
+    size_t nready;
+    size_t ready_size;
+    uint64_t *running;
+    size_t running_size;
+
+    /* Connections with output to hand to the kernel */
+    uint64_t *flush;
+    size_t nflush;
+    size_t flush_size;
+};
+
+static void uring_event_handler(const int fd, const short which, void *arg);
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode,
+                                 void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static uint64_t uring_user_data(enum uring_op op, const struct uring_conn *uc) {
+    return ((uint64_t)op << 56) | ((uint64_t)(uc->gen & GEN_MASK) << 32) |
+        uc->slot;
+}
+
+static void uring_kick(struct uring *ring) {
+    if (!ring->in_handler && !ring->kicked) {
+        ring->kicked = true;
+        event_active(&ring->event, EV_READ, 1);
+    }
+}
+
+/*
+ * Hand everything queued in the submission ring to the kernel, and
+ * optionally wait for a number of completions.
+ *
+ * @return the number of submissions consumed, or -1 (errno set)
+ */
+static int uring_submit(struct uring *ring, unsigned wait) {
+    unsigned pending = ring->sq_local_tail - ring->sq_submitted;
+    if (pending == 0 && wait == 0) {
+        return 0;
+    }
+
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    int ret;
+    do {
+        ret = sys_io_uring_enter(ring->fd, pending, wait,
+                                 wait ? IORING_ENTER_GETEVENTS : 0);
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret >= 0) {
+        ring->sq_submitted += ret;
+    } else if (errno != EAGAIN && errno != EBUSY) {
+        settings.extensions.logger->log(EXTENSION_LOG_WARNING, NULL,
+                                        "io_uring_enter failed: %s\n",
+                                        strerror(errno));
+    }
+
+    return ret;
+}
+
+static struct io_uring_sqe *uring_get_sqe(struct uring *ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_local_tail - head >= ring->sq_entries) {
+        uring_submit(ring, 0);
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (ring->sq_local_tail - head >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_local_tail++;
+    uring_kick(ring);
+    return sqe;
+}
+
+/*
+ * Give a receive buffer back to the kernel. Only the fields we need are
+ * written, because the resv field of the first entry is the ring tail.
+ */
+static void uring_buffer_recycle(struct uring *ring, uint16_t bid) {
+    struct io_uring_buf *buf = &ring->br->bufs[ring->br_tail & (URING_BUFFERS - 1)];
+    buf->addr = (uintptr_t)(ring->buffers + (size_t)bid * URING_BUFFER_SIZE);
+    buf->len = URING_BUFFER_SIZE;
+    buf->bid = bid;
+    ring->br_tail++;
+    __atomic_store_n(&ring->br->tail, ring->br_tail, __ATOMIC_RELEASE);
+}
+
+static bool uring_list_push(uint64_t **list, size_t *count, size_t *size,
+                            const struct uring_conn *uc) {
+    if (*count == *size) {
+        size_t nsize = *size ? *size * 2 : 64;
+        uint64_t *ptr = realloc(*list, nsize * sizeof(*ptr));
+        if (ptr == NULL) {
+            return false;
+        }
+        *list = ptr;
+        *size = nsize;
+    }
+    (*list)[(*count)++] = ((uint64_t)uc->gen << 32) | uc->slot;
+    return true;
+}
+
+/* Look up the connection a list entry refers to (NULL if it is gone) */
+static struct uring_conn *uring_list_entry(struct uring *ring, uint64_t entry) {
+    struct uring_conn *uc = ring->slots[(uint32_t)entry];
+    if (uc->c == NULL || uc->gen != (uint32_t)(entry >> 32)) {
+        return NULL;
+    }
+    return uc;
+}
+
+static short uring_conn_ready(const struct uring_conn *uc) {
+    const conn *c = uc->c;
+    short which = 0;
+
+    if (c->registered_in_libevent) {
+        if ((c->ev_flags & EV_READ) &&
+            (uc->pending > 0 || uc->eof || uc->error != 0)) {
+            which |= EV_READ;
+        }
+        if ((c->ev_flags & EV_WRITE) &&
+            (uc->send_error != 0 ||
+             (uc->direct_msg ? uc->direct_done : uc->outbox_len < OUTBOX_HIGHWAT))) {
+            which |= EV_WRITE;
+        }
+    }
+
+    return which;
+}
+
+void uring_conn_poll(conn *c) {
+    struct uring_conn *uc = c->uring;
+    if (uc == NULL || uc->queued || uring_conn_ready(uc) == 0) {
+        return;
+    }
+
+    struct uring *ring = uc->ring;
+    if (!uring_list_push(&ring->ready, &ring->nready, &ring->ready_size, uc)) {
+        settings.extensions.logger->log(EXTENSION_LOG_WARNING, c,
+                                        "Failed to schedule connection %d\n",
+                                        c->sfd);
+        return;
+    }
+    uc->queued = true;
+    uring_kick(ring);
+}
+
+static void uring_recv_arm(struct uring_conn *uc) {
+    struct io_uring_sqe *sqe = uring_get_sqe(uc->ring);
+    if (sqe == NULL) {
+        uc->error = ENOBUFS;
+        return;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = uc->c->sfd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    if (uc->ring->multishot) {
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+    }
+    sqe->user_data = uring_user_data(URING_RECV, uc);
+    uc->recv_armed = true;
+}
+
+static void uring_cancel(struct uring_conn *uc, enum uring_op op) {
+    struct io_uring_sqe *sqe = uring_get_sqe(uc->ring);
+    if (sqe == NULL) {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = uring_user_data(op, uc);
+    sqe->user_data = uring_user_data(URING_CANCEL, uc);
+    if (op == URING_RECV) {
+        uc->recv_cancelled = true;
+    }
+}
+
+static bool uring_inbox_append(struct uring_conn *uc, const char *data,
+                               size_t len) {
+    if (uc->inbox_offset + uc->inbox_len + len > uc->inbox_size) {
+        if (uc->inbox_offset > 0) {
+            memmove(uc->inbox, uc->inbox + uc->inbox_offset, uc->inbox_len);
+            uc->inbox_offset = 0;
+        }
+        if (uc->inbox_len + len > uc->inbox_size) {
+            size_t size = uc->inbox_size ? uc->inbox_size : URING_BUFFER_SIZE;
+            while (size < uc->inbox_len + len) {
+                size *= 2;
+            }
+            char *ptr = realloc(uc->inbox, size);
+            if (ptr == NULL) {
+                uc->error = ENOMEM;
+                return false;
+            }
+            uc->inbox = ptr;
+            uc->inbox_size = size;
+        }
+    }
+
+    memcpy(uc->inbox + uc->inbox_offset + uc->inbox_len, data, len);
+    uc->inbox_len += len;
+    return true;
+}
+
+/*
+ * Take the data the kernel put in a receive buffer. The connection
+ * keeps the buffer unless it already holds its share of them (or the
+ * data must queue up behind what's already in the inbox), in which case
+ * the data is copied and the buffer goes straight back to the kernel.
+ */
+static void uring_conn_received(struct uring_conn *uc, uint16_t bid,
+                                size_t len) {
+    struct uring *ring = uc->ring;
+
+    if (uc->inbox_len == 0 && uc->seg_count < URING_CONN_SEGMENTS &&
+        ring->held < URING_BUFFERS - URING_BUFFER_RESERVE) {
+        unsigned idx = (uc->seg_head + uc->seg_count) & (URING_CONN_SEGMENTS - 1);
+        uc->segments[idx].bid = bid;
+        uc->segments[idx].offset = 0;
+        uc->segments[idx].len = (uint16_t)len;
+        uc->seg_count++;
+        uc->pending += len;
+        ring->held++;
+        return;
+    }
+
+    if (uring_inbox_append(uc, ring->buffers + (size_t)bid * URING_BUFFER_SIZE,
+                           len)) {
+        uc->pending += len;
+    }
+    uring_buffer_recycle(ring, bid);
+}
+
+/* Give all of the receive buffers held by the connection back */
+static void uring_conn_release_buffers(struct uring_conn *uc) {
+    while (uc->seg_count > 0) {
+        uring_buffer_recycle(uc->ring, uc->segments[uc->seg_head].bid);
+        uc->ring->held--;
+        uc->pending -= uc->segments[uc->seg_head].len;
+        uc->seg_head = (uc->seg_head + 1) & (URING_CONN_SEGMENTS - 1);
+        uc->seg_count--;
+    }
+}
+
+/*
+ * Copy up to len bytes of the received data to buf, giving the receive
+ * buffers we're done with back to the kernel.
+ */
+static size_t uring_conn_copyout(struct uring_conn *uc, char *buf, size_t len) {
+    struct uring *ring = uc->ring;
+    size_t n = 0;
+
+    while (n < len && uc->seg_count > 0) {
+        struct uring_segment *seg = &uc->segments[uc->seg_head];
+        size_t chunk = len - n < seg->len ? len - n : seg->len;
+        memcpy(buf + n, ring->buffers + (size_t)seg->bid * URING_BUFFER_SIZE +
+               seg->offset, chunk);
+        n += chunk;
+        seg->offset += chunk;
+        seg->len -= chunk;
+        if (seg->len == 0) {
+            uring_buffer_recycle(ring, seg->bid);
+            ring->held--;
+            uc->seg_head = (uc->seg_head + 1) & (URING_CONN_SEGMENTS - 1);
+            uc->seg_count--;
+        }
+    }
+
+    if (n < len && uc->inbox_len > 0) {
+        size_t chunk = len - n < uc->inbox_len ? len - n : uc->inbox_len;
+        memcpy(buf + n, uc->inbox + uc->inbox_offset, chunk);
+        n += chunk;
+        uc->inbox_offset += chunk;
+        uc->inbox_len -= chunk;
+        if (uc->inbox_len == 0) {
+            uc->inbox_offset = 0;
+        }
+    }
+
+    uc->pending -= n;
+    return n;
+}
+
+static void uring_recv_complete(struct uring_conn *uc, int res, unsigned flags) {
+    struct uring *ring = uc->ring;
+
+    if (res == 0) {
+        uc->eof = true;
+    } else if (res < 0 && res != -ENOBUFS && res != -ECANCELED) {
+        if (res == -EINVAL && ring->multishot) {
+            /* The kernel doesn't do multishot receives; arm one at a time */
+            ring->multishot = false;
+        } else {
+            uc->error = -res;
+        }
+    }
+
+    if ((flags & IORING_CQE_F_MORE) == 0) {
+        uc->recv_armed = false;
+        uc->recv_cancelled = false;
+        if (!uc->eof && uc->error == 0 && !uc->recv_paused && !uc->quiesced) {
+            uring_recv_arm(uc);
+        }
+    }
+
+    if (uc->pending >= INBOX_HIGHWAT && !uc->recv_paused) {
+        uc->recv_paused = true;
+        if (uc->recv_armed && !uc->recv_cancelled) {
+            uring_cancel(uc, URING_RECV);
+        }
+    }
+
+    uring_conn_poll(uc->c);
+}
+
+/* Send the message the caller handed us without copying it */
+static void uring_sendmsg_start(struct uring_conn *uc) {
+    struct io_uring_sqe *sqe = uring_get_sqe(uc->ring);
+    if (sqe == NULL) {
+        uc->send_error = ENOBUFS;
+        return;
+    }
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = uc->c->sfd;
+    sqe->addr = (uintptr_t)uc->direct_msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_WAITALL;
+    sqe->user_data = uring_user_data(URING_SENDMSG, uc);
+    uc->send_inflight = true;
+    uc->send_op = URING_SENDMSG;
+}
+
+/*
+ * Hand the queued output to the kernel, unless a send is already in
+ * flight (we'll get to it when that one completes). The outbox always
+ * goes first, because it holds the output queued before a message we
+ * send directly.
+ */
+static void uring_send_start(struct uring_conn *uc) {
+    if (uc->send_inflight || uc->send_error != 0 || uc->quiesced) {
+        return;
+    }
+
+    if (uc->sending_offset == uc->sending_len) {
+        if (uc->outbox_len == 0) {
+            if (uc->direct_msg != NULL && !uc->direct_done) {
+                uring_sendmsg_start(uc);
+            }
+            return;
+        }
+        char *buf = uc->sending;
+        size_t size = uc->sending_size;
+        uc->sending = uc->outbox;
+        uc->sending_size = uc->outbox_size;
+        uc->sending_len = uc->outbox_len;
+        uc->sending_offset = 0;
+        uc->outbox = buf;
+        uc->outbox_size = size;
+        uc->outbox_len = 0;
+    }
+
+    struct io_uring_sqe *sqe = uring_get_sqe(uc->ring);
+    if (sqe == NULL) {
+        uc->send_error = ENOBUFS;
+        return;
+    }
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = uc->c->sfd;
+    sqe->addr = (uintptr_t)(uc->sending + uc->sending_offset);
+    sqe->len = (uint32_t)(uc->sending_len - uc->sending_offset);
+    sqe->msg_flags = MSG_WAITALL;
+    sqe->user_data = uring_user_data(URING_SEND, uc);
+    uc->send_inflight = true;
+    uc->send_op = URING_SEND;
+}
+
+static void uring_send_complete(struct uring_conn *uc, enum uring_op op,
+                                int res) {
+    uc->send_inflight = false;
+    if (res > 0) {
+        if (op == URING_SENDMSG) {
+            uc->direct_result = res;
+            uc->direct_done = true;
+        } else {
+            uc->sending_offset += res;
+        }
+    } else if (res == 0) {
+        uc->send_error = EPIPE;
+    } else if (res != -ECANCELED || !uc->quiesced) {
+        uc->send_error = -res;
+    }
+
+    uring_send_start(uc);
+    uring_conn_poll(uc->c);
+}
+
+static void uring_complete(struct uring *ring, const struct io_uring_cqe *cqe) {
+    enum uring_op op = (enum uring_op)(cqe->user_data >> 56);
+    uint32_t gen = (uint32_t)(cqe->user_data >> 32) & GEN_MASK;
+    uint32_t slot = (uint32_t)cqe->user_data;
+    struct uring_conn *uc = NULL;
+
+    if (slot < ring->nslots && ring->slots[slot]->c != NULL &&
+        (ring->slots[slot]->gen & GEN_MASK) == gen) {
+        uc = ring->slots[slot];
+    }
+
+    switch (op) {
+    case URING_RECV:
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            if (uc != NULL && cqe->res > 0) {
+                uring_conn_received(uc, bid, cqe->res);
+            } else {
+                uring_buffer_recycle(ring, bid);
+            }
+        }
+        if (uc != NULL) {
+            uring_recv_complete(uc, cqe->res, cqe->flags);
+        }
+        break;
+    case URING_SEND:
+    case URING_SENDMSG:
+        if (uc != NULL) {
+            uring_send_complete(uc, op, cqe->res);
+        }
+        break;
+    case URING_CANCEL:
+        break;
+    }
+}
+
+static void uring_reap(struct uring *ring) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        uring_complete(ring, &ring->cqes[head & ring->cq_mask]);
+        ++head;
+    }
+
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/*
+ * Run the state machine for the connections on the ready list. The list
+ * is level triggered: a connection that is still ready when we're done
+ * with it goes back on the list for the next round.
+ */
+static void uring_drive(struct uring *ring) {
+    uint64_t *list = ring->ready;
+    size_t size = ring->ready_size;
+    size_t count = ring->nready;
+
+    ring->ready = ring->running;
+    ring->ready_size = ring->running_size;
+    ring->nready = 0;
+    ring->running = list;
+    ring->running_size = size;
+
+    for (size_t ii = 0; ii < count; ++ii) {
+        struct uring_conn *uc = uring_list_entry(ring, ring->running[ii]);
+        if (uc == NULL) {
+            continue;
+        }
+
+        uc->queued = false;
+        short which = uring_conn_ready(uc);
+        if (which != 0) {
+            conn *c = uc->c;
+            uint32_t gen = uc->gen;
+            event_handler(c->sfd, which, c);
+            if (uc->c == c && uc->gen == gen) {
+                uring_conn_poll(c);
+            }
+        }
+    }
+}
+
+/* Start the sends for all of the output produced by this round */
+static void uring_flush(struct uring *ring) {
+    for (size_t ii = 0; ii < ring->nflush; ++ii) {
+        struct uring_conn *uc = uring_list_entry(ring, ring->flush[ii]);
+        if (uc != NULL) {
+            uc->flush_queued = false;
+            uring_send_start(uc);
+        }
+    }
+    ring->nflush = 0;
+}
+
+static void uring_event_handler(const int fd, const short which, void *arg) {
+    struct uring *ring = arg;
+    (void)fd;
+    (void)which;
+
+    if (memcached_shutdown) {
+        event_base_loopbreak(ring->base);
+        return;
+    }
+
+    ring->in_handler = true;
+    ring->kicked = false;
+    for (int round = 0; round < URING_MAX_ROUNDS; ++round) {
+        uring_reap(ring);
+        if (ring->nready == 0 && ring->nflush == 0 &&
+            ring->sq_local_tail == ring->sq_submitted) {
+            break;
+        }
+        uring_drive(ring);
+        uring_flush(ring);
+        uring_submit(ring, 0);
+    }
+    ring->in_handler = false;
+
+    if (ring->nready > 0 || ring->nflush > 0 ||
+        ring->sq_local_tail != ring->sq_submitted) {
+        /* Let the other events on this thread run before we continue */
+        uring_kick(ring);
+    }
+}
+
+static void uring_free(struct uring *ring) {
+    if (ring->br != NULL) {
+        munmap(ring->br, ring->br_size);
+    }
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->fd != -1) {
+        close(ring->fd);
+    }
+    free(ring->buffers);
+    free(ring);
+}
+
+void uring_destroy(struct uring *ring) {
+    event_del(&ring->event);
+    uring_free(ring);
+}
+
+struct uring *uring_create(struct event_base *base) {
+    struct uring *ring = calloc(1, sizeof(*ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->fd = -1;
+    ring->base = base;
+    ring->multishot = true;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_ENTRIES * 4;
+    if ((ring->fd = sys_io_uring_setup(URING_ENTRIES, &params)) == -1) {
+        goto error;
+    }
+
+    if ((params.features & IORING_FEAT_NODROP) == 0) {
+        /* We can't afford to lose completions if the queue overflows */
+        errno = ENOTSUP;
+        goto error;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes +
+        params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        goto error;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->fd,
+                             IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            goto error;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        goto error;
+    }
+
+    char *sq = ring->sq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = *(unsigned *)(sq + params.sq_off.ring_entries);
+    ring->sq_local_tail = ring->sq_submitted = *ring->sq_tail;
+
+    /* We always fill the submission entries in order */
+    unsigned *array = (unsigned *)(sq + params.sq_off.array);
+    for (unsigned ii = 0; ii < ring->sq_entries; ++ii) {
+        array[ii] = ii;
+    }
+
+    char *cq = ring->cq_ring;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    ring->br_size = URING_BUFFERS * sizeof(struct io_uring_buf);
+    ring->br = mmap(NULL, ring->br_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->br == MAP_FAILED) {
+        ring->br = NULL;
+        goto error;
+    }
+
+    ring->buffers = malloc((size_t)URING_BUFFERS * URING_BUFFER_SIZE);
+    if (ring->buffers == NULL) {
+        goto error;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)ring->br;
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid = URING_BGID;
+    if (sys_io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        goto error;
+    }
+
+    for (uint16_t ii = 0; ii < URING_BUFFERS; ++ii) {
+        uring_buffer_recycle(ring, ii);
+    }
+
+    event_set(&ring->event, ring->fd, EV_READ | EV_PERSIST,
+              uring_event_handler, ring);
+    event_base_set(base, &ring->event);
+    if (event_add(&ring->event, 0) == -1) {
+        goto error;
+    }
+
+    return ring;
+
+ error:
+    {
+        int error = errno;
+        uring_free(ring);
+        errno = error;
+    }
+    return NULL;
+}
+
+static struct uring_conn *uring_slot_alloc(struct uring *ring) {
+    if (ring->nfree == 0) {
+        uint32_t size = ring->nslots ? ring->nslots * 2 : 64;
+        struct uring_conn **slots = realloc(ring->slots, size * sizeof(*slots));
+        if (slots == NULL) {
+            return NULL;
+        }
+        ring->slots = slots;
+
+        uint32_t *free_slots = realloc(ring->free_slots, size * sizeof(*free_slots));
+        if (free_slots == NULL) {
+            return NULL;
+        }
+        ring->free_slots = free_slots;
+
+        while (ring->nslots < size) {
+            struct uring_conn *uc = calloc(1, sizeof(*uc));
+            if (uc == NULL) {
+                break;
+            }
+            uc->ring = ring;
+            uc->slot = ring->nslots;
+            ring->slots[ring->nslots++] = uc;
+            ring->free_slots[ring->nfree++] = uc->slot;
+        }
+
+        if (ring->nfree == 0) {
+            return NULL;
+        }
+    }
+
+    return ring->slots[ring->free_slots[--ring->nfree]];
+}
+
+static void uring_conn_reset(struct uring_conn *uc) {
+    assert(uc->seg_count == 0);
+    uc->queued = false;
+    uc->seg_head = 0;
+    uc->pending = 0;
+    uc->inbox_offset = uc->inbox_len = 0;
+    uc->recv_armed = uc->recv_cancelled = uc->recv_paused = false;
+    uc->quiesced = uc->eof = false;
+    uc->error = 0;
+    uc->outbox_len = 0;
+    uc->sending_len = uc->sending_offset = 0;
+    uc->send_inflight = uc->flush_queued = false;
+    uc->send_error = 0;
+    uc->direct_msg = NULL;
+    uc->direct_done = false;
+}
+
+bool uring_conn_attach(struct uring *ring, conn *c) {
+    assert(c->uring == NULL);
+
+    struct uring_conn *uc = uring_slot_alloc(ring);
+    if (uc == NULL) {
+        return false;
+    }
+
+    if (c->registered_in_libevent && event_del(&c->event) == -1) {
+        ring->free_slots[ring->nfree++] = uc->slot;
+        return false;
+    }
+
+    uring_conn_reset(uc);
+    uc->c = c;
+    c->uring = uc;
+    uring_recv_arm(uc);
+    uring_conn_poll(c);
+
+    return true;
+}
+
+void uring_conn_quiesce(conn *c) {
+    struct uring_conn *uc = c->uring;
+    assert(uc != NULL);
+
+    if (uc->quiesced) {
+        return;
+    }
+
+    uc->quiesced = true;
+    if (uc->recv_armed && !uc->recv_cancelled) {
+        uring_cancel(uc, URING_RECV);
+    }
+    if (uc->send_inflight) {
+        uring_cancel(uc, uc->send_op);
+    }
+
+    while (uc->recv_armed || uc->send_inflight) {
+        if (uring_submit(uc->ring, 1) == -1 &&
+            errno != EAGAIN && errno != EBUSY) {
+            break;
+        }
+        uring_reap(uc->ring);
+    }
+
+    /*
+     * The state machine sends the rest of a large message itself once the
+     * connection is detached, so drop the part the kernel did send.
+     */
+    if (uc->direct_msg != NULL) {
+        struct msghdr *m = uc->direct_msg;
+        size_t res = uc->direct_done ? (size_t)uc->direct_result : 0;
+        while (m->msg_iovlen > 0 && res >= m->msg_iov->iov_len) {
+            res -= m->msg_iov->iov_len;
+            m->msg_iovlen--;
+            m->msg_iov++;
+        }
+        if (res > 0) {
+            m->msg_iov->iov_base = (char *)m->msg_iov->iov_base + res;
+            m->msg_iov->iov_len -= res;
+        }
+        uc->direct_msg = NULL;
+        uc->direct_done = false;
+    }
+
+    /*
+     * Try to get the output the kernel didn't get to onto the wire (like
+     * an error message sent right before closing the connection).
+     */
+    if (uc->send_error == 0 && !uc->send_inflight) {
+        struct iovec iov[2] = {
+            { uc->sending + uc->sending_offset, uc->sending_len - uc->sending_offset },
+            { uc->outbox, uc->outbox_len }
+        };
+        struct msghdr m;
+        memset(&m, 0, sizeof(m));
+        m.msg_iov = iov;
+        m.msg_iovlen = 2;
+        while (iov[0].iov_len + iov[1].iov_len > 0) {
+            ssize_t nw = sendmsg(c->sfd, &m, MSG_DONTWAIT);
+            if (nw <= 0) {
+                break;
+            }
+            for (int ii = 0; ii < 2; ++ii) {
+                size_t n = (size_t)nw < iov[ii].iov_len ? (size_t)nw : iov[ii].iov_len;
+                iov[ii].iov_base = (char *)iov[ii].iov_base + n;
+                iov[ii].iov_len -= n;
+                nw -= n;
+            }
+        }
+        uc->sending_len = uc->sending_offset = uc->outbox_len = 0;
+    }
+}
+
+void uring_conn_detach(conn *c) {
+    struct uring_conn *uc = c->uring;
+    if (uc == NULL) {
+        return;
+    }
+
+    uring_conn_quiesce(c);
+    uring_conn_release_buffers(uc);
+    c->uring = NULL;
+    uc->c = NULL;
+
+    if (uc->recv_armed || uc->send_inflight) {
+        /* The kernel didn't let go of it, so the slot can't be reused */
+        settings.extensions.logger->log(EXTENSION_LOG_WARNING, NULL,
+                                        "Leaking io_uring slot %u\n",
+                                        uc->slot);
+        return;
+    }
+
+    uc->gen = (uc->gen + 1) & GEN_MASK;
+    uring_conn_reset(uc);
+    if (uc->inbox_size > BUFFER_KEEP) {
+        free(uc->inbox);
+        uc->inbox = NULL;
+        uc->inbox_size = 0;
+    }
+    if (uc->outbox_size > BUFFER_KEEP) {
+        free(uc->outbox);
+        uc->outbox = NULL;
+        uc->outbox_size = 0;
+    }
+    if (uc->sending_size > BUFFER_KEEP) {
+        free(uc->sending);
+        uc->sending = NULL;
+        uc->sending_size = 0;
+    }
+    uc->ring->free_slots[uc->ring->nfree++] = uc->slot;
+}
+
+size_t uring_conn_pending(const conn *c) {
+    return c->uring ? c->uring->pending : 0;
+}
+
+ssize_t uring_conn_recv(conn *c, void *buf, size_t len) {
+    struct uring_conn *uc = c->uring;
+
+    if (uc->pending > 0) {
+        size_t n = uring_conn_copyout(uc, buf, len);
+
+        if (uc->recv_paused && uc->pending < INBOX_LOWWAT && !uc->quiesced) {
+            uc->recv_paused = false;
+            if (!uc->recv_armed && !uc->eof && uc->error == 0) {
+                uring_recv_arm(uc);
+            }
+        }
+        return n;
+    }
+
+    if (uc->error != 0) {
+        errno = uc->error;
+        return -1;
+    }
+
+    if (uc->eof) {
+        return 0;
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+/* Make sure the output gets handed to the kernel at the end of the round */
+static void uring_conn_flush(struct uring_conn *uc) {
+    if (!uc->send_inflight && !uc->flush_queued) {
+        struct uring *ring = uc->ring;
+        if (uring_list_push(&ring->flush, &ring->nflush, &ring->flush_size, uc)) {
+            uc->flush_queued = true;
+            uring_kick(ring);
+        } else {
+            uring_send_start(uc);
+        }
+    }
+}
+
+ssize_t uring_conn_sendmsg(conn *c, struct msghdr *m) {
+    struct uring_conn *uc = c->uring;
+    assert(!uc->quiesced);
+
+    if (uc->send_error != 0) {
+        errno = uc->send_error;
+        return -1;
+    }
+
+    if (uc->direct_msg != NULL) {
+        if (uc->direct_msg != m || !uc->direct_done) {
+            errno = EAGAIN;
+            return -1;
+        }
+        uc->direct_msg = NULL;
+        uc->direct_done = false;
+        return uc->direct_result;
+    }
+
+    if (uc->outbox_len >= OUTBOX_HIGHWAT) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    size_t total = 0;
+    for (size_t ii = 0; ii < (size_t)m->msg_iovlen; ++ii) {
+        total += m->msg_iov[ii].iov_len;
+    }
+
+    if (total > URING_SEND_COPY_MAX) {
+        uc->direct_msg = m;
+        uring_conn_flush(uc);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    if (uc->outbox_len + total > uc->outbox_size) {
+        size_t size = uc->outbox_size ? uc->outbox_size : URING_BUFFER_SIZE;
+        while (size < uc->outbox_len + total) {
+            size *= 2;
+        }
+        char *ptr = realloc(uc->outbox, size);
+        if (ptr == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        uc->outbox = ptr;
+        uc->outbox_size = size;
+    }
+
+    for (size_t ii = 0; ii < (size_t)m->msg_iovlen; ++ii) {
+        memcpy(uc->outbox + uc->outbox_len, m->msg_iov[ii].iov_base,
+               m->msg_iov[ii].iov_len);
+        uc->outbox_len += m->msg_iov[ii].iov_len;
+    }
+
+    uring_conn_flush(uc);
+    return total;
+}
+
+#else
+
+struct uring *uring_create(struct event_base *base) {
+    (void)base;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+void uring_destroy(struct uring *ring) {
+    (void)ring;
+}
+
+bool uring_conn_attach(struct uring *ring, conn *c) {
+    (void)ring;
+    (void)c;
+    return false;
+}
+
+void uring_conn_quiesce(conn *c) {
+    (void)c;
+}
+
+void uring_conn_detach(conn *c) {
+    c->uring = NULL;
+}
+
+size_t uring_conn_pending(const conn *c) {
+    (void)c;
+    return 0;
+}
+
+void uring_conn_poll(conn *c) {
+    (void)c;
+}
+
+ssize_t uring_conn_recv(conn *c, void *buf, size_t len) {
+    return recv(c->sfd, buf, len, 0);
+}
+
+ssize_t uring_conn_sendmsg(conn *c, struct msghdr *m) {
+    return sendmsg(c->sfd, m, 0);
+}
+
+#endif
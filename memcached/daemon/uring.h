@@ -0,0 +1,108 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+#ifndef URING_H
+#define URING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <event.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Optional io_uring network backend for the worker threads.
+ *
+ * Each worker thread owns one ring. Every connection handed to the
+ * thread gets a multishot receive posted on it, and holds on to the
+ * receive buffers the kernel filled for it until it has read them.
+ * Small responses are collected in a per connection outbox, so all of
+ * the responses to a batch of pipelined requests go out in a single
+ * send, while large ones are sent straight from the connection's
+ * iovecs. All of the submissions made while serving the connections
+ * are handed to the kernel in a single system call.
+ *
+ * The state machine in memcached.c is left untouched: recv() and
+ * sendmsg() are replaced with uring_conn_recv() and uring_conn_sendmsg()
+ * which behave like their non-blocking counterparts, and the event
+ * registration functions (register_event() etc) tell the ring which
+ * readiness the connection is waiting for. The ring itself is monitored
+ * by the thread's event base, and the connections are driven through
+ * event_handler() when they become ready.
+ */
+struct uring;
+struct uring_conn;
+struct conn;
+
+/**
+ * Create a ring for a worker thread and add it to the thread's event
+ * base.
+ *
+ * @return the new ring, or NULL if io_uring isn't supported by the build
+ *         or the running kernel (errno is set)
+ */
+struct uring *uring_create(struct event_base *base);
+
+/**
+ * Remove a ring from its event base and release it. Only used before the
+ * thread owning the ring is started (so no connections are attached).
+ */
+void uring_destroy(struct uring *ring);
+
+/**
+ * Start serving the connection through the ring. The connection must
+ * belong to the thread owning the ring, and it stops using its libevent
+ * event.
+ */
+bool uring_conn_attach(struct uring *ring, struct conn *c);
+
+/**
+ * Stop all network I/O on the connection (cancel the receive and wait
+ * for an outstanding send to complete). The data already received may
+ * still be read with uring_conn_recv().
+ */
+void uring_conn_quiesce(struct conn *c);
+
+/**
+ * Release the connection from the ring (quiescing it first). Any data
+ * left in the inbox is discarded.
+ */
+void uring_conn_detach(struct conn *c);
+
+/**
+ * Get the number of bytes received but not yet read by the connection.
+ */
+size_t uring_conn_pending(const struct conn *c);
+
+/**
+ * Re-evaluate if the connection is ready for the events it is
+ * registered for, and schedule it to be driven if it is. Called when the
+ * event registration of the connection changes.
+ */
+void uring_conn_poll(struct conn *c);
+
+/**
+ * Read from the connection's inbox. Returns like recv() on a
+ * non-blocking socket.
+ */
+ssize_t uring_conn_recv(struct conn *c, void *buf, size_t len);
+
+/**
+ * Send a message over the connection. Returns like sendmsg() on a
+ * non-blocking socket. A small message is copied to the connection's
+ * outbox, and is accepted as a whole unless too much output is already
+ * queued. A large message is sent from its own buffers: the call
+ * returns -1 with errno set to EAGAIN until the send completes, and the
+ * next call with the same message returns the number of bytes sent, so
+ * the message must stay intact until then. Errors from sending earlier
+ * output are reported here too.
+ */
+ssize_t uring_conn_sendmsg(struct conn *c, struct msghdr *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
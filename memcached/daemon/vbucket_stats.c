@@ -0,0 +1,171 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+#include "config.h"
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include "vbucket_stats.h"
+
+/*
+ * The counters in a row are only ever written by the thread owning the
+ * row, so an increment is a plain load and store. The atomic accessors
+ * just make sure the readers never see a torn value.
+ */
+#ifdef __GNUC__
+#define VBSTATS_LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define VBSTATS_ADD(ptr, val) \
+    __atomic_store_n(ptr, __atomic_load_n(ptr, __ATOMIC_RELAXED) + (val), \
+                     __ATOMIC_RELAXED)
+#else
+#define VBSTATS_LOAD(ptr) (*(volatile uint64_t *)(ptr))
+#define VBSTATS_ADD(ptr, val) (*(volatile uint64_t *)(ptr) += (val))
+#endif
+
+vbucket_stats_t *vbucket_stats_init(int nvbuckets, int nthreads) {
+    assert(nvbuckets > 0);
+    assert(nthreads > 0);
+    vbucket_stats_t *vs = calloc(sizeof(vbucket_stats_t), 1);
+    if (vs == NULL) {
+        return NULL;
+    }
+
+    vs->nvbuckets = nvbuckets;
+    vs->nthreads = nthreads;
+    vs->stats = calloc((size_t)nvbuckets * nthreads,
+                       sizeof(struct vbucket_op_stats));
+    vs->baseline = calloc(nvbuckets, sizeof(struct vbucket_op_stats));
+    if (vs->stats == NULL || vs->baseline == NULL) {
+        free(vs->stats);
+        free(vs->baseline);
+        free(vs);
+        return NULL;
+    }
+    pthread_mutex_init(&vs->mutex, NULL);
+    return vs;
+}
+
+void vbucket_stats_free(vbucket_stats_t *vs) {
+    pthread_mutex_destroy(&vs->mutex);
+    free(vs->stats);
+    free(vs->baseline);
+    free(vs);
+}
+
+uint64_t vbucket_stats_now(void) {
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+#endif
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000000 + (uint64_t)tv.tv_usec * 1000;
+}
+
+static inline int latency_bucket(uint64_t usec) {
+    int bucket = 0;
+    while (usec != 0 && bucket < VBSTATS_HISTOGRAM_SIZE - 1) {
+        usec >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+void vbucket_stats_record(vbucket_stats_t *vs, int thread,
+                          const struct vbucket_op *op, uint64_t now) {
+    assert(thread >= 0 && thread < vs->nthreads);
+    if (op->vbucket >= vs->nvbuckets) {
+        return;
+    }
+
+    struct vbucket_op_stats *s;
+    s = vs->stats + (size_t)thread * vs->nvbuckets + op->vbucket;
+    VBSTATS_ADD(&s->ops, 1);
+    VBSTATS_ADD(&s->bytes_in, op->bytes_in);
+    VBSTATS_ADD(&s->bytes_out, op->bytes_out);
+    if (op->misses != 0) {
+        VBSTATS_ADD(&s->misses, op->misses);
+    }
+
+    uint64_t usec = now > op->start ? (now - op->start) / 1000 : 0;
+    VBSTATS_ADD(&s->latency[latency_bucket(usec)], 1);
+}
+
+/* Sum the rows of all of the threads for a vbucket */
+static void vbucket_stats_merge(vbucket_stats_t *vs, int vbucket,
+                                struct vbucket_op_stats *out) {
+    memset(out, 0, sizeof(*out));
+    for (int ii = 0; ii < vs->nthreads; ++ii) {
+        struct vbucket_op_stats *s;
+        s = vs->stats + (size_t)ii * vs->nvbuckets + vbucket;
+#define VBSTATS_SUM(name) out->name += VBSTATS_LOAD(&s->name);
+        VBSTATS_OPS(VBSTATS_SUM)
+#undef VBSTATS_SUM
+        for (int jj = 0; jj < VBSTATS_HISTOGRAM_SIZE; ++jj) {
+            out->latency[jj] += VBSTATS_LOAD(&s->latency[jj]);
+        }
+    }
+}
+
+/*
+ * The worker threads never stop to let us clear their rows, so a reset
+ * just remembers the current totals and the readers subtract them.
+ */
+void vbucket_stats_reset(vbucket_stats_t *vs) {
+    pthread_mutex_lock(&vs->mutex);
+    for (int ii = 0; ii < vs->nvbuckets; ++ii) {
+        vbucket_stats_merge(vs, ii, &vs->baseline[ii]);
+    }
+    pthread_mutex_unlock(&vs->mutex);
+}
+
+static void append_stat(const void *cookie, int vbucket, const char *name,
+                        uint64_t value, ADD_STAT add_stat) {
+    char key[64];
+    char val[32];
+    int klen = snprintf(key, sizeof(key), "vb_%d:%s", vbucket, name);
+    int vlen = snprintf(val, sizeof(val), "%"PRIu64, value);
+    add_stat(key, klen, val, vlen, cookie);
+}
+
+ENGINE_ERROR_CODE vbucket_stats_details(vbucket_stats_t *vs,
+                                        const void *cookie,
+                                        ADD_STAT add_stat) {
+    pthread_mutex_lock(&vs->mutex);
+    for (int ii = 0; ii < vs->nvbuckets; ++ii) {
+        struct vbucket_op_stats total;
+        struct vbucket_op_stats *base = &vs->baseline[ii];
+        vbucket_stats_merge(vs, ii, &total);
+        if (total.ops == base->ops) {
+            continue;
+        }
+
+#define VBSTATS_APPEND(name) \
+        append_stat(cookie, ii, #name, total.name - base->name, add_stat);
+        VBSTATS_OPS(VBSTATS_APPEND)
+#undef VBSTATS_APPEND
+
+        for (int jj = 0; jj < VBSTATS_HISTOGRAM_SIZE; ++jj) {
+            uint64_t count = total.latency[jj] - base->latency[jj];
+            if (count == 0) {
+                continue;
+            }
+            char name[32];
+            uint64_t lo = jj == 0 ? 0 : (uint64_t)1 << (jj - 1);
+            if (jj == VBSTATS_HISTOGRAM_SIZE - 1) {
+                snprintf(name, sizeof(name), "latency_%"PRIu64"us_inf", lo);
+            } else {
+                snprintf(name, sizeof(name), "latency_%"PRIu64"us_%"PRIu64"us",
+                         lo, (uint64_t)1 << jj);
+            }
+            append_stat(cookie, ii, name, count, add_stat);
+        }
+    }
+    pthread_mutex_unlock(&vs->mutex);
+    return ENGINE_SUCCESS;
+}
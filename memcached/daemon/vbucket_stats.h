@@ -0,0 +1,67 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+#ifndef VBUCKET_STATS_H
+#define VBUCKET_STATS_H 1
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <memcached/engine.h>
+
+/*
+ * Per-vbucket operation counters and latency histograms.
+ *
+ * Every worker thread owns one row of counters (indexed by the thread's
+ * index, like the thread_stats), and is the only one writing to it, so the
+ * hot path doesn't need any locks. "stats vbucket-details" merges the rows
+ * of all of the threads. Only binary commands carry a vbucket, so the ascii
+ * commands aren't accounted.
+ */
+
+/* Bucket 0 is < 1us, bucket n is [2^(n-1), 2^n) us, the last one is open */
+#define VBSTATS_HISTOGRAM_SIZE 24
+
+#define VBSTATS_OPS(C) C(ops) C(bytes_in) C(bytes_out) C(misses)
+
+struct vbucket_op_stats {
+#define VBSTATS_CUR(name) uint64_t name;
+    VBSTATS_OPS(VBSTATS_CUR)
+#undef VBSTATS_CUR
+    uint64_t latency[VBSTATS_HISTOGRAM_SIZE];
+};
+
+typedef struct vbucket_stats {
+    int nvbuckets;
+    int nthreads;
+    /* nthreads rows of nvbuckets entries */
+    struct vbucket_op_stats *stats;
+    /* Protects the reset baseline (readers and "stats reset" only) */
+    pthread_mutex_t mutex;
+    struct vbucket_op_stats *baseline;
+} vbucket_stats_t;
+
+/* The operation a connection is currently timing */
+struct vbucket_op {
+    uint64_t start;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint32_t misses;
+    uint16_t vbucket;
+    bool active;
+};
+
+vbucket_stats_t *vbucket_stats_init(int nvbuckets, int nthreads);
+void vbucket_stats_free(vbucket_stats_t *vs);
+
+/* Get a monotonic timestamp in nanoseconds */
+uint64_t vbucket_stats_now(void);
+
+/* Account a completed operation (called by the thread owning the row) */
+void vbucket_stats_record(vbucket_stats_t *vs, int thread,
+                          const struct vbucket_op *op, uint64_t now);
+
+void vbucket_stats_reset(vbucket_stats_t *vs);
+ENGINE_ERROR_CODE vbucket_stats_details(vbucket_stats_t *vs,
+                                        const void *cookie,
+                                        ADD_STAT add_stat);
+
+#endif
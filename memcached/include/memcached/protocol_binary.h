@@ -123,6 +123,7 @@ extern "C"
         PROTOCOL_BINARY_CMD_TOUCH = 0x1c,
         PROTOCOL_BINARY_CMD_GAT = 0x1d,
         PROTOCOL_BINARY_CMD_GATQ = 0x1e,
+        PROTOCOL_BINARY_CMD_HELLO = 0x1f,
 
         PROTOCOL_BINARY_CMD_SASL_LIST_MECHS = 0x20,
         PROTOCOL_BINARY_CMD_SASL_AUTH = 0x21,
@@ -477,6 +478,32 @@ extern "C"
     typedef protocol_binary_response_get protocol_binary_response_gat;
     typedef protocol_binary_response_get protocol_binary_response_gatq;
 
+    /**
+     * The features a client may ask for with the HELLO command. The
+     * body of the request is a list of the features (16 bit each, in
+     * network byte order) and the body of the response is the list of
+     * the features the server enabled.
+     */
+    typedef enum {
+        /**
+         * The server may execute the requests on the connection in any
+         * order, and the client matches the responses to the requests
+         * by the opaque field.
+         */
+        PROTOCOL_BINARY_FEATURE_UNORDERED_EXECUTION = 0x0e
+    } protocol_binary_hello_features;
+
+    /**
+     * Definition of the packet used by the HELLO command. The key is the
+     * name of the client (may be empty).
+     */
+    typedef protocol_binary_request_no_extras protocol_binary_request_hello;
+
+    /**
+     * Definition of the packet returned from the HELLO command
+     */
+    typedef protocol_binary_response_no_extras protocol_binary_response_hello;
+
 
     /**
      * Definition of a request for a range operation.
@@ -0,0 +1,389 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Loopback benchmark for the network backends of the daemon. Starts
+ * ./memcached once with the libevent backend and once with the io_uring
+ * backend (MEMCACHED_IO_URING), drives both with the same pipelined ascii
+ * get load and reports the throughput and the CPU time the server spent
+ * per request.
+ *
+ * usage: io_bench [-c connections] [-C client threads] [-d depth]
+ *                 [-s value size] [-t seconds] [-T server threads]
+ */
+#include "config.h"
+#include <assert.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <memcached/util.h>
+
+#define NKEYS 1024
+
+static int connections = 32;
+static int client_threads = 2;
+static int depth = 16;
+static int value_size = 32;
+static int duration = 5;
+static int server_threads = 4;
+
+static volatile int running;
+
+struct client {
+    pthread_t tid;
+    int *socks;
+    int nsocks;
+    int offset;
+    uint64_t ops;
+};
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static pid_t start_server(bool use_uring, in_port_t *port_out) {
+    char filename[80];
+    snprintf(filename, sizeof(filename), "/tmp/io_bench.ports.%lu",
+             (unsigned long)getpid());
+    remove(filename);
+
+    char engine[1024];
+    char logger[1024];
+    assert(getcwd(engine, sizeof(engine)));
+    strcpy(logger, engine);
+    strcat(engine, "/.libs/default_engine.so");
+    strcat(logger, "/.libs/blackhole_logger.so");
+
+    char threads[16];
+    snprintf(threads, sizeof(threads), "%d", server_threads);
+
+    pid_t pid = fork();
+    assert(pid != -1);
+
+    if (pid == 0) {
+        char *argv[20];
+        int arg = 0;
+
+        setenv("MEMCACHED_PORT_FILENAME", filename, 1);
+        setenv("MEMCACHED_IO_URING", use_uring ? "1" : "0", 1);
+        argv[arg++] = "./memcached";
+        argv[arg++] = "-E";
+        argv[arg++] = engine;
+        argv[arg++] = "-X";
+        argv[arg++] = logger;
+        argv[arg++] = "-p";
+        argv[arg++] = "-1";
+        argv[arg++] = "-U";
+        argv[arg++] = "0";
+        argv[arg++] = "-t";
+        argv[arg++] = threads;
+        argv[arg++] = "-c";
+        argv[arg++] = "4096";
+        if (getuid() == 0) {
+            argv[arg++] = "-u";
+            argv[arg++] = "root";
+        }
+        argv[arg++] = NULL;
+        execv(argv[0], argv);
+        fprintf(stderr, "Failed to start ./memcached: %s\n", strerror(errno));
+        _exit(1);
+    }
+
+    while (access(filename, F_OK) == -1) {
+        usleep(10);
+    }
+    FILE *fp = fopen(filename, "r");
+    assert(fp != NULL);
+
+    *port_out = 0;
+    char buffer[80];
+    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+        if (strncmp(buffer, "TCP INET: ", 10) == 0) {
+            int32_t val;
+            assert(safe_strtol(buffer + 10, &val));
+            *port_out = (in_port_t)val;
+        }
+    }
+    fclose(fp);
+    remove(filename);
+
+    return pid;
+}
+
+static int connect_server(in_port_t port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    assert(sock != -1);
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "Failed to connect: %s\n", strerror(errno));
+        exit(1);
+    }
+    int flag = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    return sock;
+}
+
+static void send_all(int sock, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t nw = send(sock, buf, len, 0);
+        if (nw == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "send: %s\n", strerror(errno));
+            exit(1);
+        }
+        buf += nw;
+        len -= nw;
+    }
+}
+
+/*
+ * Read from the socket until we've seen the given number of responses
+ * terminated by needle (which must not overlap itself).
+ */
+static void wait_responses(int sock, const char *needle, int count) {
+    size_t len = strlen(needle);
+    size_t matched = 0;
+    char buf[16384];
+
+    while (count > 0) {
+        ssize_t nr = recv(sock, buf, sizeof(buf), 0);
+        if (nr <= 0) {
+            if (nr == -1 && errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Lost connection to the server\n");
+            exit(1);
+        }
+        for (ssize_t ii = 0; ii < nr; ++ii) {
+            if (buf[ii] == needle[matched]) {
+                if (++matched == len) {
+                    --count;
+                    matched = 0;
+                }
+            } else {
+                matched = (buf[ii] == needle[0]) ? 1 : 0;
+            }
+        }
+    }
+}
+
+static void populate(in_port_t port) {
+    int sock = connect_server(port);
+    char *value = malloc(value_size);
+    assert(value != NULL);
+    memset(value, 'x', value_size);
+
+    for (int ii = 0; ii < NKEYS; ++ii) {
+        char cmd[80];
+        int len = snprintf(cmd, sizeof(cmd), "set key%d 0 0 %d noreply\r\n",
+                           ii, value_size);
+        send_all(sock, cmd, len);
+        send_all(sock, value, value_size);
+        send_all(sock, "\r\n", 2);
+    }
+    send_all(sock, "version\r\n", 9);
+    wait_responses(sock, "\r\n", 1);
+    close(sock);
+    free(value);
+}
+
+static void *client_main(void *arg) {
+    struct client *cl = arg;
+    char *batch = malloc(depth * 32);
+    assert(batch != NULL);
+    int key = cl->offset;
+
+    while (running) {
+        for (int ii = 0; ii < cl->nsocks; ++ii) {
+            size_t len = 0;
+            for (int jj = 0; jj < depth; ++jj) {
+                len += sprintf(batch + len, "get key%d\r\n", key);
+                key = (key + 1) % NKEYS;
+            }
+            send_all(cl->socks[ii], batch, len);
+        }
+        for (int ii = 0; ii < cl->nsocks; ++ii) {
+            wait_responses(cl->socks[ii], "END\r\n", depth);
+            cl->ops += depth;
+        }
+    }
+
+    free(batch);
+    return NULL;
+}
+
+/* Get the CPU time (user + system) used by the process, in seconds */
+static double process_cpu(pid_t pid) {
+    char fname[64];
+    char buffer[1024];
+    snprintf(fname, sizeof(fname), "/proc/%lu/stat", (unsigned long)pid);
+    FILE *fp = fopen(fname, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    size_t nr = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    fclose(fp);
+    buffer[nr] = '\0';
+
+    /* utime and stime are field 14 and 15, counted after the comm field */
+    char *ptr = strrchr(buffer, ')');
+    unsigned long utime = 0, stime = 0;
+    if (ptr == NULL ||
+        sscanf(ptr + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+               &utime, &stime) != 2) {
+        return 0;
+    }
+    return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+/* Ask the server which network backend it ended up using */
+static void server_backend(in_port_t port, char backend[32]) {
+    int sock = connect_server(port);
+    char buf[8192];
+    size_t offset = 0;
+
+    buf[0] = '\0';
+    send_all(sock, "stats settings\r\n", 16);
+    while (strstr(buf, "END\r\n") == NULL) {
+        ssize_t nr = recv(sock, buf + offset, sizeof(buf) - offset - 1, 0);
+        if (nr <= 0) {
+            break;
+        }
+        offset += nr;
+        buf[offset] = '\0';
+    }
+    close(sock);
+
+    char *ptr = strstr(buf, "STAT io_backend ");
+    if (ptr != NULL) {
+        sscanf(ptr + 16, "%31s", backend);
+    }
+}
+
+static void run(bool use_uring) {
+    in_port_t port;
+    pid_t pid = start_server(use_uring, &port);
+    char backend[32] = "unknown";
+
+    populate(port);
+    server_backend(port, backend);
+    if (use_uring && strcmp(backend, "io_uring") != 0) {
+        printf("%-9s not available (server uses %s)\n", "io_uring", backend);
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        return;
+    }
+
+    struct client *clients = calloc(client_threads, sizeof(*clients));
+    assert(clients != NULL);
+    for (int ii = 0; ii < client_threads; ++ii) {
+        clients[ii].nsocks = connections / client_threads +
+            (ii < connections % client_threads ? 1 : 0);
+        clients[ii].socks = calloc(clients[ii].nsocks, sizeof(int));
+        clients[ii].offset = ii * 97;
+        assert(clients[ii].socks != NULL);
+        for (int jj = 0; jj < clients[ii].nsocks; ++jj) {
+            clients[ii].socks[jj] = connect_server(port);
+        }
+    }
+
+    running = 1;
+    double cpu = process_cpu(pid);
+    double start = now();
+    for (int ii = 0; ii < client_threads; ++ii) {
+        pthread_create(&clients[ii].tid, NULL, client_main, &clients[ii]);
+    }
+    sleep(duration);
+    running = 0;
+
+    uint64_t ops = 0;
+    for (int ii = 0; ii < client_threads; ++ii) {
+        pthread_join(clients[ii].tid, NULL);
+        ops += clients[ii].ops;
+    }
+    double elapsed = now() - start;
+    cpu = process_cpu(pid) - cpu;
+
+    printf("%-9s %10.0f ops/s %8.2f us cpu/op %6.0f%% cpu\n", backend,
+           ops / elapsed, cpu * 1e6 / ops, cpu * 100 / elapsed);
+
+    for (int ii = 0; ii < client_threads; ++ii) {
+        for (int jj = 0; jj < clients[ii].nsocks; ++jj) {
+            close(clients[ii].socks[jj]);
+        }
+        free(clients[ii].socks);
+    }
+    free(clients);
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+int main(int argc, char **argv) {
+    int cmd;
+
+    while ((cmd = getopt(argc, argv, "c:C:d:s:t:T:")) != EOF) {
+        switch (cmd) {
+        case 'c':
+            connections = atoi(optarg);
+            break;
+        case 'C':
+            client_threads = atoi(optarg);
+            break;
+        case 'd':
+            depth = atoi(optarg);
+            break;
+        case 's':
+            value_size = atoi(optarg);
+            break;
+        case 't':
+            duration = atoi(optarg);
+            break;
+        case 'T':
+            server_threads = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr,
+                    "Usage: %s [-c connections] [-C client threads] [-d depth]\n"
+                    "          [-s value size] [-t seconds] [-T server threads]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (connections <= 0 || client_threads <= 0 || depth <= 0 ||
+        value_size <= 0 || duration <= 0 || server_threads <= 0 ||
+        client_threads > connections) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    printf("%d connections, %d client threads, pipeline depth %d, "
+           "%d byte values, %d server threads\n", connections,
+           client_threads, depth, value_size, server_threads);
+
+    run(false);
+    run(true);
+    return 0;
+}
@@ -21,6 +21,7 @@
 #include <ctype.h>
 
 #include "cache.h"
+#include "tokenizer.h"
 #include <memcached/util.h>
 #include <memcached/protocol_binary.h>
 #include <memcached/config_parser.h>
@@ -225,6 +226,90 @@ static enum test_return test_safe_strtoull(void) {
     return TEST_PASS;
 }
 
+/*
+ * Run the same input through the scalar tokenizer and the one we'd pick
+ * at startup and verify that they produce identical output.
+ */
+static void verify_tokenizer(const tokenizer_t *tok, const char *input,
+                             size_t max_tokens) {
+    const tokenizer_t *scalar = tokenizer_lookup("scalar");
+    /* keep the copies at different alignments */
+    char abuf[512] __attribute__((aligned(16)));
+    char bbuf[512] __attribute__((aligned(16)));
+    size_t len = strlen(input);
+    assert(len + 8 < sizeof(abuf));
+    char *a = abuf + (len % 16);
+    char *b = bbuf + 3;
+    memcpy(a, input, len + 1);
+    memcpy(b, input, len + 1);
+
+    token_t atok[32], btok[32];
+    assert(max_tokens <= 32);
+    size_t an = scalar->tokenize(a, atok, max_tokens);
+    size_t bn = tok->tokenize(b, btok, max_tokens);
+    assert(an == bn);
+    for (size_t ii = 0; ii < an; ++ii) {
+        assert(atok[ii].length == btok[ii].length);
+        if (atok[ii].value == NULL) {
+            assert(btok[ii].value == NULL);
+        } else {
+            assert(btok[ii].value != NULL);
+            assert(atok[ii].value - a == btok[ii].value - b);
+        }
+    }
+    assert(memcmp(a, b, len + 1) == 0);
+
+    uint32_t aoff[8], boff[8];
+    size_t ascan, bscan;
+    for (size_t max = 1; max <= 8; ++max) {
+        an = scalar->find_lines(input, len, aoff, max, &ascan);
+        bn = tok->find_lines(input, len, boff, max, &bscan);
+        assert(an == bn && ascan == bscan);
+        assert(memcmp(aoff, boff, an * sizeof(aoff[0])) == 0);
+    }
+}
+
+static enum test_return test_tokenizer(void) {
+    const char *inputs[] = {
+        "",
+        " ",
+        "get",
+        "get foo",
+        "  get   foo  bar ",
+        "set key 0 0 5",
+        "get a b c d e f g h i j k l m n o p q r s t u v w x y z 1 2 3 4 5 6",
+        "get keys_that_are_longer_than_sixteen_bytes another_long_key_here",
+        "gets\n\nfoo\nbar baz\n quux \n",
+        "stats\r\nget a\r\nget b\r\n\r\n",
+        NULL
+    };
+    const tokenizer_t *tok = tokenizer_select(NULL);
+    assert(tok != NULL);
+    assert(tokenizer_lookup("scalar") != NULL);
+    assert(tokenizer_lookup("bogus") == NULL);
+
+    for (int ii = 0; inputs[ii] != NULL; ++ii) {
+        for (size_t max = 2; max < 32; ++max) {
+            verify_tokenizer(tok, inputs[ii], max);
+        }
+    }
+
+    /* And some random garbage made of the interesting characters */
+    const char alphabet[] = "ab \n\r";
+    char input[300];
+    srand(0xcafe);
+    for (int ii = 0; ii < 2000; ++ii) {
+        size_t len = rand() % (sizeof(input) - 1);
+        for (size_t jj = 0; jj < len; ++jj) {
+            input[jj] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        input[len] = '\0';
+        verify_tokenizer(tok, input, 2 + rand() % 30);
+    }
+
+    return TEST_PASS;
+}
+
 static enum test_return test_safe_strtoll(void) {
     int64_t val;
     assert(safe_strtoll("123", &val));
@@ -2113,6 +2198,7 @@ struct testcase testcases[] = {
     { "strtoll", test_safe_strtoll },
     { "strtoul", test_safe_strtoul },
     { "strtoull", test_safe_strtoull },
+    { "tokenizer", test_tokenizer },
     { "issue_44", test_issue_44 },
     { "vperror", test_vperror },
     { "issue_101", test_issue_101 },
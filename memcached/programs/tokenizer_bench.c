@@ -0,0 +1,167 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Microbenchmark for the ascii protocol tokenizers. Builds a read buffer
+ * full of pipelined multi-get commands and measures how long it takes
+ * each implementation to split it into lines and tokens, the same way
+ * try_read_command() and process_command() do it.
+ *
+ * usage: tokenizer_bench [-k keys per get] [-l key length] [-n iterations]
+ */
+#include "config.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "tokenizer.h"
+
+#define MAX_TOKENS 30
+#define BUFFER_SIZE (256 * 1024)
+
+static char *build_pipeline(size_t nkeys, size_t keylen, size_t *size) {
+    char *buf = malloc(BUFFER_SIZE);
+    size_t offset = 0;
+    size_t ii = 0;
+    assert(buf != NULL);
+
+    for (;;) {
+        size_t need = 4 + nkeys * (keylen + 1) + 2;
+        if (offset + need >= BUFFER_SIZE) {
+            break;
+        }
+        memcpy(buf + offset, "get", 3);
+        offset += 3;
+        for (size_t jj = 0; jj < nkeys; ++jj, ++ii) {
+            char key[64];
+            snprintf(key, sizeof(key), "%0*lu", (int)keylen, (unsigned long)ii);
+            buf[offset++] = ' ';
+            memcpy(buf + offset, key, keylen);
+            offset += keylen;
+        }
+        memcpy(buf + offset, "\r\n", 2);
+        offset += 2;
+    }
+
+    *size = offset;
+    return buf;
+}
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * Consume the whole buffer like the daemon does: find the line
+ * terminators in batches, terminate each line and tokenize it (calling
+ * tokenize again for the remainder of long multi-gets).
+ */
+static size_t parse_buffer(const tokenizer_t *tok, char *buf, size_t size) {
+    uint32_t eol[32];
+    token_t tokens[MAX_TOKENS];
+    size_t scanned = 0;
+    size_t start = 0;
+    size_t ntok = 0;
+
+    while (scanned < size) {
+        size_t nscanned;
+        size_t count = tok->find_lines(buf + scanned, size - scanned, eol,
+                                       sizeof(eol) / sizeof(eol[0]),
+                                       &nscanned);
+        for (size_t ii = 0; ii < count; ++ii) {
+            char *el = buf + scanned + eol[ii];
+            if (el > buf + start && el[-1] == '\r') {
+                --el;
+            }
+            *el = '\0';
+
+            size_t n = tok->tokenize(buf + start, tokens, MAX_TOKENS);
+            ntok += n;
+            while (tokens[n - 1].value != NULL) {
+                n = tok->tokenize(tokens[n - 1].value, tokens, MAX_TOKENS);
+                ntok += n;
+            }
+            start = scanned + eol[ii] + 1;
+        }
+        scanned += nscanned;
+    }
+
+    return ntok;
+}
+
+int main(int argc, char **argv) {
+    size_t nkeys = 100;
+    size_t keylen = 16;
+    int iterations = 200;
+    int cmd;
+
+    while ((cmd = getopt(argc, argv, "k:l:n:")) != EOF) {
+        switch (cmd) {
+        case 'k':
+            nkeys = atoi(optarg);
+            break;
+        case 'l':
+            keylen = atoi(optarg);
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr,
+                    "Usage: %s [-k keys per get] [-l key length] [-n iterations]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (nkeys == 0 || keylen == 0 || keylen > 60 || iterations <= 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    size_t size;
+    char *pristine = build_pipeline(nkeys, keylen, &size);
+    char *buf = malloc(size);
+    const char *names[] = { "scalar", "sse2", NULL };
+    assert(buf != NULL);
+
+    /* Restoring the buffer isn't part of the parse cost */
+    double start = now();
+    for (int jj = 0; jj < iterations; ++jj) {
+        memcpy(buf, pristine, size);
+    }
+    double overhead = now() - start;
+
+    printf("%lu bytes, %lu keys per get, key length %lu\n",
+           (unsigned long)size, (unsigned long)nkeys, (unsigned long)keylen);
+
+    for (int ii = 0; names[ii] != NULL; ++ii) {
+        const tokenizer_t *tok = tokenizer_lookup(names[ii]);
+        if (tok == NULL) {
+            printf("%-8s not supported\n", names[ii]);
+            continue;
+        }
+
+        memcpy(buf, pristine, size);
+        size_t ntok = parse_buffer(tok, buf, size);
+        start = now();
+        for (int jj = 0; jj < iterations; ++jj) {
+            memcpy(buf, pristine, size);
+            if (parse_buffer(tok, buf, size) != ntok) {
+                fprintf(stderr, "%s: inconsistent result\n", tok->name);
+                return 1;
+            }
+        }
+        double elapsed = now() - start - overhead;
+        printf("%-8s %8.1f MB/s %8.2f ns/token\n", tok->name,
+               (double)size * iterations / elapsed / (1024 * 1024),
+               elapsed * 1e9 / ((double)ntok * iterations));
+    }
+
+    free(buf);
+    free(pristine);
+    return 0;
+}
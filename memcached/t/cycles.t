@@ -0,0 +1,67 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 19;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, 'settings');
+is($settings->{cycle_stats}, "off", "No cycle stats by default");
+
+my $stats = mem_stats($sock, 'cycles');
+is(join(",", keys %$stats), "cycles_per_usec", "Nothing accounted");
+
+print $sock "cycles bogus\r\n";
+is(scalar <$sock>, "ERROR\r\n", "cycles bogus");
+print $sock "cycles on\r\n";
+is(scalar <$sock>, "OK\r\n", "cycles on");
+$settings = mem_stats($sock, 'settings');
+is($settings->{cycle_stats}, "on", "Cycle stats enabled");
+
+# A command is accounted once its response is sent, so read the stats
+# on the connection which did the commands.
+print $sock "set foo 0 0 6\r\nfooval\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored foo");
+mem_get_is($sock, "foo", "fooval");
+
+$stats = mem_stats($sock, 'cycles');
+is($stats->{'ascii_set:count'}, 1, "ascii set accounted");
+is($stats->{'ascii_get:count'}, 1, "ascii get accounted");
+ok($stats->{'ascii_get:engine_cycles'} > 0, "Cycles spent in the engine");
+ok($stats->{'ascii_get:response_cycles'} > 0, "Cycles spent responding");
+is($stats->{'ascii_stats:count'}, 1, "stats settings accounted");
+
+# The binary protocol
+my $bsock = $server->new_sock;
+print $bsock pack("CCnCCnNNNN", 0x80, 0x00, 3, 0, 0, 0, 3, 0, 0, 0) . "foo";
+my $header;
+read($bsock, $header, 24);
+my ($bodylen) = unpack("x8N", $header);
+read($bsock, my $body, $bodylen);
+
+my %bstats = ();
+print $bsock pack("CCnCCnNNNN", 0x80, 0x10, 6, 0, 0, 0, 6, 0, 0, 0) . "cycles";
+while (1) {
+    read($bsock, $header, 24);
+    my ($keylen, $len) = unpack("x2n x4 N", $header);
+    last if ($keylen == 0);
+    read($bsock, $body, $len);
+    $bstats{substr($body, 0, $keylen)} = substr($body, $keylen);
+}
+is($bstats{'bin_get:count'}, 1, "binary get accounted");
+ok(defined($bstats{'bin_get:parse_cycles'}), "parse cycles");
+
+print $sock "cycles off\r\n";
+is(scalar <$sock>, "OK\r\n", "cycles off");
+mem_get_is($sock, "foo", "fooval");
+$stats = mem_stats($sock, 'cycles');
+is($stats->{'ascii_get:count'}, 1, "Nothing accounted after cycles off");
+
+print $sock "stats reset\r\n";
+is(scalar <$sock>, "RESET\r\n", "stats reset");
+$stats = mem_stats($sock, 'cycles');
+is(join(",", keys %$stats), "cycles_per_usec", "Everything was reset");
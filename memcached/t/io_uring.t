@@ -0,0 +1,71 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+$ENV{"MEMCACHED_IO_URING"} = "1";
+my $server = new_memcached();
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, 'settings');
+if ($settings->{io_backend} ne "io_uring") {
+    plan skip_all => 'io_uring is not available';
+    exit 0;
+}
+plan tests => 11;
+
+print $sock "set foo 0 0 3\r\nbar\r\n";
+is (scalar <$sock>, "STORED\r\n", "stored foo");
+mem_get_is($sock, "foo", "bar");
+
+# Pipelined requests are answered in order
+my $count = 500;
+print $sock "get foo\r\n" x $count;
+my $ok = 0;
+for (my $ii = 0; $ii < $count; ++$ii) {
+    $ok++ if (scalar <$sock> eq "VALUE foo 0 3\r\n" &&
+              scalar <$sock> eq "bar\r\n" &&
+              scalar <$sock> eq "END\r\n");
+}
+is ($ok, $count, "pipelined gets");
+
+# Values larger than the receive buffers and the outbox watermark
+my $len = 1024 * 1000;
+my $big = "B" x $len;
+print $sock "set big 0 0 $len\r\n$big\r\n";
+is (scalar <$sock>, "STORED\r\n", "stored big");
+print $sock "get big\r\n";
+is (scalar <$sock>, "VALUE big 0 $len\r\n", "big header");
+my $data = scalar <$sock>;
+ok ($data eq "$big\r\n", "big value");
+is (scalar <$sock>, "END\r\n", "big end");
+
+# Small responses queued ahead of a large one go out first
+$count = 20;
+print $sock "get foo\r\nget big\r\nget foo\r\n" x $count;
+$ok = 0;
+for (my $ii = 0; $ii < $count; ++$ii) {
+    for my $pair (["foo", "bar"], ["big", $big], ["foo", "bar"]) {
+        my ($key, $val) = @$pair;
+        my $vlen = length($val);
+        $ok++ if (scalar <$sock> eq "VALUE $key 0 $vlen\r\n" &&
+                  scalar <$sock> eq "$val\r\n" &&
+                  scalar <$sock> eq "END\r\n");
+    }
+}
+is ($ok, 3 * $count, "mixed pipelined gets");
+
+# The data for an item we can't store is swallowed
+$len = 2 * 1024 * 1024;
+print $sock "set toobig 0 0 $len\r\n" . ("T" x $len) . "\r\n";
+is (scalar <$sock>, "SERVER_ERROR object too large for cache\r\n",
+    "object too large");
+
+# Other connections keep working
+my $sock2 = $server->new_sock;
+print $sock2 "get foo\r\n";
+is (scalar <$sock2>, "VALUE foo 0 3\r\n", "new connection");
+is (scalar <$sock2>, "bar\r\n", "new connection value");
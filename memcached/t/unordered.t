@@ -0,0 +1,123 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 22;
+use Cwd;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# The engine takes a while to "fetch" the keys starting with "cold"
+my $engine = getcwd . "/.libs/ewouldblock_engine.so";
+my $server = new_memcached("-E $engine");
+my $sock = $server->sock;
+
+use constant CMD_GET     => 0x00;
+use constant CMD_SET     => 0x01;
+use constant CMD_NOOP    => 0x0a;
+use constant CMD_GETK    => 0x0c;
+use constant CMD_GETKQ   => 0x0d;
+use constant CMD_HELLO   => 0x1f;
+use constant UNORDERED   => 0x0e;
+
+sub request {
+    my ($cmd, $key, $body, $opaque, $extra) = @_;
+    $extra = '' unless defined $extra;
+    $body = '' unless defined $body;
+    return pack("CCnCCnNNNN", 0x80, $cmd, length($key), length($extra), 0, 0,
+                length($key) + length($extra) + length($body), $opaque,
+                0, 0) . $extra . $key . $body;
+}
+
+sub response {
+    my $s = shift;
+    my $header;
+    read($s, $header, 24) == 24 or return undef;
+    my ($magic, $cmd, $keylen, $extlen, $datatype, $status, $bodylen,
+        $opaque) = unpack("CCnCCnNN", $header);
+    my $body = '';
+    read($s, $body, $bodylen) if ($bodylen > 0);
+    return { cmd => $cmd, status => $status, opaque => $opaque,
+             key => substr($body, $extlen, $keylen),
+             value => substr($body, $extlen + $keylen) };
+}
+
+sub hello {
+    my ($s, @features) = @_;
+    print $s request(CMD_HELLO, "unordered.t", pack("n*", @features), 0);
+    my $rsp = response($s);
+    is($rsp->{status}, 0, "HELLO succeeded");
+    return unpack("n*", $rsp->{value});
+}
+
+foreach my $key ("cold1", "hot1", "hot2") {
+    my $value = "v_$key";
+    print $sock "set $key 0 0 " . length($value) . "\r\n$value\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored $key");
+}
+
+# A batch of gets where the first one has to wait for the engine
+my $batch = request(CMD_GETKQ, "cold1", '', 1) .
+    request(CMD_GETK, "hot1", '', 2) .
+    request(CMD_GETKQ, "hot2", '', 3) .
+    request(CMD_GETKQ, "missing", '', 4) .
+    request(CMD_NOOP, "", '', 5);
+
+sub run_batch {
+    my $s = shift;
+    print $s $batch;
+    my @order = ();
+    while (1) {
+        my $rsp = response($s);
+        last unless defined $rsp;
+        push(@order, $rsp->{opaque});
+        last if ($rsp->{cmd} == CMD_NOOP);
+    }
+    return join(",", @order);
+}
+
+my $ordered = $server->new_sock;
+is(run_batch($ordered), "1,2,3,5", "Responses are in order by default");
+
+my $unordered = $server->new_sock;
+is_deeply([hello($unordered, 0x99, UNORDERED)], [UNORDERED],
+          "Unordered execution enabled");
+is(run_batch($unordered), "2,3,1,5",
+   "The cold get completes last, but before the NOOP");
+
+# The parked get still gets its own response
+print $unordered request(CMD_GETK, "cold1", '', 7) .
+    request(CMD_GETK, "hot1", '', 8);
+my $rsp = response($unordered);
+is($rsp->{opaque}, 8, "The hot get completes first");
+$rsp = response($unordered);
+is($rsp->{opaque}, 7, "Then the cold one");
+is($rsp->{key}, "cold1", "with its own key");
+is($rsp->{value}, "v_cold1", "and value");
+
+print $unordered request(CMD_GET, "cold_missing", '', 9);
+$rsp = response($unordered);
+is($rsp->{opaque}, 9, "Missing cold key");
+is($rsp->{status}, 1, "is not found");
+is($rsp->{value}, "Not found", "with a message");
+
+# Any other command waits for the parked gets
+print $unordered request(CMD_GETKQ, "cold1", '', 10) .
+    request(CMD_SET, "hot1", "new", 11, pack("NN", 0, 0)) .
+    request(CMD_GETK, "hot1", '', 12);
+is(response($unordered)->{opaque}, 10, "The set waits for the cold get");
+is(response($unordered)->{opaque}, 11, "Set");
+is(response($unordered)->{value}, "new", "The get after the set");
+
+# Turn it off again
+is_deeply([hello($unordered)], [], "Unordered execution disabled");
+is(run_batch($unordered), "1,2,3,5", "Back to ordered responses");
+
+# Close a connection while its gets are parked
+my $closed = $server->new_sock;
+hello($closed, UNORDERED);
+print $closed request(CMD_GETKQ, "cold1", '', 1) .
+    request(CMD_GETKQ, "cold2", '', 2);
+close($closed);
+select(undef, undef, undef, 0.4);
+mem_get_is($sock, "hot2", "v_hot2");
@@ -0,0 +1,116 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 23;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, 'settings');
+is($settings->{vbucket_stats}, 0, "No vbucket stats by default");
+
+# An operation is accounted once its response is sent, so the stats are
+# always read on the connection which did the operations to make sure
+# they're all accounted.
+$ENV{"MEMCACHED_VBUCKET_STATS"} = "16";
+$server = new_memcached();
+$sock = $server->sock;
+
+# The ascii protocol doesn't carry a vbucket, so ascii commands aren't
+# accounted to any of them
+print $sock "set foo 0 0 6\r\nfooval\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored foo");
+mem_get_is($sock, "foo", "fooval");
+mem_get_is($sock, "bar", undef);
+print $sock "delete bar\r\n";
+is(scalar <$sock>, "NOT_FOUND\r\n", "bar not found");
+
+my $stats = mem_stats($sock, 'vbucket-details');
+is(join(",", keys %$stats), "", "ascii commands aren't accounted");
+
+# Binary requests are accounted to the vbucket in the header. Send the
+# stats requests to a vbucket of their own so they don't show up in the
+# stats for the vbuckets we're testing.
+my $bsock = $server->new_sock;
+
+sub binary_request {
+    my ($cmd, $key, $vbucket) = @_;
+    my $msg = pack("CCnCCnNNNN", 0x80, $cmd, length($key), 0, 0, $vbucket,
+                   length($key), 0, 0, 0) . $key;
+    print $bsock $msg;
+}
+
+my $received = 0;
+
+sub binary_response {
+    my $header;
+    read($bsock, $header, 24);
+    my ($magic, $cmd, $keylen, $extralen, $datatype, $status, $bodylen) =
+        unpack("CCnCCnN", $header);
+    my $body = '';
+    read($bsock, $body, $bodylen) if ($bodylen > 0);
+    $received += 24 + $bodylen;
+    return ($status, substr($body, $extralen, $keylen),
+            substr($body, $extralen + $keylen));
+}
+
+sub binary_get {
+    my ($key, $vbucket) = @_;
+    binary_request(0x00, $key, $vbucket);
+    my ($status) = binary_response();
+    return $status;
+}
+
+sub vbucket_details {
+    my %stats = ();
+    binary_request(0x10, "vbucket-details", 15);
+    while (1) {
+        my ($status, $key, $value) = binary_response();
+        last if ($key eq '');
+        $stats{$key} = $value;
+    }
+    return \%stats;
+}
+
+is(binary_get("foo", 0), 0, "got foo");
+isnt(binary_get("bar", 0), 0, "bar is missing");
+my $sent = $received;
+
+$stats = vbucket_details();
+is($stats->{'vb_0:ops'}, 2, "vb_0 ops");
+is($stats->{'vb_0:misses'}, 1, "vb_0 misses");
+is($stats->{'vb_0:bytes_in'}, 2 * (24 + 3), "vb_0 bytes_in");
+is($stats->{'vb_0:bytes_out'}, $sent, "vb_0 bytes_out");
+
+my $histogram = 0;
+foreach my $key (keys %$stats) {
+    $histogram += $stats->{$key} if ($key =~ /^vb_0:latency_/);
+}
+is($histogram, 2, "Every operation is in the latency histogram");
+
+isnt(binary_get("foo", 5), 0, "vbucket 5 isn't active");
+binary_get("foo", 5);
+binary_get("foo", 99);
+
+$stats = vbucket_details();
+is($stats->{'vb_5:ops'}, 2, "vb_5 ops");
+is($stats->{'vb_5:bytes_in'}, 2 * (24 + 3), "vb_5 bytes_in");
+ok(!defined($stats->{'vb_99:ops'}), "vbuckets beyond the limit are ignored");
+is($stats->{'vb_15:ops'}, 1, "Only the earlier stats request is accounted");
+is($stats->{'vb_0:ops'}, 2, "The ascii stats request isn't accounted");
+
+# A reset clears everything up to (but not including) the reset itself
+binary_request(0x10, "reset", 15);
+binary_response();
+$stats = vbucket_details();
+is(join(",", sort grep { !/:latency_/ } keys %$stats),
+   "vb_15:bytes_in,vb_15:bytes_out,vb_15:misses,vb_15:ops",
+   "Everything was reset");
+is($stats->{'vb_15:ops'}, 1, "Only the reset itself is accounted");
+is($stats->{'vb_15:bytes_in'}, 24 + length("reset"), "reset bytes_in");
+
+$settings = mem_stats($sock, 'settings');
+is($settings->{vbucket_stats}, 16, "Tracking 16 vbuckets");
@@ -0,0 +1,87 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * The default engine, except that it pretends to fetch the items with a
+ * key starting with "cold" from disk: the first get of such a key returns
+ * EWOULDBLOCK, and the cookie is notified from another thread a while
+ * later. Like ep-engine, it remembers that the item was fetched in the
+ * engine specific data of the cookie. Used by the tests for the requests
+ * the engine completes in the background (t/unordered.t).
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <memcached/engine.h>
+
+#undef create_instance
+
+/* The time it takes to "fetch" a cold item */
+#define COLD_FETCH_USEC 200000
+
+ENGINE_ERROR_CODE default_engine_create_instance(uint64_t interface,
+                                                 GET_SERVER_API get_server_api,
+                                                 ENGINE_HANDLE **handle);
+MEMCACHED_PUBLIC_API
+ENGINE_ERROR_CODE create_instance(uint64_t interface,
+                                  GET_SERVER_API get_server_api,
+                                  ENGINE_HANDLE **handle);
+
+static SERVER_HANDLE_V1 *server;
+static ENGINE_ERROR_CODE (*default_get)(ENGINE_HANDLE *handle,
+                                        const void *cookie,
+                                        item **item,
+                                        const void *key,
+                                        const int nkey,
+                                        uint16_t vbucket);
+
+/* Stored with a cookie when its item was fetched */
+static char fetched;
+
+static void *fetch(void *cookie) {
+    usleep(COLD_FETCH_USEC);
+    server->cookie->store_engine_specific(cookie, &fetched);
+    server->cookie->notify_io_complete(cookie, ENGINE_SUCCESS);
+    return NULL;
+}
+
+static ENGINE_ERROR_CODE ewouldblock_get(ENGINE_HANDLE *handle,
+                                         const void *cookie,
+                                         item **item,
+                                         const void *key,
+                                         const int nkey,
+                                         uint16_t vbucket) {
+    if (server->cookie->get_engine_specific(cookie) == &fetched) {
+        server->cookie->store_engine_specific(cookie, NULL);
+    } else if (nkey >= 4 && memcmp(key, "cold", 4) == 0) {
+        pthread_t tid;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&tid, &attr, fetch, (void *)cookie) != 0) {
+            pthread_attr_destroy(&attr);
+            return ENGINE_TMPFAIL;
+        }
+        pthread_attr_destroy(&attr);
+        return ENGINE_EWOULDBLOCK;
+    }
+
+    return default_get(handle, cookie, item, key, nkey, vbucket);
+}
+
+ENGINE_ERROR_CODE create_instance(uint64_t interface,
+                                  GET_SERVER_API get_server_api,
+                                  ENGINE_HANDLE **handle) {
+    ENGINE_ERROR_CODE ret;
+    ret = default_engine_create_instance(interface, get_server_api, handle);
+    if (ret != ENGINE_SUCCESS) {
+        return ret;
+    }
+
+    server = get_server_api();
+    ENGINE_HANDLE_V1 *h1 = (ENGINE_HANDLE_V1 *)*handle;
+    default_get = h1->get;
+    h1->get = ewouldblock_get;
+    return ENGINE_SUCCESS;
+}
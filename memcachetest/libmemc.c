@@ -45,6 +45,12 @@
 #include <assert.h>
 #include <sys/uio.h>
 #include <math.h>
+#include <stdbool.h>
+
+#ifndef CMD_GET_LOCKED
+/* membase's get and lock, see command_ids.h in ep-engine */
+#define CMD_GET_LOCKED 0x94
+#endif
 
 struct Server {
     int sock;
@@ -53,6 +59,9 @@ struct Server {
     const char *peername;
     char *buffer;
     size_t buffersize;
+    /* the bucket to authenticate to whenever we (re)connect */
+    const char *bucket;
+    const char *password;
 };
 
 enum StoreCommand {add, set, replace};
@@ -61,19 +70,29 @@ struct Memcache {
     struct Server** servers;
     enum Protocol protocol;
     int no_servers;
+    const char *bucket;
+    const char *password;
 };
 
-static struct Server* server_create(const char *name, in_port_t port);
+static struct Server* server_create(const char *name, in_port_t port,
+                                    const char *bucket, const char *password);
 static void server_destroy(struct Server *server);
 static int textual_store(struct Server* server, enum StoreCommand cmd,
                          const struct Item *item);
 static int textual_get(struct Server* server, struct Item* item);
 static int binary_store(struct Server* server, enum StoreCommand cmd,
                         const struct Item *item);
-static int binary_get(struct Server* server, struct Item* item);
+static int binary_get(struct Server* server, struct Item* item, bool lock);
+static int binary_delete(struct Server* server, const struct Item *item);
+static int binary_incr(struct Server* server, const struct Item *item,
+                       uint64_t delta, uint64_t *value);
+static int binary_touch(struct Server* server, const struct Item *item);
+static int binary_auth(struct Server* server);
 static int libmemc_store(struct Memcache* handle, enum StoreCommand cmd, const struct Item *item);
 static int libmemc_store_backoff(struct Memcache* handle, enum StoreCommand cmd, const struct Item *item, int backoff);
 static struct Server *get_server(struct Memcache *handle, const char *key);
+static struct Server *get_connected_server(struct Memcache *handle,
+                                           const char *key);
 static int server_connect(struct Server *server);
 
 
@@ -130,7 +149,8 @@ int libmemc_add_server(struct Memcache *handle, const char *host, in_port_t port
     handle->servers = servers;
     free(old);
 
-    struct Server *server = server_create(host, port);
+    struct Server *server = server_create(host, port,
+                                          handle->bucket, handle->password);
     if (server != NULL) {
         handle->servers[handle->no_servers++] = server;
     }
@@ -138,6 +158,20 @@ int libmemc_add_server(struct Memcache *handle, const char *host, in_port_t port
     return 0;
 }
 
+/**
+ * Authenticate to the given bucket (SASL PLAIN, binary protocol only)
+ * on every connection to the servers added after this call.
+ */
+int libmemc_set_bucket(struct Memcache *handle, const char *bucket,
+                       const char *password) {
+    if (handle->protocol != Binary) {
+        return -1;
+    }
+    handle->bucket = bucket;
+    handle->password = password == NULL ? "" : password;
+    return 0;
+}
+
 int libmemc_add(struct Memcache *handle, const struct Item *item) {
     return libmemc_store(handle, add, item);
 }
@@ -150,6 +184,10 @@ int libmemc_replace(struct Memcache *handle, const struct Item *item) {
     return libmemc_store(handle, replace, item);
 }
 
+/*
+ * The lookups (get, getl, delete and touch) return 1 when the key doesn't
+ * exist, so that a miss can be told apart from an error.
+ */
 int libmemc_get(struct Memcache *handle, struct Item *item) {
     struct Server* server = get_server(handle, item->key);
     if (server == NULL) {
@@ -164,10 +202,10 @@ int libmemc_get(struct Memcache *handle, struct Item *item) {
         }
 
         if (handle->protocol == Binary) {
-            return binary_get(server, item);
+            return binary_get(server, item, false);
         } else {
             int ret = textual_get(server, item);
-            if(!ret) {
+            if (ret >= 0) {
                 return ret;
             } else if (ret == -2) { // something went wrong with the get
                 fprintf(stderr, "%s\n", server->errmsg);
@@ -181,6 +219,47 @@ int libmemc_get(struct Memcache *handle, struct Item *item) {
     }
 }
 
+/*
+ * The commands below only exist in the binary protocol (or we only
+ * bother to implement them there), and return -1 with the textual one.
+ */
+int libmemc_delete(struct Memcache *handle, const struct Item *item) {
+    struct Server* server = get_connected_server(handle, item->key);
+    if (server == NULL || handle->protocol != Binary) {
+        return -1;
+    }
+    return binary_delete(server, item);
+}
+
+int libmemc_incr(struct Memcache *handle, const struct Item *item,
+                 uint64_t delta, uint64_t *value) {
+    struct Server* server = get_connected_server(handle, item->key);
+    if (server == NULL || handle->protocol != Binary) {
+        return -1;
+    }
+    return binary_incr(server, item, delta, value);
+}
+
+int libmemc_touch(struct Memcache *handle, const struct Item *item) {
+    struct Server* server = get_connected_server(handle, item->key);
+    if (server == NULL || handle->protocol != Binary) {
+        return -1;
+    }
+    return binary_touch(server, item);
+}
+
+/**
+ * Get and lock an item (a membase extension). item->exptime holds the
+ * lock timeout in seconds, 0 leaves it to the server.
+ */
+int libmemc_getl(struct Memcache *handle, struct Item *item) {
+    struct Server* server = get_connected_server(handle, item->key);
+    if (server == NULL || handle->protocol != Binary) {
+        return -1;
+    }
+    return binary_get(server, item, true);
+}
+
 static struct addrinfo *lookuphost(const char *hostname, in_port_t port)
 {
     struct addrinfo *ai = 0;
@@ -244,13 +323,33 @@ static struct Server *get_server(struct Memcache *handle, const char *key) {
     if (handle->no_servers == 1) {
         return handle->servers[0];
     } else if (handle->no_servers > 0) {
-        int idx = simplehash(key) % handle->no_servers;
+        /*
+         * With a vbucket config the servers were added in the order of the
+         * config's server list, so the master's index is ours as well.
+         */
+        int idx = get_vbucket_master(get_vbucket(key, strlen(key)));
+        if (idx < 0 || idx >= handle->no_servers) {
+            idx = simplehash(key) % handle->no_servers;
+        }
         return handle->servers[idx];
     } else {
         return NULL;
     }
 }
 
+static struct Server *get_connected_server(struct Memcache *handle,
+                                           const char *key) {
+    struct Server* server = get_server(handle, key);
+    if (server != NULL && server->sock == -1) {
+        if (server_connect(server) == -1) {
+            fprintf(stderr, "%s\n", server->errmsg);
+            fflush(stderr);
+            return NULL;
+        }
+    }
+    return server;
+}
+
 static int libmemc_store(struct Memcache* handle, enum StoreCommand cmd,
                          const struct Item *item) {
     struct Server* server = get_server(handle, item->key);
@@ -345,7 +444,8 @@ void server_destroy(struct Server *server) {
     }
 }
 
-struct Server* server_create(const char *name, in_port_t port) {
+struct Server* server_create(const char *name, in_port_t port,
+                             const char *bucket, const char *password) {
     struct addrinfo* ai = lookuphost(name, port);
     struct Server* ret = NULL;
     if (ai != NULL) {
@@ -357,6 +457,8 @@ struct Server* server_create(const char *name, in_port_t port) {
             ret->addrinfo = ai;
             sprintf(buffer, "%s:%d", name, port);
             ret->peername = strdup(buffer);
+            ret->bucket = bucket;
+            ret->password = password;
             ret->buffer = malloc(1024 * 1024 + 256);
             ret->buffersize = 1024 * 1024 + 256;
             server_connect(ret);
@@ -404,6 +506,11 @@ static int server_connect(struct Server *server)
         return -1;
     }
 
+    if (server->bucket != NULL && binary_auth(server) != 0) {
+        server_disconnect(server);
+        return -1;
+    }
+
     return 0;
 }
 
@@ -508,27 +615,37 @@ static int64_t swap64(int64_t in) {
     return in;
 #endif
 }
+
+static void server_set_errmsg(struct Server *server, char *errmsg) {
+    free(server->errmsg);
+    server->errmsg = errmsg;
+}
 #endif
 
 /**
  * Implementation of the Binary protocol
  */
-static int binary_get(struct Server* server, struct Item* item)
+static int binary_get(struct Server* server, struct Item* item, bool lock)
 {
 #ifndef HAVE_MEMCACHED_PROTOCOL_BINARY_H
     (void)server;
     (void)item;
+    (void)lock;
     fprintf(stderr, "Compiled without support for binary protocol\n");
     return -1;
 #else
     uint16_t keylen = item->keylen;
-    uint32_t bodylen = keylen;
+    /* getl takes the lock timeout as an optional extra */
+    uint8_t extlen = (lock && item->exptime != 0) ? 4 : 0;
+    uint32_t bodylen = keylen + extlen;
+    uint32_t timeout = htonl(item->exptime);
 
     protocol_binary_request_get request = {
         .message.header.request = {
             .magic = PROTOCOL_BINARY_REQ,
-            .opcode = PROTOCOL_BINARY_CMD_GET,
+            .opcode = lock ? CMD_GET_LOCKED : PROTOCOL_BINARY_CMD_GET,
             .keylen = htons(keylen),
+            .extlen = extlen,
             .datatype = PROTOCOL_BINARY_RAW_BYTES,
             .vbucket = htons(get_vbucket(item->key, keylen)),
             .bodylen = htonl(bodylen),
@@ -536,13 +653,15 @@ static int binary_get(struct Server* server, struct Item* item)
         }
     };
 
-    struct iovec iovec[2];
+    struct iovec iovec[3];
     iovec[0].iov_base = (void*)&request;
     iovec[0].iov_len = sizeof(request);
-    iovec[1].iov_base = (void*)item->key;
-    iovec[1].iov_len = keylen;
+    iovec[1].iov_base = (void*)&timeout;
+    iovec[1].iov_len = extlen;
+    iovec[2].iov_base = (void*)item->key;
+    iovec[2].iov_len = keylen;
 
-    server_sendv(server, iovec, 2);
+    server_sendv(server, iovec, 3);
 
     protocol_binary_response_set response;
     size_t nread = server_receive(server, (char*)response.bytes,
@@ -581,7 +700,7 @@ static int binary_get(struct Server* server, struct Item* item)
             iov[1].iov_base = item->data;
             iov[1].iov_len = item->size;
 
-            nread = readv(server->sock, iovec, 2);
+            nread = readv(server->sock, iov, 2);
             if (nread < bodylen) {
                 // partial read.. read the rest!
                 nread -= 4;
@@ -604,9 +723,16 @@ static int binary_get(struct Server* server, struct Item* item)
             return -1;
         }
         buffer[bodylen] = '\0';
-        server_receive(server, buffer, bodylen, 0);
-        server->errmsg = buffer;
+        /* a zero sized recv() blocks until there is data */
+        if (bodylen > 0) {
+            server_receive(server, buffer, bodylen, 0);
+        }
+        server_set_errmsg(server, buffer);
 
+        if (ntohs(response.message.header.response.status) ==
+            PROTOCOL_BINARY_RESPONSE_KEY_ENOENT) {
+            return 1;
+        }
         return -1;
     }
 
@@ -736,6 +862,208 @@ static int binary_store(struct Server* server,
 #endif
 }
 
+#ifdef HAVE_MEMCACHED_PROTOCOL_BINARY_H
+/**
+ * Send a binary request and read back the response for the commands
+ * that don't carry an item back (or only a small fixed size value)
+ * @param server the server to talk to
+ * @param opcode the command to send
+ * @param vbucket the vbucket the key lives in
+ * @param ext the extras to send (extlen bytes)
+ * @param key the key to send (keylen bytes)
+ * @param value the value to send (nvalue bytes)
+ * @param body where to store the value of a successful response, or NULL
+ * @param nbody the size of the value we expect back
+ * @return 0 on success, 1 if the key doesn't exist, -2 on a temporary
+ *         failure and -1 otherwise
+ */
+static int binary_command(struct Server* server, uint8_t opcode,
+                          uint16_t vbucket,
+                          const void *ext, uint8_t extlen,
+                          const void *key, uint16_t keylen,
+                          const void *value, uint32_t nvalue,
+                          void *body, uint32_t nbody)
+{
+    protocol_binary_request_header request = {
+        .request = {
+            .magic = PROTOCOL_BINARY_REQ,
+            .opcode = opcode,
+            .keylen = htons(keylen),
+            .extlen = extlen,
+            .datatype = PROTOCOL_BINARY_RAW_BYTES,
+            .vbucket = htons(vbucket),
+            .bodylen = htonl(extlen + keylen + nvalue),
+            .opaque = 0
+        }
+    };
+
+    struct iovec iovec[4];
+    iovec[0].iov_base = (void*)&request;
+    iovec[0].iov_len = sizeof(request);
+    iovec[1].iov_base = (void*)ext;
+    iovec[1].iov_len = extlen;
+    iovec[2].iov_base = (void*)key;
+    iovec[2].iov_len = keylen;
+    iovec[3].iov_base = (void*)value;
+    iovec[3].iov_len = nvalue;
+
+    if (server_sendv(server, iovec, 4) != 0) {
+        return -1;
+    }
+
+    protocol_binary_response_header response;
+    size_t nread = server_receive(server, (char*)response.bytes,
+                                  sizeof(response.bytes), 0);
+    if (nread != sizeof(response)) {
+        server_set_errmsg(server, strdup("Protocol error"));
+        server_disconnect(server);
+        return -1;
+    }
+
+    uint16_t status = ntohs(response.response.status);
+    uint32_t bodylen = ntohl(response.response.bodylen);
+    char *buffer = NULL;
+    if (bodylen > 0) {
+        buffer = malloc(bodylen);
+        if (buffer == NULL) {
+            server_set_errmsg(server, strdup("failed to allocate memory\n"));
+            server_disconnect(server);
+            return -1;
+        }
+        if (server_receive(server, buffer, bodylen, 0) != bodylen) {
+            free(buffer);
+            return -1;
+        }
+    }
+
+    int ret = 0;
+    if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+        if (body != NULL) {
+            if (bodylen - response.response.extlen != nbody) {
+                server_set_errmsg(server, strdup("Unexpected data returned\n"));
+                server_disconnect(server);
+                ret = -1;
+            } else {
+                memcpy(body, buffer + response.response.extlen, nbody);
+            }
+        }
+    } else {
+        const char *textual = response_texts[status];
+        char errmsg[128];
+        snprintf(errmsg, sizeof(errmsg), "command %02x failed: %0x (%s)",
+                 opcode, status, textual == NULL ? "unknown" : textual);
+        server_set_errmsg(server, strdup(errmsg));
+        if (status == PROTOCOL_BINARY_RESPONSE_KEY_ENOENT) {
+            ret = 1;
+        } else if (status == PROTOCOL_BINARY_RESPONSE_ETMPFAIL) {
+            ret = -2;
+        } else {
+            ret = -1;
+        }
+    }
+
+    free(buffer);
+    return ret;
+}
+#endif
+
+static int binary_delete(struct Server* server, const struct Item *item)
+{
+#ifndef HAVE_MEMCACHED_PROTOCOL_BINARY_H
+    (void)server;
+    (void)item;
+    fprintf(stderr, "Compiled without support for binary protocol\n");
+    return -1;
+#else
+    return binary_command(server, PROTOCOL_BINARY_CMD_DELETE,
+                          get_vbucket(item->key, item->keylen),
+                          NULL, 0, item->key, item->keylen, NULL, 0,
+                          NULL, 0);
+#endif
+}
+
+/**
+ * Increment a counter, creating it (with the value 0) if it doesn't
+ * exist.
+ */
+static int binary_incr(struct Server* server, const struct Item *item,
+                       uint64_t delta, uint64_t *value)
+{
+#ifndef HAVE_MEMCACHED_PROTOCOL_BINARY_H
+    (void)server;
+    (void)item;
+    (void)delta;
+    (void)value;
+    fprintf(stderr, "Compiled without support for binary protocol\n");
+    return -1;
+#else
+    /* the extras are 20 bytes on the wire, the struct is padded to 24 */
+    protocol_binary_request_incr request;
+    request.message.body.delta = swap64(delta);
+    request.message.body.initial = 0;
+    request.message.body.expiration = htonl(item->exptime);
+
+    uint64_t result;
+    int ret = binary_command(server, PROTOCOL_BINARY_CMD_INCREMENT,
+                             get_vbucket(item->key, item->keylen),
+                             &request.message.body, 20,
+                             item->key, item->keylen, NULL, 0,
+                             &result, sizeof(result));
+    if (ret == 0 && value != NULL) {
+        *value = swap64(result);
+    }
+    return ret;
+#endif
+}
+
+static int binary_touch(struct Server* server, const struct Item *item)
+{
+#ifndef HAVE_MEMCACHED_PROTOCOL_BINARY_H
+    (void)server;
+    (void)item;
+    fprintf(stderr, "Compiled without support for binary protocol\n");
+    return -1;
+#else
+    uint32_t expiration = htonl(item->exptime);
+    return binary_command(server, PROTOCOL_BINARY_CMD_TOUCH,
+                          get_vbucket(item->key, item->keylen),
+                          &expiration, sizeof(expiration),
+                          item->key, item->keylen, NULL, 0, NULL, 0);
+#endif
+}
+
+/**
+ * Select the server's bucket by authenticating with SASL PLAIN
+ * (the bucket name is the user name)
+ */
+static int binary_auth(struct Server* server)
+{
+#ifndef HAVE_MEMCACHED_PROTOCOL_BINARY_H
+    (void)server;
+    fprintf(stderr, "Compiled without support for binary protocol\n");
+    return -1;
+#else
+    size_t ulen = strlen(server->bucket);
+    size_t plen = strlen(server->password);
+    char *data = malloc(ulen + plen + 2);
+    if (data == NULL) {
+        server_set_errmsg(server, strdup("failed to allocate memory\n"));
+        return -1;
+    }
+
+    data[0] = '\0';
+    memcpy(data + 1, server->bucket, ulen);
+    data[ulen + 1] = '\0';
+    memcpy(data + ulen + 2, server->password, plen);
+
+    int ret = binary_command(server, PROTOCOL_BINARY_CMD_SASL_AUTH, 0,
+                             NULL, 0, "PLAIN", 5, data, ulen + plen + 2,
+                             NULL, 0);
+    free(data);
+    return ret;
+#endif
+}
+
 /**
  * Implementation of the Textual protocol
  */
@@ -823,7 +1151,7 @@ static int textual_get(struct Server* server, struct Item* item) {
         memcpy(item->data, result, item->size);
         return 0;
     } else if (strstr(server->buffer, "END") == server->buffer) {
-        return -1; // indicating a miss
+        return 1; // indicating a miss
     } else if (strstr(server->buffer, "SERVER_ERROR") == server->buffer) {
         textual_seterrmsg(server, strdup("ASCII get error: "));
         return -2; //indicating a server error
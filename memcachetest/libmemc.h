@@ -50,6 +50,13 @@ extern "C"  {
     int libmemc_set(struct Memcache *handle, const struct Item *item);
     int libmemc_replace(struct Memcache *handle, const struct Item *item);
     int libmemc_get(struct Memcache *handle, struct Item *item);
+    int libmemc_delete(struct Memcache *handle, const struct Item *item);
+    int libmemc_incr(struct Memcache *handle, const struct Item *item,
+                     uint64_t delta, uint64_t *value);
+    int libmemc_touch(struct Memcache *handle, const struct Item *item);
+    int libmemc_getl(struct Memcache *handle, struct Item *item);
+    int libmemc_set_bucket(struct Memcache *handle, const char *bucket,
+                           const char *password);
     int libmemc_connect_server(const char *hostname, in_port_t port);
     char *libmemc_get_error(struct Memcache *handle);
 
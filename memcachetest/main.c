@@ -51,6 +51,7 @@
 #include "memcachetest.h"
 #include "boxmuller.h"
 #include "vbucket.h"
+#include "workload.h"
 
 #ifndef MAXINT
 /* MAXINT doesn't seem to exist on MacOS */
@@ -63,6 +64,15 @@ struct host {
     struct host *next;
 } *hosts = NULL;
 
+/**
+ * The buckets to spread the keys over (a key with index idx lives in
+ * bucket idx % no_buckets), authenticated to with SASL
+ */
+struct bucket {
+    const char *name;
+    const char *password;
+} *buckets = NULL;
+int no_buckets = 0;
 
 /**
  * The set of data to operate on
@@ -94,9 +104,9 @@ struct datablock {
 const char *prefix = "";
 
 /**
- * Set to one if you would like fixed block sizes
+ * The size of the working set (0 means use the number of items)
  */
-int use_fixed_block_size = 0;
+uint64_t working_set = 0;
 
 /**
  * Set to 1 if you would like the memcached client to connect to multiple
@@ -154,8 +164,10 @@ struct connection {
 
 /**
  * Create a handle to a memcached library
+ * @param bucket the bucket the handle should use (ignored if we don't
+ *               run with buckets)
  */
-static void *create_memcached_handle(void) {
+static void *create_memcached_handle(int bucket) {
     struct memcachelib* ret = malloc(sizeof(*ret));
     ret->type = current_memcached_library;
 
@@ -202,6 +214,10 @@ static void *create_memcached_handle(void) {
     case LIBMEMC_BINARY:
         {
             struct Memcache* memcache = libmemc_create(Binary);
+            if (no_buckets > 0) {
+                libmemc_set_bucket(memcache, buckets[bucket].name,
+                                   buckets[bucket].password);
+            }
             for (struct host *host = hosts; host != NULL; host = host->next) {
                 libmemc_add_server(memcache, host->hostname, host->port);
                 if (!use_multiple_servers) {
@@ -296,13 +312,13 @@ static inline int memcached_set_wrapper(struct connection *connection,
  * @param connection the connection to use
  * @param key The items key
  * @param nkey The length of the key
- * @param The size of the data
- * @return pointer to the data on success, -1 otherwise
- * TODO: the return of -1 isn't really true
+ * @param size Where to store the size of the data
+ * @param data Where to store the data
+ * @return 0 on success, 1 if the key doesn't exist, -1 otherwise
  */
-static inline bool memcached_get_wrapper(struct connection* connection,
-                                          const char *key, int nkey,
-                                          size_t *size, void **data) {
+static inline int memcached_get_wrapper(struct connection* connection,
+                                         const char *key, int nkey,
+                                         size_t *size, void **data) {
     struct memcachelib* lib = (struct memcachelib*)connection->handle;
     switch (lib->type) {
 #ifdef HAVE_LIBMEMCACHED
@@ -312,8 +328,10 @@ static inline bool memcached_get_wrapper(struct connection* connection,
             memcached_return rc;
             uint32_t flags;
             *data = memcached_get(lib->handle, key, nkey, size, &flags, &rc);
-            if (rc != MEMCACHED_SUCCESS) {
-                return false;
+            if (rc == MEMCACHED_NOTFOUND) {
+                return 1;
+            } else if (rc != MEMCACHED_SUCCESS) {
+                return -1;
             }
         }
         break;
@@ -326,8 +344,9 @@ static inline bool memcached_get_wrapper(struct connection* connection,
                 .keylen = nkey
             };
 
-            if (libmemc_get(lib->handle, &mitem) != 0) {
-                return false;
+            int ret = libmemc_get(lib->handle, &mitem);
+            if (ret != 0) {
+                return ret > 0 ? 1 : -1;
             }
             *size = mitem.size;
             *data = mitem.data;
@@ -338,7 +357,174 @@ static inline bool memcached_get_wrapper(struct connection* connection,
         abort();
     }
 
-    return true;
+    return 0;
+}
+
+/**
+ * Delete a key from the memcached server
+ * @param connection the connection to use
+ * @param key The items key
+ * @param nkey The length of the key
+ * @return 0 on success, 1 if the key doesn't exist, -1 otherwise
+ */
+static inline int memcached_delete_wrapper(struct connection *connection,
+                                           const char *key, int nkey) {
+    struct memcachelib* lib = (struct memcachelib*)connection->handle;
+    switch (lib->type) {
+#ifdef HAVE_LIBMEMCACHED
+    case LIBMEMCACHED_BINARY: /* FALLTHROUGH */
+    case LIBMEMCACHED_TEXTUAL:
+        {
+            memcached_return rc = memcached_delete(lib->handle, key, nkey, 0);
+            if (rc == MEMCACHED_NOTFOUND) {
+                return 1;
+            } else if (rc != MEMCACHED_SUCCESS) {
+                return -1;
+            }
+        }
+        break;
+#endif
+    case LIBMEMC_BINARY:
+        {
+            struct Item mitem = {
+                .key = key,
+                .keylen = nkey
+            };
+            int ret = libmemc_delete(lib->handle, &mitem);
+            if (ret != 0) {
+                return ret > 0 ? 1 : -1;
+            }
+        }
+        break;
+
+    default:
+        abort();
+    }
+    return 0;
+}
+
+/**
+ * Increment a counter on the memcached server (creating it if it
+ * doesn't exist)
+ * @param connection the connection to use
+ * @param key The counters key
+ * @param nkey The length of the key
+ * @return 0 on success -1 otherwise
+ */
+static inline int memcached_incr_wrapper(struct connection *connection,
+                                         const char *key, int nkey) {
+    struct memcachelib* lib = (struct memcachelib*)connection->handle;
+    uint64_t value;
+    switch (lib->type) {
+#ifdef HAVE_LIBMEMCACHED
+    case LIBMEMCACHED_BINARY:
+        if (memcached_increment_with_initial(lib->handle, key, nkey, 1, 0, 0,
+                                             &value) != MEMCACHED_SUCCESS) {
+            return -1;
+        }
+        break;
+#endif
+    case LIBMEMC_BINARY:
+        {
+            struct Item mitem = {
+                .key = key,
+                .keylen = nkey
+            };
+            if (libmemc_incr(lib->handle, &mitem, 1, &value) != 0) {
+                return -1;
+            }
+        }
+        break;
+
+    default:
+        abort();
+    }
+    return 0;
+}
+
+/**
+ * Update the expiry time of a key (only supported by libmemc's binary
+ * protocol)
+ * @param connection the connection to use
+ * @param key The items key
+ * @param nkey The length of the key
+ * @param exptime The new expiry time
+ * @return 0 on success, 1 if the key doesn't exist, -1 otherwise
+ */
+static inline int memcached_touch_wrapper(struct connection *connection,
+                                          const char *key, int nkey,
+                                          size_t exptime) {
+    struct memcachelib* lib = (struct memcachelib*)connection->handle;
+    struct Item mitem = {
+        .key = key,
+        .keylen = nkey,
+        .exptime = exptime
+    };
+
+    assert(lib->type == LIBMEMC_BINARY);
+    int ret = libmemc_touch(lib->handle, &mitem);
+    return ret > 0 ? 1 : (ret == 0 ? 0 : -1);
+}
+
+/**
+ * Get and lock a key (only supported by libmemc's binary protocol)
+ * @param connection the connection to use
+ * @param key The items key
+ * @param nkey The length of the key
+ * @param size Where to store the size of the data
+ * @param data Where to store the data
+ * @param cas Where to store the cas needed to unlock the item
+ * @return 0 if the item was found and locked, 1 if the key doesn't exist,
+ *         -1 otherwise
+ */
+static inline int memcached_getl_wrapper(struct connection *connection,
+                                          const char *key, int nkey,
+                                          size_t *size, void **data,
+                                          uint64_t *cas) {
+    struct memcachelib* lib = (struct memcachelib*)connection->handle;
+    struct Item mitem = {
+        .key = key,
+        .keylen = nkey,
+        /* don't leave it locked for long if we fail to unlock it */
+        .exptime = 1
+    };
+
+    assert(lib->type == LIBMEMC_BINARY);
+    int ret = libmemc_getl(lib->handle, &mitem);
+    if (ret != 0) {
+        return ret > 0 ? 1 : -1;
+    }
+    *size = mitem.size;
+    *data = mitem.data;
+    *cas = mitem.cas_id;
+    return 0;
+}
+
+/**
+ * Store a key with a cas value (this is what unlocks a locked item)
+ * @param connection the connection to use
+ * @param key The items key
+ * @param nkey The length of the key
+ * @param data The data to set
+ * @param size The size of the data to set
+ * @param cas The cas value returned when the item was locked
+ * @return 0 on success -1 otherwise
+ */
+static inline int memcached_cas_wrapper(struct connection *connection,
+                                        const char *key, int nkey,
+                                        const void *data, size_t size,
+                                        uint64_t cas) {
+    struct memcachelib* lib = (struct memcachelib*)connection->handle;
+    struct Item mitem = {
+        .key = key,
+        .keylen = nkey,
+        .data = (void*)data,
+        .size = size,
+        .cas_id = cas
+    };
+
+    assert(lib->type == LIBMEMC_BINARY);
+    return libmemc_set(lib->handle, &mitem) == 0 ? 0 : -1;
 }
 
 static struct connection* connectionpool;
@@ -355,7 +541,8 @@ static int create_connection_pool(void) {
         if (pthread_mutex_init(&connectionpool[ii].mutex, NULL) != 0) {
             abort();
         }
-        if ((connectionpool[ii].handle = create_memcached_handle()) == NULL) {
+        int bucket = no_buckets > 0 ? (int)(ii % no_buckets) : 0;
+        if ((connectionpool[ii].handle = create_memcached_handle(bucket)) == NULL) {
             abort();
         }
     }
@@ -372,17 +559,31 @@ static void destroy_connection_pool(void) {
     connectionpool = NULL;
 }
 
-static struct connection *get_connection(void) {
+/**
+ * Get the bucket a key lives in
+ * @param idx the index of the key
+ */
+static int key_bucket(long idx) {
+    return no_buckets > 0 ? (int)(idx % no_buckets) : 0;
+}
+
+/**
+ * Get a connection from the pool. Connection ii talks to bucket
+ * ii % no_buckets (and the pool size is a multiple of no_buckets)
+ * @param bucket the bucket the connection should use
+ */
+static struct connection *get_connection(int bucket) {
     if (thread_bind_connection) {
 #ifdef __sun
         return &connectionpool[pthread_self()];
 #else
-        return &connectionpool[0];
+        return &connectionpool[bucket];
 #endif
     } else {
+        size_t nb = no_buckets > 0 ? no_buckets : 1;
         int idx;
         do {
-            idx = random() % connection_pool_size;
+            idx = bucket + nb * (random() % (connection_pool_size / nb));
         } while (pthread_mutex_trylock(&connectionpool[idx].mutex) != 0);
 
         return &connectionpool[idx];
@@ -437,19 +638,18 @@ static int initialize_dataset(void) {
     }
 
     for (long ii = 0; ii < no_items; ++ii) {
-        if (use_fixed_block_size) {
-            dataset[ii] = datablock.size;
-        } else {
-            dataset[ii] = datablock.min_size +
-                (random() % (datablock.size - datablock.min_size));
-            assert(dataset[ii] >= datablock.min_size);
-            assert(dataset[ii] <= datablock.size);
-        }
+        dataset[ii] = workload_next_size(datablock.min_size, datablock.size);
+        assert(dataset[ii] >= datablock.min_size);
+        assert(dataset[ii] <= datablock.size);
 
         total += dataset[ii];
     }
 
     datablock.avg = (size_t)(total / no_items);
+    if (working_set != 0) {
+        fprintf(stdout, "Working set: %ld items, %llu bytes\n", no_items,
+                (unsigned long long)total);
+    }
     return 0;
 }
 
@@ -458,7 +658,7 @@ static int initialize_dataset(void) {
  * @return 0 if success, -1 if an error occurs
  */
 static int populate_dataset(struct thread_context *ctx) {
-    struct connection* connection = get_connection();
+    struct connection* connection;
     int end = ctx->offset + ctx->total;
     char key[256];
     size_t nkey;
@@ -469,17 +669,17 @@ static int populate_dataset(struct thread_context *ctx) {
         fprintf(stderr, "Populating from %d to %d\n", ctx->offset, end);
     }
     for (int ii = ctx->offset; ii < end; ++ii) {
+        connection = get_connection(key_bucket(ii));
         nkey = snprintf(key, sizeof(key), "%s%d", prefix, ii);
         sres = memcached_set_wrapper(connection, key, nkey,
                                      datablock.data, dataset[ii]);
+        release_connection(connection);
         if (sres != 0) {
             fprintf(stderr, "Failed to set [%s]: during populate.\n", key);
-            release_connection(connection);
             return -1;
         }
     }
 
-    release_connection(connection);
     return 0;
 }
 
@@ -548,8 +748,72 @@ static int populate_data(int no_threads) {
 }
 
 
-static int get_setval(void) {
-    return random() % no_items;
+/**
+ * Run a get, and verify what we got back
+ */
+static void test_get(struct thread_context *ctx,
+                     struct connection *connection,
+                     const char *key, size_t nkey, long idx) {
+    size_t size = 0;
+    void *data;
+    hrtime_t start = gethrtime();
+    int ret = memcached_get_wrapper(connection, key, nkey, &size, &data);
+    hrtime_t delta = gethrtime() - start;
+
+    if (ret == 0) {
+        if (size != dataset[idx]) {
+            fprintf(stderr,
+                    "Incorrect length returned for <%s>. "
+                    "Stored %zu got %zu\n",
+                    key, dataset[idx], size);
+        } else if (verify_data &&
+                   memcmp(datablock.data, data, size) != 0) {
+            fprintf(stderr, "Garbled data for <%s>\n", key);
+        }
+        record_tx(TX_GET, delta, ctx);
+        free(data);
+    } else if (ret > 0) {
+        record_miss(TX_GET, delta, ctx);
+        /*
+         * with deletes in the mix, or a working set that may not fit in
+         * the server's memory, misses are expected
+         */
+        if (!workload_uses(OP_DELETE) && working_set == 0) {
+            fprintf(stderr, "<%s> isn't there anymore\n", key);
+        }
+    } else {
+        record_error(TX_GET, ctx);
+    }
+}
+
+/**
+ * Lock an item, and unlock it again by storing it back with the cas
+ * the lock returned
+ */
+static void test_getl(struct thread_context *ctx,
+                      struct connection *connection,
+                      const char *key, size_t nkey) {
+    size_t size = 0;
+    void *data;
+    uint64_t cas;
+    hrtime_t start = gethrtime();
+    int ret = memcached_getl_wrapper(connection, key, nkey, &size, &data, &cas);
+
+    if (ret == 0) {
+        record_tx(TX_GETL, gethrtime() - start, ctx);
+
+        start = gethrtime();
+        if (memcached_cas_wrapper(connection, key, nkey, data, size, cas) == 0) {
+            record_tx(TX_CAS, gethrtime() - start, ctx);
+        } else {
+            record_error(TX_CAS, ctx);
+        }
+        free(data);
+    } else if (ret > 0) {
+        record_miss(TX_GETL, gethrtime() - start, ctx);
+    } else {
+        record_error(TX_GETL, ctx);
+    }
 }
 
 /**
@@ -563,48 +827,70 @@ static int test(struct thread_context *ctx) {
     char key[256];
     size_t nkey;
     for (size_t ii = 0; ii < ctx->total; ++ii) {
-        connection = get_connection();
-        int idx = get_setval();
-        nkey = snprintf(key, sizeof(key), "%s%d", prefix, idx);
+        long idx = workload_next_key(ctx->rng);
+        enum WorkloadOp op = workload_next_op(ctx->rng);
+        hrtime_t start;
+        int rc;
+
+        connection = get_connection(key_bucket(idx));
+        if (op == OP_INCR) {
+            nkey = snprintf(key, sizeof(key), "%scounter%ld", prefix, idx);
+        } else {
+            nkey = snprintf(key, sizeof(key), "%s%ld", prefix, idx);
+        }
 
-        if (setprc > 0 && (random() % 100) < setprc) {
-            if (verbose) {
-                fprintf(stderr, "CMD: set %s\n", key);
+        if (verbose) {
+            fprintf(stderr, "CMD: %s %s\n", workload_op_name(op), key);
+        }
+
+        switch (op) {
+        case OP_GET:
+            test_get(ctx, connection, key, nkey, idx);
+            break;
+        case OP_SET:
+            start = gethrtime();
+            if (memcached_set_wrapper(connection, key, nkey,
+                                      datablock.data, dataset[idx]) == 0) {
+                record_tx(TX_SET, gethrtime() - start, ctx);
+            } else {
+                record_error(TX_SET, ctx);
             }
-            hrtime_t delta;
-            hrtime_t start = gethrtime();
-            memcached_set_wrapper(connection, key, nkey,
-                                  datablock.data, dataset[idx]);
-            delta = gethrtime() - start;
-            record_tx(TX_SET, delta, ctx);
-        } else {
-            /* go set it from random data */
-            if (verbose) {
-                fprintf(stderr, "CMD: get %s\n", key);
+            break;
+        case OP_DELETE:
+            start = gethrtime();
+            rc = memcached_delete_wrapper(connection, key, nkey);
+            if (rc == 0) {
+                record_tx(TX_DELETE, gethrtime() - start, ctx);
+            } else if (rc > 0) {
+                record_miss(TX_DELETE, gethrtime() - start, ctx);
+            } else {
+                record_error(TX_DELETE, ctx);
             }
-            hrtime_t delta;
-            size_t size = 0;
-            hrtime_t start = gethrtime();
-            void *data;
-            bool found = memcached_get_wrapper(connection, key, nkey, &size,
-                                               &data);
-
-            delta = gethrtime() - start;
-            if (found) {
-                if (size != dataset[idx]) {
-                    fprintf(stderr,
-                            "Incorrect length returned for <%s>. "
-                            "Stored %zu got %zu\n",
-                            key, dataset[idx], (long)size);
-                } else if (verify_data &&
-                           memcmp(datablock.data, data, size) != 0) {
-                    fprintf(stderr, "Garbled data for <%s>\n", key);
-                }
-                record_tx(TX_GET, delta, ctx);
-                free(data);
+            break;
+        case OP_INCR:
+            start = gethrtime();
+            if (memcached_incr_wrapper(connection, key, nkey) == 0) {
+                record_tx(TX_INCR, gethrtime() - start, ctx);
+            } else {
+                record_error(TX_INCR, ctx);
+            }
+            break;
+        case OP_GETL:
+            test_getl(ctx, connection, key, nkey);
+            break;
+        case OP_TOUCH:
+            start = gethrtime();
+            rc = memcached_touch_wrapper(connection, key, nkey, 0);
+            if (rc == 0) {
+                record_tx(TX_TOUCH, gethrtime() - start, ctx);
+            } else if (rc > 0) {
+                record_miss(TX_TOUCH, gethrtime() - start, ctx);
             } else {
-                fprintf(stderr, "<%s> isn't there anymore\n", key);
+                record_error(TX_TOUCH, ctx);
             }
+            break;
+        default:
+            abort();
         }
         release_connection(connection);
     }
@@ -647,6 +933,82 @@ static void add_host(const char *hostname) {
     }
 }
 
+/**
+ * Add a bucket to spread the keys over
+ * @param spec bucket[:password]
+ */
+static void add_bucket(const char *spec) {
+    struct bucket *b = realloc(buckets, (no_buckets + 1) * sizeof(*b));
+    char *name = strdup(spec);
+    if (b == NULL || name == NULL) {
+        fprintf(stderr, "Failed to allocate memory for <%s>. Bucket ignored\n",
+                spec);
+        fflush(stderr);
+        free(name);
+        return;
+    }
+    buckets = b;
+    char *ptr = strchr(name, ':');
+    if (ptr != NULL) {
+        *ptr = '\0';
+        ++ptr;
+    }
+    buckets[no_buckets].name = name;
+    buckets[no_buckets].password = ptr;
+    ++no_buckets;
+}
+
+/**
+ * Parse a size with an optional k, m or g suffix
+ * @param str the string to parse
+ * @return the size in bytes (0 if it's invalid)
+ */
+static uint64_t parse_size(const char *str) {
+    char *end;
+    uint64_t ret = strtoull(str, &end, 10);
+    switch (*end) {
+    case 'g': case 'G':
+        ret *= 1024;
+        /* FALLTHROUGH */
+    case 'm': case 'M':
+        ret *= 1024;
+        /* FALLTHROUGH */
+    case 'k': case 'K':
+        ret *= 1024;
+        ++end;
+        break;
+    default:
+        break;
+    }
+
+    return *end == '\0' ? ret : 0;
+}
+
+/**
+ * Check if the selected library can run an operation
+ * @param op the operation to check
+ * @return true if it is supported
+ */
+static bool library_supports(enum WorkloadOp op) {
+    switch (op) {
+    case OP_GET:
+    case OP_SET:
+        return true;
+    case OP_DELETE:
+        return current_memcached_library != LIBMEMC_TEXTUAL;
+    case OP_INCR:
+#ifdef HAVE_LIBMEMCACHED
+        if (current_memcached_library == LIBMEMCACHED_BINARY) {
+            return true;
+        }
+#endif
+        return current_memcached_library == LIBMEMC_BINARY;
+    default:
+        /* getl and touch are only implemented in libmemc */
+        return current_memcached_library == LIBMEMC_BINARY;
+    }
+}
+
 static struct addrinfo *lookuphost(const char *hostname, in_port_t port) {
     struct addrinfo *ai = 0;
     struct addrinfo hints = {
@@ -749,7 +1111,7 @@ int main(int argc, char **argv) {
     int size;
     gettimeofday(&starttime, NULL);
 
-    while ((cmd = getopt(argc, argv, "K:QW:M:pL:P:Fm:t:h:i:s:c:VlSvC:")) != EOF) {
+    while ((cmd = getopt(argc, argv, "K:QW:M:pL:P:Fm:t:h:i:s:c:VlSvC:k:o:z:w:b:")) != EOF) {
         switch (cmd) {
         case 'K':
             if (strlen(prefix) > 240) {
@@ -783,7 +1145,7 @@ int main(int argc, char **argv) {
                 datablock.size = size;
             }
             break;
-        case 'F': use_fixed_block_size = 1;
+        case 'F': workload.sizes = SIZES_FIXED;
             break;
         case 'h': add_host(optarg);
             break;
@@ -825,10 +1187,37 @@ int main(int argc, char **argv) {
             }
 #endif
             break;
+        case 'k':
+            if (!workload_parse_keys(optarg)) {
+                fprintf(stderr, "Invalid key distribution: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'o':
+            if (!workload_parse_mix(optarg)) {
+                fprintf(stderr, "Invalid operation mix: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'z':
+            if (!workload_parse_sizes(optarg)) {
+                fprintf(stderr, "Invalid size distribution: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'w':
+            if ((working_set = parse_size(optarg)) == 0) {
+                fprintf(stderr, "Invalid working set size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'b': add_bucket(optarg);
+            break;
         default:
             fprintf(stderr, "Usage: test [-h host[:port]] [-t #threads]");
             fprintf(stderr, " [-T] [-i #items] [-c #iterations]\n");
             fprintf(stderr, "            [-v] [-V] [-f dir] [-s seed] [-W size] [-C vbucketconfig]\n");
+            fprintf(stderr, "            [-k keydist] [-o mix] [-z sizedist] [-w size] [-b bucket]\n");
             fprintf(stderr, "\t-h The hostname:port where the memcached server is running\n");
             fprintf(stderr, "\t   (use mulitple -h args for multiple servers)\n");
             fprintf(stderr, "\t-t The number of threads to use\n");
@@ -848,15 +1237,78 @@ int main(int argc, char **argv) {
             fprintf(stderr, "\t   (default: 33 meaning set 33%% of the time)\n");
             fprintf(stderr, "\t-K specify a prefix that is added to all of the keys\n");
             fprintf(stderr, "\t-C Read vbucket data from host:port specified\n");
+            fprintf(stderr, "\t   (and use the servers in it, with the binary protocol)\n");
+            fprintf(stderr, "\t-k The key distribution: uniform (default), zipfian[:theta]\n");
+            fprintf(stderr, "\t   or hotspot[:keys%%:ops%%] (default: hotspot:20:80)\n");
+            fprintf(stderr, "\t-o The operation mix, for instance get=70,set=25,delete=5\n");
+            fprintf(stderr, "\t   (get, set, delete, incr, getl and touch; default: from -P)\n");
+            fprintf(stderr, "\t-z The size distribution: uniform (default), fixed\n");
+            fprintf(stderr, "\t   or normal[:stddev]\n");
+            fprintf(stderr, "\t-w The working set size (k, m or g suffix), overrides -i\n");
+            fprintf(stderr, "\t-b Spread the keys over the bucket[:password] (repeatable,\n");
+            fprintf(stderr, "\t   requires -L 2)\n");
             fprintf(stderr, "\nVersion: %s\n\n", VERSION);
             return 1;
         }
     }
 
+    if (workload.mix_total == 0) {
+        workload.mix[OP_SET] = setprc;
+        workload.mix[OP_GET] = 100 - setprc;
+        workload.mix_total = 100;
+    }
+
+    if (get_vbucket_num_servers() > 0) {
+        /*
+         * Talk to the servers in the config, in the config's order (so
+         * libmemc can map the vbucket masters to its own servers).
+         * add_host() prepends to the list.
+         */
+        hosts = NULL;
+        for (int ii = get_vbucket_num_servers() - 1; ii >= 0; --ii) {
+            add_host(get_vbucket_server(ii));
+        }
+        if (current_memcached_library == LIBMEMC_TEXTUAL) {
+            current_memcached_library = LIBMEMC_BINARY;
+        }
+    }
+
+    if ((no_buckets > 0 || get_vbucket_num_servers() > 0) &&
+        current_memcached_library != LIBMEMC_BINARY) {
+        fprintf(stderr, "Buckets and vbuckets require -L %d\n", LIBMEMC_BINARY);
+        return 1;
+    }
+
+    for (int ii = 0; ii < OP_MAX; ++ii) {
+        if (workload_uses(ii) && !library_supports(ii)) {
+            fprintf(stderr, "%s isn't supported by library %d\n",
+                    workload_op_name(ii), current_memcached_library);
+            return 1;
+        }
+    }
+
+    if (working_set != 0) {
+        size_t avg = datablock.size;
+        if (workload.sizes != SIZES_FIXED) {
+            avg = (datablock.min_size + datablock.size) / 2;
+        }
+        no_items = working_set / avg;
+    }
+
+    if (no_items <= 0) {
+        fprintf(stderr, "You need at least one item\n");
+        return 1;
+    }
+    workload_init(no_items);
+
     if (connection_pool_size < (size_t)no_threads) {
         connection_pool_size = no_threads;
     }
 
+    if (no_buckets > 0 && connection_pool_size % no_buckets != 0) {
+        connection_pool_size += no_buckets - connection_pool_size % no_buckets;
+    }
+
     {
         size_t maxthreads = no_threads;
         struct rlimit rlim;
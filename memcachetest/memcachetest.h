@@ -38,18 +38,15 @@
 extern "C" {
 #endif
 
-    struct samples {
-        int current;
-        hrtime_t *set;
-    };
-
     /**
      * A struct for the info on the thread
      */
     struct thread_context {
         int offset;
         size_t total;
-        struct samples tx[TX_CAS - TX_GET];
+        /* state for the thread's own erand48() / nrand48() stream */
+        unsigned short rng[3];
+        struct histogram tx[TX_MAX];
         /* struct report thr_summary; */
     };
 
@@ -42,45 +42,137 @@ bool initialize_thread_ctx(struct thread_context *ctx, int offset, size_t total)
     ctx->offset = offset;
     ctx->total = total;
 
-    for (int ii = 0; ii < TX_CAS - TX_GET; ++ii) {
-        ctx->tx[ii].set = calloc(ctx->total, sizeof(hrtime_t));
-        if (ctx->tx[ii].set == NULL) {
-            for (int jj = 0; jj < ii; ++jj) {
-                free(ctx->tx[jj].set);
-            }
-            return false;
-        }
+    for (int ii = 0; ii < 3; ++ii) {
+        ctx->rng[ii] = (unsigned short)random();
+    }
+
+    for (int ii = 0; ii < TX_MAX; ++ii) {
+        memset(&ctx->tx[ii], 0, sizeof(ctx->tx[ii]));
+        ctx->tx[ii].min = (hrtime_t)-1;
     }
 
     return true;
 }
 
 /**
- * A comparison-function used by qsort.
- * @param p1 element 1 to compare
- * @param p2 element 2 to compare
- * @return -1, 0 or 1
+ * Get the histogram bucket a sample belongs in
+ * @param value the sample
+ * @return the index of the bucket
+ */
+static int histogram_index(hrtime_t value)
+{
+    int shift = 0;
+
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (int)value;
+    }
+
+    while ((value >> shift) >= HISTOGRAM_SUB_BUCKETS) {
+        ++shift;
+    }
+
+    /* value >> shift is in [HISTOGRAM_HALF_BUCKETS, HISTOGRAM_SUB_BUCKETS) */
+    return HISTOGRAM_SUB_BUCKETS + (shift - 1) * HISTOGRAM_HALF_BUCKETS +
+        (int)(value >> shift) - HISTOGRAM_HALF_BUCKETS;
+}
+
+/**
+ * Get the highest value a histogram bucket stands for
+ * @param idx the index of the bucket
+ * @return the highest value that ends up in the bucket
  */
-static int compare(const void *p1, const void *p2)
+static hrtime_t histogram_value(int idx)
 {
-   hrtime_t a = *((hrtime_t *)p1);
-   hrtime_t b = *((hrtime_t *)p2);
-
-   if (a < b) {
-      return -1;
-   } else if (a > b) {
-      return 1;
-   } else {
-      return 0;
-   }
+    if (idx < HISTOGRAM_SUB_BUCKETS) {
+        return idx;
+    }
+
+    int shift = (idx - HISTOGRAM_SUB_BUCKETS) / HISTOGRAM_HALF_BUCKETS + 1;
+    hrtime_t sub = (idx - HISTOGRAM_SUB_BUCKETS) % HISTOGRAM_HALF_BUCKETS +
+        HISTOGRAM_HALF_BUCKETS;
+
+    /* wraps to the largest hrtime_t for the topmost bucket */
+    return ((sub + 1) << shift) - 1;
+}
+
+/**
+ * Get the time within which the given fraction of the samples completed
+ * @param h the histogram to look in
+ * @param fraction the fraction of the samples (0.99 for the 99th percentile)
+ * @return the time
+ */
+static hrtime_t histogram_percentile(const struct histogram *h,
+                                     double fraction)
+{
+    uint64_t wanted = (uint64_t)(fraction * (double)(h->count - 1)) + 1;
+    uint64_t seen = 0;
+
+    for (int ii = 0; ii < HISTOGRAM_BUCKETS; ++ii) {
+        seen += h->buckets[ii];
+        if (seen >= wanted) {
+            hrtime_t value = histogram_value(ii);
+            return value < h->max ? value : h->max;
+        }
+    }
+
+    return h->max;
+}
+
+/**
+ * Add all of the samples in one histogram to another
+ * @param to where to add them
+ * @param from the histogram to add
+ */
+static void histogram_merge(struct histogram *to,
+                            const struct histogram *from)
+{
+    to->count += from->count;
+    to->misses += from->misses;
+    to->errors += from->errors;
+    to->total += from->total;
+    if (from->min < to->min) {
+        to->min = from->min;
+    }
+    if (from->max > to->max) {
+        to->max = from->max;
+    }
+
+    for (int ii = 0; ii < HISTOGRAM_BUCKETS; ++ii) {
+        to->buckets[ii] += from->buckets[ii];
+    }
 }
 
 /**
  * External interface
  */
 void record_tx(enum TxnType tx_type, hrtime_t tx_time, struct thread_context *ctx) {
-    assert(tx_type < (TX_CAS - TX_GET));
-    ctx->tx[tx_type].set[ctx->tx[tx_type].current++] = tx_time;
+    assert(tx_type < TX_MAX);
+    struct histogram *h = &ctx->tx[tx_type];
+
+    h->count++;
+    h->total += tx_time;
+    if (tx_time < h->min) {
+        h->min = tx_time;
+    }
+    if (tx_time > h->max) {
+        h->max = tx_time;
+    }
+    h->buckets[histogram_index(tx_time)]++;
+}
+
+/*
+ * A miss (the key doesn't exist) is a normal answer from the server, so
+ * it is counted as an operation and its latency recorded, and counted
+ * as a miss too. Only real failures are errors.
+ */
+void record_miss(enum TxnType tx_type, hrtime_t tx_time, struct thread_context *ctx) {
+    record_tx(tx_type, tx_time, ctx);
+    ctx->tx[tx_type].misses++;
+}
+
+void record_error(enum TxnType tx_type, struct thread_context *ctx) {
+    assert(tx_type < TX_MAX);
+    ctx->tx[tx_type].errors++;
 }
 
 struct ResultMetrics *calc_metrics(enum TxnType tx_type,
@@ -90,31 +182,21 @@ struct ResultMetrics *calc_metrics(enum TxnType tx_type,
     if (ret == NULL) {
         return NULL;
     }
-    struct samples *sample = &ctx->tx[tx_type];
-    if (sample->current == 0) {
+    struct histogram *h = &ctx->tx[tx_type];
+    ret->error_count = h->errors;
+    if (h->count == 0) {
         return ret;
     }
 
-    // sort the result
-    qsort(sample->set, sample->current, sizeof(hrtime_t), compare);
-
-    ret->success_count = sample->current ;
-    long percentile90 = (0.9) * (float) (ret->success_count - 1) + 1.0;
-    long percentile95 = (0.95) * (float) (ret->success_count - 1) + 1.0;
-    long percentile99 = (0.99) * (float) (ret->success_count - 1) + 1.0;
-
-    ret->max90th_result = sample->set[percentile90];
-    ret->max95th_result = sample->set[percentile95];
-    ret->max99th_result = sample->set[percentile99];
-    ret->min_result = sample->set[0];
-    ret->max_result = sample->set[sample->current - 1];
-
-    hrtime_t total = 0;
-    for (int ii = 0; ii < sample->current; ++ii) {
-        total += sample->set[ii];
-    }
-
-    ret->average = total / sample->current;
+    ret->success_count = h->count;
+    ret->miss_count = h->misses;
+    ret->max90th_result = histogram_percentile(h, 0.9);
+    ret->max95th_result = histogram_percentile(h, 0.95);
+    ret->max99th_result = histogram_percentile(h, 0.99);
+    ret->max999th_result = histogram_percentile(h, 0.999);
+    ret->min_result = h->min;
+    ret->max_result = h->max;
+    ret->average = h->total / h->count;
 
     return ret;
 }
@@ -146,7 +228,11 @@ static void print_details(enum TxnType tx_type, struct ResultMetrics *r) {
                                    [TX_REPLACE] = "Replace",
                                    [TX_APPEND] = "Append",
                                    [TX_PREPEND] = "Prepend",
-                                   [TX_CAS] = "Cas" };
+                                   [TX_CAS] = "Cas",
+                                   [TX_DELETE] = "Delete",
+                                   [TX_INCR] = "Incr",
+                                   [TX_GETL] = "Getl",
+                                   [TX_TOUCH] = "Touch" };
 
 
     printf("%s operations:\n", txt[tx_type]);
@@ -156,19 +242,22 @@ static void print_details(enum TxnType tx_type, struct ResultMetrics *r) {
     char tmax90[80];
     char tmax95[80];
     char tmax99[80];
-    printf("     #of ops.       min       max       avg   max90th   max95th   max99th\n");
-    printf("%13ld%10.10s%10.10s%10.10s%10.10s%10.10s%10.10s\n\n", r->success_count,
+    char tmax999[80];
+    printf("     #of ops.    misses    errors       min       max       avg   max90th   max95th   max99th max99.9th\n");
+    printf("%13ld%10ld%10ld%10.10s%10.10s%10.10s%10.10s%10.10s%10.10s%10.10s\n\n",
+           r->success_count, r->miss_count, r->error_count,
            hrtime2text(r->min_result, tmin, sizeof (tmin)),
            hrtime2text(r->max_result, tmax, sizeof (tmax)),
            hrtime2text(r->average, tavg, sizeof(tavg)),
            hrtime2text(r->max90th_result, tmax90, sizeof(tmax90)),
            hrtime2text(r->max95th_result, tmax95, sizeof(tmax95)),
-           hrtime2text(r->max99th_result, tmax99, sizeof(tmax99)));
+           hrtime2text(r->max99th_result, tmax99, sizeof(tmax99)),
+           hrtime2text(r->max999th_result, tmax999, sizeof(tmax999)));
 }
 
 void print_metrics(struct thread_context *ctx) {
-    for (int ii = 0; ii < TX_CAS - TX_GET; ++ii) {
-        if (ctx->tx[ii].current > 0) {
+    for (int ii = 0; ii < TX_MAX; ++ii) {
+        if (ctx->tx[ii].count > 0 || ctx->tx[ii].errors > 0) {
             struct ResultMetrics *r = calc_metrics(ii, ctx);
             if (r) {
                 print_details(ii, r);
@@ -180,22 +269,20 @@ void print_metrics(struct thread_context *ctx) {
 
 void print_aggregated_metrics(struct thread_context *ctx, int num)
 {
-    int total = 0;
-    for (int ii = 0; ii < num; ++ii) {
-        total += ctx[ii].total;
+    struct thread_context *context = calloc(1, sizeof(*context));
+    if (context == NULL) {
+        fprintf(stderr, "Failed to allocate memory for the metrics\n");
+        return;
     }
 
-    struct thread_context context;
-    memset(&context, 0, sizeof(context));
-    initialize_thread_ctx(&context, 0, total);
-
+    initialize_thread_ctx(context, 0, 0);
     for (int ii = 0; ii < num; ++ii) {
-        for (int jj = 0; jj < TX_CAS - TX_GET; ++jj) {
-            memcpy(context.tx[jj].set + context.tx[jj].current,
-                   ctx[ii].tx[jj].set, ctx[ii].tx[jj].current * sizeof(hrtime_t));
-            context.tx[jj].current += ctx[ii].tx[jj].current;
+        context->total += ctx[ii].total;
+        for (int jj = 0; jj < TX_MAX; ++jj) {
+            histogram_merge(&context->tx[jj], &ctx[ii].tx[jj]);
         }
     }
 
-    print_metrics(&context);
+    print_metrics(context);
+    free(context);
 }
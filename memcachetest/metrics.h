@@ -33,10 +33,37 @@ extern "C" {
 #endif
 
 enum TxnType { TX_GET, TX_SET, TX_ADD, TX_REPLACE,
-               TX_APPEND, TX_PREPEND, TX_CAS };
+               TX_APPEND, TX_PREPEND, TX_CAS,
+               TX_DELETE, TX_INCR, TX_GETL, TX_TOUCH,
+               TX_MAX };
+
+/*
+ * The latencies are kept in a log-linear histogram the way HdrHistogram
+ * does it: HISTOGRAM_SUB_BUCKETS linear buckets for the smallest values
+ * and HISTOGRAM_HALF_BUCKETS linear buckets for every power of two above
+ * them, so each sample is known to within 1/64 of its value while the
+ * histogram stays the same size however long the test runs.
+ */
+#define HISTOGRAM_SUB_BITS 7
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_HALF_BUCKETS (HISTOGRAM_SUB_BUCKETS / 2)
+#define HISTOGRAM_BUCKETS (HISTOGRAM_SUB_BUCKETS + \
+                           (64 - HISTOGRAM_SUB_BITS) * HISTOGRAM_HALF_BUCKETS)
+
+struct histogram {
+    uint64_t count;
+    uint64_t misses;
+    uint64_t errors;
+    hrtime_t min;
+    hrtime_t max;
+    hrtime_t total;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+};
 
 struct thread_context;
 void record_tx(enum TxnType, hrtime_t, struct thread_context *);
+void record_miss(enum TxnType, hrtime_t, struct thread_context *);
+void record_error(enum TxnType, struct thread_context *);
 struct ResultMetrics *calc_metrics(enum TxnType tx_type,
                                    struct thread_context *);
 void print_metrics(struct thread_context *);
@@ -48,8 +75,10 @@ struct ResultMetrics {
     hrtime_t max90th_result;
     hrtime_t max95th_result;
     hrtime_t max99th_result;
+    hrtime_t max999th_result;
     hrtime_t average;
     long success_count;
+    long miss_count;
     long error_count;
 };
 
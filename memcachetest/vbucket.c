@@ -96,6 +96,31 @@ uint16_t get_vbucket(const char *key, size_t nkey) {
     return 0;
 }
 
+/**
+ * Get the index (in the config's server list) of the server that is
+ * the master for a vbucket, or -1 if we don't run with a vbucket config
+ */
+int get_vbucket_master(uint16_t vbucket) {
+    if (vbucket_handle) {
+        return vbucket_get_master(vbucket_handle, vbucket);
+    }
+    return -1;
+}
+
+int get_vbucket_num_servers(void) {
+    if (vbucket_handle) {
+        return vbucket_config_get_num_servers(vbucket_handle);
+    }
+    return 0;
+}
+
+const char *get_vbucket_server(int idx) {
+    if (vbucket_handle) {
+        return vbucket_config_get_server(vbucket_handle, idx);
+    }
+    return NULL;
+}
+
 #else
 bool initialize_vbuckets(const char *location)
 {
@@ -109,4 +134,18 @@ uint16_t get_vbucket(const char *key, size_t nkey) {
     return 0;
 }
 
+int get_vbucket_master(uint16_t vbucket) {
+    (void)vbucket;
+    return -1;
+}
+
+int get_vbucket_num_servers(void) {
+    return 0;
+}
+
+const char *get_vbucket_server(int idx) {
+    (void)idx;
+    return NULL;
+}
+
 #endif
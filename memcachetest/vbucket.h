@@ -28,5 +28,8 @@
 
 extern bool initialize_vbuckets(const char *location);
 extern uint16_t get_vbucket(const char *key, size_t nkey);
+extern int get_vbucket_master(uint16_t vbucket);
+extern int get_vbucket_num_servers(void);
+extern const char *get_vbucket_server(int idx);
 
 #endif
@@ -0,0 +1,308 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * See LICENSE.txt included in this distribution for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at LICENSE.txt.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "workload.h"
+#include "boxmuller.h"
+
+struct workload workload = {
+    .keys = KEYS_UNIFORM,
+    .theta = 0.99,
+    .hot_keys = 0.2,
+    .hot_ops = 0.8,
+    .sizes = SIZES_UNIFORM
+};
+
+static const char * const op_names[OP_MAX] = {
+    [OP_GET] = "get",
+    [OP_SET] = "set",
+    [OP_DELETE] = "delete",
+    [OP_INCR] = "incr",
+    [OP_GETL] = "getl",
+    [OP_TOUCH] = "touch"
+};
+
+/**
+ * Parse the key distribution: uniform, zipfian[:theta] or
+ * hotspot[:keys%:ops%]
+ * @param spec the specification given on the command line
+ * @return true on success, false if the spec is invalid
+ */
+bool workload_parse_keys(const char *spec) {
+    if (strcmp(spec, "uniform") == 0) {
+        workload.keys = KEYS_UNIFORM;
+        return true;
+    }
+
+    if (strncmp(spec, "zipfian", 7) == 0) {
+        workload.keys = KEYS_ZIPFIAN;
+        if (spec[7] == ':') {
+            workload.theta = atof(spec + 8);
+        } else if (spec[7] != '\0') {
+            return false;
+        }
+        if (workload.theta <= 0 || workload.theta >= 1) {
+            fprintf(stderr, "The zipfian theta must be between 0 and 1\n");
+            return false;
+        }
+        return true;
+    }
+
+    if (strncmp(spec, "hotspot", 7) == 0) {
+        workload.keys = KEYS_HOTSPOT;
+        if (spec[7] == ':') {
+            int keys, ops;
+            if (sscanf(spec + 8, "%d:%d", &keys, &ops) != 2 ||
+                keys <= 0 || keys > 100 || ops < 0 || ops > 100) {
+                fprintf(stderr, "Invalid hotspot: %s\n", spec + 8);
+                return false;
+            }
+            workload.hot_keys = keys / 100.0;
+            workload.hot_ops = ops / 100.0;
+        } else if (spec[7] != '\0') {
+            return false;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Parse the operation mix, a comma separated list of op=weight
+ * (for instance get=70,set=25,delete=5)
+ * @param spec the specification given on the command line
+ * @return true on success, false if the spec is invalid
+ */
+bool workload_parse_mix(const char *spec) {
+    int mix[OP_MAX] = { 0 };
+    int total = 0;
+
+    while (*spec != '\0') {
+        const char *eq = strchr(spec, '=');
+        if (eq == NULL) {
+            return false;
+        }
+
+        int ii;
+        for (ii = 0; ii < OP_MAX; ++ii) {
+            if (strlen(op_names[ii]) == (size_t)(eq - spec) &&
+                strncmp(spec, op_names[ii], eq - spec) == 0) {
+                break;
+            }
+        }
+        if (ii == OP_MAX) {
+            fprintf(stderr, "Unknown operation in the mix: %.*s\n",
+                    (int)(eq - spec), spec);
+            return false;
+        }
+
+        char *end;
+        long weight = strtol(eq + 1, &end, 10);
+        if (end == eq + 1 || weight < 0 || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        mix[ii] = (int)weight;
+        total += (int)weight;
+        spec = (*end == ',') ? end + 1 : end;
+    }
+
+    if (total == 0) {
+        fprintf(stderr, "The operation mix is empty\n");
+        return false;
+    }
+
+    memcpy(workload.mix, mix, sizeof(mix));
+    workload.mix_total = total;
+    return true;
+}
+
+/**
+ * Parse the value size distribution: uniform, fixed or normal[:stddev]
+ * @param spec the specification given on the command line
+ * @return true on success, false if the spec is invalid
+ */
+bool workload_parse_sizes(const char *spec) {
+    if (strcmp(spec, "uniform") == 0) {
+        workload.sizes = SIZES_UNIFORM;
+    } else if (strcmp(spec, "fixed") == 0) {
+        workload.sizes = SIZES_FIXED;
+    } else if (strncmp(spec, "normal", 6) == 0) {
+        workload.sizes = SIZES_NORMAL;
+        if (spec[6] == ':') {
+            workload.stddev = atof(spec + 7);
+            if (workload.stddev <= 0) {
+                return false;
+            }
+        } else if (spec[6] != '\0') {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Precompute the constants for the key distribution. The zipfian
+ * generator is the one from Gray et al, "Quickly Generating
+ * Billion-Record Synthetic Databases" (the one YCSB use as well).
+ * @param no_items the number of keys to pick from
+ */
+void workload_init(long no_items) {
+    workload.no_items = no_items;
+
+    if (workload.keys == KEYS_ZIPFIAN) {
+        double theta = workload.theta;
+        double zeta2 = 1 + pow(0.5, theta);
+        double zetan = 0;
+        for (long ii = 1; ii <= no_items; ++ii) {
+            zetan += 1 / pow((double)ii, theta);
+        }
+        workload.zetan = zetan;
+        workload.alpha = 1 / (1 - theta);
+        workload.eta = (1 - pow(2.0 / no_items, 1 - theta)) /
+            (1 - zeta2 / zetan);
+    }
+}
+
+bool workload_uses(enum WorkloadOp op) {
+    return workload.mix[op] > 0;
+}
+
+const char *workload_op_name(enum WorkloadOp op) {
+    return op_names[op];
+}
+
+/**
+ * Spread the zipfian ranks over the key space, so that the hot keys
+ * don't all end up next to each other (and on the same vbuckets)
+ */
+static uint64_t fnv1a_64(uint64_t val) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int ii = 0; ii < 8; ++ii) {
+        hash ^= val & 0xff;
+        hash *= 0x100000001b3ULL;
+        val >>= 8;
+    }
+    return hash;
+}
+
+static long zipfian_next(unsigned short rng[3]) {
+    double u = erand48(rng);
+    double uz = u * workload.zetan;
+    long rank;
+
+    if (uz < 1) {
+        rank = 0;
+    } else if (uz < 1 + pow(0.5, workload.theta)) {
+        rank = 1;
+    } else {
+        rank = (long)(workload.no_items *
+                      pow(workload.eta * u - workload.eta + 1,
+                          workload.alpha));
+    }
+
+    return (long)(fnv1a_64(rank) % workload.no_items);
+}
+
+static long hotspot_next(unsigned short rng[3]) {
+    long hot = (long)(workload.no_items * workload.hot_keys);
+    if (hot == 0) {
+        hot = 1;
+    }
+
+    if (hot == workload.no_items || erand48(rng) < workload.hot_ops) {
+        return nrand48(rng) % hot;
+    }
+    return hot + nrand48(rng) % (workload.no_items - hot);
+}
+
+/**
+ * Pick the next key to operate on
+ * @param rng the random state of the calling thread
+ * @return the index of the key
+ */
+long workload_next_key(unsigned short rng[3]) {
+    switch (workload.keys) {
+    case KEYS_ZIPFIAN:
+        return zipfian_next(rng);
+    case KEYS_HOTSPOT:
+        return hotspot_next(rng);
+    default:
+        return nrand48(rng) % workload.no_items;
+    }
+}
+
+/**
+ * Pick the next operation from the mix
+ * @param rng the random state of the calling thread
+ * @return the operation to run
+ */
+enum WorkloadOp workload_next_op(unsigned short rng[3]) {
+    int val = nrand48(rng) % workload.mix_total;
+    int ii;
+    for (ii = 0; ii < OP_MAX - 1; ++ii) {
+        if (val < workload.mix[ii]) {
+            break;
+        }
+        val -= workload.mix[ii];
+    }
+    return (enum WorkloadOp)ii;
+}
+
+/**
+ * Pick the size of a value. This is only used while the dataset is
+ * initialized (box_muller() isn't thread safe).
+ * @param min the smallest size to return
+ * @param max the biggest size to return
+ * @return the size
+ */
+size_t workload_next_size(size_t min, size_t max) {
+    switch (workload.sizes) {
+    case SIZES_FIXED:
+        return max;
+    case SIZES_NORMAL:
+        {
+            double stddev = workload.stddev;
+            if (stddev == 0) {
+                stddev = (max - min) / 6.0;
+            }
+            double val = box_muller((min + max) / 2.0, stddev);
+            if (val < min) {
+                return min;
+            } else if (val > max) {
+                return max;
+            }
+            return (size_t)val;
+        }
+    default:
+        if (max == min) {
+            return min;
+        }
+        return min + (random() % (max - min));
+    }
+}
@@ -0,0 +1,86 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * See LICENSE.txt included in this distribution for the specific
+ * language governing permissions and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at LICENSE.txt.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+#ifndef WORKLOAD_H
+#define WORKLOAD_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+    /** How popular the keys are */
+    enum KeyDistribution {
+        KEYS_UNIFORM,
+        /** A few keys get most of the traffic (a "scrambled" zipfian) */
+        KEYS_ZIPFIAN,
+        /** A fixed fraction of the ops go to a fixed fraction of the keys */
+        KEYS_HOTSPOT
+    };
+
+    /** How the value sizes are spread between the min and max size */
+    enum SizeDistribution { SIZES_UNIFORM, SIZES_FIXED, SIZES_NORMAL };
+
+    enum WorkloadOp {
+        OP_GET, OP_SET, OP_DELETE, OP_INCR, OP_GETL, OP_TOUCH, OP_MAX
+    };
+
+    struct workload {
+        enum KeyDistribution keys;
+        /** The skew of the zipfian distribution (0 < theta < 1) */
+        double theta;
+        /** The fraction of the keys that are hot */
+        double hot_keys;
+        /** The fraction of the operations going to the hot keys */
+        double hot_ops;
+
+        enum SizeDistribution sizes;
+        /** The standard deviation of the normal sizes, 0 for the default */
+        double stddev;
+
+        /** The weight of each operation in the mix */
+        int mix[OP_MAX];
+        int mix_total;
+
+        /* Precomputed by workload_init() */
+        long no_items;
+        double zetan;
+        double alpha;
+        double eta;
+    };
+
+    extern struct workload workload;
+
+    bool workload_parse_keys(const char *spec);
+    bool workload_parse_mix(const char *spec);
+    bool workload_parse_sizes(const char *spec);
+    void workload_init(long no_items);
+    bool workload_uses(enum WorkloadOp op);
+    const char *workload_op_name(enum WorkloadOp op);
+    long workload_next_key(unsigned short rng[3]);
+    enum WorkloadOp workload_next_op(unsigned short rng[3]);
+    size_t workload_next_size(size_t min, size_t max);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
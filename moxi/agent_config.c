@@ -1584,6 +1584,12 @@ static void update_ptd_config(void *data0, void *data1) {
             }
         }
 
+        cproxy_hot_keys_stop(ptd);
+
+        if (ptd->config != NULL) {
+            cproxy_hot_keys_start(ptd);
+        }
+
         if (settings.verbose > 2) {
             moxi_log_write("update_ptd_config %u, %u to %u\n",
                     port, prev, ptd->config_ver);
@@ -38,6 +38,7 @@ static void work_stats_reset(void *data0, void *data1);
 
 static void add_proxy_stats_td(proxy_stats_td *agg,
                                proxy_stats_td *x);
+static void add_proxy_stats_snapshots(proxy_stats_td *agg, proxy *p);
 static void add_raw_key_stats(genhash_t *key_stats_map,
                               mcache *key_stats);
 static void add_processed_key_stats(genhash_t *dest_map,
@@ -58,10 +59,6 @@ void map_pstd_foreach_emit(const void *key,
                            const void *value,
                            void *user_data);
 
-void map_pstd_foreach_merge(const void *key,
-                            const void *value,
-                            void *user_data);
-
 static void map_key_stats_foreach_free(const void *key,
                                        const void *value,
                                        void *user_data);
@@ -141,7 +138,6 @@ static char *cmd_type_names[] = { // Keep sync'ed with enum_stats_cmd_type.
 };
 
 struct stats_gathering_pair {
-    genhash_t *map_pstd; // maps "<proxy-name>:<port>" strings to (proxy_stats_td *)
     genhash_t *map_key_stats; // maps "<proxy-name>:<port>" strings to (genhash that maps key names to (struct key_stats *))
 };
 
@@ -205,9 +201,11 @@ out_free:
 /* This callback is invoked by conflate on a conflate thread
  * when it wants proxy stats.
  *
- * We use the work_queues to retrieve the info, so that normal
- * runtime has fewer locks, at the cost of scatter/gather
- * complexity to handle the proxy stats request.
+ * Proxy stats come from the snapshots that worker threads publish,
+ * so gathering them doesn't interrupt the workers.  We use the
+ * work_queues only to retrieve key stats, so that normal runtime
+ * has fewer locks, at the cost of scatter/gather complexity to
+ * handle the proxy stats request.
  */
 enum conflate_mgmt_cb_result on_conflate_get_stats(void *userdata,
                                                    conflate_handle_t *handle,
@@ -313,16 +311,9 @@ enum conflate_mgmt_cb_result on_conflate_get_stats(void *userdata,
                 break;
             }
 
-            // Each thread gets its own collection hashmap, which
+            // Each thread gets its own key stats hashmap, which
             // is keyed by each proxy's "binding:name", and whose
-            // values are proxy_stats_td.
-            //
-            if (!(pair->map_pstd = genhash_init(128, strhash_ops))) {
-                break;
-            }
-
-            // Key stats hashmap has same keys and
-            // genhash<string, struct key_stats *> as values.
+            // values are genhash<string, struct key_stats *>.
             //
             if (!(pair->map_key_stats = genhash_init(128, strhash_ops))) {
                 break;
@@ -345,32 +336,20 @@ enum conflate_mgmt_cb_result on_conflate_get_stats(void *userdata,
 
             if (msci.do_stats) {
                 struct stats_gathering_pair *end_pair = ca[1].data;
-                genhash_t *end_pstd = end_pair->map_pstd;
                 genhash_t *end_map_key_stats = end_pair->map_key_stats;
-                if (end_pstd != NULL) {
-                    // Skip the first worker thread (index 1)'s results,
-                    // because that's where we'll aggregate final results.
-                    //
-                    for (i = 2; i < m->nthreads; i++) {
-                        struct stats_gathering_pair *pair = ca[i].data;
-                        genhash_t *map_pstd = pair->map_pstd;
-                        if (map_pstd != NULL) {
-                            genhash_iter(map_pstd, map_pstd_foreach_merge,
-                                         end_pstd);
-                        }
 
-                        genhash_t *map_key_stats = pair->map_key_stats;
-                        if (map_key_stats != NULL) {
-                            genhash_iter(map_key_stats,
-                                         map_key_stats_foreach_merge,
-                                         end_map_key_stats);
-                        }
-                    }
-
-                    genhash_iter(end_pstd, map_pstd_foreach_emit, &msci);
-                    genhash_iter(end_map_key_stats,
-                                 map_key_stats_foreach_emit, &msci);
+                // Skip the first worker thread (index 1)'s results,
+                // because that's where we'll aggregate final results.
+                //
+                for (i = 2; i < m->nthreads; i++) {
+                    struct stats_gathering_pair *pair = ca[i].data;
+                    genhash_iter(pair->map_key_stats,
+                                 map_key_stats_foreach_merge,
+                                 end_map_key_stats);
                 }
+
+                genhash_iter(end_map_key_stats,
+                             map_key_stats_foreach_emit, &msci);
             }
         }
 
@@ -387,11 +366,6 @@ enum conflate_mgmt_cb_result on_conflate_get_stats(void *userdata,
             if (!pair) {
                 continue;
             }
-            genhash_t *map_pstd = pair->map_pstd;
-            if (map_pstd != NULL) {
-                genhash_iter(map_pstd, genhash_free_entry, NULL);
-                genhash_free(map_pstd);
-            }
             genhash_t *map_key_stats = pair->map_key_stats;
             if (map_key_stats != NULL) {
                 genhash_iter(map_key_stats, map_key_stats_foreach_free, NULL);
@@ -406,21 +380,6 @@ enum conflate_mgmt_cb_result on_conflate_get_stats(void *userdata,
     return RV_OK;
 }
 
-void map_pstd_foreach_merge(const void *key,
-                            const void *value,
-                            void *user_data) {
-    genhash_t *map_end_pstd = user_data;
-    if (key != NULL &&
-        map_end_pstd != NULL) {
-        proxy_stats_td *cur_pstd = (proxy_stats_td *) value;
-        proxy_stats_td *end_pstd = genhash_find(map_end_pstd, key);
-        if (cur_pstd != NULL &&
-            end_pstd != NULL) {
-            add_proxy_stats_td(end_pstd, cur_pstd);
-        }
-    }
-}
-
 void map_key_stats_foreach_free(const void *key,
                                 const void *value,
                                 void *user_data) {
@@ -482,6 +441,14 @@ static void proxy_stats_dump_behavior(ADD_STAT add_stats,
               (b->wait_queue_timeout.tv_sec * 1000 +
                b->wait_queue_timeout.tv_usec / 1000));
         APPEND_PREFIX_STAT("time_stats", "%d", b->time_stats);
+        APPEND_PREFIX_STAT("downstream_conn_mux", "%d", b->downstream_conn_mux);
+        APPEND_PREFIX_STAT("downstream_mux_max", "%u", b->downstream_mux_max);
+        APPEND_PREFIX_STAT("coalesce_gets", "%d", b->coalesce_gets);
+        APPEND_PREFIX_STAT("downstream_timeout_adaptive", "%d", b->downstream_timeout_adaptive);
+        APPEND_PREFIX_STAT("downstream_timeout_min", "%u", b->downstream_timeout_min);
+        APPEND_PREFIX_STAT("downstream_hedge", "%d", b->downstream_hedge);
+        APPEND_PREFIX_STAT("downstream_hedge_delay", "%u", b->downstream_hedge_delay);
+        APPEND_PREFIX_STAT("replica_reads", "%d", b->replica_reads);
         APPEND_PREFIX_STAT("connect_max_errors", "%d", b->connect_max_errors);
         APPEND_PREFIX_STAT("connect_retry_interval", "%d", b->connect_retry_interval);
         APPEND_PREFIX_STAT("front_cache_max", "%u", b->front_cache_max);
@@ -493,6 +460,10 @@ static void proxy_stats_dump_behavior(ADD_STAT add_stats,
         APPEND_PREFIX_STAT("key_stats_spec", "%s", b->key_stats_spec);
         APPEND_PREFIX_STAT("key_stats_unspec", "%s", b->key_stats_unspec);
         APPEND_PREFIX_STAT("optimize_set", "%s", b->optimize_set);
+        APPEND_PREFIX_STAT("hot_key_spec", "%s", b->hot_key_spec);
+        APPEND_PREFIX_STAT("hot_key_threshold", "%u", b->hot_key_threshold);
+        APPEND_PREFIX_STAT("hot_key_window", "%u", b->hot_key_window);
+        APPEND_PREFIX_STAT("hot_key_replica_lag", "%u", b->hot_key_replica_lag);
     }
 
     APPEND_PREFIX_STAT("usr",    "%s", b->usr);
@@ -508,36 +479,36 @@ static void proxy_stats_dump_behavior(ADD_STAT add_stats,
 
 static void proxy_stats_dump_frontcache(ADD_STAT add_stats, conn *c,
                                         const char *prefix, proxy *p) {
-    pthread_mutex_lock(p->front_cache.lock);
+    mcache_stats fcs;
+    uint32_t     size;
+    uint32_t     oldest_live;
 
-    if (p->front_cache.map != NULL) {
-        APPEND_PREFIX_STAT("size", "%u", genhash_size(p->front_cache.map));
+    if (mcache_get_stats(&p->front_cache, &fcs, &size, &oldest_live)) {
+        APPEND_PREFIX_STAT("size", "%u", size);
     }
 
     APPEND_PREFIX_STAT("max", "%u", p->front_cache.max);
-    APPEND_PREFIX_STAT("oldest_live", "%u", p->front_cache.oldest_live);
+    APPEND_PREFIX_STAT("oldest_live", "%u", oldest_live);
     APPEND_PREFIX_STAT("tot_get_hits",
-           "%llu", (long long unsigned int) p->front_cache.tot_get_hits);
+           "%llu", (long long unsigned int) fcs.tot_get_hits);
     APPEND_PREFIX_STAT("tot_get_expires",
-           "%llu", (long long unsigned int) p->front_cache.tot_get_expires);
+           "%llu", (long long unsigned int) fcs.tot_get_expires);
     APPEND_PREFIX_STAT("tot_get_misses",
-           "%llu", (long long unsigned int) p->front_cache.tot_get_misses);
+           "%llu", (long long unsigned int) fcs.tot_get_misses);
     APPEND_PREFIX_STAT("tot_get_bytes",
-           "%llu", (long long unsigned int) p->front_cache.tot_get_bytes);
+           "%llu", (long long unsigned int) fcs.tot_get_bytes);
     APPEND_PREFIX_STAT("tot_adds",
-           "%llu", (long long unsigned int) p->front_cache.tot_adds);
+           "%llu", (long long unsigned int) fcs.tot_adds);
     APPEND_PREFIX_STAT("tot_add_skips",
-           "%llu", (long long unsigned int) p->front_cache.tot_add_skips);
+           "%llu", (long long unsigned int) fcs.tot_add_skips);
     APPEND_PREFIX_STAT("tot_add_fails",
-           "%llu", (long long unsigned int) p->front_cache.tot_add_fails);
+           "%llu", (long long unsigned int) fcs.tot_add_fails);
     APPEND_PREFIX_STAT("tot_add_bytes",
-           "%llu", (long long unsigned int) p->front_cache.tot_add_bytes);
+           "%llu", (long long unsigned int) fcs.tot_add_bytes);
     APPEND_PREFIX_STAT("tot_deletes",
-           "%llu", (long long unsigned int) p->front_cache.tot_deletes);
+           "%llu", (long long unsigned int) fcs.tot_deletes);
     APPEND_PREFIX_STAT("tot_evictions",
-           "%llu", (long long unsigned int) p->front_cache.tot_evictions);
-
-    pthread_mutex_unlock(p->front_cache.lock);
+           "%llu", (long long unsigned int) fcs.tot_evictions);
 }
 
 static void proxy_stats_dump_pstd_stats(ADD_STAT add_stats,
@@ -567,6 +538,8 @@ static void proxy_stats_dump_pstd_stats(ADD_STAT add_stats,
               "%llu", (long long unsigned int) pstats->max_downstream_reserved_time);
     APPEND_PREFIX_STAT("tot_downstream_freed",
               "%llu", (long long unsigned int) pstats->tot_downstream_freed);
+    APPEND_PREFIX_STAT("tot_downstream_remap_frees_avoided",
+              "%llu", (long long unsigned int) pstats->tot_downstream_remap_frees_avoided);
     APPEND_PREFIX_STAT("tot_downstream_quit_server",
               "%llu", (long long unsigned int) pstats->tot_downstream_quit_server);
     APPEND_PREFIX_STAT("tot_downstream_max_reached",
@@ -607,6 +580,14 @@ static void proxy_stats_dump_pstd_stats(ADD_STAT add_stats,
               "%llu", (long long unsigned int) pstats->tot_downstream_conn_queue_add);
     APPEND_PREFIX_STAT("tot_downstream_conn_queue_remove",
               "%llu", (long long unsigned int) pstats->tot_downstream_conn_queue_remove);
+    APPEND_PREFIX_STAT("tot_downstream_mux_requests",
+              "%llu", (long long unsigned int) pstats->tot_downstream_mux_requests);
+    APPEND_PREFIX_STAT("tot_downstream_mux_waits",
+              "%llu", (long long unsigned int) pstats->tot_downstream_mux_waits);
+    APPEND_PREFIX_STAT("tot_downstream_mux_orphans",
+              "%llu", (long long unsigned int) pstats->tot_downstream_mux_orphans);
+    APPEND_PREFIX_STAT("max_downstream_mux_inflight",
+              "%llu", (long long unsigned int) pstats->max_downstream_mux_inflight);
     APPEND_PREFIX_STAT("tot_downstream_timeout",
               "%llu", (long long unsigned int) pstats->tot_downstream_timeout);
     APPEND_PREFIX_STAT("tot_wait_queue_timeout",
@@ -627,6 +608,26 @@ static void proxy_stats_dump_pstd_stats(ADD_STAT add_stats,
               "%llu", (long long unsigned int) pstats->tot_multiget_keys_dedupe);
     APPEND_PREFIX_STAT("tot_multiget_bytes_dedupe",
               "%llu", (long long unsigned int) pstats->tot_multiget_bytes_dedupe);
+    APPEND_PREFIX_STAT("tot_coalesce_gets",
+              "%llu", (long long unsigned int) pstats->tot_coalesce_gets);
+    APPEND_PREFIX_STAT("tot_coalesce_bytes",
+              "%llu", (long long unsigned int) pstats->tot_coalesce_bytes);
+    APPEND_PREFIX_STAT("tot_coalesce_retries",
+              "%llu", (long long unsigned int) pstats->tot_coalesce_retries);
+    APPEND_PREFIX_STAT("tot_hot_key_reads",
+              "%llu", (long long unsigned int) pstats->tot_hot_key_reads);
+    APPEND_PREFIX_STAT("tot_hot_key_replica_reads",
+              "%llu", (long long unsigned int) pstats->tot_hot_key_replica_reads);
+    APPEND_PREFIX_STAT("tot_hot_key_replica_rejects",
+              "%llu", (long long unsigned int) pstats->tot_hot_key_replica_rejects);
+    APPEND_PREFIX_STAT("tot_hedge_sent",
+              "%llu", (long long unsigned int) pstats->tot_hedge_sent);
+    APPEND_PREFIX_STAT("tot_hedge_won",
+              "%llu", (long long unsigned int) pstats->tot_hedge_won);
+    APPEND_PREFIX_STAT("tot_b2b_bytes_copied",
+              "%llu", (long long unsigned int) pstats->tot_b2b_bytes_copied);
+    APPEND_PREFIX_STAT("tot_b2b_bytes_direct",
+              "%llu", (long long unsigned int) pstats->tot_b2b_bytes_direct);
     APPEND_PREFIX_STAT("tot_optimize_sets",
               "%llu", (long long unsigned int) pstats->tot_optimize_sets);
     APPEND_PREFIX_STAT("tot_retry",
@@ -877,14 +878,7 @@ void proxy_stats_dump_proxies(ADD_STAT add_stats, conn *c,
         if (pscip->do_stats) {
             proxy_stats_td *pstd = calloc(1, sizeof(proxy_stats_td));
             if (pstd != NULL) {
-                pthread_mutex_lock(&p->proxy_lock);
-                for (int i = 1; i < pm->nthreads; i++) {
-                    proxy_td *thread_ptd = &p->thread_data[i];
-                    if (thread_ptd != NULL) {
-                        add_proxy_stats_td(pstd, &thread_ptd->stats);
-                    }
-                }
-                pthread_mutex_unlock(&p->proxy_lock);
+                add_proxy_stats_snapshots(pstd, p);
 
                 snprintf(prefix, sizeof(prefix), "%u:%s:pstd_stats:",
                          p->port, p->name);
@@ -929,7 +923,10 @@ void proxy_stats_dump_proxies(ADD_STAT add_stats, conn *c,
 
 /* Must be invoked on the main listener thread.
  *
- * Puts stats gathering work on every worker thread's work_queue.
+ * Emits the per-proxy stats, merged from the snapshots that the
+ * worker threads publish, and puts key stats gathering work on the
+ * work_queue of every worker thread, but only for proxies that
+ * have key stats enabled.
  */
 static void main_stats_collect(void *data0, void *data1) {
     struct main_stats_collect_info *msci = data0;
@@ -948,8 +945,8 @@ static void main_stats_collect(void *data0, void *data1) {
     struct main_stats_collect_info ase = *msci;
     ase.prefix = "";
 
-    int sent   = 0;
-    int nproxy = 0;
+    int nproxy    = 0;
+    int nkeystats = 0;
 
     char bufk[200];
     char bufv[4000];
@@ -958,7 +955,20 @@ static void main_stats_collect(void *data0, void *data1) {
 
     for (proxy *p = m->proxy_head; p != NULL; p = p->next) {
         nproxy++;
+    }
+
+    struct main_stats_proxy_info *infos =
+        calloc(nproxy + 1, sizeof(struct main_stats_proxy_info));
+
+    // Proxies whose key stats the worker threads need to collect.
+    // Proxies are never freed, so the pointers stay valid after
+    // we unlock.
+    //
+    proxy **keystats = calloc(nproxy + 1, sizeof(proxy *));
 
+    int n = 0;
+
+    for (proxy *p = m->proxy_head; p != NULL; p = p->next, n++) {
 #define emit_s(key, val)                               \
         snprintf(bufk, sizeof(bufk), "%u:%s:%s",       \
                  p->port,                              \
@@ -1000,118 +1010,118 @@ static void main_stats_collect(void *data0, void *data1) {
                    "%llu", (long long unsigned int) p->listening_failed);
         }
 
+        if (infos != NULL) {
+            infos[n].name = p->name != NULL ? strdup(p->name) : NULL;
+            infos[n].port = p->port;
+        }
+
+        if (msci->do_stats &&
+            keystats != NULL &&
+            p->name != NULL &&
+            p->behavior_pool.base.key_stats_max > 0 &&
+            p->behavior_pool.base.key_stats_lifespan > 0) {
+            keystats[nkeystats++] = p;
+        }
+
         pthread_mutex_unlock(&p->proxy_lock);
 
         // Emit front_cache stats.
         //
         if (msci->do_stats) {
-            pthread_mutex_lock(p->front_cache.lock);
+            mcache_stats fcs;
+            uint32_t     size;
+            uint32_t     oldest_live;
 
-            if (p->front_cache.map != NULL) {
-                emit_f("front_cache_size", "%u", genhash_size(p->front_cache.map));
+            if (mcache_get_stats(&p->front_cache, &fcs,
+                                 &size, &oldest_live)) {
+                emit_f("front_cache_size", "%u", size);
             }
 
             emit_f("front_cache_max",
                    "%u", p->front_cache.max);
             emit_f("front_cache_oldest_live",
-                   "%u", p->front_cache.oldest_live);
+                   "%u", oldest_live);
 
             emit_f("front_cache_tot_get_hits",
                    "%llu",
-                   (long long unsigned int) p->front_cache.tot_get_hits);
+                   (long long unsigned int) fcs.tot_get_hits);
             emit_f("front_cache_tot_get_expires",
                    "%llu",
-                   (long long unsigned int) p->front_cache.tot_get_expires);
+                   (long long unsigned int) fcs.tot_get_expires);
             emit_f("front_cache_tot_get_misses",
                    "%llu",
-                   (long long unsigned int) p->front_cache.tot_get_misses);
+                   (long long unsigned int) fcs.tot_get_misses);
             emit_f("front_cache_tot_get_bytes",
                    "%llu",
-                   (long long unsigned int) p->front_cache.tot_get_bytes);
+                   (long long unsigned int) fcs.tot_get_bytes);
             emit_f("front_cache_tot_adds",
                    "%llu",
-                   (long long unsigned int) p->front_cache.tot_adds);
+                   (long long unsigned int) fcs.tot_adds);
             emit_f("front_cache_tot_add_skips",
                    "%llu",
-                   (long long unsigned int) p->front_cache.tot_add_skips);
+                   (long long unsigned int) fcs.tot_add_skips);
             emit_f("front_cache_tot_add_fails",
                    "%llu",
-                   (long long unsigned int) p->front_cache.tot_add_fails);
+                   (long long unsigned int) fcs.tot_add_fails);
             emit_f("front_cache_tot_add_bytes",
                    "%llu",
-                   (long long unsigned int) p->front_cache.tot_add_bytes);
+                   (long long unsigned int) fcs.tot_add_bytes);
             emit_f("front_cache_tot_deletes",
                    "%llu",
-                   (long long unsigned int) p->front_cache.tot_deletes);
+                   (long long unsigned int) fcs.tot_deletes);
             emit_f("front_cache_tot_evictions",
                    "%llu",
-                   (long long unsigned int) p->front_cache.tot_evictions);
+                   (long long unsigned int) fcs.tot_evictions);
+        }
+
+        // Emit the proxy stats, from the workers' snapshots.
+        //
+        if (msci->do_stats && p->name != NULL) {
+            proxy_stats_td *pstd = calloc(1, sizeof(proxy_stats_td));
+            if (pstd != NULL) {
+                add_proxy_stats_snapshots(pstd, p);
 
-            pthread_mutex_unlock(p->front_cache.lock);
+                snprintf(bufk, sizeof(bufk), "%d:%s", p->port, p->name);
+                map_pstd_foreach_emit(bufk, pstd, msci);
+
+                free(pstd);
+            }
         }
+#undef emit_f
+#undef emit_s
     }
 
     pthread_mutex_unlock(&m->proxy_main_lock);
 
+    msci->proxies = infos;
+    msci->nproxy = infos != NULL ? nproxy : 0;
+
+    // The conflate thread continues as soon as the counts are set,
+    // so msci must not be touched after this point.
+    //
     // Starting at 1 because 0 is the main listen thread.
     //
     for (int i = 1; i < m->nthreads; i++) {
         work_collect *c = &ca[i];
 
-        work_collect_count(c, nproxy);
+        work_collect_count(c, nkeystats);
 
-        if (nproxy > 0) {
+        if (nkeystats > 0) {
             LIBEVENT_THREAD *t = thread_by_index(i);
             assert(t);
             assert(t->work_queue);
 
-            pthread_mutex_lock(&m->proxy_main_lock);
-
-            for (proxy *p = m->proxy_head; p != NULL; p = p->next) {
-                proxy_td *ptd = &p->thread_data[i];
-                if (ptd != NULL &&
-                    work_send(t->work_queue, work_stats_collect, ptd, c)) {
-                    sent++;
+            for (int j = 0; j < nkeystats; j++) {
+                proxy_td *ptd = &keystats[j]->thread_data[i];
+                if (!work_send(t->work_queue, work_stats_collect, ptd, c)) {
+                    work_collect_one(c);
                 }
             }
-
-            pthread_mutex_unlock(&m->proxy_main_lock);
         }
     }
 
-    {
-        struct main_stats_proxy_info *infos =
-            calloc(nproxy, sizeof(struct main_stats_proxy_info));
-
-        pthread_mutex_lock(&m->proxy_main_lock);
+    free(keystats);
 
-        proxy *p = m->proxy_head;
-        for (int i = 0; i < nproxy; i++, p = p->next) {
-            if (p == NULL) {
-                break;
-            }
-
-            pthread_mutex_lock(&p->proxy_lock);
-            infos[i].name = p->name != NULL ? strdup(p->name) : NULL;
-            infos[i].port = p->port;
-            pthread_mutex_unlock(&p->proxy_lock);
-        }
-
-        pthread_mutex_unlock(&m->proxy_main_lock);
-
-        msci->proxies = infos;
-        msci->nproxy = nproxy;
-    }
-
-    // Normally, no need to wait for the worker threads to finish,
-    // as the workers will signal using work_collect_one().
-    //
-    // TODO: If sent is too small, then some proxies were disabled?
-    //       Need to decrement count?
-    //
-    // TODO: Might want to block here until worker threads are done,
-    //       so that concurrent reconfigs don't cause issues.
-    //
     // In the case when config/config_ver changes might already
     // be inflight, as long as they're not removing proxies,
     // we're ok.  New proxies that happen afterwards are fine, too.
@@ -1130,8 +1140,7 @@ static void work_stats_collect(void *data0, void *data1) {
     assert(is_listen_thread() == false); // Expecting a worker thread.
 
     struct stats_gathering_pair *pair = c->data;
-    genhash_t *map_pstd = pair->map_pstd;
-    assert(map_pstd != NULL);
+    assert(pair->map_key_stats != NULL);
 
     pthread_mutex_lock(&p->proxy_lock);
     bool locked = true;
@@ -1145,24 +1154,6 @@ static void work_stats_collect(void *data0, void *data1) {
             pthread_mutex_unlock(&p->proxy_lock);
             locked = false;
 
-            proxy_stats_td *pstd = genhash_find(map_pstd, key_buf);
-            if (pstd == NULL) {
-                pstd = calloc(1, sizeof(proxy_stats_td));
-                if (pstd != NULL) {
-                    char *key = strdup(key_buf);
-                    if (key == NULL) {
-                        free(pstd);
-                        pstd = NULL;
-                    } else {
-                        genhash_update(map_pstd, key, pstd);
-                    }
-                }
-            }
-
-            if (pstd != NULL) {
-                add_proxy_stats_td(pstd, &ptd->stats);
-            }
-
             genhash_t *key_stats_map = genhash_find(pair->map_key_stats, key_buf);
             if (key_stats_map == NULL) {
                 key_stats_map = genhash_init(16, strhash_ops);
@@ -1207,6 +1198,24 @@ static void add_proxy_stats_td(proxy_stats_td *agg,
     }
 }
 
+/* Sums the stats snapshots that the worker threads publish for
+ * a proxy, without waiting on the workers, so the result can be
+ * up to STATS_SNAPSHOT_MSECS old.  Must not be called with the
+ * proxy_lock held.
+ */
+static void add_proxy_stats_snapshots(proxy_stats_td *agg, proxy *p) {
+    assert(agg);
+    assert(p);
+
+    proxy_stats_td snapshot;
+
+    for (int i = 1; i < p->thread_data_num; i++) {
+        cproxy_stats_snapshot_read(&p->thread_data[i], thread_by_index(i),
+                                   &snapshot);
+        add_proxy_stats_td(agg, &snapshot);
+    }
+}
+
 static void add_proxy_stats(proxy_stats *agg, proxy_stats *x) {
     assert(agg);
     assert(x);
@@ -1227,6 +1236,8 @@ static void add_proxy_stats(proxy_stats *agg, proxy_stats *x) {
     }
 
     agg->tot_downstream_freed          += x->tot_downstream_freed;
+    agg->tot_downstream_remap_frees_avoided +=
+        x->tot_downstream_remap_frees_avoided;
     agg->tot_downstream_quit_server    += x->tot_downstream_quit_server;
     agg->tot_downstream_max_reached    += x->tot_downstream_max_reached;
     agg->tot_downstream_create_failed  += x->tot_downstream_create_failed;
@@ -1252,6 +1263,17 @@ static void add_proxy_stats(proxy_stats *agg, proxy_stats *x) {
         x->tot_downstream_conn_queue_add;
     agg->tot_downstream_conn_queue_remove +=
         x->tot_downstream_conn_queue_remove;
+    agg->tot_downstream_mux_requests +=
+        x->tot_downstream_mux_requests;
+    agg->tot_downstream_mux_waits +=
+        x->tot_downstream_mux_waits;
+    agg->tot_downstream_mux_orphans +=
+        x->tot_downstream_mux_orphans;
+
+    if (agg->max_downstream_mux_inflight < x->max_downstream_mux_inflight) {
+        agg->max_downstream_mux_inflight = x->max_downstream_mux_inflight;
+    }
+
     agg->tot_downstream_timeout   += x->tot_downstream_timeout;
     agg->tot_wait_queue_timeout   += x->tot_wait_queue_timeout;
     agg->tot_auth_timeout         += x->tot_auth_timeout;
@@ -1262,6 +1284,16 @@ static void add_proxy_stats(proxy_stats *agg, proxy_stats *x) {
     agg->tot_multiget_keys        += x->tot_multiget_keys;
     agg->tot_multiget_keys_dedupe += x->tot_multiget_keys_dedupe;
     agg->tot_multiget_bytes_dedupe += x->tot_multiget_bytes_dedupe;
+    agg->tot_coalesce_gets        += x->tot_coalesce_gets;
+    agg->tot_coalesce_bytes       += x->tot_coalesce_bytes;
+    agg->tot_coalesce_retries     += x->tot_coalesce_retries;
+    agg->tot_hot_key_reads        += x->tot_hot_key_reads;
+    agg->tot_hot_key_replica_reads += x->tot_hot_key_replica_reads;
+    agg->tot_hot_key_replica_rejects += x->tot_hot_key_replica_rejects;
+    agg->tot_hedge_sent           += x->tot_hedge_sent;
+    agg->tot_hedge_won            += x->tot_hedge_won;
+    agg->tot_b2b_bytes_copied     += x->tot_b2b_bytes_copied;
+    agg->tot_b2b_bytes_direct     += x->tot_b2b_bytes_direct;
     agg->tot_optimize_sets        += x->tot_optimize_sets;
     agg->tot_retry                += x->tot_retry;
     agg->tot_retry_time           += x->tot_retry_time;
@@ -1478,6 +1510,8 @@ void map_pstd_foreach_emit(const void *k,
               pstd->stats.max_downstream_reserved_time);
     more_stat("tot_downstream_freed",
               pstd->stats.tot_downstream_freed);
+    more_stat("tot_downstream_remap_frees_avoided",
+              pstd->stats.tot_downstream_remap_frees_avoided);
     more_stat("tot_downstream_quit_server",
               pstd->stats.tot_downstream_quit_server);
     more_stat("tot_downstream_max_reached",
@@ -1518,6 +1552,14 @@ void map_pstd_foreach_emit(const void *k,
               pstd->stats.tot_downstream_conn_queue_add);
     more_stat("tot_downstream_conn_queue_remove",
               pstd->stats.tot_downstream_conn_queue_remove);
+    more_stat("tot_downstream_mux_requests",
+              pstd->stats.tot_downstream_mux_requests);
+    more_stat("tot_downstream_mux_waits",
+              pstd->stats.tot_downstream_mux_waits);
+    more_stat("tot_downstream_mux_orphans",
+              pstd->stats.tot_downstream_mux_orphans);
+    more_stat("max_downstream_mux_inflight",
+              pstd->stats.max_downstream_mux_inflight);
     more_stat("tot_downstream_timeout",
               pstd->stats.tot_downstream_timeout);
     more_stat("tot_wait_queue_timeout",
@@ -1538,6 +1580,26 @@ void map_pstd_foreach_emit(const void *k,
               pstd->stats.tot_multiget_keys_dedupe);
     more_stat("tot_multiget_bytes_dedupe",
               pstd->stats.tot_multiget_bytes_dedupe);
+    more_stat("tot_coalesce_gets",
+              pstd->stats.tot_coalesce_gets);
+    more_stat("tot_coalesce_bytes",
+              pstd->stats.tot_coalesce_bytes);
+    more_stat("tot_coalesce_retries",
+              pstd->stats.tot_coalesce_retries);
+    more_stat("tot_hot_key_reads",
+              pstd->stats.tot_hot_key_reads);
+    more_stat("tot_hot_key_replica_reads",
+              pstd->stats.tot_hot_key_replica_reads);
+    more_stat("tot_hot_key_replica_rejects",
+              pstd->stats.tot_hot_key_replica_rejects);
+    more_stat("tot_hedge_sent",
+              pstd->stats.tot_hedge_sent);
+    more_stat("tot_hedge_won",
+              pstd->stats.tot_hedge_won);
+    more_stat("tot_b2b_bytes_copied",
+              pstd->stats.tot_b2b_bytes_copied);
+    more_stat("tot_b2b_bytes_direct",
+              pstd->stats.tot_b2b_bytes_direct);
     more_stat("tot_optimize_sets",
               pstd->stats.tot_optimize_sets);
     more_stat("tot_retry",
@@ -1755,6 +1817,7 @@ static void work_stats_reset(void *data0, void *data1) {
     assert(is_listen_thread() == false); // Expecting a worker thread.
 
     cproxy_reset_stats_td(&ptd->stats);
+    cproxy_stats_snapshot_publish(ptd);
 
     mcache_flush_all(&ptd->key_stats, 0);
 
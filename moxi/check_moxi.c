@@ -292,11 +292,10 @@ START_TEST(test_mcache) {
     fail_if(NULL == mcache_get(&m, s_len("ks1"), 0),
             "hit after set");
     mcache_set(&m, &ks9, 0, false, false);
-    fail_if(NULL == mcache_get(&m, s_len("ks9"), 0),
-            "hit after set");
 
-    fail_if(NULL == mcache_get(&m, s_len("ks1"), 0), // We last touched ks1,
-            "hit after set");                        // so ks9 is LRU.
+    fail_if(NULL == mcache_get(&m, s_len("ks1"), 0), // We visited ks1 but
+            "hit after set");                        // not ks9, so the clock
+                                                     // evicts ks9.
 
     key_stats ks8 = {
       .key = "ks8",
@@ -313,6 +312,65 @@ START_TEST(test_mcache) {
             "miss");
     fail_unless(NULL == mcache_get(&m, s_len("ks9"), 0),
                 "miss");
+
+    // Both ks1 and ks8 are visited, so the clock gives each
+    // a second chance, and then evicts the older ks1.
+    //
+    mcache_set(&m, &ks9, 0, false, false);
+    fail_if(NULL == mcache_get(&m, s_len("ks9"), 0),
+            "hit after set");
+    fail_if(NULL == mcache_get(&m, s_len("ks8"), 0),
+            "hit");
+    fail_unless(NULL == mcache_get(&m, s_len("ks1"), 0),
+                "miss");
+}
+END_TEST
+
+START_TEST(test_mcache_sharded)
+{
+    mcache m;
+    mcache_init(&m, true, &mcache_key_stats_funcs, false);
+    fail_unless(m.nshards == MCACHE_SHARDS, "sharded");
+
+    mcache_start(&m, 1000);
+    fail_unless(mcache_started(&m), "started");
+
+    key_stats ks[100];
+    memset(ks, 0, sizeof(ks));
+
+    for (int i = 0; i < 100; i++) {
+        snprintf(ks[i].key, sizeof(ks[i].key), "key%d", i);
+        ks[i].refcount = 1;
+        mcache_set(&m, &ks[i], 0, false, false);
+    }
+
+    for (int i = 0; i < 100; i++) {
+        void *it = mcache_get(&m, s_len(ks[i].key), 0);
+        fail_unless(it == &ks[i], "hit after set");
+        key_stats_dec_ref(it);
+    }
+
+    mcache_delete(&m, s_len("key42"));
+    fail_unless(NULL == mcache_get(&m, s_len("key42"), 0),
+                "miss after deleted");
+
+    mcache_stats st;
+    uint32_t     size = 0;
+    fail_unless(mcache_get_stats(&m, &st, &size, NULL), "stats");
+    fail_unless(size == 99, "size");
+    fail_unless(st.tot_adds == 100, "adds");
+    fail_unless(st.tot_get_hits == 100, "hits");
+    fail_unless(st.tot_get_misses == 1, "misses");
+    fail_unless(st.tot_deletes == 1, "deletes");
+
+    mcache_flush_all(&m, 0);
+    fail_unless(NULL == mcache_get(&m, s_len("key7"), 0),
+                "miss after flush");
+    fail_unless(ks[7].next == NULL && ks[7].prev == NULL,
+                "unlinked after flush");
+
+    mcache_stop(&m);
+    fail_if(mcache_started(&m), "stopped");
 }
 END_TEST
 
@@ -451,6 +509,7 @@ static Suite* moxi_suite(void)
     tcase_add_test(tc_core, test_whitespace);
     tcase_add_test(tc_core, test_parse_behavior);
     tcase_add_test(tc_core, test_mcache);
+    tcase_add_test(tc_core, test_mcache_sharded);
     tcase_add_test(tc_core, test_matcher);
     suite_add_tcase(s, tc_core);
 
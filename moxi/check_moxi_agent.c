@@ -149,6 +149,7 @@ struct field_description proxy_stats_description[] = {
   describe_field(struct proxy_stats, tot_downstream_released),
   describe_field(struct proxy_stats, tot_downstream_reserved),
   describe_field(struct proxy_stats, tot_downstream_freed),
+  describe_field(struct proxy_stats, tot_downstream_remap_frees_avoided),
   describe_field(struct proxy_stats, tot_downstream_quit_server),
   describe_field(struct proxy_stats, tot_downstream_max_reached),
   describe_field(struct proxy_stats, tot_downstream_create_failed),
@@ -160,6 +161,10 @@ struct field_description proxy_stats_description[] = {
   describe_field(struct proxy_stats, tot_downstream_bucket_failed),
   describe_field(struct proxy_stats, tot_downstream_propagate_failed),
   describe_field(struct proxy_stats, tot_downstream_close_on_upstream_close),
+  describe_field(struct proxy_stats, tot_downstream_mux_requests),
+  describe_field(struct proxy_stats, tot_downstream_mux_waits),
+  describe_field(struct proxy_stats, tot_downstream_mux_orphans),
+  describe_field(struct proxy_stats, max_downstream_mux_inflight),
   describe_field(struct proxy_stats, tot_downstream_timeout),
   describe_field(struct proxy_stats, tot_wait_queue_timeout),
   describe_field(struct proxy_stats, tot_assign_downstream),
@@ -170,6 +175,16 @@ struct field_description proxy_stats_description[] = {
   describe_field(struct proxy_stats, tot_multiget_keys),
   describe_field(struct proxy_stats, tot_multiget_keys_dedupe),
   describe_field(struct proxy_stats, tot_multiget_bytes_dedupe),
+  describe_field(struct proxy_stats, tot_coalesce_gets),
+  describe_field(struct proxy_stats, tot_coalesce_bytes),
+  describe_field(struct proxy_stats, tot_coalesce_retries),
+  describe_field(struct proxy_stats, tot_hot_key_reads),
+  describe_field(struct proxy_stats, tot_hot_key_replica_reads),
+  describe_field(struct proxy_stats, tot_hot_key_replica_rejects),
+  describe_field(struct proxy_stats, tot_hedge_sent),
+  describe_field(struct proxy_stats, tot_hedge_won),
+  describe_field(struct proxy_stats, tot_b2b_bytes_copied),
+  describe_field(struct proxy_stats, tot_b2b_bytes_direct),
   describe_field(struct proxy_stats, tot_optimize_sets),
   describe_field(struct proxy_stats, err_oom),
   describe_field(struct proxy_stats, err_upstream_write_prep),
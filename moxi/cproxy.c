@@ -9,6 +9,7 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <math.h>
+#include <sys/socket.h>
 #include "memcached.h"
 #include "cproxy.h"
 #include "work.h"
@@ -18,6 +19,11 @@
 #define MOXI_BLOCKING_CONNECT false
 #endif
 
+// Number of reply latency samples per server between recomputations
+// of the latency percentiles used by adaptive timeouts and hedging.
+//
+#define DOWNSTREAM_LATENCY_WINDOW 1000
+
 // Internal forward declarations.
 //
 downstream *downstream_list_remove(downstream *head, downstream *d);
@@ -57,6 +63,7 @@ conn *zstored_acquire_downstream_conn(downstream *d,
                                       LIBEVENT_THREAD *thread,
                                       mcs_server_st *msst,
                                       proxy_behavior *behavior,
+                                      bool mux,
                                       bool *downstream_conn_max_reached);
 
 void zstored_release_downstream_conn(conn *dc, bool closing);
@@ -67,7 +74,8 @@ void zstored_error_count(LIBEVENT_THREAD *thread,
 
 bool zstored_downstream_waiting_add(downstream *d, LIBEVENT_THREAD *thread,
                                     mcs_server_st *msst,
-                                    proxy_behavior *behavior);
+                                    proxy_behavior *behavior,
+                                    bool mux);
 
 bool zstored_downstream_waiting_remove(downstream *d);
 
@@ -84,15 +92,50 @@ typedef struct {
     //
     downstream *downstream_waiting_head;
     downstream *downstream_waiting_tail;
+
+    // The writer conn of the downstream_mux shared by all downstreams
+    // of this thread, when downstream_conn_mux is enabled.  Downstreams
+    // wait on the mux_waiting queue while the writer is busy.
+    //
+    conn       *mux;
+    downstream *mux_waiting_head;
+    downstream *mux_waiting_tail;
+
+    // Reply latencies, in usecs, of non-multiplexed conns, when
+    // downstream_timeout_adaptive or downstream_hedge are enabled.
+    // The percentiles are from the last full window of samples,
+    // or 0 before there's been one.
+    //
+    HTGRAM_HANDLE latency;
+    uint32_t      latency_samples;
+    uint64_t      latency_p95;
+    uint64_t      latency_p99;
 } zstored_downstream_conns;
 
 zstored_downstream_conns *zstored_get_downstream_conns(LIBEVENT_THREAD *thread,
                                                        const char *host_ident);
 
+static void zstored_mux_wake(zstored_downstream_conns *conns);
+
+static bool downstream_mux_init(conn *w, zstored_downstream_conns *conns);
+static bool downstream_mux_start_reader(conn *w);
+static void downstream_mux_detach(conn *dc, downstream *d);
+static void downstream_mux_pause(conn *c);
+static void downstream_mux_close(conn *c);
+
+static void downstream_conn_closed(downstream *d, conn *c, int k);
+
+static struct timeval downstream_adaptive_timeout(downstream *d, conn *c,
+                                                  struct timeval dt);
+static uint64_t downstream_latency_p95(conn *c);
+
 bool cproxy_forward_or_error(downstream *d);
 
 int delink_from_downstream_conns(conn *c);
 
+static bool cproxy_remap_downstream(downstream *d, mcs_st *next,
+                                    int next_n);
+
 int cproxy_num_active_proxies(proxy_main *m);
 
 // Function tables.
@@ -135,7 +178,7 @@ conn_funcs cproxy_downstream_funcs = {
     .conn_complete_nread_binary  = cproxy_process_downstream_binary_nread,
     .conn_pause                  = cproxy_on_pause_downstream_conn,
     .conn_realtime               = cproxy_realtime,
-    .conn_state_change           = NULL,
+    .conn_state_change           = cproxy_downstream_state_change,
     .conn_binary_command_magic   = PROTOCOL_BINARY_RES
 };
 
@@ -238,7 +281,12 @@ proxy *cproxy_create(proxy_main *main,
                 ptd->downstream_tot = 0;
                 ptd->downstream_num = 0;
                 ptd->downstream_max = behavior_pool->base.downstream_max;
+                ptd->downstream_mux_max =
+                    behavior_pool->base.downstream_mux_max;
+                ptd->downstream_reserved_num = 0;
+                ptd->downstream_mux_reserved_num = 0;
                 ptd->downstream_assigns = 0;
+                ptd->coalesce_gets = NULL;
                 ptd->timeout_tv.tv_sec = 0;
                 ptd->timeout_tv.tv_usec = 0;
                 ptd->stats.stats.num_upstream = 0;
@@ -266,6 +314,11 @@ proxy *cproxy_create(proxy_main *main,
                                       behavior_pool->base.key_stats_unspec);
                     }
                 }
+
+                matcher_init(&ptd->hot_key_matcher, false);
+                ptd->hot_keys = NULL;
+
+                cproxy_hot_keys_start(ptd);
             }
 
             return p;
@@ -564,6 +617,9 @@ void cproxy_on_close_upstream_conn(conn *c) {
     for (downstream *d = ptd->downstream_reserved; d != NULL; d = d->next) {
         bool found = false;
 
+        d->coalesce_conns = conn_list_remove(d->coalesce_conns, NULL,
+                                             c, NULL);
+
         d->upstream_conn = conn_list_remove(d->upstream_conn, NULL,
                                             c, &found);
         if (d->upstream_conn == NULL) {
@@ -605,7 +661,9 @@ void cproxy_on_close_upstream_conn(conn *c) {
                 conn *downstream_conn = d->downstream_conns[i];
                 if (downstream_conn != NULL &&
                     downstream_conn != NULL_CONN &&
-                    downstream_conn->state == conn_mwrite) {
+                    downstream_conn->state == conn_mwrite &&
+                    (downstream_conn->mux == NULL ||
+                     downstream_conn->extra == d)) {
                     downstream_conn->msgcurr = 0;
                     downstream_conn->msgused = 0;
                     downstream_conn->iovused = 0;
@@ -669,6 +727,14 @@ void cproxy_on_close_downstream_conn(conn *c) {
         moxi_log_write("<%d cproxy_on_close_downstream_conn\n", c->sfd);
     }
 
+    // A multiplexed conn fails all the requests in flight on it,
+    // and is not counted in the zstored conn pool.
+    //
+    bool mux = c->mux != NULL;
+    if (mux) {
+        downstream_mux_close(c);
+    }
+
     downstream *d = c->extra;
 
     // Might have been set to NULL during cproxy_free_downstream().
@@ -683,11 +749,16 @@ void cproxy_on_close_downstream_conn(conn *c) {
         return;
     }
 
+    if (d->hedge_conn == c) {
+        d->hedge_conn = NULL;
+    }
+
     int k = delink_from_downstream_conns(c);
 
     c->extra = NULL;
 
-    if (c->thread != NULL &&
+    if (!mux &&
+        c->thread != NULL &&
         c->host_ident != NULL) {
         zstored_error_count(c->thread, c->host_ident, true);
     }
@@ -695,10 +766,21 @@ void cproxy_on_close_downstream_conn(conn *c) {
     proxy_td *ptd = d->ptd;
     assert(ptd);
 
-    if (ptd->stats.stats.num_downstream_conn > 0) {
+    if (!mux &&
+        ptd->stats.stats.num_downstream_conn > 0) {
         ptd->stats.stats.num_downstream_conn--;
     }
 
+    downstream_conn_closed(d, c, k);
+}
+
+/* Error handling for a downstream whose conn (at index k, or -1 if
+ * no longer linked) was closed.
+ */
+static void downstream_conn_closed(downstream *d, conn *c, int k) {
+    proxy_td *ptd = d->ptd;
+    assert(ptd);
+
     if (k < 0) {
         // If this downstream conn wasn't linked into the
         // downstream, it was delinked already during connect error
@@ -863,8 +945,13 @@ void cproxy_add_downstream(proxy_td *ptd) {
     assert(ptd != NULL);
     assert(ptd->proxy != NULL);
 
+    // Downstreams reserved against downstream_mux_max are kept
+    // for reuse too, so there might be that many more.
+    //
     if (ptd->downstream_max == 0 ||
-        ptd->downstream_num < ptd->downstream_max) {
+        ptd->downstream_mux_max == 0 ||
+        ptd->downstream_num < ptd->downstream_max +
+                              ptd->downstream_mux_max) {
         if (settings.verbose > 2) {
             moxi_log_write("cproxy_add_downstream %d %d\n",
                     ptd->downstream_num,
@@ -894,9 +981,28 @@ void cproxy_add_downstream(proxy_td *ptd) {
     }
 }
 
-downstream *cproxy_reserve_downstream(proxy_td *ptd) {
+/* Reserves a downstream for an upstream request, where mux is true
+ * if the request will be pipelined over a shared downstream conn
+ * (see cproxy_mux_eligible()).  Requests that hold a downstream
+ * conn of their own count against downstream_max, while pipelined
+ * ones, which don't, first count against downstream_mux_max.
+ */
+downstream *cproxy_reserve_downstream(proxy_td *ptd, bool mux) {
     assert(ptd != NULL);
 
+    int plain_num = ptd->downstream_reserved_num -
+                    ptd->downstream_mux_reserved_num;
+
+    mux = mux &&
+          (ptd->downstream_mux_max == 0 ||
+           ptd->downstream_mux_reserved_num < ptd->downstream_mux_max);
+    if (!mux &&
+        ptd->downstream_max != 0 &&
+        plain_num >= ptd->downstream_max) {
+        ptd->stats.stats.tot_downstream_max_reached++;
+        return NULL;
+    }
+
     // Loop in case we need to clear out downstreams
     // that have outdated configs.
     //
@@ -955,6 +1061,14 @@ downstream *cproxy_reserve_downstream(proxy_td *ptd) {
             d->next = ptd->downstream_reserved;
             ptd->downstream_reserved = d;
 
+            assert(!d->reserved);
+            d->reserved = true;
+            d->mux_reserved = mux;
+            ptd->downstream_reserved_num++;
+            if (mux) {
+                ptd->downstream_mux_reserved_num++;
+            }
+
             ptd->stats.stats.tot_downstream_reserved++;
 
             return d;
@@ -993,6 +1107,7 @@ bool cproxy_release_downstream(downstream *d, bool force) {
     // to avoid pegging CPU with leaked timeout_events.
     //
     cproxy_clear_timeout(d);
+    cproxy_clear_hedge(d);
 
     // If we need to retry the command, we do so here,
     // keeping the same downstream that would otherwise
@@ -1037,6 +1152,10 @@ bool cproxy_release_downstream(downstream *d, bool force) {
         }
     }
 
+    // Let gets that coalesced onto this downstream go on their own.
+    //
+    cproxy_coalesce_done(d);
+
     // Record reserved_time histogram timings.
     //
     if (d->usec_start > 0) {
@@ -1164,8 +1283,24 @@ bool cproxy_release_downstream(downstream *d, bool force) {
         conn *dc = d->downstream_conns[i];
         d->downstream_conns[i] = NULL;
         if (dc != NULL) {
-            zstored_release_downstream_conn(dc, false);
+            if (dc != NULL_CONN &&
+                dc->mux != NULL) {
+                downstream_mux_detach(dc, d);
+            } else {
+                zstored_release_downstream_conn(dc, false);
+            }
+        }
+    }
+
+    if (d->reserved) {
+        d->reserved = false;
+        d->ptd->downstream_reserved_num--;
+        if (d->mux_reserved) {
+            d->mux_reserved = false;
+            d->ptd->downstream_mux_reserved_num--;
         }
+        assert(d->ptd->downstream_reserved_num >= 0);
+        assert(d->ptd->downstream_mux_reserved_num >= 0);
     }
 
     // If this downstream still has the same configuration as our top-level
@@ -1200,6 +1335,9 @@ void cproxy_free_downstream(downstream *d) {
     assert(d->upstream_conn == NULL);
     assert(d->multiget == NULL);
     assert(d->merger == NULL);
+    assert(d->coalesce_key == NULL);
+    assert(d->coalesce_conns == NULL);
+    assert(d->coalesce_mutation == false);
     assert(d->timeout_tv.tv_sec == 0);
     assert(d->timeout_tv.tv_usec == 0);
 
@@ -1224,9 +1362,15 @@ void cproxy_free_downstream(downstream *d) {
 
     if (d->downstream_conns != NULL) {
         for (int i = 0; i < n; i++) {
-            if (d->downstream_conns[i] != NULL &&
-                d->downstream_conns[i] != NULL_CONN) {
-                d->downstream_conns[i]->extra = NULL;
+            conn *dc = d->downstream_conns[i];
+            if (dc != NULL &&
+                dc != NULL_CONN) {
+                if (dc->mux != NULL) {
+                    d->downstream_conns[i] = NULL;
+                    downstream_mux_detach(dc, d);
+                } else {
+                    dc->extra = NULL;
+                }
             }
         }
     }
@@ -1238,6 +1382,7 @@ void cproxy_free_downstream(downstream *d) {
     mcs_free(&d->mst);
 
     cproxy_clear_timeout(d);
+    cproxy_clear_hedge(d);
 
     if (d->downstream_conns != NULL) {
         free(d->downstream_conns);
@@ -1342,13 +1487,11 @@ bool cproxy_check_downstream_config(downstream *d) {
     if (d->config_ver == d->ptd->config_ver) {
         rv = true;
     } else if (d->config != NULL &&
-               d->ptd->config != NULL &&
-               cproxy_equal_behaviors(d->behaviors_num,
-                                      d->behaviors_arr,
-                                      d->ptd->behavior_pool.num,
-                                      d->ptd->behavior_pool.arr)) {
-        // Parse the proxy/parent's config to see if we can
-        // reuse our existing downstream connections.
+               d->ptd->config != NULL) {
+        // Parse the proxy/parent's config once to see if we can
+        // reuse our existing downstream connections, either with
+        // a stable update when only the vbucket map changed, or
+        // by remapping an idle downstream to a new server list.
         //
         char *usr = d->ptd->behavior_pool.base.usr[0] != '\0' ?
             d->ptd->behavior_pool.base.usr :
@@ -1362,7 +1505,11 @@ bool cproxy_check_downstream_config(downstream *d) {
         int n = init_mcs_st(&next, d->ptd->config, usr, pwd,
                             d->ptd->behavior_pool.base.mcs_opts);
         if (n > 0) {
-            if (mcs_stable_update(&d->mst, &next)) {
+            if (cproxy_equal_behaviors(d->behaviors_num,
+                                       d->behaviors_arr,
+                                       d->ptd->behavior_pool.num,
+                                       d->ptd->behavior_pool.arr) &&
+                mcs_stable_update(&d->mst, &next)) {
                 if (settings.verbose > 2) {
                     moxi_log_write("check_downstream_config stable update\n");
                 }
@@ -1371,6 +1518,8 @@ bool cproxy_check_downstream_config(downstream *d) {
                 d->config     = strdup(d->ptd->config);
                 d->config_ver = d->ptd->config_ver;
                 rv = true;
+            } else {
+                rv = cproxy_remap_downstream(d, &next, n);
             }
 
             mcs_free(&next);
@@ -1384,6 +1533,99 @@ bool cproxy_check_downstream_config(downstream *d) {
     return rv;
 }
 
+/* Updates an idle downstream in place to the proxy's config after
+ * the server list changed, such as when servers are added or removed
+ * during a rebalance, instead of freeing it and creating a new one.
+ * The next mcs_st is the already parsed proxy config, with next_n
+ * servers, and is taken over (and left zeroed) on success.  Returns
+ * false if the downstream isn't idle or a server that remains got
+ * different behaviors, in which case the downstream should be freed.
+ */
+static bool cproxy_remap_downstream(downstream *d, mcs_st *next,
+                                    int next_n) {
+    assert(d != NULL);
+    assert(d->ptd != NULL);
+    assert(next != NULL);
+
+    proxy_td *ptd = d->ptd;
+
+    if (d->upstream_conn != NULL ||
+        d->downstream_conns == NULL ||
+        next_n != ptd->behavior_pool.num) {
+        return false;
+    }
+
+    int n = mcs_server_count(&d->mst);
+    for (int i = 0; i < n; i++) {
+        if (d->downstream_conns[i] != NULL) {
+            return false;
+        }
+    }
+
+    bool ok = true;
+
+    for (int j = 0; ok && j < next_n; j++) {
+        mcs_server_st *msst = mcs_server_index(next, j);
+
+        char *ident = mcs_server_st_ident(msst, false);
+
+        for (int i = 0; i < n; i++) {
+            if (strcmp(ident,
+                       mcs_server_st_ident(mcs_server_index(&d->mst, i),
+                                           false)) == 0) {
+                ok = cproxy_equal_behavior(&d->behaviors_arr[i],
+                                           &ptd->behavior_pool.arr[j]);
+                break;
+            }
+        }
+    }
+
+    conn **conns = NULL;
+    proxy_behavior *behaviors_arr = NULL;
+    char *config = NULL;
+
+    if (ok) {
+        conns = (conn **) calloc(next_n, sizeof(conn *));
+        behaviors_arr = cproxy_copy_behaviors(ptd->behavior_pool.num,
+                                              ptd->behavior_pool.arr);
+        config = strdup(ptd->config);
+    }
+
+    if (conns == NULL ||
+        behaviors_arr == NULL ||
+        config == NULL) {
+        free(conns);
+        free(behaviors_arr);
+        free(config);
+
+        return false;
+    }
+
+    if (settings.verbose > 2) {
+        moxi_log_write("remap_downstream %d to %d servers\n",
+                       n, next_n);
+    }
+
+    mcs_free(&d->mst);
+    d->mst = *next;
+    memset(next, 0, sizeof(*next));
+
+    free(d->downstream_conns);
+    d->downstream_conns = conns;
+
+    free(d->behaviors_arr);
+    d->behaviors_arr = behaviors_arr;
+    d->behaviors_num = ptd->behavior_pool.num;
+
+    free(d->config);
+    d->config     = config;
+    d->config_ver = ptd->config_ver;
+
+    ptd->stats.stats.tot_downstream_remap_frees_avoided++;
+
+    return true;
+}
+
 // Returns -1 if the connections aren't fully assigned and ready.
 // In that case, the downstream has to wait for a downstream connection
 // to get out of the conn_connecting state.
@@ -1456,10 +1698,22 @@ int cproxy_connect_downstream(downstream *d, LIBEVENT_THREAD *thread,
 
             bool downstream_conn_max_reached = false;
 
+            // Only single-key requests with a single, non-quiet reply
+            // can be pipelined over a multiplexed conn.
+            //
+            bool mux = (i == server_index &&
+                        d->behaviors_arr[i].downstream_conn_mux &&
+                        IS_BINARY(d->behaviors_arr[i].downstream_protocol) &&
+                        c != NULL &&
+                        c->peer_protocol == 0 &&
+                        c->noreply == false &&
+                        c->next == NULL);
+
             d->downstream_conns[i] =
                 zstored_acquire_downstream_conn(d, thread,
                                                 msst_actual,
                                                 &d->behaviors_arr[i],
+                                                mux,
                                                 &downstream_conn_max_reached);
             if (c != NULL &&
                 i == server_index &&
@@ -1490,7 +1744,8 @@ int cproxy_connect_downstream(downstream *d, LIBEVENT_THREAD *thread,
 
                 if (zstored_downstream_waiting_add(d, thread,
                                                    msst_actual,
-                                                   &d->behaviors_arr[i]) == true) {
+                                                   &d->behaviors_arr[i],
+                                                   mux) == true) {
                     // Since we're waiting on the downstream conn queue,
                     // start a downstream timer per configuration.
                     //
@@ -1660,6 +1915,22 @@ conn *cproxy_find_downstream_conn_ex(downstream *d,
     int v = -1;
     int s = cproxy_server_index(d, key, key_length, &v);
 
+    if (d->ptd->hot_keys != NULL &&
+        s >= 0 &&
+        s < (int) mcs_server_count(&d->mst) &&
+        (d->downstream_conns[s] == NULL ||
+         d->downstream_conns[s] == NULL_CONN)) {
+        // A replica was picked for a hot key read that wasn't a hot
+        // key read when the downstream conns were connected, so fall
+        // back to the master.
+        //
+        s = (int) mcs_key_hash(&d->mst, key, key_length, &v);
+    }
+
+    if (d->ptd->hot_keys != NULL && s >= 0) {
+        cproxy_hot_key_touch(d, key, key_length, s, v);
+    }
+
     if (settings.verbose > 2 && s >= 0) {
         moxi_log_write("%d: server_index %d, vbucket %d, conn %d\n", s, v,
                        (d->upstream_conn != NULL ?
@@ -1738,7 +2009,8 @@ bool cproxy_update_event_write(downstream *d, conn *c) {
 
 /**
  * Do a hash through libmemcached to see which server (by index)
- * should hold a given key.
+ * should hold a given key.  Reads of hot keys might instead be
+ * spread to a replica.
  */
 int cproxy_server_index(downstream *d, char *key, size_t key_length,
                         int *vbucket) {
@@ -1750,7 +2022,38 @@ int cproxy_server_index(downstream *d, char *key, size_t key_length,
         return -1;
     }
 
-    return (int) mcs_key_hash(&d->mst, key, key_length, vbucket);
+    int v = -1;
+    int s = (int) mcs_key_hash(&d->mst, key, key_length, &v);
+
+    if (vbucket != NULL) {
+        *vbucket = v;
+    }
+
+    if (d->ptd->hot_keys != NULL) {
+        s = cproxy_hot_key_server_index(d, key, key_length, s, v);
+    }
+
+    return s;
+}
+
+/* Returns true if the waiting upstream request is a single-key,
+ * single-reply request that will be pipelined over the shared
+ * downstream conn, so it can be reserved against downstream_mux_max.
+ */
+static bool cproxy_mux_eligible(proxy_td *ptd, conn *uc) {
+    proxy_behavior *b = &ptd->behavior_pool.base;
+
+    if (!b->downstream_conn_mux ||
+        !IS_BINARY(b->downstream_protocol) ||
+        uc->peer_protocol != 0 ||
+        uc->noreply ||
+        uc->corked != NULL) {
+        return false;
+    }
+
+    int cmd = IS_BINARY(uc->protocol) ? uc->cmd : (int) uc->cmd_curr;
+
+    return cproxy_is_broadcast_cmd(cmd) == false;
 }
 
 void cproxy_assign_downstream(proxy_td *ptd) {
@@ -1776,11 +2079,30 @@ void cproxy_assign_downstream(proxy_td *ptd) {
     bool  stop = false;
 
     while (ptd->waiting_any_downstream_head != NULL && !stop) {
-        if (ptd->waiting_any_downstream_head == tail) {
+        conn *uc = ptd->waiting_any_downstream_head;
+        conn *uc_prev = NULL;
+
+        bool mux = cproxy_mux_eligible(ptd, uc);
+
+        downstream *d = cproxy_reserve_downstream(ptd, mux);
+        if (d == NULL && !mux && ptd->downstream_num > 0) {
+            // The head waits for downstream_max, but requests behind
+            // it that get pipelined needn't, so let them pass.
+            //
+            while (uc != tail) {
+                uc_prev = uc;
+                uc = uc->next;
+                if (cproxy_mux_eligible(ptd, uc)) {
+                    d = cproxy_reserve_downstream(ptd, true);
+                    break;
+                }
+            }
+        }
+
+        if (uc == tail) {
             stop = true;
         }
 
-        downstream *d = cproxy_reserve_downstream(ptd);
         if (d == NULL) {
             if (ptd->downstream_num <= 0) {
                 // Absolutely no downstreams connected, so
@@ -1811,17 +2133,22 @@ void cproxy_assign_downstream(proxy_td *ptd) {
         assert(d->downstream_used_start == 0);
         assert(d->multiget == NULL);
         assert(d->merger == NULL);
+        assert(d->coalesce_key == NULL);
+        assert(d->coalesce_mutation == false);
         assert(d->timeout_tv.tv_sec == 0);
         assert(d->timeout_tv.tv_usec == 0);
 
-        // We have a downstream reserved, so assign the first
-        // waiting upstream conn to it.
+        // We have a downstream reserved, so assign the waiting
+        // upstream conn to it.
         //
-        d->upstream_conn = ptd->waiting_any_downstream_head;
-        ptd->waiting_any_downstream_head =
-            ptd->waiting_any_downstream_head->next;
-        if (ptd->waiting_any_downstream_head == NULL) {
-            ptd->waiting_any_downstream_tail = NULL;
+        d->upstream_conn = uc;
+        if (uc_prev == NULL) {
+            ptd->waiting_any_downstream_head = uc->next;
+        } else {
+            uc_prev->next = uc->next;
+        }
+        if (ptd->waiting_any_downstream_tail == uc) {
+            ptd->waiting_any_downstream_tail = uc_prev;
         }
         d->upstream_conn->next = NULL;
 
@@ -1834,7 +2161,8 @@ void cproxy_assign_downstream(proxy_td *ptd) {
         //
         conn *uc_last = d->upstream_conn;
 
-        while (is_compatible_request(uc_last,
+        while (uc_prev == NULL &&
+               is_compatible_request(uc_last,
                                      ptd->waiting_any_downstream_head)) {
             uc_last->next = ptd->waiting_any_downstream_head;
 
@@ -1858,6 +2186,11 @@ void cproxy_assign_downstream(proxy_td *ptd) {
                     d->upstream_conn->sfd);
         }
 
+        // Register before forwarding, as a forward that fails
+        // releases the downstream, which unregisters it.
+        //
+        cproxy_coalesce_start(d);
+
         if (cproxy_forward(d) == false) {
             // TODO: This stat is incorrect, as we might reach here
             // when we have entire front cache hit or talk-to-self
@@ -2154,6 +2487,11 @@ void cproxy_on_pause_downstream_conn(conn *c) {
                 c->sfd);
     }
 
+    if (c->mux != NULL) {
+        downstream_mux_pause(c);
+        return;
+    }
+
     downstream *d = c->extra;
     assert(d != NULL);
     assert(d->ptd != NULL);
@@ -2206,7 +2544,7 @@ struct timeval cproxy_get_downstream_timeout(downstream *d, conn *c) {
             rv = d->behaviors_arr[i].downstream_timeout;
             if (rv.tv_sec != 0 ||
                 rv.tv_usec != 0) {
-                return rv;
+                return downstream_adaptive_timeout(d, c, rv);
             }
         }
     }
@@ -2216,6 +2554,85 @@ struct timeval cproxy_get_downstream_timeout(downstream *d, conn *c) {
 
     rv = ptd->behavior_pool.base.downstream_timeout;
 
+    return downstream_adaptive_timeout(d, c, rv);
+}
+
+/* Returns twice the p99 reply latency of the server of a downstream
+ * conn, in usecs, or 0 when there's no estimate yet.
+ */
+static uint64_t downstream_latency_timeout(conn *c) {
+    if (c == NULL ||
+        c == NULL_CONN ||
+        c->mux != NULL ||
+        c->thread == NULL ||
+        c->host_ident == NULL) {
+        return 0;
+    }
+
+    zstored_downstream_conns *conns =
+        zstored_get_downstream_conns(c->thread, c->host_ident);
+    if (conns == NULL) {
+        return 0;
+    }
+
+    return conns->latency_p99 * 2;
+}
+
+/* When downstream_timeout_adaptive is enabled, shortens a static
+ * downstream timeout, dt, based on the observed latency of the
+ * server of conn c, or of the slowest server in use by d when c is
+ * NULL.  A static timeout of 0 (no timeout) imposes no ceiling.
+ */
+static struct timeval downstream_adaptive_timeout(downstream *d, conn *c,
+                                                  struct timeval dt) {
+    proxy_behavior *b = &d->ptd->behavior_pool.base;
+    if (b->downstream_timeout_adaptive == false) {
+        return dt;
+    }
+
+    uint64_t usec = 0;
+
+    if (c != NULL) {
+        usec = downstream_latency_timeout(c);
+    } else if (d->downstream_conns != NULL) {
+        int n = mcs_server_count(&d->mst);
+
+        for (int i = 0; i < n; i++) {
+            conn *dc = d->downstream_conns[i];
+            if (dc != NULL &&
+                dc != NULL_CONN) {
+                uint64_t x = downstream_latency_timeout(dc);
+                if (x == 0) {
+                    return dt; // A server without an estimate.
+                }
+
+                if (usec < x) {
+                    usec = x;
+                }
+            }
+        }
+    }
+
+    if (usec == 0) {
+        return dt;
+    }
+
+    uint64_t usec_min = (uint64_t) b->downstream_timeout_min * 1000;
+    if (usec < usec_min) {
+        usec = usec_min;
+    }
+
+    uint64_t usec_max = dt.tv_sec * 1000000 + dt.tv_usec;
+    if (usec_max > 0 &&
+        usec >= usec_max) {
+        return dt;
+    }
+
+    struct timeval rv;
+
+    rv.tv_sec  = usec / 1000000;
+    rv.tv_usec = usec % 1000000;
+
     return rv;
 }
 
@@ -2712,7 +3129,15 @@ void downstream_timeout(const int fd,
         for (int i = 0; i < n; i++) {
             conn *dc = d->downstream_conns[i];
             if (dc != NULL &&
-                dc != NULL_CONN) {
+                dc != NULL_CONN &&
+                dc->mux != NULL) {
+                // Other downstreams still have requests in flight
+                // on a multiplexed conn, so just forget about ours.
+                //
+                d->downstream_conns[i] = NULL;
+                downstream_mux_detach(dc, d);
+            } else if (dc != NULL &&
+                       dc != NULL_CONN) {
                 // We have to de-link early, because we don't want
                 // to have cproxy_close_conn() release the downstream
                 // while we're in the middle of this loop.
@@ -2773,93 +3198,333 @@ bool cproxy_start_downstream_timeout_ex(downstream *d, conn *c,
     return (evtimer_add(&d->timeout_event, &d->timeout_tv) == 0);
 }
 
-// Return 0 on success, -1 on general failure, 1 on timeout failure.
-//
-int cproxy_auth_downstream(mcs_server_st *server,
-                           proxy_behavior *behavior,
-                           int fd) {
-    assert(server);
-    assert(behavior);
-    assert(fd != -1);
+/* Timer callback that re-sends a slow single-key get to the replica
+ * chosen by cproxy_start_downstream_hedge(), over an idle conn from
+ * the pool, as a hedge that has to wait for a connect() would rarely
+ * win.
+ */
+static void downstream_hedge(const int fd,
+                             const short which,
+                             void *arg) {
+    (void)fd;
+    (void)which;
 
-    char buf[3000];
+    downstream *d = arg;
+    assert(d != NULL);
+    assert(d->ptd != NULL);
 
-    if (!IS_BINARY(behavior->downstream_protocol)) {
-        return 0;
+    d->hedge_armed = false;
+
+    conn *uc = d->upstream_conn;
+    int   r  = d->hedge_server;
+
+    if (uc == NULL ||
+        d->hedge_conn != NULL ||
+        d->downstream_used != 1 ||
+        r < 0 ||
+        r >= (int) mcs_server_count(&d->mst) ||
+        d->downstream_conns[r] != NULL) {
+        return;
     }
 
-    const char *usr = mcs_server_st_usr(server) != NULL ?
-        mcs_server_st_usr(server) : behavior->usr;
-    const char *pwd = mcs_server_st_pwd(server) != NULL ?
-        mcs_server_st_pwd(server) : behavior->pwd;
+    char *key     = NULL;
+    int   key_len = 0;
 
-    int usr_len = strlen(usr);
-    int pwd_len = strlen(pwd);
+    if (ascii_scan_key(uc->cmd_start, &key, &key_len) == false ||
+        key == NULL ||
+        key_len <= 0) {
+        return;
+    }
 
-    if (usr_len <= 0) {
-        return 0;
+    int vbucket = -1;
+
+    mcs_key_hash(&d->mst, key, key_len, &vbucket);
+    if (vbucket < 0) {
+        return;
     }
 
-    if (settings.verbose > 2) {
-        moxi_log_write("cproxy_auth_downstream usr: %s pwd: (%d)\n",
-                       usr, pwd_len);
+    mcs_server_st *msst = mcs_server_index(&d->mst, r);
+
+    zstored_downstream_conns *conns =
+        zstored_get_downstream_conns(uc->thread,
+                                     mcs_server_st_ident(msst, false));
+    if (conns == NULL ||
+        conns->dc == NULL) {
+        return;
     }
 
-    if (usr_len <= 0 ||
-        !IS_PROXY(behavior->downstream_protocol) ||
-        (usr_len + pwd_len + 50 > (int) sizeof(buf))) {
-        if (settings.verbose > 1) {
-            moxi_log_write("auth failure args\n");
-        }
+    bool downstream_conn_max_reached = false;
 
-        return -1; // Probably misconfigured.
+    conn *dc = zstored_acquire_downstream_conn(d, uc->thread, msst,
+                                               &d->behaviors_arr[r],
+                                               false,
+                                               &downstream_conn_max_reached);
+    if (dc == NULL) {
+        return;
     }
 
-    // The key should look like "PLAIN", or the sasl mech string.
-    // The data should look like "\0usr\0pwd".  So, the body buf
-    // should look like "PLAIN\0usr\0pwd".
-    //
-    // TODO: Allow binary passwords.
-    //
-    int buf_len = snprintf(buf, sizeof(buf), "PLAIN%c%s%c%s",
-                           0, usr,
-                           0, pwd);
-    assert(buf_len == 7 + usr_len + pwd_len);
+    d->downstream_conns[r] = dc;
 
-    protocol_binary_request_header req = { .bytes = {0} };
+    if (cproxy_prep_conn_for_write(dc) == false) {
+        d->downstream_conns[r] = NULL;
+        zstored_release_downstream_conn(dc, true);
+        return;
+    }
 
-    req.request.magic    = PROTOCOL_BINARY_REQ;
-    req.request.opcode   = PROTOCOL_BINARY_CMD_SASL_AUTH;
-    req.request.keylen   = htons((uint16_t) 5); // 5 == strlen("PLAIN").
-    req.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
-    req.request.bodylen  = htonl(buf_len);
+    protocol_binary_request_header *header =
+        (protocol_binary_request_header *) dc->wbuf;
 
-    if (mcs_io_write(fd, (const char *) req.bytes,
-                     sizeof(req.bytes)) != sizeof(req.bytes) ||
-        mcs_io_write(fd, buf, buf_len) == -1) {
-        mcs_io_reset(fd);
+    memset(header, 0, sizeof(header->bytes));
 
-        if (settings.verbose > 1) {
-            moxi_log_write("auth failure during write for %s (%d)\n",
-                           usr, buf_len);
-        }
+    header->request.magic    = PROTOCOL_BINARY_REQ;
+    header->request.opcode   = PROTOCOL_BINARY_CMD_GETK;
+    header->request.keylen   = htons(key_len);
+    header->request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    header->request.reserved = htons(vbucket);
+    header->request.bodylen  = htonl(key_len);
+    header->request.opaque   = htonl(vbucket);
 
-        return -1;
+    add_iov(dc, header, sizeof(header->bytes));
+    add_iov(dc, key, key_len);
+
+    if (settings.verbose > 2) {
+        moxi_log_write("%d: hedging get to %d, vbucket %d\n",
+                       uc->sfd, dc->sfd, vbucket);
     }
 
-    protocol_binary_response_header res = { .bytes = {0} };
+    conn_set_state(dc, conn_mwrite);
+    dc->write_and_go = conn_new_cmd;
 
-    struct timeval *timeout = NULL;
-    if (behavior->auth_timeout.tv_sec != 0 ||
-        behavior->auth_timeout.tv_usec != 0) {
-        timeout = &behavior->auth_timeout;
+    if (update_event(dc, EV_WRITE | EV_PERSIST) == false) {
+        d->ptd->stats.stats.err_oom++;
+        d->downstream_conns[r] = NULL;
+        zstored_release_downstream_conn(dc, true);
+        return;
     }
 
-    mcs_return mr = mcs_io_read(fd, &res.bytes, sizeof(res.bytes), timeout);
-    if (mr == MCS_SUCCESS &&
-        res.response.magic == PROTOCOL_BINARY_RES) {
-        res.response.status  = ntohs(res.response.status);
-        res.response.keylen  = ntohs(res.response.keylen);
+    d->downstream_used++;
+    d->hedge_conn = dc;
+
+    d->ptd->stats.stats.tot_hedge_sent++;
+}
+
+/* Arms a hedge for an ascii single-key get that was just forwarded
+ * on binary downstream conn c, to fire after downstream_hedge_delay
+ * or else the p95 reply latency of c's server, when downstream_hedge
+ * is enabled and the vbucket has a replica.  Replicas only serve the
+ * hedge with replica_reads, as ep-engine answers not-my-vbucket.
+ */
+bool cproxy_start_downstream_hedge(downstream *d, conn *c, int vbucket) {
+    assert(d != NULL);
+    assert(d->ptd != NULL);
+    assert(c != NULL);
+
+    cproxy_clear_hedge(d);
+
+    conn *uc = d->upstream_conn;
+
+    proxy_behavior *b = &d->ptd->behavior_pool.base;
+
+    if (b->downstream_hedge == false ||
+        b->replica_reads == false ||
+        uc == NULL ||
+        uc->cmd_curr != PROTOCOL_BINARY_CMD_GETK ||
+        uc->noreply ||
+        uc->peer_protocol != 0 ||
+        uc->next != NULL ||
+        uc->cmd_start == NULL ||
+        strncmp(uc->cmd_start, "get ", 4) != 0 ||
+        d->upstream_retries > 0 ||
+        c->mux != NULL ||
+        vbucket < 0) {
+        return false;
+    }
+
+    int r = mcs_vbucket_replica(&d->mst, vbucket, 0);
+    if (r < 0 ||
+        r >= (int) mcs_server_count(&d->mst) ||
+        d->downstream_conns[r] != NULL ||
+        !IS_BINARY(d->behaviors_arr[r].downstream_protocol)) {
+        return false;
+    }
+
+    uint64_t usec = (uint64_t) b->downstream_hedge_delay * 1000;
+    if (usec == 0) {
+        usec = downstream_latency_p95(c);
+        if (usec == 0) {
+            return false;
+        }
+    }
+
+    assert(uc->thread != NULL);
+    assert(uc->thread->base != NULL);
+
+    evtimer_set(&d->hedge_event, downstream_hedge, d);
+
+    event_base_set(uc->thread->base, &d->hedge_event);
+
+    struct timeval tv;
+
+    tv.tv_sec  = usec / 1000000;
+    tv.tv_usec = usec % 1000000;
+
+    d->hedge_server = r;
+    d->hedge_armed  = (evtimer_add(&d->hedge_event, &tv) == 0);
+
+    return d->hedge_armed;
+}
+
+bool cproxy_clear_hedge(downstream *d) {
+    bool rv = d->hedge_armed;
+
+    if (d->hedge_armed) {
+        evtimer_del(&d->hedge_event);
+        d->hedge_armed = false;
+    }
+
+    d->hedge_conn = NULL;
+
+    return rv;
+}
+
+/* Invoked on a reply read by conn c of a downstream that might have
+ * a hedge in flight.  Returns true if the reply was consumed, which
+ * happens to a miss or error from the replica while the original
+ * request is still outstanding.  Otherwise, the first reply wins,
+ * and the other conn, whose reply is still in flight, is closed
+ * when the downstream is released.
+ */
+bool cproxy_hedge_response(downstream *d, conn *c, uint16_t status,
+                           item *it) {
+    assert(d != NULL);
+    assert(c != NULL);
+
+    conn *hc = d->hedge_conn;
+    if (hc == NULL) {
+        return false;
+    }
+
+    d->hedge_conn = NULL;
+
+    if (c == hc &&
+        status != PROTOCOL_BINARY_RESPONSE_SUCCESS &&
+        d->downstream_used > 1) {
+        if (it != NULL) {
+            item_remove(it);
+        }
+
+        conn_set_state(c, conn_pause);
+
+        return true;
+    }
+
+    int n = mcs_server_count(&d->mst);
+
+    for (int i = 0; i < n; i++) {
+        conn *dc = d->downstream_conns[i];
+        if (dc != NULL &&
+            dc != NULL_CONN &&
+            dc != c &&
+            dc->state != conn_pause) {
+            dc->cmd_start_time = 0; // Not a latency sample.
+            d->downstream_used--;
+        }
+    }
+
+    if (c == hc) {
+        d->ptd->stats.stats.tot_hedge_won++;
+    }
+
+    return false;
+}
+
+// Return 0 on success, -1 on general failure, 1 on timeout failure.
+//
+int cproxy_auth_downstream(mcs_server_st *server,
+                           proxy_behavior *behavior,
+                           int fd) {
+    assert(server);
+    assert(behavior);
+    assert(fd != -1);
+
+    char buf[3000];
+
+    if (!IS_BINARY(behavior->downstream_protocol)) {
+        return 0;
+    }
+
+    const char *usr = mcs_server_st_usr(server) != NULL ?
+        mcs_server_st_usr(server) : behavior->usr;
+    const char *pwd = mcs_server_st_pwd(server) != NULL ?
+        mcs_server_st_pwd(server) : behavior->pwd;
+
+    int usr_len = strlen(usr);
+    int pwd_len = strlen(pwd);
+
+    if (usr_len <= 0) {
+        return 0;
+    }
+
+    if (settings.verbose > 2) {
+        moxi_log_write("cproxy_auth_downstream usr: %s pwd: (%d)\n",
+                       usr, pwd_len);
+    }
+
+    if (usr_len <= 0 ||
+        !IS_PROXY(behavior->downstream_protocol) ||
+        (usr_len + pwd_len + 50 > (int) sizeof(buf))) {
+        if (settings.verbose > 1) {
+            moxi_log_write("auth failure args\n");
+        }
+
+        return -1; // Probably misconfigured.
+    }
+
+    // The key should look like "PLAIN", or the sasl mech string.
+    // The data should look like "\0usr\0pwd".  So, the body buf
+    // should look like "PLAIN\0usr\0pwd".
+    //
+    // TODO: Allow binary passwords.
+    //
+    int buf_len = snprintf(buf, sizeof(buf), "PLAIN%c%s%c%s",
+                           0, usr,
+                           0, pwd);
+    assert(buf_len == 7 + usr_len + pwd_len);
+
+    protocol_binary_request_header req = { .bytes = {0} };
+
+    req.request.magic    = PROTOCOL_BINARY_REQ;
+    req.request.opcode   = PROTOCOL_BINARY_CMD_SASL_AUTH;
+    req.request.keylen   = htons((uint16_t) 5); // 5 == strlen("PLAIN").
+    req.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    req.request.bodylen  = htonl(buf_len);
+
+    if (mcs_io_write(fd, (const char *) req.bytes,
+                     sizeof(req.bytes)) != sizeof(req.bytes) ||
+        mcs_io_write(fd, buf, buf_len) == -1) {
+        mcs_io_reset(fd);
+
+        if (settings.verbose > 1) {
+            moxi_log_write("auth failure during write for %s (%d)\n",
+                           usr, buf_len);
+        }
+
+        return -1;
+    }
+
+    protocol_binary_response_header res = { .bytes = {0} };
+
+    struct timeval *timeout = NULL;
+    if (behavior->auth_timeout.tv_sec != 0 ||
+        behavior->auth_timeout.tv_usec != 0) {
+        timeout = &behavior->auth_timeout;
+    }
+
+    mcs_return mr = mcs_io_read(fd, &res.bytes, sizeof(res.bytes), timeout);
+    if (mr == MCS_SUCCESS &&
+        res.response.magic == PROTOCOL_BINARY_RES) {
+        res.response.status  = ntohs(res.response.status);
+        res.response.keylen  = ntohs(res.response.keylen);
         res.response.bodylen = ntohl(res.response.bodylen);
 
         // Swallow whatever body comes.
@@ -3123,7 +3788,9 @@ bool cproxy_on_connect_downstream_conn(conn *c) {
     k = downstream_conn_index(d, c);
     if (k >= 0) {
         if (downstream_connect_init(d, mcs_server_index(&d->mst, k),
-                                    &d->behaviors_arr[k], c)) {
+                                    &d->behaviors_arr[k], c) &&
+            (c->mux == NULL ||
+             downstream_mux_start_reader(c))) {
             /* We are connected to the server now */
             if (settings.verbose > 2) {
                 moxi_log_write("%d: connected to: %s\n",
@@ -3177,6 +3844,120 @@ void downstream_connect_time_sample(proxy_stats_td *pstd, uint64_t duration) {
     }
 }
 
+/* Returns the upper bound of the histogram bin that holds the
+ * pct'th percentile of total samples.
+ */
+static uint64_t downstream_latency_percentile(HTGRAM_HANDLE h,
+                                              uint64_t total,
+                                              uint64_t pct) {
+    uint64_t want = (total * pct + 99) / 100;
+    uint64_t seen = 0;
+    uint64_t rv   = 0;
+
+    int64_t  start;
+    int64_t  width;
+    uint64_t count;
+
+    for (int i = 0; htgram_get_bin_data(h, i, &start, &width, &count); i++) {
+        rv = start + width;
+
+        seen += count;
+        if (seen >= want) {
+            break;
+        }
+    }
+
+    return rv;
+}
+
+static void downstream_latency_sample(conn *c, uint64_t duration) {
+    if (c->thread == NULL ||
+        c->host_ident == NULL) {
+        return;
+    }
+
+    zstored_downstream_conns *conns =
+        zstored_get_downstream_conns(c->thread, c->host_ident);
+    if (conns == NULL) {
+        return;
+    }
+
+    if (conns->latency == NULL) {
+        conns->latency = cproxy_create_timing_histogram();
+        if (conns->latency == NULL) {
+            return;
+        }
+    }
+
+    htgram_incr(conns->latency, duration, 1);
+
+    conns->latency_samples++;
+    if (conns->latency_samples >= DOWNSTREAM_LATENCY_WINDOW) {
+        conns->latency_p95 =
+            downstream_latency_percentile(conns->latency,
+                                          conns->latency_samples, 95);
+        conns->latency_p99 =
+            downstream_latency_percentile(conns->latency,
+                                          conns->latency_samples, 99);
+
+        htgram_reset(conns->latency);
+        conns->latency_samples = 0;
+    }
+}
+
+/* Samples the reply latency of a non-multiplexed downstream conn,
+ * from when it starts writing a request until it's paused after
+ * reading the reply.  A conn that goes from conn_mwrite straight to
+ * conn_pause sent a noreply request, so isn't sampled.
+ */
+void cproxy_downstream_state_change(conn *c, enum conn_states next_state) {
+    assert(c != NULL);
+
+    downstream *d = c->extra;
+    if (d == NULL ||
+        c->mux != NULL) {
+        return;
+    }
+
+    proxy_behavior *b = &d->ptd->behavior_pool.base;
+    if (b->downstream_timeout_adaptive == false &&
+        b->downstream_hedge == false) {
+        return;
+    }
+
+    if (next_state == conn_mwrite &&
+        c->state == conn_pause) {
+        c->cmd_start_time = usec_now();
+    } else if (next_state == conn_pause &&
+               c->state != conn_mwrite &&
+               c->state != conn_connecting &&
+               c->cmd_start_time != 0) {
+        downstream_latency_sample(c, usec_now() - c->cmd_start_time);
+        c->cmd_start_time = 0;
+    }
+}
+
+/* Returns the p95 reply latency, in usecs, of the server of
+ * downstream conn c, or 0 when there's no estimate yet.
+ */
+static uint64_t downstream_latency_p95(conn *c) {
+    assert(c != NULL);
+
+    if (c->mux != NULL ||
+        c->thread == NULL ||
+        c->host_ident == NULL) {
+        return 0;
+    }
+
+    zstored_downstream_conns *conns =
+        zstored_get_downstream_conns(c->thread, c->host_ident);
+    if (conns == NULL) {
+        return 0;
+    }
+
+    return conns->latency_p95;
+}
+
 // A histogram for tracking timings, such as for usec request timings.
 //
 HTGRAM_HANDLE cproxy_create_timing_histogram(void) {
@@ -3280,6 +4061,7 @@ conn *zstored_acquire_downstream_conn(downstream *d,
                                       LIBEVENT_THREAD *thread,
                                       mcs_server_st *msst,
                                       proxy_behavior *behavior,
+                                      bool mux,
                                       bool *downstream_conn_max_reached) {
     assert(d);
     assert(d->ptd);
@@ -3307,7 +4089,33 @@ conn *zstored_acquire_downstream_conn(downstream *d,
 
     zstored_downstream_conns *conns =
         zstored_get_downstream_conns(thread, host_ident);
-    if (conns != NULL) {
+    if (conns != NULL && mux) {
+        // All downstreams share the writer of a multiplexed conn,
+        // taking turns to send their requests.
+        //
+        dc = conns->mux;
+        if (dc != NULL) {
+            assert(dc->mux != NULL);
+            assert(dc->thread == thread);
+
+            if (dc->mux->writing == NULL &&
+                dc->state == conn_pause) {
+                assert(dc->extra == NULL);
+                dc->mux->writing = d;
+                dc->extra = d;
+
+                return dc;
+            }
+
+            d->ptd->stats.stats.tot_downstream_mux_waits++;
+
+            *downstream_conn_max_reached = true;
+
+            return NULL;
+        }
+    }
+
+    if (conns != NULL && !mux) {
         dc = conns->dc;
         if (dc != NULL) {
             assert(dc->thread == thread);
@@ -3322,7 +4130,9 @@ conn *zstored_acquire_downstream_conn(downstream *d,
 
             return dc;
         }
+    }
 
+    if (conns != NULL) {
         if (behavior->connect_max_errors > 0 &&
             behavior->connect_max_errors < conns->error_count) {
             rel_time_t msecs_since_error =
@@ -3344,7 +4154,8 @@ conn *zstored_acquire_downstream_conn(downstream *d,
             }
         }
 
-        if (behavior->downstream_conn_max > 0 &&
+        if (!mux &&
+            behavior->downstream_conn_max > 0 &&
             behavior->downstream_conn_max <= conns->dc_acquired) {
             d->ptd->stats.stats.tot_downstream_connect_max_reached++;
 
@@ -3359,7 +4170,18 @@ conn *zstored_acquire_downstream_conn(downstream *d,
         assert(dc->host_ident == NULL);
         dc->host_ident = strdup(host_ident);
         if (conns != NULL) {
-            conns->dc_acquired++;
+            if (!mux) {
+                conns->dc_acquired++;
+            } else if (dc->host_ident == NULL ||
+                       !downstream_mux_init(dc, conns)) {
+                dc->extra = NULL;
+                cproxy_close_conn(dc);
+
+                conns->error_count++;
+                conns->error_time = msec_current_time;
+
+                return NULL;
+            }
 
             if (dc->state != conn_connecting) {
                 conns->error_count = 0;
@@ -3506,6 +4328,24 @@ bool zstored_downstream_waiting_remove(downstream *d) {
                 prev = curr;
                 curr = curr->next_waiting;
             }
+
+            // Or, the downstream might be waiting for the writer
+            // of a multiplexed conn.
+            //
+            for (curr = conns->mux_waiting_head;
+                 curr != NULL && found == false;
+                 curr = curr->next_waiting) {
+                if (curr == d) {
+                    found = true;
+
+                    conns->mux_waiting_head =
+                        downstream_list_waiting_remove(conns->mux_waiting_head,
+                                                       &conns->mux_waiting_tail,
+                                                       d);
+
+                    d->ptd->stats.stats.tot_downstream_conn_queue_remove++;
+                }
+            }
         }
     }
 
@@ -3514,7 +4354,8 @@ bool zstored_downstream_waiting_remove(downstream *d) {
 
 bool zstored_downstream_waiting_add(downstream *d, LIBEVENT_THREAD *thread,
                                     mcs_server_st *msst,
-                                    proxy_behavior *behavior) {
+                                    proxy_behavior *behavior,
+                                    bool mux) {
     assert(thread != NULL);
     assert(d != NULL);
     assert(d->upstream_conn != NULL);
@@ -3531,17 +4372,25 @@ bool zstored_downstream_waiting_add(downstream *d, LIBEVENT_THREAD *thread,
     zstored_downstream_conns *conns =
         zstored_get_downstream_conns(thread, host_ident);
     if (conns != NULL) {
-        assert(conns->dc == NULL);
+        downstream **head = &conns->downstream_waiting_head;
+        downstream **tail = &conns->downstream_waiting_tail;
 
-        if (conns->downstream_waiting_head == NULL) {
-            assert(conns->downstream_waiting_tail == NULL);
-            conns->downstream_waiting_head = d;
+        if (mux) {
+            head = &conns->mux_waiting_head;
+            tail = &conns->mux_waiting_tail;
+        } else {
+            assert(conns->dc == NULL);
         }
-        if (conns->downstream_waiting_tail != NULL) {
-            assert(conns->downstream_waiting_tail->next_waiting == NULL);
-            conns->downstream_waiting_tail->next_waiting = d;
+
+        if (*head == NULL) {
+            assert(*tail == NULL);
+            *head = d;
         }
-        conns->downstream_waiting_tail = d;
+        if (*tail != NULL) {
+            assert((*tail)->next_waiting == NULL);
+            (*tail)->next_waiting = d;
+        }
+        *tail = d;
 
         d->ptd->stats.stats.tot_downstream_conn_queue_add++;
 
@@ -3551,6 +4400,499 @@ bool zstored_downstream_waiting_add(downstream *d, LIBEVENT_THREAD *thread,
     return false;
 }
 
+// -------------------------------------------------
+
+/* Dispatches downstreams waiting for the writer of the multiplexed
+ * conn to a host_ident, until the writer is busy again.  If there's
+ * no multiplexed conn (it was closed), the first waiter will try to
+ * create a new one.
+ */
+static void zstored_mux_wake(zstored_downstream_conns *conns) {
+    while (conns->mux_waiting_head != NULL &&
+           (conns->mux == NULL ||
+            conns->mux->mux->writing == NULL)) {
+        downstream *d = conns->mux_waiting_head;
+
+        conns->mux_waiting_head = d->next_waiting;
+        if (conns->mux_waiting_head == NULL) {
+            conns->mux_waiting_tail = NULL;
+        }
+        d->next_waiting = NULL;
+
+        d->ptd->stats.stats.tot_downstream_conn_queue_remove++;
+
+        cproxy_forward_or_error(d);
+    }
+}
+
+static bool downstream_mux_init(conn *w, zstored_downstream_conns *conns) {
+    downstream *d = w->extra;
+    assert(d != NULL);
+    assert(w->mux == NULL);
+
+    downstream_mux *mux = calloc(1, sizeof(downstream_mux));
+    if (mux == NULL) {
+        d->ptd->stats.stats.err_oom++;
+        return false;
+    }
+
+    mux->ptd     = d->ptd;
+    mux->writer  = w;
+    mux->writing = d;
+    mux->refs    = 1;
+
+    w->mux = mux;
+
+    // A non-blocking connect() starts the reader once connected.
+    //
+    if (w->state != conn_connecting &&
+        downstream_mux_start_reader(w) == false) {
+        return false;
+    }
+
+    conns->mux = w;
+
+    return true;
+}
+
+/* The reader gets its own fd for the same socket, so that it can
+ * wait for replies while the writer sends more requests.
+ */
+static bool downstream_mux_start_reader(conn *w) {
+    downstream_mux *mux = w->mux;
+    assert(mux != NULL);
+    assert(mux->reader == NULL);
+    assert(w->extra != NULL);
+    assert(w->host_ident != NULL);
+
+    char *host_ident = strdup(w->host_ident);
+    if (host_ident == NULL) {
+        mux->ptd->stats.stats.err_oom++;
+        return false;
+    }
+
+    int fd = dup(w->sfd);
+    if (fd < 0) {
+        free(host_ident);
+        return false;
+    }
+
+    conn *r = conn_new(fd, conn_new_cmd, EV_READ | EV_PERSIST,
+                       DATA_BUFFER_SIZE,
+                       tcp_transport,
+                       w->thread->base,
+                       &cproxy_downstream_funcs, w->extra);
+    if (r == NULL) {
+        mux->ptd->stats.stats.err_oom++;
+        free(host_ident);
+        close(fd);
+        return false;
+    }
+
+    r->extra      = NULL;
+    r->protocol   = w->protocol;
+    r->thread     = w->thread;
+    r->host_ident = host_ident;
+    r->mux        = mux;
+
+    mux->reader = r;
+    mux->refs++;
+
+    return true;
+}
+
+void cproxy_mux_add_request(conn *c, downstream *d,
+                            protocol_binary_request_header *req) {
+    downstream_mux *mux = c->mux;
+    if (mux == NULL) {
+        return;
+    }
+
+    assert(mux->writer == c);
+    assert(mux->writing == d);
+    assert(c->extra == d);
+
+    downstream_mux_req *r = calloc(1, sizeof(downstream_mux_req));
+    if (r == NULL) {
+        d->ptd->stats.stats.err_oom++;
+
+        // Closing the writer fails the request.
+        //
+        c->write_and_go = conn_closing;
+        return;
+    }
+
+    r->d          = d;
+    r->opaque     = req->request.opaque;
+    r->mux_opaque = ++mux->next_opaque;
+
+    req->request.opaque = htonl(r->mux_opaque);
+
+    if (mux->inflight_tail != NULL) {
+        mux->inflight_tail->next = r;
+    } else {
+        mux->inflight_head = r;
+    }
+    mux->inflight_tail = r;
+    mux->num_inflight++;
+
+    d->ptd->stats.stats.tot_downstream_mux_requests++;
+    if (d->ptd->stats.stats.max_downstream_mux_inflight <
+        mux->num_inflight) {
+        d->ptd->stats.stats.max_downstream_mux_inflight = mux->num_inflight;
+    }
+
+    // Instead of waiting for the reply, let the next request be sent.
+    //
+    c->write_and_go = conn_pause;
+}
+
+/* A binary upstream's request item is sent as is, so put back
+ * its opaque in case the request is retried.
+ */
+static void downstream_mux_req_restore(downstream_mux_req *r) {
+    conn *uc = r->d->upstream_conn;
+    if (uc != NULL &&
+        IS_BINARY(uc->protocol) &&
+        uc->item != NULL) {
+        protocol_binary_request_header *req =
+            (protocol_binary_request_header *) ITEM_data((item *) uc->item);
+        if (req->request.opaque == htonl(r->mux_opaque)) {
+            req->request.opaque = r->opaque;
+        }
+    }
+}
+
+/* Called when the reader has a response header.  Returns true if the
+ * response should be processed, in which case the reader is now
+ * associated with the response's downstream.
+ */
+bool cproxy_mux_process_downstream_binary(conn *c) {
+    downstream_mux *mux = c->mux;
+    assert(mux != NULL);
+    assert(mux->reader == c);
+    assert(c->extra == NULL);
+
+    uint32_t mux_opaque = ntohl(c->binary_header.request.opaque);
+
+    downstream_mux_req *prev = NULL;
+    downstream_mux_req *r = mux->inflight_head;
+
+    while (r != NULL &&
+           r->mux_opaque != mux_opaque) {
+        prev = r;
+        r = r->next;
+    }
+
+    if (r == NULL ||
+        mux->closed ||
+        (r->d != NULL && r->d == mux->writing)) {
+        if (settings.verbose > 1) {
+            moxi_log_write("%d: unexpected mux response, opaque %u\n",
+                           c->sfd, mux_opaque);
+        }
+
+        conn_set_state(c, conn_closing);
+        return false;
+    }
+
+    if (prev != NULL) {
+        prev->next = r->next;
+    } else {
+        mux->inflight_head = r->next;
+    }
+    if (mux->inflight_tail == r) {
+        mux->inflight_tail = prev;
+    }
+    mux->num_inflight--;
+
+    downstream *d = r->d;
+    if (d == NULL) {
+        // The downstream gave up (timed out), so eat the response.
+        //
+        free(r);
+
+        c->sbytes = c->binary_header.request.bodylen;
+        conn_set_state(c, conn_swallow);
+        return false;
+    }
+
+    int k = downstream_conn_index(d, mux->writer);
+    assert(k >= 0);
+
+    d->downstream_conns[k] = c;
+    c->extra = d;
+
+    // Put back the opaque that the downstream expects.
+    //
+    protocol_binary_response_header *header =
+        (protocol_binary_response_header *) c->rcurr;
+
+    header->response.opaque = r->opaque;
+    c->binary_header.request.opaque = r->opaque;
+    c->opaque = r->opaque;
+
+    downstream_mux_req_restore(r);
+    free(r);
+
+    return true;
+}
+
+/* Copies the rest of the writer's request into an item of its own.
+ * The request's iovecs might point into buffers of the upstream conn,
+ * which moves on once its downstream gives up.
+ */
+static bool downstream_mux_pin_request(conn *w) {
+    size_t n = 0;
+
+    for (int m = w->msgcurr; m < w->msgused; m++) {
+        struct msghdr *msg = &w->msglist[m];
+        for (int i = 0; i < (int) msg->msg_iovlen; i++) {
+            n += msg->msg_iov[i].iov_len;
+        }
+    }
+
+    if (n == 0) {
+        return true;
+    }
+
+    item *it = item_alloc("p", 1, 0, 0, n);
+    if (it == NULL) {
+        w->mux->ptd->stats.stats.err_oom++;
+        return false;
+    }
+
+    if (add_conn_item(w, it) == false) {
+        w->mux->ptd->stats.stats.err_oom++;
+        item_remove(it);
+        return false;
+    }
+
+    char *p = ITEM_data(it);
+
+    for (int m = w->msgcurr; m < w->msgused; m++) {
+        struct msghdr *msg = &w->msglist[m];
+        for (int i = 0; i < (int) msg->msg_iovlen; i++) {
+            memcpy(p, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+            msg->msg_iov[i].iov_base = p;
+            p += msg->msg_iov[i].iov_len;
+        }
+    }
+
+    return true;
+}
+
+/* Releases a multiplexed conn from a downstream which is done with it,
+ * whether it had been replied to or not.  Other downstreams might
+ * have requests in flight on the same socket, so it is only closed
+ * if the writer's request can't be kept.
+ */
+static void downstream_mux_detach(conn *dc, downstream *d) {
+    downstream_mux *mux = dc->mux;
+    assert(mux != NULL);
+
+    for (downstream_mux_req *r = mux->inflight_head; r != NULL; r = r->next) {
+        if (r->d == d) {
+            downstream_mux_req_restore(r);
+            r->d = NULL;
+
+            d->ptd->stats.stats.tot_downstream_mux_orphans++;
+        }
+    }
+
+    if (dc->extra != d) {
+        return;
+    }
+
+    dc->extra = NULL;
+
+    if (dc == mux->writer) {
+        assert(mux->writing == d);
+
+        if (dc->state == conn_pause) {
+            // Nothing was sent yet.
+            //
+            mux->writing = NULL;
+
+            zstored_downstream_conns *conns =
+                zstored_get_downstream_conns(dc->thread, dc->host_ident);
+            if (conns != NULL) {
+                zstored_mux_wake(conns);
+            }
+
+            return;
+        }
+
+        if (dc->state == conn_mwrite &&
+            downstream_mux_pin_request(dc)) {
+            // Finish sending the request, whose reply was orphaned
+            // above.  The writer stays busy until it's sent, in
+            // downstream_mux_pause().
+            //
+            return;
+        }
+    } else if (dc->state == conn_nread) {
+        // The reader is in the middle of the reply, so read and
+        // drop the rest of it.
+        //
+        if (dc->item != NULL) {
+            item_remove(dc->item);
+            dc->item = NULL;
+        }
+
+        dc->sbytes  = dc->rlbytes;
+        dc->rlbytes = 0;
+
+        conn_set_state(dc, conn_swallow);
+
+        d->ptd->stats.stats.tot_downstream_mux_orphans++;
+        return;
+    }
+
+    // The downstream is still connecting, or out of memory.
+    //
+    cproxy_close_conn(dc);
+}
+
+static void downstream_mux_pause(conn *c) {
+    downstream_mux *mux = c->mux;
+    assert(mux != NULL);
+
+    downstream *d = c->extra;
+    c->extra = NULL;
+
+    if (c == mux->writer) {
+        // The request was sent, so the next waiting downstream
+        // can use the writer while this one awaits its reply.
+        //
+        mux->writing = NULL;
+
+        zstored_downstream_conns *conns =
+            zstored_get_downstream_conns(c->thread, c->host_ident);
+        if (conns != NULL) {
+            zstored_mux_wake(conns);
+        }
+
+        return;
+    }
+
+    // The reader is done with a reply, so go on to the next.
+    //
+    conn_set_state(c, conn_new_cmd);
+
+    if (d != NULL) {
+        int k = downstream_conn_index(d, c);
+        if (k >= 0) {
+            d->downstream_conns[k] = NULL;
+        }
+
+        cproxy_release_downstream_conn(d, c);
+    }
+}
+
+/* Called when either conn of a multiplexed pair closes.  The first
+ * close fails every request still in flight, except for the ones
+ * that the closing conn is itself busy with (handled by the regular
+ * close logic) or that the writer is busy with (handled when the
+ * writer closes, too).
+ */
+static void downstream_mux_close(conn *c) {
+    downstream_mux *mux = c->mux;
+    assert(mux != NULL);
+
+    c->mux = NULL;
+
+    conn *writer = mux->writer;
+
+    if (c == mux->writer) {
+        mux->writer = NULL;
+    } else {
+        assert(c == mux->reader);
+        mux->reader = NULL;
+    }
+
+    if (mux->ptd->stats.stats.num_downstream_conn > 0) {
+        mux->ptd->stats.stats.num_downstream_conn--;
+    }
+
+    if (mux->closed == false) {
+        mux->closed = true;
+
+        zstored_downstream_conns *conns = NULL;
+        if (c->thread != NULL &&
+            c->host_ident != NULL) {
+            conns = zstored_get_downstream_conns(c->thread, c->host_ident);
+        }
+
+        if (conns != NULL &&
+            conns->mux == writer) {
+            conns->mux = NULL;
+            conns->error_count++;
+            conns->error_time = msec_current_time;
+        }
+
+        // The other conn shares the socket, so it will see an error
+        // the next time it does any I/O.  An idle writer, though,
+        // has to be woken up to close.
+        //
+        if (mux->reader != NULL) {
+            shutdown(mux->reader->sfd, SHUT_RDWR);
+        }
+        if (mux->writer != NULL) {
+            shutdown(mux->writer->sfd, SHUT_RDWR);
+
+            if (mux->writer->state == conn_pause) {
+                conn_set_state(mux->writer, conn_closing);
+                update_event(mux->writer, EV_WRITE | EV_PERSIST);
+            }
+        }
+
+        downstream *own = c->extra;
+
+        downstream_mux_req *r = mux->inflight_head;
+
+        mux->inflight_head = NULL;
+        mux->inflight_tail = NULL;
+        mux->num_inflight = 0;
+
+        while (r != NULL) {
+            downstream_mux_req *next = r->next;
+            downstream *d = r->d;
+
+            if (d != NULL) {
+                downstream_mux_req_restore(r);
+            }
+
+            if (d != NULL &&
+                d != mux->writing) {
+                int k = downstream_conn_index(d, writer);
+                if (k >= 0) {
+                    d->downstream_conns[k] = c;
+                    c->extra = d;
+
+                    k = delink_from_downstream_conns(c);
+                    c->extra = NULL;
+
+                    downstream_conn_closed(d, c, k);
+                }
+            }
+
+            free(r);
+            r = next;
+        }
+
+        c->extra = own;
+
+        if (conns != NULL) {
+            zstored_mux_wake(conns);
+        }
+    }
+
+    if (--mux->refs <= 0) {
+        free(mux);
+    }
+}
+
 // Find an appropriate proxy struct or NULL.
 //
 proxy *cproxy_find_proxy_by_auth(proxy_main *m,
@@ -54,29 +54,14 @@ typedef struct {
     void  (*item_set_prev)(void *it, void *prev);
     uint64_t (*item_get_exptime)(void *it);
     void     (*item_set_exptime)(void *it, uint64_t exptime);
+    bool  (*item_get_visited)(void *it);
+    void  (*item_set_visited)(void *it, bool visited);
 } mcache_funcs;
 
 extern mcache_funcs mcache_item_funcs;
 extern mcache_funcs mcache_key_stats_funcs;
 
 typedef struct {
-    mcache_funcs *funcs;
-
-    pthread_mutex_t *lock; // NULL-able, for non-multithreaded.
-
-    bool key_alloc;        // True if mcache must alloc key memory.
-
-    genhash_t *map;        // NULL-able, keyed by string, value is item.
-
-    uint32_t max;          // Maxiumum number of items to keep.
-
-    void *lru_head;        // Most recently used.
-    void *lru_tail;        // Least recently used.
-
-    uint32_t oldest_live;  // In millisecs, relative to msec_current_time.
-
-    // Statistics.
-    //
     uint64_t tot_get_hits;
     uint64_t tot_get_expires;
     uint64_t tot_get_misses;
@@ -87,8 +72,69 @@ typedef struct {
     uint64_t tot_add_bytes;
     uint64_t tot_deletes;
     uint64_t tot_evictions;
+} mcache_stats;
+
+// Number of shards of a multithreaded mcache.  A key is owned
+// by exactly one shard, chosen by its hash, so that threads working
+// on different keys don't contend on a single lock.
+//
+#define MCACHE_SHARDS 16
+
+typedef struct {
+    pthread_mutex_t lock;  // Only used for a multithreaded mcache.
+
+    genhash_t *map;        // NULL-able, keyed by string, value is item.
+
+    uint32_t max;          // Maxiumum number of items in this shard.
+
+    // Items form a circular list, linked by the item next/prev
+    // fields.  Instead of relinking an item on every hit, a hit
+    // just marks the item visited.  On eviction, the CLOCK hand
+    // sweeps forward, clearing visited marks, until it finds an
+    // unvisited item to evict.
+    //
+    void *clock_hand;      // Next item for eviction to inspect.
+
+    uint32_t oldest_live;  // In millisecs, relative to msec_current_time.
+
+    mcache_stats stats;
+} mcache_shard;
+
+typedef struct {
+    mcache_funcs *funcs;
+
+    bool multithreaded;    // True if shards must be locked.
+
+    bool key_alloc;        // True if mcache must alloc key memory.
+
+    mcache_shard *shards;  // Array of nshards, immutable after init.
+    uint32_t      nshards; // A power of 2; 0 if shards alloc failed.
+
+    uint32_t max;          // Maxiumum number of items to keep.
 } mcache;
 
+// Dimensions of the per-thread count-min sketch that detects hot keys.
+// The width must be a power of 2.
+//
+#define HOT_KEYS_DEPTH 4
+#define HOT_KEYS_WIDTH 1024
+
+typedef struct {
+    // Estimated reads per key, halved every hot_key_window.
+    //
+    uint32_t reads[HOT_KEYS_DEPTH][HOT_KEYS_WIDTH];
+
+    // Time of latest mutation per key, in msec_current_time units.
+    // Only ever over-estimated, so a key looks recently written
+    // rather than safe to read from a replica.
+    //
+    uint64_t writes[HOT_KEYS_DEPTH][HOT_KEYS_WIDTH];
+
+    uint64_t decay_time;  // When reads were last halved.
+    uint64_t reject_time; // When a replica last refused a read.
+    uint32_t spread;      // Round-robins hot key reads over replicas.
+} hot_keys;
+
 typedef struct proxy               proxy;
 typedef struct proxy_td            proxy_td;
 typedef struct proxy_main          proxy_main;
@@ -96,6 +142,7 @@ typedef struct proxy_stats         proxy_stats;
 typedef struct proxy_behavior      proxy_behavior;
 typedef struct proxy_behavior_pool proxy_behavior_pool;
 typedef struct downstream          downstream;
+typedef struct downstream_mux_req  downstream_mux_req;
 typedef struct key_stats           key_stats;
 
 struct proxy_behavior {
@@ -117,6 +164,26 @@ struct proxy_behavior {
     struct timeval connect_timeout;     // PL: Fields of 0 mean no timeout.
     struct timeval auth_timeout;        // PL: Fields of 0 mean no timeout.
     bool           time_stats;          // IL: Capture timing stats.
+    bool           downstream_conn_mux; // SL: Pipeline requests over a shared
+                                        // conn per thread and per host_ident.
+    uint32_t       downstream_mux_max;  // PL: Downstream concurrency of
+                                        // requests pipelined over shared
+                                        // conns, on top of downstream_max.
+    bool           coalesce_gets;       // PL: Concurrent single-key gets of
+                                        // a key share one downstream get.
+    bool           downstream_timeout_adaptive; // PL: Derive downstream
+                                        // timeouts from each server's
+                                        // observed reply latency.
+    uint32_t       downstream_timeout_min; // PL: In millisecs, the least
+                                        // adaptive downstream timeout.
+    bool           downstream_hedge;    // PL: Re-send a slow single-key get
+                                        // to a vbucket replica, which
+                                        // also needs replica_reads.
+    uint32_t       downstream_hedge_delay; // PL: In millisecs, when to
+                                        // hedge.  0 means the server's
+                                        // observed p95 reply latency.
+    bool           replica_reads;       // PL: Downstream servers serve reads
+                                        // of the vbuckets they replicate.
     char           mcs_opts[80];        // PL: Extra options for mcs initialization.
 
     uint32_t connect_max_errors;      // IL: Pause when too many connect() errs.
@@ -136,6 +203,16 @@ struct proxy_behavior {
 
     char optimize_set[400]; // PL: Matcher prefixes for SET optimization.
 
+    char     hot_key_spec[300];   // PL: Matcher prefixes for hot key
+                                  // reads spread over replicas.
+    uint32_t hot_key_threshold;   // PL: Reads per hot_key_window for
+                                  // a key to be hot.
+    uint32_t hot_key_window;      // PL: In millisecs.
+    uint32_t hot_key_replica_lag; // PL: In millisecs.  Hot key reads only
+                                  // go to the master for this long after
+                                  // a mutation of the key, or after a
+                                  // replica refused a read.
+
     char usr[250];    // SL.
     char pwd[900];    // SL.
     char host[250];   // SL.
@@ -272,6 +349,7 @@ struct proxy_stats {
     uint64_t tot_downstream_reserved_time;
     uint64_t max_downstream_reserved_time;
     uint64_t tot_downstream_freed;
+    uint64_t tot_downstream_remap_frees_avoided;
     uint64_t tot_downstream_quit_server;
     uint64_t tot_downstream_max_reached;
     uint64_t tot_downstream_create_failed;
@@ -303,6 +381,10 @@ struct proxy_stats {
     uint64_t tot_downstream_conn_queue_timeout;
     uint64_t tot_downstream_conn_queue_add;
     uint64_t tot_downstream_conn_queue_remove;
+    uint64_t tot_downstream_mux_requests;
+    uint64_t tot_downstream_mux_waits;
+    uint64_t tot_downstream_mux_orphans;
+    uint64_t max_downstream_mux_inflight;
     uint64_t tot_downstream_timeout;
     uint64_t tot_wait_queue_timeout;
     uint64_t tot_auth_timeout;
@@ -319,6 +401,16 @@ struct proxy_stats {
     uint64_t tot_multiget_keys;
     uint64_t tot_multiget_keys_dedupe;
     uint64_t tot_multiget_bytes_dedupe;
+    uint64_t tot_coalesce_gets;
+    uint64_t tot_coalesce_bytes;
+    uint64_t tot_coalesce_retries;
+    uint64_t tot_hot_key_reads;
+    uint64_t tot_hot_key_replica_reads;
+    uint64_t tot_hot_key_replica_rejects;
+    uint64_t tot_hedge_sent;
+    uint64_t tot_hedge_won;
+    uint64_t tot_b2b_bytes_copied;
+    uint64_t tot_b2b_bytes_direct;
     uint64_t tot_optimize_sets;
     uint64_t err_oom;
     uint64_t err_upstream_write_prep;
@@ -383,6 +475,7 @@ struct key_stats {
     uint64_t added_at;
     key_stats *next;
     key_stats *prev;
+    bool visited;
     proxy_stats_cmd stats_cmd[STATS_CMD_TYPE_last][STATS_CMD_last];
 };
 
@@ -411,6 +504,11 @@ struct proxy_td { // Per proxy, per worker-thread data struct.
     uint64_t    downstream_tot;      // Total lifetime downstreams created.
     int         downstream_num;      // Number downstreams existing.
     int         downstream_max;      // Max downstream concurrency number.
+    int         downstream_mux_max;  // Extra concurrency for requests that
+                                     // are pipelined over shared conns.
+    int         downstream_reserved_num;     // Number downstreams reserved,
+    int         downstream_mux_reserved_num; // and how many of them count
+                                             // against downstream_mux_max.
     uint64_t    downstream_assigns;  // Track recursion.
 
     // A timeout for the wait_queue, so that we can emit error
@@ -426,7 +524,27 @@ struct proxy_td { // Per proxy, per worker-thread data struct.
     matcher key_stats_matcher;
     matcher key_stats_unmatcher;
 
+    // Keyed by string, value is the reserved downstream that's
+    // getting that key for a single-key get, when coalesce_gets
+    // is enabled.  NULL until first used.
+    //
+    genhash_t *coalesce_gets;
+
+    matcher   hot_key_matcher;
+    hot_keys *hot_keys; // NULL unless hot_key_spec is set.
+
     proxy_stats_td stats;
+
+    // Copy of stats that the worker publishes for stats readers
+    // on other threads, while they keep reading it.
+    // See cproxy_stats_snapshot_publish().
+    //
+    volatile uint32_t stats_snapshot_seq; // Odd while being written.
+    proxy_stats_td    stats_snapshot;
+    struct event      stats_snapshot_event;
+    bool              stats_snapshot_event_set;
+    volatile bool     stats_snapshot_started;
+    volatile uint64_t stats_snapshot_read_time; // In msecs.
 };
 
 /* A 'downstream' struct represents a set of downstream connections.
@@ -449,6 +567,9 @@ struct downstream {
     downstream *next; // To track reserved/released lists.
                       // See ptd->downstream_reserved/downstream_released.
 
+    bool reserved;     // True while on the reserved list.
+    bool mux_reserved; // True if reserved against downstream_mux_max.
+
     downstream *next_waiting; // To track lists when a downstream is reserved,
                               // but is waiting for a downstream connection,
                               // per zstored perf enhancement.
@@ -482,12 +603,65 @@ struct downstream {
     genhash_t *multiget; // Keyed by string.
     genhash_t *merger;   // Keyed by string, for merging replies like STATS.
 
+    // Non-NULL when this downstream is getting a key that other
+    // upstream conns can coalesce onto, in ptd->coalesce_gets.
+    // When coalesce_mutation is set, the downstream is instead
+    // mutating the key (or every key, if coalesce_key is NULL),
+    // so no later get may coalesce onto a get sent before it.
+    //
+    char *coalesce_key;   // Mem owned by downstream.
+    conn *coalesce_conns; // Upstream conns waiting on this get, via next.
+    bool  coalesce_mutation;
+
+    // A single-key get that's slower than its server's p95 latency
+    // is re-sent to a replica, when downstream_hedge is enabled.
+    // Whichever reply arrives first is used.
+    //
+    struct event hedge_event;
+    bool         hedge_armed;  // True while hedge_event is pending.
+    int          hedge_server; // Server index of the replica.
+    conn        *hedge_conn;   // Non-NULL while the hedge is in flight.
+
     // Timeout is in use when timeout_tv fields are non-zero.
     //
     struct timeval timeout_tv;
     struct event   timeout_event;
 };
 
+/* A downstream_mux is shared by a pair of conns to a binary downstream
+ * server, so that requests from many downstreams can be in flight
+ * at once.  The writer conn sends one request at a time (other
+ * downstreams wait on a per-host_ident queue), while the reader conn,
+ * on a dup()'ed fd, matches each response to its request by the
+ * opaque that moxi assigned when the request was sent.
+ *
+ * Owned by worker thread.
+ */
+struct downstream_mux_req {
+    downstream *d;          // NULL when the downstream has given up.
+    uint32_t    opaque;     // The request's own opaque, restored on reply.
+    uint32_t    mux_opaque; // The opaque on the wire.
+    downstream_mux_req *next;
+};
+
+struct downstream_mux {
+    proxy_td   *ptd;
+    conn       *writer;
+    conn       *reader;
+    downstream *writing;     // Owner of the writer, or NULL if available.
+                             // Only compared, as the owner might have
+                             // given up while the writer finishes.
+    uint32_t    next_opaque;
+    uint32_t    num_inflight;
+    int         refs;        // Number of writer/reader conns attached.
+    bool        closed;      // No more requests, after a conn error.
+
+    // FIFO of sent requests, in the order that replies are expected.
+    //
+    downstream_mux_req *inflight_head;
+    downstream_mux_req *inflight_tail;
+};
+
 // Sentinel value for downstream->downstream_conns[] array entries,
 // which usually signals that moxi wasn't able to create a connection
 // to a downstream server.
@@ -519,6 +693,7 @@ void      cproxy_on_close_downstream_conn(conn *c);
 void      cproxy_on_pause_downstream_conn(conn *c);
 
 void cproxy_upstream_state_change(conn *c, enum conn_states next_state);
+void cproxy_downstream_state_change(conn *c, enum conn_states next_state);
 
 void cproxy_add_downstream(proxy_td *ptd);
 void cproxy_free_downstream(downstream *d);
@@ -527,7 +702,7 @@ downstream *cproxy_create_downstream(char *config,
                                      uint32_t config_ver,
                                      proxy_behavior_pool *behavior_pool);
 
-downstream *cproxy_reserve_downstream(proxy_td *ptd);
+downstream *cproxy_reserve_downstream(proxy_td *ptd, bool mux);
 bool        cproxy_release_downstream(downstream *d, bool force);
 void        cproxy_release_downstream_conn(downstream *d, conn *c);
 bool        cproxy_check_downstream_config(downstream *d);
@@ -573,6 +748,10 @@ void upstream_retry(void *data0, void *data1);
 
 int downstream_conn_index(downstream *d, conn *c);
 
+void cproxy_mux_add_request(conn *c, downstream *d,
+                            protocol_binary_request_header *req);
+bool cproxy_mux_process_downstream_binary(conn *c);
+
 void cproxy_dump_header(int prefix, char *bb);
 
 int cproxy_max_retries(downstream *d);
@@ -711,6 +890,10 @@ bool cproxy_start_downstream_timeout_ex(downstream *d, conn *c,
                                         struct timeval dt);
 bool cproxy_start_wait_queue_timeout(proxy_td *ptd, conn *uc);
 
+bool cproxy_start_downstream_hedge(downstream *d, conn *c, int vbucket);
+bool cproxy_clear_hedge(downstream *d);
+bool cproxy_hedge_response(downstream *d, conn *c, uint16_t status, item *it);
+
 rel_time_t cproxy_realtime(const time_t exptime);
 
 void cproxy_close_conn(conn *c);
@@ -719,6 +902,17 @@ void cproxy_reset_stats_td(proxy_stats_td *pstd);
 void cproxy_reset_stats(proxy_stats *ps);
 void cproxy_reset_stats_cmd(proxy_stats_cmd *sc);
 
+// How often a worker publishes its stats snapshot, which bounds
+// how stale "stats proxy" results can be, and how long a worker
+// keeps publishing after the last read.
+//
+#define STATS_SNAPSHOT_MSECS      100
+#define STATS_SNAPSHOT_IDLE_MSECS 60000
+
+void cproxy_stats_snapshot_publish(proxy_td *ptd);
+void cproxy_stats_snapshot_read(proxy_td *ptd, LIBEVENT_THREAD *thread,
+                                proxy_stats_td *out);
+
 bool cproxy_binary_cork_cmd(conn *uc);
 void cproxy_binary_uncork_cmds(downstream *d, conn *uc);
 
@@ -744,6 +938,11 @@ bool multiget_ascii_downstream(
 
 void multiget_ascii_downstream_response(downstream *d, item *it);
 
+bool cproxy_coalesce_get(proxy_td *ptd, conn *uc);
+void cproxy_coalesce_start(downstream *d);
+void cproxy_coalesce_reply(downstream *d, item *it);
+void cproxy_coalesce_done(downstream *d);
+
 void multiget_foreach_free(const void *key,
                            const void *value,
                            void *user_data);
@@ -797,6 +996,15 @@ void cproxy_front_cache_delete(proxy_td *ptd, char *key, int key_len);
 
 bool cproxy_front_cache_key(proxy_td *ptd, char *key, int key_len);
 
+void cproxy_hot_keys_start(proxy_td *ptd);
+void cproxy_hot_keys_stop(proxy_td *ptd);
+int  cproxy_hot_key_server_index(downstream *d, char *key, int key_len,
+                                 int server_index, int vbucket);
+void cproxy_hot_key_touch(downstream *d, char *key, int key_len,
+                          int server_index, int vbucket);
+bool cproxy_hot_key_replica_rejected(downstream *d, int server_index,
+                                     int vbucket);
+
 HTGRAM_HANDLE cproxy_create_timing_histogram(void);
 
 typedef void (*mcache_traversal_func)(const void *it, void *userdata);
@@ -809,6 +1017,8 @@ void  mcache_start(mcache *m, uint32_t max);
 bool  mcache_started(mcache *m);
 void  mcache_stop(mcache *m);
 void  mcache_reset_stats(mcache *m);
+bool  mcache_get_stats(mcache *m, mcache_stats *out,
+                       uint32_t *size, uint32_t *oldest_live);
 void *mcache_get(mcache *m, char *key, int key_len,
                  uint64_t curr_time);
 void  mcache_set(mcache *m, void *it,
@@ -68,6 +68,14 @@ proxy_behavior behavior_default_g = {
         .tv_usec = 100000
     },
     .time_stats = false,
+    .downstream_conn_mux = false,
+    .downstream_mux_max = 4096, // Use 0 for unlimited.
+    .coalesce_gets = false,
+    .downstream_timeout_adaptive = false,
+    .downstream_timeout_min = 50,
+    .downstream_hedge = false,
+    .downstream_hedge_delay = 0,
+    .replica_reads = false,
     .mcs_opts = {0},
     .connect_max_errors = 5,         // In zstored, 10.
     .connect_retry_interval = 30000, // In zstored, 30000.
@@ -80,6 +88,10 @@ proxy_behavior behavior_default_g = {
     .key_stats_spec = {0},
     .key_stats_unspec = {0},
     .optimize_set = {0},
+    .hot_key_spec = {0},
+    .hot_key_threshold = 1000,
+    .hot_key_window = 1000,
+    .hot_key_replica_lag = 1000,
     .host = {0},
     .port = 0,
     .bucket = {0},
@@ -686,6 +698,27 @@ void cproxy_parse_behavior_key_val(char *key,
         } else if (wordeq(key, "time_stats")) {
             ok = safe_strtoul(val, &x);
             behavior->time_stats = x;
+        } else if (wordeq(key, "downstream_conn_mux")) {
+            ok = safe_strtoul(val, &x);
+            behavior->downstream_conn_mux = x;
+        } else if (wordeq(key, "downstream_mux_max")) {
+            ok = safe_strtoul(val, &behavior->downstream_mux_max);
+        } else if (wordeq(key, "coalesce_gets")) {
+            ok = safe_strtoul(val, &x);
+            behavior->coalesce_gets = x;
+        } else if (wordeq(key, "downstream_timeout_adaptive")) {
+            ok = safe_strtoul(val, &x);
+            behavior->downstream_timeout_adaptive = x;
+        } else if (wordeq(key, "downstream_timeout_min")) {
+            ok = safe_strtoul(val, &behavior->downstream_timeout_min);
+        } else if (wordeq(key, "downstream_hedge")) {
+            ok = safe_strtoul(val, &x);
+            behavior->downstream_hedge = x;
+        } else if (wordeq(key, "downstream_hedge_delay")) {
+            ok = safe_strtoul(val, &behavior->downstream_hedge_delay);
+        } else if (wordeq(key, "replica_reads")) {
+            ok = safe_strtoul(val, &x);
+            behavior->replica_reads = x;
         } else if (wordeq(key, "mcs_opts")) {
             if (strlen(val) < sizeof(behavior->mcs_opts)) {
                 strcpy(behavior->mcs_opts, val);
@@ -728,6 +761,17 @@ void cproxy_parse_behavior_key_val(char *key,
                 strcpy(behavior->optimize_set, val);
                 ok = true;
             }
+        } else if (wordeq(key, "hot_key_spec")) {
+            if (strlen(val) < sizeof(behavior->hot_key_spec)) {
+                strcpy(behavior->hot_key_spec, val);
+                ok = true;
+            }
+        } else if (wordeq(key, "hot_key_threshold")) {
+            ok = safe_strtoul(val, &behavior->hot_key_threshold);
+        } else if (wordeq(key, "hot_key_window")) {
+            ok = safe_strtoul(val, &behavior->hot_key_window);
+        } else if (wordeq(key, "hot_key_replica_lag")) {
+            ok = safe_strtoul(val, &behavior->hot_key_replica_lag);
         } else if (wordeq(key, "usr")) {
             if (strlen(val) < sizeof(behavior->usr)) {
                 strcpy(behavior->usr, val);
@@ -879,6 +923,14 @@ void cproxy_dump_behavior_ex(proxy_behavior *b, char *prefix, int level,
               (b->auth_timeout.tv_sec * 1000 +
                b->auth_timeout.tv_usec / 1000));
         vdump("time_stats", "%d", b->time_stats);
+        vdump("downstream_conn_mux", "%d", b->downstream_conn_mux);
+        vdump("downstream_mux_max", "%u", b->downstream_mux_max);
+        vdump("coalesce_gets", "%d", b->coalesce_gets);
+        vdump("downstream_timeout_adaptive", "%d", b->downstream_timeout_adaptive);
+        vdump("downstream_timeout_min", "%u", b->downstream_timeout_min);
+        vdump("downstream_hedge", "%d", b->downstream_hedge);
+        vdump("downstream_hedge_delay", "%u", b->downstream_hedge_delay);
+        vdump("replica_reads", "%d", b->replica_reads);
         vdump("mcs_opts", "%s", b->mcs_opts);
         vdump("connect_max_errors", "%u", b->connect_max_errors);
         vdump("connect_retry_interval", "%u", b->connect_retry_interval);
@@ -891,6 +943,10 @@ void cproxy_dump_behavior_ex(proxy_behavior *b, char *prefix, int level,
         vdump("key_stats_spec", "%s", b->key_stats_spec);
         vdump("key_stats_unspec", "%s", b->key_stats_unspec);
         vdump("optimize_set", "%s", b->optimize_set);
+        vdump("hot_key_spec", "%s", b->hot_key_spec);
+        vdump("hot_key_threshold", "%u", b->hot_key_threshold);
+        vdump("hot_key_window", "%u", b->hot_key_window);
+        vdump("hot_key_replica_lag", "%u", b->hot_key_replica_lag);
     }
 
     vdump("usr",    "%s", b->usr);
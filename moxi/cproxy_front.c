@@ -22,9 +22,12 @@ static void *item_get_prev(void *it);
 static void item_set_prev(void *it, void *prev);
 static uint64_t item_get_exptime(void *it);
 static void item_set_exptime(void *it, uint64_t exptime);
+static bool item_get_visited(void *it);
+static void item_set_visited(void *it, bool visited);
 
-void mcache_item_unlink(mcache *m, void *it);
-void mcache_item_touch(mcache *m, void *it);
+static void mcache_item_unlink(mcache *m, mcache_shard *s, void *it);
+static void mcache_item_link(mcache *m, mcache_shard *s, void *it);
+static void mcache_item_unlink_all(mcache *m, void *hand);
 
 mcache_funcs mcache_item_funcs = {
     .item_key         = item_key,
@@ -37,29 +40,59 @@ mcache_funcs mcache_item_funcs = {
     .item_get_prev    = item_get_prev,
     .item_set_prev    = item_set_prev,
     .item_get_exptime = item_get_exptime,
-    .item_set_exptime = item_set_exptime
+    .item_set_exptime = item_set_exptime,
+    .item_get_visited = item_get_visited,
+    .item_set_visited = item_set_visited
 };
 
+static inline void shard_lock(mcache *m, mcache_shard *s) {
+    if (m->multithreaded) {
+        pthread_mutex_lock(&s->lock);
+    }
+}
+
+static inline void shard_unlock(mcache *m, mcache_shard *s) {
+    if (m->multithreaded) {
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+/* Returns the shard that owns a key, or NULL if the shards
+ * couldn't be allocated.
+ */
+static mcache_shard *mcache_shard_for(mcache *m, char *key, int key_len) {
+    if (m->nshards <= 1) {
+        return m->shards;
+    }
+
+    // Use the high bits, as the genhash of the shard
+    // uses the same hash function for its buckets.
+    //
+    uint32_t h = murmur_hash(key, key_len);
+
+    return &m->shards[(h >> 16) & (m->nshards - 1)];
+}
+
 void mcache_init(mcache *m, bool multithreaded,
                  mcache_funcs *funcs, bool key_alloc) {
     assert(m);
     assert(funcs);
 
-    m->funcs       = funcs;
-    m->key_alloc   = key_alloc;
-    m->map         = NULL;
-    m->max         = 0;
-    m->lru_head    = NULL;
-    m->lru_tail    = NULL;
-    m->oldest_live = 0;
-
-    if (multithreaded) {
-        m->lock = malloc(sizeof(pthread_mutex_t));
-        if (m->lock != NULL) {
-            pthread_mutex_init(m->lock, NULL);
+    m->funcs         = funcs;
+    m->multithreaded = multithreaded;
+    m->key_alloc     = key_alloc;
+    m->nshards       = multithreaded ? MCACHE_SHARDS : 1;
+    m->shards        = calloc(m->nshards, sizeof(mcache_shard));
+    m->max           = 0;
+
+    if (m->shards != NULL) {
+        for (uint32_t i = 0; i < m->nshards; i++) {
+            if (multithreaded) {
+                pthread_mutex_init(&m->shards[i].lock, NULL);
+            }
         }
     } else {
-        m->lock = NULL;
+        m->nshards = 0;
     }
 
     mcache_reset_stats(m);
@@ -68,69 +101,120 @@ void mcache_init(mcache *m, bool multithreaded,
 void mcache_reset_stats(mcache *m) {
     assert(m);
 
-    if (m->lock) {
-        pthread_mutex_lock(m->lock);
-    }
+    for (uint32_t i = 0; i < m->nshards; i++) {
+        mcache_shard *s = &m->shards[i];
 
-    m->tot_get_hits    = 0;
-    m->tot_get_expires = 0;
-    m->tot_get_misses  = 0;
-    m->tot_get_bytes   = 0;
-    m->tot_adds        = 0;
-    m->tot_add_skips   = 0;
-    m->tot_add_fails   = 0;
-    m->tot_add_bytes   = 0;
-    m->tot_deletes     = 0;
-    m->tot_evictions   = 0;
-
-    if (m->lock) {
-        pthread_mutex_unlock(m->lock);
+        shard_lock(m, s);
+        memset(&s->stats, 0, sizeof(s->stats));
+        shard_unlock(m, s);
     }
 }
 
-void mcache_start(mcache *m, uint32_t max) {
+/* Sums the stats of all the shards.  Returns false if the
+ * mcache isn't started, in which case size is untouched.
+ */
+bool mcache_get_stats(mcache *m, mcache_stats *out,
+                      uint32_t *size, uint32_t *oldest_live) {
     assert(m);
+    assert(out);
 
-    if (m->lock) {
-        pthread_mutex_lock(m->lock);
+    bool started = false;
+    uint32_t tot_size = 0;
+
+    memset(out, 0, sizeof(*out));
+
+    if (oldest_live != NULL) {
+        *oldest_live = 0;
     }
 
+    for (uint32_t i = 0; i < m->nshards; i++) {
+        mcache_shard *s = &m->shards[i];
+
+        shard_lock(m, s);
+
+        if (s->map != NULL) {
+            started = true;
+            tot_size += genhash_size(s->map);
+        }
+
+        if (oldest_live != NULL &&
+            *oldest_live < s->oldest_live) {
+            *oldest_live = s->oldest_live;
+        }
+
+        out->tot_get_hits    += s->stats.tot_get_hits;
+        out->tot_get_expires += s->stats.tot_get_expires;
+        out->tot_get_misses  += s->stats.tot_get_misses;
+        out->tot_get_bytes   += s->stats.tot_get_bytes;
+        out->tot_adds        += s->stats.tot_adds;
+        out->tot_add_skips   += s->stats.tot_add_skips;
+        out->tot_add_fails   += s->stats.tot_add_fails;
+        out->tot_add_bytes   += s->stats.tot_add_bytes;
+        out->tot_deletes     += s->stats.tot_deletes;
+        out->tot_evictions   += s->stats.tot_evictions;
+
+        shard_unlock(m, s);
+    }
+
+    if (started && size != NULL) {
+        *size = tot_size;
+    }
+
+    return started;
+}
+
+void mcache_start(mcache *m, uint32_t max) {
+    assert(m);
     assert(m->funcs);
-    assert(m->map == NULL);
     assert(m->max == 0);
-    assert(m->lru_head == NULL);
-    assert(m->lru_tail == NULL);
-    assert(m->oldest_live == 0);
 
     struct hash_ops hops = skeyhash_ops;
     hops.freeKey = m->key_alloc ? free : noop_free;
     hops.freeValue = m->funcs->item_dec_ref;
 
-    m->map = genhash_init(128, hops);
-    if (m->map != NULL) {
-        m->max         = max;
-        m->lru_head    = NULL;
-        m->lru_tail    = NULL;
-        m->oldest_live = 0;
-    }
+    // The max is split evenly across the shards, so an
+    // unlucky shard may evict before the whole cache is full.
+    //
+    uint32_t shard_max = m->nshards > 0 ?
+        (max + m->nshards - 1) / m->nshards : 0;
+
+    for (uint32_t i = 0; i < m->nshards; i++) {
+        mcache_shard *s = &m->shards[i];
+
+        shard_lock(m, s);
+
+        assert(s->map == NULL);
+        assert(s->max == 0);
+        assert(s->clock_hand == NULL);
+        assert(s->oldest_live == 0);
 
-    if (m->lock) {
-        pthread_mutex_unlock(m->lock);
+        s->map = genhash_init(128, hops);
+        if (s->map != NULL) {
+            s->max         = shard_max;
+            s->clock_hand  = NULL;
+            s->oldest_live = 0;
+        }
+
+        shard_unlock(m, s);
     }
+
+    m->max = max;
 }
 
 bool mcache_started(mcache *m) {
     assert(m);
 
-    if (m->lock) {
-        pthread_mutex_lock(m->lock);
+    if (m->nshards <= 0) {
+        return false;
     }
 
-    bool rv = m->map != NULL;
+    mcache_shard *s = &m->shards[0];
 
-    if (m->lock) {
-        pthread_mutex_unlock(m->lock);
-    }
+    shard_lock(m, s);
+
+    bool rv = s->map != NULL;
+
+    shard_unlock(m, s);
 
     return rv;
 }
@@ -138,32 +222,34 @@ bool mcache_started(mcache *m) {
 void mcache_stop(mcache *m) {
     assert(m);
 
-    if (m->lock) {
-        pthread_mutex_lock(m->lock);
-    }
+    for (uint32_t i = 0; i < m->nshards; i++) {
+        mcache_shard *s = &m->shards[i];
 
-    genhash_t *x = m->map;
+        shard_lock(m, s);
 
-    m->map         = NULL;
-    m->max         = 0;
-    m->lru_head    = NULL;
-    m->lru_tail    = NULL;
-    m->oldest_live = 0;
+        genhash_t *x    = s->map;
+        void      *hand = s->clock_hand;
 
-    if (m->lock) {
-        pthread_mutex_unlock(m->lock);
-    }
+        s->map         = NULL;
+        s->max         = 0;
+        s->clock_hand  = NULL;
+        s->oldest_live = 0;
 
-    // Destroying hash table outside the lock.
-    //
-    if (x != NULL) {
-        genhash_free(x);
+        shard_unlock(m, s);
+
+        // Destroying hash table outside the lock.
+        //
+        if (x != NULL) {
+            mcache_item_unlink_all(m, hand);
+            genhash_free(x);
+        }
     }
+
+    m->max = 0;
 }
 
 void *mcache_get(mcache *m, char *key, int key_len,
                  uint64_t curr_time) {
-    (void)key_len;
     assert(key);
 
     if (m == NULL) {
@@ -172,29 +258,33 @@ void *mcache_get(mcache *m, char *key, int key_len,
 
     assert(m->funcs);
 
-    if (m->lock) {
-        pthread_mutex_lock(m->lock);
+    mcache_shard *s = mcache_shard_for(m, key, key_len);
+    if (s == NULL) {
+        return NULL;
     }
 
-    if (m->map != NULL) {
-        void *it = genhash_find(m->map, key);
-        if (it != NULL) {
-            mcache_item_unlink(m, it);
+    shard_lock(m, s);
 
+    if (s->map != NULL) {
+        void *it = genhash_find(s->map, key);
+        if (it != NULL) {
             uint64_t exptime = m->funcs->item_get_exptime(it);
             if ((exptime <= 0) ||
                 (exptime >= curr_time &&
-                 exptime >= m->oldest_live)) {
-                mcache_item_touch(m, it);
+                 exptime >= s->oldest_live)) {
+                // Only write the mark when it changes, so
+                // repeated hits on a hot item stay read-mostly.
+                //
+                if (!m->funcs->item_get_visited(it)) {
+                    m->funcs->item_set_visited(it, true);
+                }
 
                 m->funcs->item_add_ref(it); // TODO: Need lock here?
 
-                m->tot_get_hits++;
-                m->tot_get_bytes += m->funcs->item_len(it);
+                s->stats.tot_get_hits++;
+                s->stats.tot_get_bytes += m->funcs->item_len(it);
 
-                if (m->lock) {
-                    pthread_mutex_unlock(m->lock);
-                }
+                shard_unlock(m, s);
 
                 if (settings.verbose > 1) {
                     moxi_log_write("mcache hit: %s\n", key);
@@ -205,15 +295,17 @@ void *mcache_get(mcache *m, char *key, int key_len,
 
             // Handle item expiration.
             //
-            m->tot_get_expires++;
+            s->stats.tot_get_expires++;
 
             if (settings.verbose > 1) {
                 moxi_log_write("mcache expire: %s\n", key);
             }
 
-            genhash_delete(m->map, key);
+            mcache_item_unlink(m, s, it);
+
+            genhash_delete(s->map, key);
         } else {
-            m->tot_get_misses++;
+            s->stats.tot_get_misses++;
 
             if (settings.verbose > 1) {
                 moxi_log_write("mcache miss: %s\n", key);
@@ -221,9 +313,7 @@ void *mcache_get(mcache *m, char *key, int key_len,
         }
     }
 
-    if (m->lock) {
-        pthread_mutex_unlock(m->lock);
-    }
+    shard_unlock(m, s);
 
     return NULL;
 }
@@ -241,23 +331,52 @@ void mcache_set(mcache *m, void *it,
         return;
     }
 
-    // TODO: Our lock areas are possibly too wide.
-    //
-    if (m->lock) {
-        pthread_mutex_lock(m->lock);
+    char *key     = m->funcs->item_key(it);
+    int   key_len = m->funcs->item_key_len(it);
+    char *key_buf = NULL;
+
+    mcache_shard *s = mcache_shard_for(m, key, key_len);
+    if (s == NULL) {
+        return;
     }
 
-    if (m->map != NULL) {
+    if (m->key_alloc) {
+        // The ITEM_key is not NULL or space terminated,
+        // and we need a copy, too, for hashtable ownership.
+        //
+        key_buf = malloc(key_len + 1);
+        if (key_buf != NULL) {
+            memcpy(key_buf, key, key_len);
+            key_buf[key_len] = '\0';
+            key = key_buf;
+        } else {
+            key = NULL;
+        }
+    }
+
+    shard_lock(m, s);
+
+    if (s->map != NULL) {
         // Evict some items if necessary.
         //
-        for (int i = 0; m->lru_tail != NULL && i < 20; i++) {
-            if ((uint32_t)genhash_size(m->map) < m->max) {
+        for (int i = 0; s->clock_hand != NULL && i < 20; i++) {
+            if ((uint32_t)genhash_size(s->map) < s->max) {
                 break;
             }
 
-            void *last_it = m->lru_tail;
+            // Sweep the hand past visited items, giving
+            // each one a second chance.  Terminates within
+            // one revolution, as each step clears a mark.
+            //
+            void *last_it = s->clock_hand;
+            while (m->funcs->item_get_visited(last_it)) {
+                m->funcs->item_set_visited(last_it, false);
+                last_it = m->funcs->item_get_next(last_it);
+            }
+
+            s->clock_hand = last_it;
 
-            mcache_item_unlink(m, last_it);
+            mcache_item_unlink(m, s, last_it);
 
             if (m->key_alloc) {
                 int  len = m->funcs->item_key_len(last_it);
@@ -265,83 +384,69 @@ void mcache_set(mcache *m, void *it,
                 memcpy(buf, m->funcs->item_key(last_it), len);
                 buf[len] = '\0';
 
-                genhash_delete(m->map, buf);
+                genhash_delete(s->map, buf);
             } else {
-                genhash_delete(m->map, m->funcs->item_key(last_it));
+                genhash_delete(s->map, m->funcs->item_key(last_it));
             }
 
-            m->tot_evictions++;
+            s->stats.tot_evictions++;
         }
 
-        if ((uint32_t)genhash_size(m->map) < m->max) {
-            char *key     = m->funcs->item_key(it);
-            int   key_len = m->funcs->item_key_len(it);
-            char *key_buf = NULL;
-
-            if (m->key_alloc) {
-                // The ITEM_key is not NULL or space terminated,
-                // and we need a copy, too, for hashtable ownership.
-                //
-                // TODO: Move this outside the lock area?
-                //
-                key_buf = malloc(key_len + 1);
-                if (key_buf != NULL) {
-                    memcpy(key_buf, key, key_len);
-                    key_buf[key_len] = '\0';
-                    key = key_buf;
-                } else {
-                    key = NULL;
-                }
-            }
-
+        if ((uint32_t)genhash_size(s->map) < s->max) {
             if (key != NULL) {
-                void *existing = add_only ? genhash_find(m->map, key) : NULL;
-                if (existing != NULL) {
-                    mcache_item_unlink(m, existing);
-                    mcache_item_touch(m, existing);
+                void *existing = genhash_find(s->map, key);
+                if (existing != NULL && add_only) {
+                    m->funcs->item_set_visited(existing, true);
 
                     if (mod_exptime_if_exists) {
                         m->funcs->item_set_exptime(existing, exptime);
                     }
 
-                    m->tot_add_skips++;
+                    s->stats.tot_add_skips++;
 
                     if (settings.verbose > 1) {
                         moxi_log_write("mcache add-skip: %s\n", key);
                     }
-
-                    if (key_buf != NULL) {
-                        free(key_buf);
-                    }
                 } else {
+                    if (existing != NULL) {
+                        // The genhash_update() releases the
+                        // existing item, so take it off the clock.
+                        //
+                        mcache_item_unlink(m, s, existing);
+                    }
+
                     m->funcs->item_set_exptime(it, exptime);
                     m->funcs->item_add_ref(it);
 
-                    genhash_update(m->map, key, it);
+                    genhash_update(s->map, key, it);
 
-                    m->tot_adds++;
-                    m->tot_add_bytes += m->funcs->item_len(it);
+                    key_buf = NULL; // Now owned by the hashtable.
+
+                    mcache_item_link(m, s, it);
+
+                    s->stats.tot_adds++;
+                    s->stats.tot_add_bytes += m->funcs->item_len(it);
 
                     if (settings.verbose > 1) {
                         moxi_log_write("mcache add: %s\n", key);
                     }
                 }
             } else {
-                m->tot_add_fails++;
+                s->stats.tot_add_fails++;
             }
         } else {
-            m->tot_add_fails++;
+            s->stats.tot_add_fails++;
         }
     }
 
-    if (m->lock) {
-        pthread_mutex_unlock(m->lock);
+    shard_unlock(m, s);
+
+    if (key_buf != NULL) {
+        free(key_buf);
     }
 }
 
 void mcache_delete(mcache *m, char *key, int key_len) {
-    (void)key_len;
-    (void)key;
     assert(key);
     assert(key_len > 0);
     assert(key[key_len] == '\0' ||
@@ -351,18 +456,21 @@ void mcache_delete(mcache *m, char *key, int key_len) {
         return;
     }
 
-    if (m->lock) {
-        pthread_mutex_lock(m->lock);
+    mcache_shard *s = mcache_shard_for(m, key, key_len);
+    if (s == NULL) {
+        return;
     }
 
-    if (m->map != NULL) {
-        void *existing = genhash_find(m->map, key);
+    shard_lock(m, s);
+
+    if (s->map != NULL) {
+        void *existing = genhash_find(s->map, key);
         if (existing != NULL) {
-            mcache_item_unlink(m, existing);
+            mcache_item_unlink(m, s, existing);
 
-            genhash_delete(m->map, key);
+            genhash_delete(s->map, key);
 
-            m->tot_deletes++;
+            s->stats.tot_deletes++;
 
             if (settings.verbose > 1) {
                 moxi_log_write("mcache delete: %s\n", key);
@@ -370,9 +478,7 @@ void mcache_delete(mcache *m, char *key, int key_len) {
         }
     }
 
-    if (m->lock) {
-        pthread_mutex_unlock(m->lock);
-    }
+    shard_unlock(m, s);
 }
 
 void mcache_flush_all(mcache *m, uint32_t msec_exp) {
@@ -380,45 +486,45 @@ void mcache_flush_all(mcache *m, uint32_t msec_exp) {
         return;
     }
 
-    if (m->lock) {
-        pthread_mutex_lock(m->lock);
-    }
+    for (uint32_t i = 0; i < m->nshards; i++) {
+        mcache_shard *s = &m->shards[i];
 
-    if (m->map != NULL) {
-        genhash_clear(m->map);
+        shard_lock(m, s);
 
-        m->lru_head = NULL;
-        m->lru_tail = NULL;
+        if (s->map != NULL) {
+            mcache_item_unlink_all(m, s->clock_hand);
+            genhash_clear(s->map);
 
-        m->oldest_live = msec_exp;
-    }
+            s->clock_hand = NULL;
+
+            s->oldest_live = msec_exp;
+        }
 
-    if (m->lock) {
-        pthread_mutex_unlock(m->lock);
+        shard_unlock(m, s);
     }
 }
 
-void mcache_item_unlink(mcache *m, void *it) {
+static void mcache_item_unlink(mcache *m, mcache_shard *s, void *it) {
     assert(m);
     assert(m->funcs);
+    assert(s);
     assert(it);
 
-    if (m->lru_head == it) {
-        m->lru_head = m->funcs->item_get_next(it);
-    }
+    void *next = m->funcs->item_get_next(it);
+    void *prev = m->funcs->item_get_prev(it);
 
-    if (m->lru_tail == it) {
-        m->lru_tail = m->funcs->item_get_prev(it);
-    }
+    assert(next != NULL);
+    assert(prev != NULL);
 
-    void *next = m->funcs->item_get_next(it);
-    if (next != NULL) {
-        m->funcs->item_set_prev(next, m->funcs->item_get_prev(it));
-    }
+    if (next == it) {
+        s->clock_hand = NULL;
+    } else {
+        m->funcs->item_set_prev(next, prev);
+        m->funcs->item_set_next(prev, next);
 
-    void *prev = m->funcs->item_get_prev(it);
-    if (prev != NULL) {
-        m->funcs->item_set_next(prev, m->funcs->item_get_next(it));
+        if (s->clock_hand == it) {
+            s->clock_hand = next;
+        }
     }
 
     m->funcs->item_set_next(it, NULL);
@@ -426,22 +532,48 @@ void mcache_item_unlink(mcache *m, void *it) {
 }
 
 /**
- * Push the item onto the head of the lru list.
+ * Link the item just behind the clock hand, so it's the
+ * last item inspected by the next eviction sweep.
  */
-void mcache_item_touch(mcache *m, void *it) {
+static void mcache_item_link(mcache *m, mcache_shard *s, void *it) {
     assert(m);
     assert(m->funcs);
     assert(m->funcs->item_get_next(it) == NULL);
     assert(m->funcs->item_get_prev(it) == NULL);
     assert(it);
 
-    if (m->lru_head != NULL) {
-        m->funcs->item_set_prev(m->lru_head, it);
+    void *hand = s->clock_hand;
+    if (hand != NULL) {
+        void *prev = m->funcs->item_get_prev(hand);
+
+        m->funcs->item_set_next(prev, it);
+        m->funcs->item_set_prev(it, prev);
+        m->funcs->item_set_next(it, hand);
+        m->funcs->item_set_prev(hand, it);
+    } else {
+        m->funcs->item_set_next(it, it);
+        m->funcs->item_set_prev(it, it);
+
+        s->clock_hand = it;
     }
-    m->funcs->item_set_next(it, m->lru_head);
-    m->lru_head = it;
-    if (m->lru_tail == NULL) {
-        m->lru_tail = it;
+
+    m->funcs->item_set_visited(it, false);
+}
+
+/**
+ * Clear the links of a whole circular list, so that items
+ * which outlive the mcache (via other refs) aren't left
+ * pointing at freed items.
+ */
+static void mcache_item_unlink_all(mcache *m, void *hand) {
+    void *it = hand;
+    while (it != NULL) {
+        void *next = m->funcs->item_get_next(it);
+
+        m->funcs->item_set_next(it, NULL);
+        m->funcs->item_set_prev(it, NULL);
+
+        it = (next != hand) ? next : NULL;
     }
 }
 
@@ -459,11 +591,20 @@ void mcache_foreach_trampoline(const void *key, const void *value, void *_data)
 
 void mcache_foreach(mcache *m, mcache_traversal_func f, void *userdata) {
     assert(m);
-    if (!m->map) {
-        return;
-    }
+
     struct mcache_foreach_data data = {.f = f, .userdata = userdata};
-    genhash_iter(m->map, mcache_foreach_trampoline, &data);
+
+    for (uint32_t i = 0; i < m->nshards; i++) {
+        mcache_shard *s = &m->shards[i];
+
+        shard_lock(m, s);
+
+        if (s->map != NULL) {
+            genhash_iter(s->map, mcache_foreach_trampoline, &data);
+        }
+
+        shard_unlock(m, s);
+    }
 }
 
 // -------------------------------------------------
@@ -536,3 +677,19 @@ static void item_set_exptime(void *it, uint64_t exptime) {
     i->exptime = exptime;
 }
 
+static bool item_get_visited(void *it) {
+    item *i = it;
+    assert(i);
+    return (i->it_flags & ITEM_VISITED) != 0;
+}
+
+static void item_set_visited(void *it, bool visited) {
+    item *i = it;
+    assert(i);
+    if (visited) {
+        i->it_flags |= ITEM_VISITED;
+    } else {
+        i->it_flags &= ~ITEM_VISITED;
+    }
+}
+
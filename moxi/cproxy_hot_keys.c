@@ -0,0 +1,273 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "memcached.h"
+#include "cproxy.h"
+#include "mcs.h"
+#include "log.h"
+
+// Hot key detection and replica read spreading.
+//
+// Each worker thread estimates per-key read rates with a small
+// count-min sketch.  Reads of keys that match hot_key_spec and
+// whose estimate reaches hot_key_threshold are counted, and when
+// replica_reads is set, round-robin'ed over the vbucket's master and
+// replicas, unless the key was mutated through this thread within
+// hot_key_replica_lag millisecs.
+//
+// Only engines that serve reads of replica vbuckets should have
+// replica_reads.  Others, like ep-engine, answer not-my-vbucket, so
+// the thread's hot key reads then stay on the masters for
+// hot_key_replica_lag millisecs.
+
+void cproxy_hot_keys_start(proxy_td *ptd) {
+    assert(ptd != NULL);
+    assert(ptd->hot_keys == NULL);
+
+    if (strlen(ptd->behavior_pool.base.hot_key_spec) == 0) {
+        return;
+    }
+
+    ptd->hot_keys = calloc(1, sizeof(hot_keys));
+    if (ptd->hot_keys != NULL) {
+        ptd->hot_keys->decay_time = msec_current_time;
+
+        matcher_start(&ptd->hot_key_matcher,
+                      ptd->behavior_pool.base.hot_key_spec);
+    }
+}
+
+void cproxy_hot_keys_stop(proxy_td *ptd) {
+    assert(ptd != NULL);
+
+    matcher_stop(&ptd->hot_key_matcher);
+
+    free(ptd->hot_keys);
+    ptd->hot_keys = NULL;
+}
+
+static bool hot_key_is_read(conn *uc) {
+    if (uc == NULL) {
+        return false;
+    }
+
+    if (IS_ASCII(uc->protocol)) {
+        return (uc->cmd_curr == PROTOCOL_BINARY_CMD_GETK ||
+                uc->cmd_curr == PROTOCOL_BINARY_CMD_GETKQ);
+    }
+
+    return (uc->cmd == PROTOCOL_BINARY_CMD_GET ||
+            uc->cmd == PROTOCOL_BINARY_CMD_GETQ ||
+            uc->cmd == PROTOCOL_BINARY_CMD_GETK ||
+            uc->cmd == PROTOCOL_BINARY_CMD_GETKQ);
+}
+
+/* Fills in the sketch column of the key for each sketch row,
+ * deriving the row hashes from one murmur hash.
+ */
+static void hot_key_slots(char *key, int key_len,
+                          uint32_t slots[HOT_KEYS_DEPTH]) {
+    uint32_t h1 = murmur_hash(key, key_len);
+    uint32_t h2 = ((h1 >> 16) | (h1 << 16)) | 1;
+
+    for (int i = 0; i < HOT_KEYS_DEPTH; i++) {
+        slots[i] = (h1 + i * h2) & (HOT_KEYS_WIDTH - 1);
+    }
+}
+
+static uint32_t hot_key_reads(hot_keys *hk, uint32_t slots[HOT_KEYS_DEPTH]) {
+    uint32_t rv = hk->reads[0][slots[0]];
+
+    for (int i = 1; i < HOT_KEYS_DEPTH; i++) {
+        if (rv > hk->reads[i][slots[i]]) {
+            rv = hk->reads[i][slots[i]];
+        }
+    }
+
+    return rv;
+}
+
+static uint64_t hot_key_written(hot_keys *hk, uint32_t slots[HOT_KEYS_DEPTH]) {
+    uint64_t rv = hk->writes[0][slots[0]];
+
+    for (int i = 1; i < HOT_KEYS_DEPTH; i++) {
+        if (rv > hk->writes[i][slots[i]]) {
+            rv = hk->writes[i][slots[i]];
+        }
+    }
+
+    return rv;
+}
+
+static bool hot_key_check(proxy_td *ptd, char *key, int key_len,
+                          uint32_t slots[HOT_KEYS_DEPTH]) {
+    hot_keys *hk = ptd->hot_keys;
+    assert(hk != NULL);
+
+    proxy_behavior *b = &ptd->behavior_pool.base;
+
+    if (hot_key_reads(hk, slots) < b->hot_key_threshold) {
+        return false;
+    }
+
+    uint64_t written = hot_key_written(hk, slots);
+    if (written > 0 &&
+        written + b->hot_key_replica_lag > msec_current_time) {
+        return false;
+    }
+
+    return matcher_check(&ptd->hot_key_matcher, key, key_len, false);
+}
+
+/* Returns the server index that a key should be sent to, given the
+ * server_index of its vbucket's master.  Only a first attempt at a
+ * read of a hot key may be routed to a replica, so that retries,
+ * such as after a not-my-vbucket reply, go to the master.
+ */
+int cproxy_hot_key_server_index(downstream *d, char *key, int key_len,
+                                int server_index, int vbucket) {
+    assert(d != NULL);
+    assert(d->ptd != NULL);
+
+    hot_keys *hk = d->ptd->hot_keys;
+
+    if (hk == NULL ||
+        d->ptd->behavior_pool.base.replica_reads == false ||
+        server_index < 0 ||
+        vbucket < 0 ||
+        d->upstream_retries > 0 ||
+        hot_key_is_read(d->upstream_conn) == false) {
+        return server_index;
+    }
+
+    uint32_t slots[HOT_KEYS_DEPTH];
+    hot_key_slots(key, key_len, slots);
+
+    if (hot_key_check(d->ptd, key, key_len, slots) == false) {
+        return server_index;
+    }
+
+    if (hk->reject_time > 0 &&
+        hk->reject_time +
+        d->ptd->behavior_pool.base.hot_key_replica_lag > msec_current_time) {
+        return server_index;
+    }
+
+    int nreplicas = mcs_num_replicas(&d->mst);
+    if (nreplicas <= 0) {
+        return server_index;
+    }
+
+    int n = hk->spread % (nreplicas + 1);
+    if (n == 0) {
+        return server_index;
+    }
+
+    int r = mcs_vbucket_replica(&d->mst, vbucket, n - 1);
+    if (r < 0 || r >= (int) mcs_server_count(&d->mst)) {
+        return server_index;
+    }
+
+    return r;
+}
+
+/* Records a request for a key that's been routed to server_index,
+ * updating the sketch and the hot key stats.
+ */
+void cproxy_hot_key_touch(downstream *d, char *key, int key_len,
+                          int server_index, int vbucket) {
+    assert(d != NULL);
+    assert(d->ptd != NULL);
+
+    proxy_td *ptd = d->ptd;
+    hot_keys *hk  = ptd->hot_keys;
+
+    if (hk == NULL) {
+        return;
+    }
+
+    uint32_t slots[HOT_KEYS_DEPTH];
+    hot_key_slots(key, key_len, slots);
+
+    if (hot_key_is_read(d->upstream_conn) == false) {
+        if (d->upstream_conn != NULL) {
+            for (int i = 0; i < HOT_KEYS_DEPTH; i++) {
+                hk->writes[i][slots[i]] = msec_current_time;
+            }
+        }
+
+        return;
+    }
+
+    if (hot_key_check(ptd, key, key_len, slots)) {
+        ptd->stats.stats.tot_hot_key_reads++;
+
+        int nreplicas = mcs_num_replicas(&d->mst);
+        for (int n = 0; n < nreplicas; n++) {
+            if (server_index == mcs_vbucket_replica(&d->mst, vbucket, n)) {
+                ptd->stats.stats.tot_hot_key_replica_reads++;
+                break;
+            }
+        }
+
+        hk->spread++;
+    }
+
+    uint32_t window = ptd->behavior_pool.base.hot_key_window;
+
+    if (msec_current_time >= hk->decay_time + window) {
+        for (int i = 0; i < HOT_KEYS_DEPTH; i++) {
+            for (int j = 0; j < HOT_KEYS_WIDTH; j++) {
+                hk->reads[i][j] = hk->reads[i][j] >> 1;
+            }
+        }
+
+        hk->decay_time = msec_current_time;
+    }
+
+    // Conservative update, only raising the smallest counters.
+    //
+    uint32_t reads = hot_key_reads(hk, slots);
+
+    for (int i = 0; i < HOT_KEYS_DEPTH; i++) {
+        if (hk->reads[i][slots[i]] == reads &&
+            reads < UINT32_MAX) {
+            hk->reads[i][slots[i]]++;
+        }
+    }
+}
+
+/* Called on a not-my-vbucket reply from server_index.  Returns true
+ * if the server is a replica of the vbucket, and so refused a hot key
+ * read rather than lost the vbucket's mastership.
+ */
+bool cproxy_hot_key_replica_rejected(downstream *d, int server_index,
+                                     int vbucket) {
+    assert(d != NULL);
+    assert(d->ptd != NULL);
+
+    hot_keys *hk = d->ptd->hot_keys;
+
+    if (hk == NULL ||
+        server_index < 0 ||
+        vbucket < 0) {
+        return false;
+    }
+
+    int nreplicas = mcs_num_replicas(&d->mst);
+    for (int n = 0; n < nreplicas; n++) {
+        if (server_index == mcs_vbucket_replica(&d->mst, vbucket, n)) {
+            hk->reject_time = msec_current_time;
+
+            d->ptd->stats.stats.tot_hot_key_replica_rejects++;
+
+            return true;
+        }
+    }
+
+    return false;
+}
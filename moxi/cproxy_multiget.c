@@ -468,5 +468,383 @@ void multiget_ascii_downstream_response(downstream *d, item *it) {
             uc = uc->next;
         }
     }
+
+    cproxy_coalesce_reply(d, it);
+}
+
+
+/* Returns the key of a single-key ascii "get" request that is
+ * eligible for coalescing, or NULL.  The returned key points into
+ * the conn's cmd_start and is space or NUL terminated.
+ */
+static char *coalesce_key(proxy_td *ptd, conn *uc) {
+    assert(ptd != NULL);
+    assert(uc != NULL);
+
+    if (ptd->behavior_pool.base.coalesce_gets == false ||
+        uc->cmd != -1 ||
+        uc->cmd_curr != PROTOCOL_BINARY_CMD_GETK ||
+        uc->noreply ||
+        uc->peer_protocol != 0 ||
+        uc->next != NULL ||
+        uc->cmd_start == NULL ||
+        !IS_ASCII(uc->protocol) ||
+        !IS_PROXY(uc->protocol)) {
+        return NULL;
+    }
+
+    char *command = uc->cmd_start;
+    while (*command == ' ') {
+        command++;
+    }
+
+    // Only plain "get", as a "gets" reply carries a cas that
+    // isn't ours to share.
+    //
+    if (strncmp(command, "get ", 4) != 0) {
+        return NULL;
+    }
+
+    char *key = command + 4;
+    while (*key == ' ') {
+        key++;
+    }
+
+    size_t key_len = skey_len(key);
+    if (key_len == 0 || key_len > KEY_MAX_LENGTH) {
+        return NULL;
+    }
+
+    return key;
 }
 
+/* Returns true if the upstream's request mutates a key, pointing
+ * *key and *key_len at the key, or mutates every key, such as
+ * flush_all, with a NULL *key.
+ */
+static bool coalesce_mutation_key(conn *uc, char **key, int *key_len) {
+    assert(uc != NULL);
+    assert(key != NULL);
+    assert(key_len != NULL);
+
+    *key = NULL;
+    *key_len = 0;
+
+    int cmd = IS_ASCII(uc->protocol) ? (int) uc->cmd_curr : (int) uc->cmd;
+
+    switch (cmd) {
+    case PROTOCOL_BINARY_CMD_FLUSH:
+        return true;
+    case PROTOCOL_BINARY_CMD_SET:
+    case PROTOCOL_BINARY_CMD_ADD:
+    case PROTOCOL_BINARY_CMD_REPLACE:
+    case PROTOCOL_BINARY_CMD_APPEND:
+    case PROTOCOL_BINARY_CMD_PREPEND:
+    case PROTOCOL_BINARY_CMD_INCREMENT:
+    case PROTOCOL_BINARY_CMD_DECREMENT:
+    case PROTOCOL_BINARY_CMD_DELETE:
+    case PROTOCOL_BINARY_CMD_TOUCH:
+    case PROTOCOL_BINARY_CMD_GAT:
+        break;
+    default:
+        return false;
+    }
+
+    if (IS_ASCII(uc->protocol)) {
+        char *command = uc->cmd_start;
+        if (command == NULL) {
+            return false;
+        }
+
+        while (*command == ' ') {
+            command++;
+        }
+
+        char *k = command + skey_len(command);
+        while (*k == ' ') {
+            k++;
+        }
+
+        *key = k;
+        *key_len = skey_len(k);
+    } else {
+        item *it = uc->item;
+        if (it == NULL) {
+            return false;
+        }
+
+        protocol_binary_request_header *req =
+            (protocol_binary_request_header *) ITEM_data(it);
+
+        *key = ((char *) req) + sizeof(*req) + req->request.extlen;
+        *key_len = ntohs(req->request.keylen);
+    }
+
+    return *key_len > 0 && *key_len <= KEY_MAX_LENGTH;
+}
+
+/* Stops later gets from coalescing onto an in-flight get of the
+ * key, or of every key if the key is NULL.  The in-flight get still
+ * replies to the upstreams that already coalesced onto it.
+ */
+static void coalesce_forget(proxy_td *ptd, char *key) {
+    assert(ptd != NULL);
+
+    if (ptd->coalesce_gets == NULL) {
+        return;
+    }
+
+    if (key == NULL) {
+        genhash_clear(ptd->coalesce_gets);
+    } else {
+        genhash_delete(ptd->coalesce_gets, key);
+    }
+}
+
+/* Updates the key-based stats of a coalesced get, like the stats
+ * of the leader's get are.
+ */
+static void coalesce_key_stats(proxy_td *ptd, char *key, int key_len,
+                               int delta_seen,
+                               int delta_hits,
+                               int delta_misses,
+                               int delta_read_bytes,
+                               int delta_write_bytes) {
+    if (matcher_check(&ptd->key_stats_matcher,
+                      key, key_len, false) == true &&
+        matcher_check(&ptd->key_stats_unmatcher,
+                      key, key_len, false) == false) {
+        touch_key_stats(ptd, key, key_len,
+                        msec_current_time,
+                        STATS_CMD_TYPE_REGULAR,
+                        STATS_CMD_GET_KEY,
+                        delta_seen, delta_hits, delta_misses,
+                        delta_read_bytes, delta_write_bytes);
+    }
+}
+
+/* Attaches an upstream single-key get onto an in-flight get of the
+ * same key, if any, so that no extra downstream request is needed.
+ * Returns false if the caller should process the request normally.
+ */
+bool cproxy_coalesce_get(proxy_td *ptd, conn *uc) {
+    assert(ptd != NULL);
+    assert(uc != NULL);
+
+    if (ptd->coalesce_gets == NULL) {
+        return false;
+    }
+
+    char *key = coalesce_key(ptd, uc);
+    if (key == NULL) {
+        return false;
+    }
+
+    downstream *d = genhash_find(ptd->coalesce_gets, key);
+    if (d == NULL) {
+        return false;
+    }
+
+    assert(d->coalesce_key != NULL);
+
+    if (settings.verbose > 2) {
+        moxi_log_write("%d: coalesce_get %s\n", uc->sfd, d->coalesce_key);
+    }
+
+    conn_set_state(uc, conn_pause);
+
+    uc->next = d->coalesce_conns;
+    d->coalesce_conns = uc;
+
+    proxy_stats_cmd *psc_get_key =
+        &ptd->stats.stats_cmd[STATS_CMD_TYPE_REGULAR][STATS_CMD_GET_KEY];
+
+    psc_get_key->seen++;
+    psc_get_key->read_bytes += skey_len(key);
+
+    coalesce_key_stats(ptd, d->coalesce_key, skey_len(key),
+                       1, 0, 0, skey_len(key), 0);
+
+    ptd->stats.stats.tot_coalesce_gets++;
+
+    return true;
+}
+
+/* Called with a just-assigned downstream, before it's forwarded,
+ * to let later gets of the same key coalesce onto it.
+ *
+ * If the downstream instead mutates a key, gets already in flight
+ * for the key might be served before the mutation, so they're
+ * forgotten, both now and again when the mutation is done, for the
+ * gets that start meanwhile.  That way a get that follows the
+ * mutation's reply, such as a set then get from one client, never
+ * coalesces onto a get sent before the mutation.
+ */
+void cproxy_coalesce_start(downstream *d) {
+    assert(d != NULL);
+    assert(d->coalesce_key == NULL);
+    assert(d->coalesce_conns == NULL);
+    assert(d->coalesce_mutation == false);
+
+    proxy_td *ptd = d->ptd;
+    assert(ptd != NULL);
+
+    if (d->upstream_conn == NULL ||
+        ptd->behavior_pool.base.coalesce_gets == false) {
+        return;
+    }
+
+    char *mkey;
+    int   mkey_len;
+
+    if (coalesce_mutation_key(d->upstream_conn, &mkey, &mkey_len)) {
+        if (mkey != NULL) {
+            d->coalesce_key = malloc(mkey_len + 1);
+            if (d->coalesce_key == NULL) {
+                // Without the key, forget every in-flight get.
+                //
+                ptd->stats.stats.err_oom++;
+            } else {
+                memcpy(d->coalesce_key, mkey, mkey_len);
+                d->coalesce_key[mkey_len] = '\0';
+            }
+        }
+
+        d->coalesce_mutation = true;
+
+        coalesce_forget(ptd, d->coalesce_key);
+        return;
+    }
+
+    char *key = coalesce_key(ptd, d->upstream_conn);
+    if (key == NULL) {
+        return;
+    }
+
+    if (ptd->coalesce_gets == NULL) {
+        ptd->coalesce_gets = genhash_init(128, skeyhash_ops);
+        if (ptd->coalesce_gets == NULL) {
+            return;
+        }
+    } else if (genhash_find(ptd->coalesce_gets, key) != NULL) {
+        return;
+    }
+
+    size_t key_len = skey_len(key);
+
+    d->coalesce_key = malloc(key_len + 1);
+    if (d->coalesce_key == NULL) {
+        ptd->stats.stats.err_oom++;
+        return;
+    }
+
+    memcpy(d->coalesce_key, key, key_len);
+    d->coalesce_key[key_len] = '\0';
+
+    genhash_update(ptd->coalesce_gets, d->coalesce_key, d);
+}
+
+/* Writes the leader's reply to every upstream coalesced onto the
+ * downstream.  A NULL item means a miss.
+ */
+void cproxy_coalesce_reply(downstream *d, item *it) {
+    assert(d != NULL);
+
+    proxy_td *ptd = d->ptd;
+    assert(ptd != NULL);
+
+    if (d->coalesce_key == NULL ||
+        d->coalesce_conns == NULL) {
+        return;
+    }
+
+    if (it != NULL &&
+        (it->nkey != skey_len(d->coalesce_key) ||
+         strncmp(ITEM_key(it), d->coalesce_key, it->nkey) != 0)) {
+        return;
+    }
+
+    proxy_stats_cmd *psc_get_key =
+        &ptd->stats.stats_cmd[STATS_CMD_TYPE_REGULAR][STATS_CMD_GET_KEY];
+
+    while (d->coalesce_conns != NULL) {
+        conn *uc = d->coalesce_conns;
+        d->coalesce_conns = uc->next;
+        uc->next = NULL;
+
+        if (it != NULL) {
+            cproxy_upstream_ascii_item_response(it, uc, -1);
+
+            psc_get_key->hits++;
+            psc_get_key->write_bytes += it->nbytes;
+
+            coalesce_key_stats(ptd, d->coalesce_key, it->nkey,
+                               0, 1, 0, 0, it->nbytes);
+
+            ptd->stats.stats.tot_coalesce_bytes += it->nbytes;
+        } else {
+            psc_get_key->misses++;
+
+            coalesce_key_stats(ptd, d->coalesce_key,
+                               skey_len(d->coalesce_key),
+                               0, 0, 1, 0, 0);
+        }
+
+        if (add_iov(uc, "END\r\n", 5) == 0 &&
+            update_event(uc, EV_WRITE | EV_PERSIST)) {
+            conn_set_state(uc, conn_mwrite);
+        } else {
+            ptd->stats.stats.err_oom++;
+            cproxy_close_conn(uc);
+        }
+    }
+}
+
+/* Called when a downstream is released, so later gets of its key
+ * go downstream again.  Upstreams still waiting, such as after a
+ * downstream error or timeout, are retried with their own request.
+ */
+void cproxy_coalesce_done(downstream *d) {
+    assert(d != NULL);
+
+    proxy_td *ptd = d->ptd;
+    assert(ptd != NULL);
+
+    if (d->coalesce_mutation) {
+        assert(d->coalesce_conns == NULL);
+
+        coalesce_forget(ptd, d->coalesce_key);
+
+        free(d->coalesce_key);
+        d->coalesce_key = NULL;
+        d->coalesce_mutation = false;
+        return;
+    }
+
+    if (d->coalesce_key == NULL) {
+        assert(d->coalesce_conns == NULL);
+        return;
+    }
+
+    assert(ptd->coalesce_gets != NULL);
+
+    if (genhash_find(ptd->coalesce_gets, d->coalesce_key) == d) {
+        genhash_delete(ptd->coalesce_gets, d->coalesce_key);
+    }
+
+    free(d->coalesce_key);
+    d->coalesce_key = NULL;
+
+    while (d->coalesce_conns != NULL) {
+        conn *uc = d->coalesce_conns;
+        d->coalesce_conns = uc->next;
+        uc->next = NULL;
+
+        ptd->stats.stats.tot_coalesce_retries++;
+
+        assert(uc->thread);
+        assert(uc->thread->work_queue);
+
+        work_send(uc->thread->work_queue, upstream_retry, ptd, uc);
+    }
+}
@@ -141,7 +141,9 @@ void cproxy_process_upstream_ascii(conn *c, char *line) {
 
         // Handles get and gets.
         //
-        cproxy_pause_upstream_for_downstream(ptd, c);
+        if (cproxy_coalesce_get(ptd, c) == false) {
+            cproxy_pause_upstream_for_downstream(ptd, c);
+        }
 
         // The cmd_len from scan_tokens might not include
         // all the keys, so cmd_len might not == strlen(command).
@@ -108,6 +108,10 @@ void cproxy_process_a2a_downstream(conn *c, char *line) {
         }
     } else if (strncmp(line, "END", 3) == 0) {
         conn_set_state(c, conn_pause);
+
+        // Any coalesced gets not already given an item missed.
+        //
+        cproxy_coalesce_reply(d, NULL);
     } else if (strncmp(line, "OK", 2) == 0) {
         conn_set_state(c, conn_pause);
 
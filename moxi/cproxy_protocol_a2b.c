@@ -707,6 +707,10 @@ void a2b_process_downstream_response(conn *c) {
         return;
     }
 
+    if (cproxy_hedge_response(d, c, status, it)) {
+        return;
+    }
+
     conn *uc = d->upstream_conn;
 
     // Handle not-my-vbucket error response.
@@ -745,6 +749,8 @@ void a2b_process_downstream_response(conn *c) {
                 }
 
                 item_remove(it);
+            } else if (status == PROTOCOL_BINARY_RESPONSE_KEY_ENOENT) {
+                cproxy_coalesce_reply(d, NULL);
             }
 
             conn_set_state(c, conn_pause);
@@ -1328,12 +1334,15 @@ bool cproxy_forward_a2b_simple_downstream(downstream *d,
                 conn_set_state(c, conn_mwrite);
                 c->write_and_go = conn_new_cmd;
 
+                cproxy_mux_add_request(c, d, header);
+
                 if (update_event(c, EV_WRITE | EV_PERSIST)) {
                     d->downstream_used_start = 1;
                     d->downstream_used       = 1;
 
                     if (cproxy_dettach_if_noreply(d, uc) == false) {
                         cproxy_start_downstream_timeout(d, c);
+                        cproxy_start_downstream_hedge(d, c, vbucket);
                     } else {
                         c->write_and_go = conn_pause;
 
@@ -1681,6 +1690,8 @@ bool cproxy_forward_a2b_item_downstream(downstream *d, short cmd,
                         conn_set_state(c, conn_mwrite);
                         c->write_and_go = conn_new_cmd;
 
+                        cproxy_mux_add_request(c, d, req);
+
                         if (update_event(c, EV_WRITE | EV_PERSIST)) {
                             d->downstream_used_start = 1;
                             d->downstream_used       = 1;
@@ -1776,7 +1787,9 @@ bool a2b_not_my_vbucket(conn *uc, conn *c,
                            c->sfd, header->response.opcode, sindex, vbucket, uc->cmd_retries);
         }
 
-        mcs_server_invalid_vbucket(&d->mst, sindex, vbucket);
+        if (cproxy_hot_key_replica_rejected(d, sindex, vbucket) == false) {
+            mcs_server_invalid_vbucket(&d->mst, sindex, vbucket);
+        }
 
         // As long as the upstream is still open and we haven't
         // retried too many times already.
@@ -1841,7 +1854,9 @@ bool a2b_not_my_vbucket(conn *uc, conn *c,
                            d->upstream_retry + 1, sindex, vbucket);
         }
 
-        mcs_server_invalid_vbucket(&d->mst, sindex, vbucket);
+        if (cproxy_hot_key_replica_rejected(d, sindex, vbucket) == false) {
+            mcs_server_invalid_vbucket(&d->mst, sindex, vbucket);
+        }
 
         // Update the de-duplication map, removing the key, so that
         // we'll reattempt another request for the key during the
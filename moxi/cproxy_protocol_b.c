@@ -280,6 +280,11 @@ void cproxy_binary_uncork_cmds(downstream *d, conn *uc) {
 }
 
 void cproxy_process_downstream_binary(conn *c) {
+    if (c->mux != NULL &&
+        cproxy_mux_process_downstream_binary(c) == false) {
+        return;
+    }
+
     downstream *d = c->extra;
     assert(d != NULL);
     assert(d->upstream_conn != NULL);
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 #include <pthread.h>
 #include <assert.h>
 #include <math.h>
@@ -26,6 +27,93 @@ void cproxy_init_b2b() {
     req_noop.message.header.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
 }
 
+/* Writes a non-quiet downstream response that's entirely in the
+ * read buffer of downstream conn c directly to the upstream conn,
+ * instead of copying it into an item, when nothing else is queued for
+ * the upstream.  Whatever the upstream socket doesn't take right away
+ * is copied into an item and written as usual.  Returns false if the
+ * response needs the regular nread path.
+ */
+static bool b2b_write_through(conn *c, downstream *d, uint32_t nbytes) {
+    conn *uc = d->upstream_conn;
+
+    protocol_binary_response_header *header =
+        (protocol_binary_response_header *) &c->binary_header;
+
+    int opcode = header->response.opcode;
+    int status = ntohs(header->response.status);
+
+    if (uc == NULL ||
+        c->noreply ||
+        IS_UDP(uc->transport) ||
+        uc->iovused != 0 ||
+        opcode == PROTOCOL_BINARY_CMD_NOOP ||
+        opcode == PROTOCOL_BINARY_CMD_FLUSH ||
+        opcode == PROTOCOL_BINARY_CMD_STAT ||
+        status == PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET) {
+        return false;
+    }
+
+    ssize_t n = write(uc->sfd, c->rcurr, nbytes);
+    if (n <= 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&uc->thread->stats.mutex);
+    uc->thread->stats.bytes_written += n;
+    pthread_mutex_unlock(&uc->thread->stats.mutex);
+
+    d->ptd->stats.stats.tot_b2b_bytes_direct += n;
+
+    if (settings.verbose > 2) {
+        moxi_log_write("<%d b2b_write_through %u, wrote %d to %d\n",
+                       c->sfd, nbytes, (int) n, uc->sfd);
+    }
+
+    bool ok = true;
+
+    if ((uint32_t) n < nbytes) {
+        uint32_t rest = nbytes - n;
+
+        item *it = item_alloc("q", 1, 0, 0, rest);
+        if (it != NULL) {
+            memcpy(ITEM_data(it), c->rcurr + n, rest);
+
+            d->ptd->stats.stats.tot_b2b_bytes_copied += rest;
+
+            if (add_conn_item(uc, it) == true) {
+                it->refcount++;
+
+                ok = (add_iov(uc, ITEM_data(it), rest) == 0);
+            } else {
+                ok = false;
+            }
+
+            item_remove(it);
+        } else {
+            ok = false;
+        }
+    }
+
+    // The caller skips past the header.
+    //
+    c->rcurr  += nbytes - sizeof(c->binary_header);
+    c->rbytes -= nbytes - sizeof(c->binary_header);
+
+    conn_set_state(c, conn_pause);
+
+    if (ok) {
+        cproxy_update_event_write(d, uc);
+
+        conn_set_state(uc, conn_mwrite);
+    } else {
+        d->ptd->stats.stats.err_oom++;
+        cproxy_close_conn(uc);
+    }
+
+    return true;
+}
+
 /* Do the actual work of forwarding the command from an
  * upstream binary conn to its assigned binary downstream.
  */
@@ -223,6 +311,8 @@ bool b2b_forward_item_vbucket(conn *uc, downstream *d, item *it,
             conn_set_state(c, conn_mwrite);
             c->write_and_go = conn_new_cmd;
 
+            cproxy_mux_add_request(c, d, req);
+
             if (update_event(c, EV_WRITE | EV_PERSIST)) {
                 if (settings.verbose > 2) {
                     moxi_log_write("%d: b2b_forward %x to %d success\n",
@@ -333,7 +423,6 @@ void cproxy_process_b2b_downstream(conn *c) {
 
     c->cmd_curr       = -1;
     c->cmd_start      = NULL;
-    c->cmd_start_time = msec_current_time;
     c->cmd_retries    = 0;
 
     int      extlen  = c->binary_header.request.extlen;
@@ -349,6 +438,14 @@ void cproxy_process_b2b_downstream(conn *c) {
 
     process_bin_noreply(c); // Map quiet c->cmd values into non-quiet.
 
+    uint32_t nbytes = sizeof(c->binary_header) + bodylen;
+
+    if (c->rbytes >= 0 &&
+        (uint32_t) c->rbytes >= nbytes &&
+        b2b_write_through(c, d, nbytes)) {
+        return;
+    }
+
     // Our approach is to read everything we can before
     // getting into big switch/case statements for the
     // actual processing.
@@ -370,6 +467,12 @@ void cproxy_process_b2b_downstream(conn *c) {
 
         memcpy(ITEM_data(it), rb, sizeof(c->binary_header));
 
+        // The header and any body bytes already in the read buffer
+        // are copied into the item, the rest is read straight into it.
+        //
+        d->ptd->stats.stats.tot_b2b_bytes_copied +=
+            ((uint32_t) c->rbytes < nbytes) ? (uint32_t) c->rbytes : nbytes;
+
         if (bodylen > 0) {
             c->ritem = ITEM_data(it) + sizeof(c->binary_header);
             c->rlbytes = bodylen;
@@ -491,7 +594,9 @@ void cproxy_process_b2b_downstream_nread(conn *c) {
                         sindex, vbucket, uc->cmd_retries);
             }
 
-            mcs_server_invalid_vbucket(&d->mst, sindex, vbucket);
+            if (cproxy_hot_key_replica_rejected(d, sindex, vbucket) == false) {
+                mcs_server_invalid_vbucket(&d->mst, sindex, vbucket);
+            }
 
             // As long as the upstream is still open and we haven't
             // retried too many times already.
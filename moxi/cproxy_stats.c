@@ -51,6 +51,8 @@ static void *key_stats_get_prev(void *it);
 static void key_stats_set_prev(void *it, void *prev);
 static uint64_t key_stats_get_exptime(void *it);
 static void key_stats_set_exptime(void *it, uint64_t exptime);
+static bool key_stats_get_visited(void *it);
+static void key_stats_set_visited(void *it, bool visited);
 
 mcache_funcs mcache_key_stats_funcs = {
     .item_key         = key_stats_key,
@@ -63,7 +65,9 @@ mcache_funcs mcache_key_stats_funcs = {
     .item_get_prev    = key_stats_get_prev,
     .item_set_prev    = key_stats_set_prev,
     .item_get_exptime = key_stats_get_exptime,
-    .item_set_exptime = key_stats_set_exptime
+    .item_set_exptime = key_stats_set_exptime,
+    .item_get_visited = key_stats_get_visited,
+    .item_set_visited = key_stats_set_visited
 };
 
 #define MAX_TOKENS     5
@@ -401,6 +405,7 @@ void cproxy_reset_stats(proxy_stats *ps) {
     ps->tot_downstream_reserved_time = 0;
     ps->max_downstream_reserved_time = 0;
     ps->tot_downstream_freed = 0;
+    ps->tot_downstream_remap_frees_avoided = 0;
     ps->tot_downstream_quit_server = 0;
     ps->tot_downstream_max_reached = 0;
     ps->tot_downstream_create_failed = 0;
@@ -421,6 +426,10 @@ void cproxy_reset_stats(proxy_stats *ps) {
     ps->tot_downstream_conn_queue_timeout = 0;
     ps->tot_downstream_conn_queue_add = 0;
     ps->tot_downstream_conn_queue_remove = 0;
+    ps->tot_downstream_mux_requests = 0;
+    ps->tot_downstream_mux_waits = 0;
+    ps->tot_downstream_mux_orphans = 0;
+    ps->max_downstream_mux_inflight = 0;
     ps->tot_downstream_timeout = 0;
     ps->tot_wait_queue_timeout = 0;
     ps->tot_assign_downstream = 0;
@@ -436,6 +445,16 @@ void cproxy_reset_stats(proxy_stats *ps) {
     ps->tot_multiget_keys = 0;
     ps->tot_multiget_keys_dedupe = 0;
     ps->tot_multiget_bytes_dedupe = 0;
+    ps->tot_coalesce_gets = 0;
+    ps->tot_coalesce_bytes = 0;
+    ps->tot_coalesce_retries = 0;
+    ps->tot_hot_key_reads = 0;
+    ps->tot_hot_key_replica_reads = 0;
+    ps->tot_hot_key_replica_rejects = 0;
+    ps->tot_hedge_sent = 0;
+    ps->tot_hedge_won = 0;
+    ps->tot_b2b_bytes_copied = 0;
+    ps->tot_b2b_bytes_direct = 0;
     ps->tot_optimize_sets = 0;
     ps->err_oom = 0;
     ps->err_upstream_write_prep = 0;
@@ -451,6 +470,140 @@ void cproxy_reset_stats_cmd(proxy_stats_cmd *sc) {
 
 // -------------------------------------------------
 
+// Stats snapshots.  Each worker thread owns its ptd->stats and
+// updates them without locks.  While stats readers on other threads
+// keep reading, every STATS_SNAPSHOT_MSECS the worker copies them
+// into ptd->stats_snapshot, which the readers can copy out without
+// sending work to the worker or waiting on it, so the stats they
+// see can be up to STATS_SNAPSHOT_MSECS old.  The copy is guarded
+// by a sequence counter that is odd while the worker is writing, so
+// a reader retries if it saw a copy in progress.  Without atomics,
+// the worker and the readers take the proxy_lock around the
+// snapshot copy instead.
+//
+// A worker stops publishing when nobody has read its snapshot for
+// STATS_SNAPSHOT_IDLE_MSECS, so idle proxies don't wake up threads.
+// The next reader then asks the worker to start publishing again,
+// and meanwhile copies the live ptd->stats, as there is no recent
+// snapshot.  That copy races with the worker, which never locks its
+// own stats, so it is only best-effort: counters can be torn or
+// not agree with each other.  It's taken only after an idle spell,
+// when the worker is likely not updating them anyway.
+//
+static void stats_snapshot_timer(const int fd, const short which,
+                                 void *arg);
+
+static void stats_snapshot_wake(void *data0, void *data1) {
+    (void)data1;
+
+    proxy_td *ptd = data0;
+    assert(ptd);
+
+    assert(is_listen_thread() == false); // Expecting a worker thread.
+
+    if (ptd->stats_snapshot_started) {
+        return;
+    }
+
+    if (!ptd->stats_snapshot_event_set) {
+        LIBEVENT_THREAD *thread =
+            thread_by_index(thread_index(pthread_self()));
+        assert(thread != NULL);
+
+        evtimer_set(&ptd->stats_snapshot_event, stats_snapshot_timer, ptd);
+        event_base_set(thread->base, &ptd->stats_snapshot_event);
+
+        ptd->stats_snapshot_event_set = true;
+    }
+
+    ptd->stats_snapshot_started = true;
+
+    stats_snapshot_timer(0, 0, ptd);
+}
+
+static void stats_snapshot_timer(const int fd, const short which,
+                                 void *arg) {
+    (void)fd;
+    (void)which;
+
+    proxy_td *ptd = arg;
+    assert(ptd);
+
+    cproxy_stats_snapshot_publish(ptd);
+
+    if (msec_current_time - ptd->stats_snapshot_read_time >
+        STATS_SNAPSHOT_IDLE_MSECS) {
+        ptd->stats_snapshot_started = false;
+        return;
+    }
+
+    struct timeval t = { .tv_sec = 0,
+                         .tv_usec = STATS_SNAPSHOT_MSECS * 1000 };
+
+    evtimer_add(&ptd->stats_snapshot_event, &t);
+}
+
+void cproxy_stats_snapshot_publish(proxy_td *ptd) {
+    assert(ptd);
+
+#ifdef HAVE_GCC_ATOMICS
+    __sync_fetch_and_add(&ptd->stats_snapshot_seq, 1);
+
+    memcpy(&ptd->stats_snapshot, &ptd->stats, sizeof(proxy_stats_td));
+
+    __sync_fetch_and_add(&ptd->stats_snapshot_seq, 1);
+#else
+    pthread_mutex_lock(&ptd->proxy->proxy_lock);
+    memcpy(&ptd->stats_snapshot, &ptd->stats, sizeof(proxy_stats_td));
+    pthread_mutex_unlock(&ptd->proxy->proxy_lock);
+#endif
+}
+
+void cproxy_stats_snapshot_read(proxy_td *ptd, LIBEVENT_THREAD *thread,
+                                proxy_stats_td *out) {
+    assert(ptd);
+    assert(thread);
+    assert(out);
+
+    ptd->stats_snapshot_read_time = msec_current_time;
+
+#ifdef HAVE_GCC_ATOMICS
+    __sync_synchronize();
+#endif
+
+    if (!ptd->stats_snapshot_started) {
+        work_send(thread->work_queue, stats_snapshot_wake, ptd, NULL);
+
+        // Racy, best-effort copy; see above.
+        //
+        memcpy(out, &ptd->stats, sizeof(proxy_stats_td));
+
+        return;
+    }
+
+#ifdef HAVE_GCC_ATOMICS
+    while (true) {
+        uint32_t seq = ptd->stats_snapshot_seq;
+        __sync_synchronize();
+
+        if ((seq & 1) == 0) {
+            memcpy(out, &ptd->stats_snapshot, sizeof(proxy_stats_td));
+            __sync_synchronize();
+
+            if (seq == ptd->stats_snapshot_seq) {
+                return;
+            }
+        }
+    }
+#else
+    pthread_mutex_lock(&ptd->proxy->proxy_lock);
+    memcpy(out, &ptd->stats_snapshot, sizeof(proxy_stats_td));
+    pthread_mutex_unlock(&ptd->proxy->proxy_lock);
+#endif
+}
+
+// -------------------------------------------------
+
 key_stats *find_key_stats(proxy_td *ptd, char *key, int key_len,
                           uint64_t msec_time) {
     assert(ptd);
@@ -573,3 +726,15 @@ static void key_stats_set_exptime(void *it, uint64_t exptime) {
     i->exptime = exptime;
 }
 
+static bool key_stats_get_visited(void *it) {
+    key_stats *i = it;
+    assert(i);
+    return i->visited;
+}
+
+static void key_stats_set_visited(void *it, bool visited) {
+    key_stats *i = it;
+    assert(i);
+    i->visited = visited;
+}
+
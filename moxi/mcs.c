@@ -27,9 +27,13 @@ void     lvb_free_data(mcs_st *ptr);
 bool     lvb_stable_update(mcs_st *curr_version, mcs_st *next_version);
 uint32_t lvb_key_hash(mcs_st *ptr, const char *key, size_t key_length,
                       int *vbucket);
+int      lvb_num_replicas(mcs_st *ptr);
+int      lvb_vbucket_replica(mcs_st *ptr, int vbucket, int n);
 void     lvb_server_invalid_vbucket(mcs_st *ptr, int server_index,
                                     int vbucket);
 
+static void lvb_routes_build(mcs_st *ptr);
+
 // The lmc stands for libmemcached.
 //
 mcs_st  *lmc_create(mcs_st *ptr, const char *config,
@@ -131,6 +135,30 @@ uint32_t mcs_key_hash(mcs_st *ptr, const char *key, size_t key_length,
     return 0;
 }
 
+/* Returns the number of replicas of each vbucket, or 0 when
+ * the config has no vbuckets.
+ */
+int mcs_num_replicas(mcs_st *ptr) {
+#ifdef MOXI_USE_LIBVBUCKET
+    if (ptr->kind == MCS_KIND_LIBVBUCKET) {
+        return lvb_num_replicas(ptr);
+    }
+#endif
+    return 0;
+}
+
+/* Returns the server index of the n'th replica of a vbucket,
+ * or -1 if there's none.
+ */
+int mcs_vbucket_replica(mcs_st *ptr, int vbucket, int n) {
+#ifdef MOXI_USE_LIBVBUCKET
+    if (ptr->kind == MCS_KIND_LIBVBUCKET) {
+        return lvb_vbucket_replica(ptr, vbucket, n);
+    }
+#endif
+    return -1;
+}
+
 void mcs_server_invalid_vbucket(mcs_st *ptr, int server_index,
                                 int vbucket) {
 #ifdef MOXI_USE_LIBVBUCKET
@@ -210,6 +238,7 @@ mcs_st *lvb_create(mcs_st *ptr, const char *config,
                 }
 
                 if (j >= ptr->nservers) {
+                    lvb_routes_build(ptr);
                     return ptr;
                 }
             }
@@ -232,6 +261,11 @@ void lvb_free_data(mcs_st *ptr) {
     }
 
     ptr->data = NULL;
+
+    free(ptr->vbucket_masters_mem);
+    ptr->vbucket_masters_mem = NULL;
+    ptr->vbucket_masters = NULL;
+    ptr->vbucket_masters_num = 0;
 }
 
 /* Returns true if curr_version could be updated with next_version in
@@ -260,6 +294,8 @@ bool lvb_stable_update(mcs_st *curr_version, mcs_st *next_version) {
             curr_version->data = next_version->data;
             next_version->data = 0;
 
+            lvb_routes_build(curr_version);
+
             rv = true;
         }
 
@@ -274,6 +310,19 @@ uint32_t lvb_key_hash(mcs_st *ptr, const char *key, size_t key_length,
     assert(ptr->kind == MCS_KIND_LIBVBUCKET);
     assert(ptr->data != NULL);
 
+    if (ptr->vbucket_masters != NULL) {
+        int v = vbucket_get_vbucket_by_key((VBUCKET_CONFIG_HANDLE) ptr->data,
+                                           key, key_length);
+
+        assert(v >= 0 && v < ptr->vbucket_masters_num);
+
+        if (vbucket != NULL) {
+            *vbucket = v;
+        }
+
+        return (uint32_t) ptr->vbucket_masters[v];
+    }
+
     VBUCKET_CONFIG_HANDLE vch = (VBUCKET_CONFIG_HANDLE) ptr->data;
 
     int v = vbucket_get_vbucket_by_key(vch, key, key_length);
@@ -284,6 +333,31 @@ uint32_t lvb_key_hash(mcs_st *ptr, const char *key, size_t key_length,
     return (uint32_t) vbucket_get_master(vch, v);
 }
 
+int lvb_num_replicas(mcs_st *ptr) {
+    assert(ptr->kind == MCS_KIND_LIBVBUCKET);
+    assert(ptr->data != NULL);
+
+    VBUCKET_CONFIG_HANDLE vch = (VBUCKET_CONFIG_HANDLE) ptr->data;
+
+    return vbucket_config_get_num_replicas(vch);
+}
+
+int lvb_vbucket_replica(mcs_st *ptr, int vbucket, int n) {
+    assert(ptr->kind == MCS_KIND_LIBVBUCKET);
+    assert(ptr->data != NULL);
+
+    VBUCKET_CONFIG_HANDLE vch = (VBUCKET_CONFIG_HANDLE) ptr->data;
+
+    if (vbucket < 0 ||
+        vbucket >= vbucket_config_get_num_vbuckets(vch) ||
+        n < 0 ||
+        n >= vbucket_config_get_num_replicas(vch)) {
+        return -1;
+    }
+
+    return vbucket_get_replica(vch, vbucket, n);
+}
+
 void lvb_server_invalid_vbucket(mcs_st *ptr, int server_index,
                                 int vbucket) {
     assert(ptr->kind == MCS_KIND_LIBVBUCKET);
@@ -292,6 +366,55 @@ void lvb_server_invalid_vbucket(mcs_st *ptr, int server_index,
     VBUCKET_CONFIG_HANDLE vch = (VBUCKET_CONFIG_HANDLE) ptr->data;
 
     vbucket_found_incorrect_master(vch, vbucket, server_index);
+
+    // Keep the routing table in step with the fixed up master.
+    //
+    if (ptr->vbucket_masters != NULL &&
+        vbucket >= 0 &&
+        vbucket < ptr->vbucket_masters_num) {
+        ptr->vbucket_masters[vbucket] =
+            (int16_t) vbucket_get_master(vch, vbucket);
+    }
+}
+
+#define MCS_CACHE_LINE_SIZE 64
+
+/* Rebuilds the flattened vbucket to master server index table from
+ * the libvbucket config.  A new table is filled in before it
+ * replaces the old one.  It is cache line aligned, so a default
+ * 1024 vbucket map takes exactly 32 lines.
+ */
+static void lvb_routes_build(mcs_st *ptr) {
+    assert(ptr->kind == MCS_KIND_LIBVBUCKET);
+    assert(ptr->data != NULL);
+
+    VBUCKET_CONFIG_HANDLE vch = (VBUCKET_CONFIG_HANDLE) ptr->data;
+
+    void    *mem = NULL;
+    int16_t *masters = NULL;
+
+    int num_vbuckets = vbucket_config_get_num_vbuckets(vch);
+    if (num_vbuckets > 0 &&
+        ptr->nservers < INT16_MAX) {
+        mem = malloc(num_vbuckets * sizeof(int16_t) +
+                     MCS_CACHE_LINE_SIZE - 1);
+    }
+
+    if (mem != NULL) {
+        masters = (int16_t *)
+            (((uintptr_t) mem + MCS_CACHE_LINE_SIZE - 1) &
+             ~((uintptr_t) MCS_CACHE_LINE_SIZE - 1));
+
+        for (int v = 0; v < num_vbuckets; v++) {
+            masters[v] = (int16_t) vbucket_get_master(vch, v);
+        }
+    }
+
+    free(ptr->vbucket_masters_mem);
+
+    ptr->vbucket_masters_mem = mem;
+    ptr->vbucket_masters     = masters;
+    ptr->vbucket_masters_num = (masters != NULL) ? num_vbuckets : 0;
 }
 
 #endif // MOXI_USE_LIBVBUCKET
@@ -50,6 +50,16 @@ typedef struct {
     void          *data;     // Depends on kind.
     int            nservers; // Size of servers array.
     mcs_server_st *servers;
+
+    // Flattened vbucket to master server index routing table, so
+    // that key routing doesn't need to go through the libvbucket
+    // config, or NULL if there isn't one.  Rebuilt whenever the
+    // vbucket map changes.  The table starts on a cache line of
+    // the vbucket_masters_mem allocation.
+    //
+    int16_t       *vbucket_masters;
+    void          *vbucket_masters_mem;
+    int            vbucket_masters_num;
 } mcs_st;
 
 mcs_st *mcs_create(mcs_st *ptr, const char *config,
@@ -66,6 +76,9 @@ mcs_server_st *mcs_server_index(mcs_st *ptr, int i);
 
 uint32_t mcs_key_hash(mcs_st *ptr, const char *key, size_t key_length, int *vbucket);
 
+int mcs_num_replicas(mcs_st *ptr);
+int mcs_vbucket_replica(mcs_st *ptr, int vbucket, int n);
+
 void mcs_server_invalid_vbucket(mcs_st *ptr, int server_index, int vbucket);
 
 void mcs_server_st_quit(mcs_server_st *ptr, uint8_t io_death);
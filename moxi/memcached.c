@@ -445,6 +445,8 @@ conn *conn_new(const int sfd, enum conn_states init_state,
     c->cmd_start_time = 0;
     c->cmd_retries = 0;
     c->corked = NULL;
+    c->mux = NULL;
+    c->stats_delta = NULL;
     c->host_ident = NULL;
     c->peer_host = NULL;
     c->peer_protocol = 0;
@@ -546,6 +548,19 @@ void conn_free(conn *c) {
     }
 }
 
+static void stats_delta_free_entry(const void *key, const void *value,
+                                   void *user_data) {
+    (void)user_data;
+    free((void *)key);
+    free((void *)value);
+}
+
+static void stats_delta_free(stats_delta *sd) {
+    genhash_iter(sd->values, stats_delta_free_entry, NULL);
+    genhash_free(sd->values);
+    free(sd);
+}
+
 static void conn_close(conn *c) {
     assert(c != NULL);
 
@@ -560,6 +575,11 @@ static void conn_close(conn *c) {
     accept_new_conns(true);
     conn_cleanup(c);
 
+    if (c->stats_delta) {
+        stats_delta_free(c->stats_delta);
+        c->stats_delta = NULL;
+    }
+
     /* if the connection has big buffers, just free it */
     if (c->rsize > READ_BUFFER_HIGHWAT || conn_add_to_freelist(c)) {
         conn_free(c);
@@ -3040,6 +3060,115 @@ void process_command(conn *c, char *command) {
     return;
 }
 
+/* Passes on only the stats whose values changed since the last
+ * "stats proxy delta" on the conn.  Stats that the conn hasn't
+ * seen before count as having been "0".  Values that don't fit
+ * a stats_delta_value are always passed on.
+ */
+static void append_stats_delta(const char *key, const uint16_t klen,
+                               const char *val, const uint32_t vlen,
+                               const void *cookie) {
+    conn *c = (conn*)cookie;
+    assert(c->stats_delta != NULL);
+
+    if (klen == 0 || vlen >= STATS_DELTA_VALUE_LEN) {
+        append_stats(key, klen, val, vlen, cookie);
+        return;
+    }
+
+    char *k = malloc(klen + 1);
+    if (k == NULL) {
+        append_stats(key, klen, val, vlen, cookie);
+        return;
+    }
+
+    memcpy(k, key, klen);
+    k[klen] = '\0';
+
+    stats_delta_value *prev = genhash_find(c->stats_delta->values, k);
+    if (prev != NULL) {
+        free(k);
+
+        if (strlen(prev->val) == vlen &&
+            memcmp(prev->val, val, vlen) == 0) {
+            return;
+        }
+    } else {
+        if (vlen == 1 && val[0] == '0') {
+            free(k);
+            return;
+        }
+
+        prev = calloc(1, sizeof(stats_delta_value));
+        if (prev == NULL) {
+            free(k);
+        } else {
+            genhash_store(c->stats_delta->values, k, prev);
+        }
+    }
+
+    if (prev != NULL) {
+        memcpy(prev->val, val, vlen);
+        prev->val[vlen] = '\0';
+    }
+
+    append_stats(key, klen, val, vlen, cookie);
+}
+
+/* A cheaper "stats proxy" for monitoring scrapes, which only has
+ * the stats that changed since the conn's previous delta, after a
+ * "delta:interval_msec" stat that tells how long ago that was.
+ */
+static void process_stats_proxy_delta(conn *c) {
+    if (c->stats_delta == NULL) {
+        stats_delta *sd = calloc(1, sizeof(stats_delta));
+        if (sd != NULL) {
+            sd->values = genhash_init(256, strhash_ops);
+            if (sd->values == NULL) {
+                free(sd);
+                sd = NULL;
+            }
+        }
+
+        c->stats_delta = sd;
+    }
+
+    if (c->stats_delta == NULL) {
+        return;
+    }
+
+    uint64_t msec_time = msec_current_time;
+
+    append_stat("delta:interval_msec", &append_stats, c, "%llu",
+                (long long unsigned int)
+                (c->stats_delta->msec_time > 0 ?
+                 msec_time - c->stats_delta->msec_time : 0));
+
+    c->stats_delta->msec_time = msec_time;
+
+    server_stats(&append_stats_delta, c, "memcached:stats:");
+
+#ifdef HAVE_CONFLATE_H
+    struct proxy_stats_cmd_info psci = {
+        .do_info       = false,
+        .do_settings   = false,
+        .do_behaviors  = false,
+        .do_frontcache = true,
+        .do_keystats   = false,
+        .do_stats      = true,
+        .do_zeros      = false
+    };
+
+    proxy_stats_dump_proxy_main(&append_stats_delta, c, &psci);
+
+    proxy_stats_dump_proxies(&append_stats_delta, c, &psci);
+#endif
+}
+
+/* The per-thread proxy stats in "stats proxy" and "stats proxy delta"
+ * come from the snapshots that the worker threads publish, so they
+ * can be up to STATS_SNAPSHOT_MSECS (100ms) old.
+ */
 void process_stats_proxy_command(conn *c, token_t *tokens, const size_t ntokens) {
     if (ntokens == 4 && strcmp(tokens[2].value, "reset") == 0) {
 #ifdef HAVE_CONFLATE_H
@@ -3061,6 +3190,8 @@ void process_stats_proxy_command(conn *c, token_t *tokens, const size_t ntokens)
 #ifdef HAVE_CONFLATE_H
         proxy_stats_dump_config(&append_stats, c);
 #endif
+    } else if (ntokens == 4 && strcmp(tokens[2].value, "delta") == 0) {
+        process_stats_proxy_delta(c);
     } else {
         bool do_all = (ntokens == 3 || strcmp(tokens[2].value, "all") == 0);
         struct proxy_stats_cmd_info psci = {
@@ -3748,7 +3879,11 @@ void drive_machine(conn *c) {
             if (c->funcs->conn_pause != NULL)
                 c->funcs->conn_pause(c);
 
-            stop = true;
+            // The pause callback might resume a multiplexed downstream
+            // reader which has more pipelined responses already
+            // buffered, so keep going for it.
+            //
+            stop = (c->mux == NULL || c->state != conn_new_cmd);
             break;
 
         case conn_closing:
@@ -4272,6 +4407,21 @@ static void usage(char **argv) {
     printf("      Millisecs before moxi will timeout a request that has been\n"
            "      waiting too long in a downstream conn queue.\n"
            "      0 means no timeout.\n");
+    printf("  downstream_conn_mux=%d\n", b->downstream_conn_mux);
+    printf("      When 1, single-key requests to binary protocol downstreams\n"
+           "      are pipelined over one shared conn per worker thread and\n"
+           "      per host:port:bucket, instead of each using its own conn.\n");
+    printf("  downstream_mux_max=%d\n", b->downstream_mux_max);
+    printf("      Number of requests pipelined over downstream_conn_mux conns\n"
+           "      that moxi will process concurrently per worker thread and\n"
+           "      per bucket, on top of concurrency (downstream_max).  These\n"
+           "      requests don't hold a downstream conn of their own, so they\n"
+           "      don't count against concurrency, and don't wait behind\n"
+           "      requests that do.  0 means no limit.\n");
+    printf("  coalesce_gets=%d\n", b->coalesce_gets);
+    printf("      When 1, concurrent ascii single-key gets of the same key\n"
+           "      wait on one in-flight downstream get instead of each\n"
+           "      sending their own.\n");
     printf("  downstream_timeout=%ld\n",
            b->downstream_timeout.tv_sec * 1000 +
            b->downstream_timeout.tv_usec / 1000);
@@ -4279,6 +4429,24 @@ static void usage(char **argv) {
            "      downstream conns have been allocated to the request (such as\n"
            "      when the request reaches the head of the downstream conn queue).\n"
            "      0 means no timeout.\n");
+    printf("  downstream_timeout_adaptive=%d\n", b->downstream_timeout_adaptive);
+    printf("      When 1, the downstream timeout is twice a server's observed\n"
+           "      p99 reply latency, but no less than downstream_timeout_min\n"
+           "      and no more than downstream_timeout.\n");
+    printf("  downstream_timeout_min=%u\n", b->downstream_timeout_min);
+    printf("      Millisecs, the shortest adaptive downstream timeout.\n");
+    printf("  downstream_hedge=%d\n", b->downstream_hedge);
+    printf("      When 1, an ascii single-key get that takes longer than its\n"
+           "      server's p95 reply latency is also sent to a vbucket replica,\n"
+           "      and the first reply is used.  Needs replica_reads.\n");
+    printf("  downstream_hedge_delay=%u\n", b->downstream_hedge_delay);
+    printf("      Millisecs before a get is hedged.  0 means the server's\n"
+           "      observed p95 reply latency.\n");
+    printf("  replica_reads=%d\n", b->replica_reads);
+    printf("      When 1, the downstream servers serve reads of the vbuckets\n"
+           "      they hold as replicas, so hot key reads may be spread over\n"
+           "      replicas and gets may be hedged.  Servers that answer such reads with not-my-vbucket,\n"
+           "      as ep-engine does, should leave this 0.\n");
     printf("  cycle=%d\n", b->cycle);
     printf("      Millisec clock quantum for moxi.\n");
     printf("  mcs_opts=<initialization options for the mcs layer>\n");
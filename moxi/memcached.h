@@ -285,6 +285,20 @@ struct proxy_stats_cmd_info {
     bool do_zeros; /* might be used later */
 };
 
+/* What a connection was last sent by "stats proxy delta", so the
+ * next delta only has the stats that changed since.
+ */
+typedef struct {
+    genhash_t *values;    /* Maps stat keys to stats_delta_value. */
+    uint64_t   msec_time; /* When the last delta was sent. */
+} stats_delta;
+
+#define STATS_DELTA_VALUE_LEN 40
+
+typedef struct {
+    char val[STATS_DELTA_VALUE_LEN];
+} stats_delta_value;
+
 #define MAX_VERBOSITY_LEVEL 4
 
 /* When adding a setting, be sure to update process_stat_settings */
@@ -325,6 +339,9 @@ extern struct settings settings;
 /* temp */
 #define ITEM_SLABBED 4
 
+/* Hit in the front cache since its last CLOCK sweep. */
+#define ITEM_VISITED 8
+
 /**
  * Structure for storing items within memcached.
  */
@@ -348,6 +365,7 @@ typedef struct _stritem {
 } item;
 
 typedef struct bin_cmd bin_cmd;
+typedef struct downstream_mux downstream_mux;
 
 struct bin_cmd {
     item *request_item;  // Has 1 refcount.
@@ -492,6 +510,10 @@ struct conn {
 
     bin_cmd *corked;
 
+    downstream_mux *mux; // Non-NULL for a multiplexed downstream conn.
+
+    stats_delta *stats_delta; // Non-NULL after a "stats proxy delta".
+
     char *host_ident; // Uniquely identifies a memcached server, including
                       // address:port and possibly optional bucket/usr/pwd info.
     char *peer_host;    // this and the following two paramters are used for mcmux
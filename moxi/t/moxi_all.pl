@@ -44,6 +44,126 @@ if ($res != 0) {
   exit($res);
 }
 
+print "------------------------------------ stats\n";
+
+my $cmd = "./t/moxi_mock.pl moxi_mock_stats ascii";
+print($cmd . "\n");
+my $res = system($cmd);
+if ($res != 0) {
+  print "exit: $res\n";
+  exit($res);
+}
+
+sleep(1);
+
+print "------------------------------------ mux\n";
+
+my $cmd = "./t/moxi_mock.pl moxi_mock_mux binary \"\" ./t/moxi_mock.cfg" .
+                 " downstream_conn_mux=1,downstream_timeout=3000";
+print($cmd . "\n");
+my $res = system($cmd);
+if ($res != 0) {
+  print "exit: $res\n";
+  exit($res);
+}
+
+sleep(1);
+
+print "------------------------------------ coalesce\n";
+
+my $cmd = "./t/moxi_mock.pl moxi_mock_coalesce ascii \"\" ./t/moxi_mock.cfg" .
+                 " coalesce_gets=1,downstream_timeout=2000";
+print($cmd . "\n");
+my $res = system($cmd);
+if ($res != 0) {
+  print "exit: $res\n";
+  exit($res);
+}
+
+sleep(1);
+
+print "------------------------------------ coalesce after mutation\n";
+
+my $cmd = "./t/moxi_mock.pl moxi_mock_coalesce_rw ascii \"\" ./t/moxi_mock.cfg" .
+                 " downstream_max=2,coalesce_gets=1,downstream_timeout=2000";
+print($cmd . "\n");
+my $res = system($cmd);
+if ($res != 0) {
+  print "exit: $res\n";
+  exit($res);
+}
+
+sleep(1);
+
+print "------------------------------------ front cache\n";
+
+my $cmd = "./t/moxi_mock.pl moxi_mock_front_cache ascii \"\" ./t/moxi_mock.cfg" .
+                 " front_cache_max=16,front_cache_lifespan=3000,front_cache_spec=fc" .
+                 " \"\" 4";
+print($cmd . "\n");
+my $res = system($cmd);
+if ($res != 0) {
+  print "exit: $res\n";
+  exit($res);
+}
+
+sleep(1);
+
+print "------------------------------------ hot keys\n";
+
+foreach my $replica_reads (0, 1) {
+  my $cmd = "./t/moxi_mock.pl moxi_mock_hot_keys binary \"\" ./t/moxi_mock_replica.cfg" .
+                   " hot_key_spec=hot,hot_key_threshold=2,hot_key_window=60000," .
+                   "replica_reads=" . $replica_reads;
+  print($cmd . "\n");
+  my $res = system($cmd);
+  if ($res != 0) {
+    print "exit: $res\n";
+    exit($res);
+  }
+
+  sleep(1);
+}
+
+print "------------------------------------ hedge\n";
+
+my $cmd = "./t/moxi_mock.pl moxi_mock_hedge binary \"\" ./t/moxi_mock_hedge.cfg" .
+                 " downstream_hedge=1,downstream_hedge_delay=500,replica_reads=1";
+print($cmd . "\n");
+my $res = system($cmd);
+if ($res != 0) {
+  print "exit: $res\n";
+  exit($res);
+}
+
+sleep(1);
+
+print "------------------------------------ write through\n";
+
+my $cmd = "./t/moxi_mock.pl moxi_mock_write_through binary";
+print($cmd . "\n");
+my $res = system($cmd);
+if ($res != 0) {
+  print "exit: $res\n";
+  exit($res);
+}
+
+sleep(1);
+
+print "------------------------------------ remap\n";
+
+my $cmd = "./t/moxi_mock.pl moxi_mock_remap binary \"\"" .
+                 " url=http://127.0.0.1:4567/pools/default/buckets/default" .
+                 " port_listen=11333";
+print($cmd . "\n");
+my $res = system($cmd);
+if ($res != 0) {
+  print "exit: $res\n";
+  exit($res);
+}
+
+sleep(1);
+
 print "------------------------------------ auth\n";
 
 my $cmd = "./t/moxi_mock.pl moxi_mock_auth binary \"\"" .
@@ -15,7 +15,8 @@
 # Alternative command-line...
 #
 #  ./t/moxi_mock.pl [mock_test] [downstream_protocol] [test_name] \
-#     [moxi-z-param] [moxi-Z-param] [rest/http-server-params]
+#     [moxi-z-param] [moxi-Z-param] [rest/http-server-params] \
+#     [num_threads]
 #
 #  ./t/moxi_mock.pl moxi_mock_auth binary "" \
 #                   url=http://127.0.0.1:4567/pools/default/buckets/default \
@@ -28,6 +29,7 @@ my $test_name           = $ARGV[2] || '';
 my $little_z            = $ARGV[3] || './t/moxi_mock.cfg';
 my $big_Z               = $ARGV[4] || '';
 my $restargs            = $ARGV[5] || '...NONE...';
+my $num_threads         = $ARGV[6] || 1;
 
 print "moxi_mock.pl: " . $upstream_protocol . " " . $downstream_protocol . " " . $test_name + "\n";
 
@@ -51,14 +53,17 @@ if ($restargs ne '...NONE...') {
   sleep(1);
 }
 
-# Fork moxi for moxi-specific testing.
+# Fork moxi for moxi-specific testing.  The -Z param comes last,
+# so that it can override the defaults.
 #
+$big_Z =~ s/,$//;
+
 my $childargs =
       " -z " . $little_z .
-      " -p 0 -U 0 -v -t 1" .
-      " -Z \"" . $big_Z .
-            "downstream_max=1,downstream_conn_max=0," .
-            "downstream_protocol=" . $downstream_protocol . "\"";
+      " -p 0 -U 0 -v -t " . $num_threads .
+      " -Z \"downstream_max=1,downstream_conn_max=0," .
+            "downstream_protocol=" . $downstream_protocol .
+            ($big_Z ne '' ? "," . $big_Z : "") . "\"";
 if ($< == 0) {
    $childargs .= " -u root";
 }
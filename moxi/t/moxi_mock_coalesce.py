@@ -0,0 +1,132 @@
+import sys
+import string
+import socket
+import select
+import unittest
+import threading
+import time
+import re
+import struct
+
+import moxi_mock_server
+
+# Tests of concurrent single-key gets coalescing onto one
+# downstream get (coalesce_gets).
+#
+# Before you run moxi_mock_coalesce.py, start a moxi like...
+#
+#   ./moxi -z ./t/moxi_mock.cfg -p 0 -U 0 -vvv -t 1 -O stderr
+#          -Z downstream_max=1,downstream_conn_max=0,downstream_protocol=ascii,
+#             coalesce_gets=1,downstream_timeout=2000
+#
+# Then...
+#
+#   python ./t/moxi_mock_coalesce.py
+#
+# ----------------------------------
+
+class TestProxyCoalesce(moxi_mock_server.ProxyClientBase):
+    def __init__(self, x):
+        moxi_mock_server.ProxyClientBase.__init__(self, x)
+
+    def sendGets(self, key, num_clients):
+        """The first client's get goes downstream, then the others
+           get the same key while it is in flight.  Returns the mock
+           session which has the get"""
+        for i in range(num_clients):
+            self.client_connect(i)
+
+        self.client_send("get " + key + "\r\n", 0)
+        s = self.mock_recv_any("get " + key + "\r\n")
+
+        for i in range(1, num_clients):
+            self.client_send("get " + key + "\r\n", i)
+        self.wait(10)
+
+        # Only the one downstream get.
+        #
+        self.assertTrue(self.mock_all_quiet())
+        return s
+
+    def testFollowersGetValue(self):
+        """Test concurrent gets of one key make one downstream get"""
+        s = self.sendGets('hotKey', 4)
+
+        self.mock_send('VALUE hotKey 0 5\r\nhello\r\nEND\r\n', s)
+
+        for i in range(4):
+            self.client_recv('VALUE hotKey 0 5\r\nhello\r\nEND\r\n', i)
+
+        self.assertTrue(self.mock_all_quiet())
+
+    def testFollowersGetMiss(self):
+        """Test followers of a get that misses see a miss"""
+        s = self.sendGets('hotMiss', 3)
+
+        self.mock_send('END\r\n', s)
+
+        for i in range(3):
+            self.client_recv('END\r\n', i)
+
+        self.assertTrue(self.mock_all_quiet())
+
+    def testNextGetGoesDownstream(self):
+        """Test a get after the reply is not coalesced"""
+        s = self.sendGets('hotAgain', 2)
+
+        self.mock_send('END\r\n', s)
+        self.client_recv('END\r\n', 0)
+        self.client_recv('END\r\n', 1)
+
+        self.client_send("get hotAgain\r\n", 1)
+        s = self.mock_recv_any("get hotAgain\r\n")
+        self.mock_send('VALUE hotAgain 0 1\r\nx\r\nEND\r\n', s)
+        self.client_recv('VALUE hotAgain 0 1\r\nx\r\nEND\r\n', 1)
+
+    def testGetsIsNotCoalesced(self):
+        """Test a gets goes downstream on its own"""
+        s = self.sendGets('hotCas', 1)
+
+        self.client_connect(1)
+        self.client_send("gets hotCas\r\n", 1)
+        self.wait(10)
+
+        self.assertTrue(self.mock_all_quiet())
+        self.mock_send('END\r\n', s)
+        self.client_recv('END\r\n', 0)
+
+        s = self.mock_recv_any("gets hotCas\r\n")
+        self.mock_send('END\r\n', s)
+        self.client_recv('END\r\n', 1)
+
+    def testFollowersServedAfterLeaderClose(self):
+        """Test followers get the reply after the leader goes away"""
+        s = self.sendGets('hotGone', 3)
+
+        self.client_close(0)
+        self.wait(10)
+
+        self.mock_send('VALUE hotGone 0 2\r\nhi\r\nEND\r\n', s)
+        self.client_recv('VALUE hotGone 0 2\r\nhi\r\nEND\r\n', 1)
+        self.client_recv('VALUE hotGone 0 2\r\nhi\r\nEND\r\n', 2)
+
+    def testFollowersRetriedOnLeaderTimeout(self):
+        """Test followers send their own get when the leader's
+           downstream times out after the leader went away"""
+        self.sendGets('hotLeader', 3)
+
+        self.client_close(0)
+
+        # The timed out downstream conn is closed, so the retries go
+        # over new ones, one after another (downstream_max=1).
+        #
+        for i in range(2):
+            s = self.mock_recv_any("get hotLeader\r\n")
+            self.mock_send('VALUE hotLeader 0 2\r\nhi\r\nEND\r\n', s)
+
+        self.client_recv('VALUE hotLeader 0 2\r\nhi\r\nEND\r\n', 1)
+        self.client_recv('VALUE hotLeader 0 2\r\nhi\r\nEND\r\n', 2)
+        self.assertTrue(self.mock_all_quiet())
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,83 @@
+import sys
+import string
+import socket
+import select
+import unittest
+import threading
+import time
+import re
+import struct
+
+import moxi_mock_server
+
+# Tests that coalesce_gets keeps read-your-writes, when a mutation
+# runs on one downstream while a get of the same key is in flight
+# on another.
+#
+# Before you run moxi_mock_coalesce_rw.py, start a moxi like...
+#
+#   ./moxi -z ./t/moxi_mock.cfg -p 0 -U 0 -vvv -t 1 -O stderr
+#          -Z downstream_max=2,downstream_conn_max=0,downstream_protocol=ascii,
+#             coalesce_gets=1,downstream_timeout=2000
+#
+# Then...
+#
+#   python ./t/moxi_mock_coalesce_rw.py
+#
+# ----------------------------------
+
+class TestProxyCoalesceAfterMutation(moxi_mock_server.ProxyClientBase):
+    def __init__(self, x):
+        moxi_mock_server.ProxyClientBase.__init__(self, x)
+
+    def setThenGet(self, key, set_client, get_client, get_during_set):
+        """The set_client sets the key and then gets it, while the
+           get_client's get of the key is in flight, sent either
+           before the set or while the set is"""
+        get = "get " + key + "\r\n"
+        set = "set " + key + " 0 0 3\r\nnew\r\n"
+
+        if not get_during_set:
+            self.client_send(get, get_client)
+            g = self.mock_recv_any(get)
+
+        self.client_send(set, set_client)
+        m = self.mock_recv_any(set)
+
+        if get_during_set:
+            self.client_send(get, get_client)
+            g = self.mock_recv_any(get)
+
+        self.mock_send("STORED\r\n", m)
+        self.client_recv("STORED\r\n", set_client)
+
+        # The set_client's get has to go downstream, instead of
+        # coalescing onto the get_client's older get.
+        #
+        self.client_send(get, set_client)
+        k = self.mock_recv_any(get)
+
+        self.mock_send("VALUE " + key + " 0 3\r\nold\r\nEND\r\n", g)
+        self.client_recv("VALUE " + key + " 0 3\r\nold\r\nEND\r\n",
+                         get_client)
+
+        self.mock_send("VALUE " + key + " 0 3\r\nnew\r\nEND\r\n", k)
+        self.client_recv("VALUE " + key + " 0 3\r\nnew\r\nEND\r\n",
+                         set_client)
+
+        self.assertTrue(self.mock_all_quiet())
+
+    def testGetAfterSetIsNotCoalesced(self):
+        """Test a client's get after its own set doesn't coalesce
+           onto a get sent before the set or while it was in flight"""
+        self.client_connect(0)
+        self.client_connect(1)
+
+        # All in one test, as the mock server closes its sessions
+        # between tests, which leaves moxi with two dead pooled conns.
+        #
+        self.setThenGet('rwBefore', 1, 0, False)
+        self.setThenGet('rwDuring', 0, 1, True)
+
+if __name__ == '__main__':
+    unittest.main()
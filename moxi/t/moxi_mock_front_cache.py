@@ -0,0 +1,180 @@
+import sys
+import string
+import socket
+import select
+import unittest
+import threading
+import time
+import re
+import struct
+
+import moxi_mock_server
+
+# Tests of the front_cache, shared by all the worker threads.
+#
+# Before you run moxi_mock_front_cache.py, start a moxi like...
+#
+#   ./moxi -z ./t/moxi_mock.cfg -p 0 -U 0 -vvv -t 4 -O stderr
+#          -Z downstream_max=1,downstream_conn_max=0,downstream_protocol=ascii,
+#             front_cache_max=16,front_cache_lifespan=3000,front_cache_spec=fc
+#
+# Then...
+#
+#   python ./t/moxi_mock_front_cache.py
+#
+# ----------------------------------
+
+NUM_THREADS = 4
+FRONT_CACHE_MAX = 16
+FRONT_CACHE_LIFESPAN = 3000
+
+class TestProxyFrontCache(moxi_mock_server.ProxyClientBase):
+    def __init__(self, x):
+        moxi_mock_server.ProxyClientBase.__init__(self, x)
+
+    def front_cache_stats(self):
+        time.sleep(0.2)
+
+        c = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        c.connect(("127.0.0.1", self.proxy_port))
+        c.send("stats proxy frontcache\r\n")
+        s = ''
+        while not s.endswith("END\r\n"):
+            s = s + c.recv(65536)
+        c.close()
+
+        rv = {}
+        for line in s.split("\r\n"):
+            m = re.match("STAT " + str(self.proxy_port) +
+                         ":default:frontcache:(\S+) (\S+)", line)
+            if m:
+                rv[m.group(1)] = int(m.group(2))
+        return rv
+
+    def delta(self, before, after, k):
+        return after[k] - before[k]
+
+    def connectClients(self):
+        # Conns are handed out to the worker threads round-robin,
+        # so each client is on a different thread.
+        #
+        for i in range(NUM_THREADS):
+            self.client_connect(i)
+
+    def values(self, keys):
+        return ''.join(['VALUE %s 0 %d\r\nv%s\r\n' % (k, len(k) + 1, k)
+                        for k in keys])
+
+    def fill(self, keys, idx=0):
+        """Has one client get the keys through the mock server"""
+        get = "get " + " ".join(keys) + "\r\n"
+        self.client_send(get, idx)
+        s = self.mock_recv_any(get)
+        self.mock_send(self.values(keys) + "END\r\n", s)
+
+        r = ''
+        while not r.endswith("END\r\n"):
+            r = r + self.clients[idx].recv(65536)
+        self.assertEqual(r, self.values(keys) + "END\r\n")
+
+    def testHitAcrossThreads(self):
+        """Test a value cached by one thread is a hit on the others"""
+        self.connectClients()
+        before = self.front_cache_stats()
+
+        self.fill(['fcHit'])
+
+        for i in range(1, NUM_THREADS):
+            self.client_send("get fcHit\r\n", i)
+            self.client_recv(self.values(['fcHit']) + "END\r\n", i)
+
+        self.assertTrue(self.mock_all_quiet())
+
+        after = self.front_cache_stats()
+        self.assertEqual(self.delta(before, after, 'tot_get_hits'),
+                         NUM_THREADS - 1)
+
+    def testExpiry(self):
+        """Test a value is not a hit after front_cache_lifespan"""
+        self.connectClients()
+        before = self.front_cache_stats()
+
+        self.fill(['fcExp'])
+
+        self.client_send("get fcExp\r\n", 1)
+        self.client_recv(self.values(['fcExp']) + "END\r\n", 1)
+
+        self.wait(FRONT_CACHE_LIFESPAN / 10 + 50)
+
+        self.fill(['fcExp'], 2)
+
+        after = self.front_cache_stats()
+        self.assertEqual(self.delta(before, after, 'tot_get_hits'), 1)
+        self.assertEqual(self.delta(before, after, 'tot_get_expires'), 1)
+
+    def testEvictionAcrossThreads(self):
+        """Test the cache stays within front_cache_max, while every
+           thread gets more keys than fit"""
+        self.connectClients()
+        keys = ['fcE%02d' % i for i in range(40)]
+
+        before = self.front_cache_stats()
+
+        self.fill(keys)
+
+        after = self.front_cache_stats()
+        self.assertTrue(after['size'] <= FRONT_CACHE_MAX)
+        self.assertTrue(self.delta(before, after, 'tot_evictions') >=
+                        len(keys) - FRONT_CACHE_MAX)
+
+        # Every thread at once gets all the keys, hits from the cache
+        # and the rest from the mock server.
+        #
+        before = after
+
+        get = "get " + " ".join(keys) + "\r\n"
+        for i in range(NUM_THREADS):
+            self.client_send(get, i)
+
+        replies = {}
+        for i in range(NUM_THREADS):
+            self.clients[i].setblocking(0)
+            replies[i] = ''
+
+        n = 0
+        while n < 100 and len([i for i in replies
+                               if not replies[i].endswith("END\r\n")]) > 0:
+            sessions = self.mock_server().sessions
+            for k in sessions.keys():
+                while len(sessions[k].received) > 0:
+                    m = sessions[k].received.pop(0)
+                    self.assertTrue(m.startswith("get ") and
+                                    m.endswith("\r\n"))
+                    misses = m[4:-2].split(' ')
+                    self.mock_send(self.values(misses) + "END\r\n", k)
+
+            for i in replies:
+                try:
+                    replies[i] = replies[i] + self.clients[i].recv(65536)
+                except socket.error:
+                    pass
+
+            time.sleep(0.1)
+            n = n + 1
+
+        for i in range(NUM_THREADS):
+            self.clients[i].setblocking(1)
+
+            got = re.findall("VALUE (\S+) 0 \d+\r\n(\S+)\r\n", replies[i])
+            self.assertEqual(sorted(got), [(k, 'v' + k) for k in keys])
+
+        after = self.front_cache_stats()
+        self.assertTrue(after['size'] <= FRONT_CACHE_MAX)
+        self.assertTrue(self.delta(before, after, 'tot_get_hits') > 0)
+        self.assertEqual(self.delta(before, after, 'tot_get_hits') +
+                         self.delta(before, after, 'tot_get_misses') +
+                         self.delta(before, after, 'tot_get_expires'),
+                         NUM_THREADS * len(keys))
+
+if __name__ == '__main__':
+    unittest.main()
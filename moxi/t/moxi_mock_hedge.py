@@ -0,0 +1,122 @@
+import sys
+import string
+import socket
+import select
+import unittest
+import threading
+import time
+import re
+import struct
+
+from memcacheConstants import REQ_MAGIC_BYTE, RES_MAGIC_BYTE
+from memcacheConstants import REQ_PKT_FMT, RES_PKT_FMT, MIN_RECV_PACKET
+from memcacheConstants import SET_PKT_FMT, DEL_PKT_FMT, INCRDECR_RES_FMT
+
+import memcacheConstants
+
+import moxi_mock_server
+
+# Tests of slow single-key gets hedged to a vbucket replica
+# (downstream_hedge), with ascii upstream and binary downstream.
+# Vbucket 0 is mastered by the usual fake memcached server and
+# vbucket 1 by a second fake memcached server, each the other's
+# replica.
+#
+# Before you run moxi_mock_hedge.py, start a moxi like...
+#
+#   ./moxi -z ./t/moxi_mock_hedge.cfg -p 0 -U 0 -vvv -t 1 -O stderr
+#          -Z downstream_max=1,downstream_conn_max=0,downstream_protocol=binary,
+#             downstream_hedge=1,downstream_hedge_delay=500,replica_reads=1
+#
+# Then...
+#
+#   python ./t/moxi_mock_hedge.py
+#
+# ----------------------------------
+
+g_replica_server = moxi_mock_server.start_replica_server()
+
+# Keys that hash to vbucket 0 and vbucket 1.
+#
+KEY_VB0 = 'hedgeA'
+KEY_VB1 = 'hedgeB'
+
+class TestProxyHedge(moxi_mock_server.ProxyClientBase):
+    def __init__(self, x):
+        moxi_mock_server.ProxyClientBase.__init__(self, x)
+
+    def getk(self, key, vbucket=0):
+        return self.packReq(memcacheConstants.CMD_GETK, key=key,
+                            reserved=vbucket, opaque=vbucket)
+
+    def value(self, key, val, status=0):
+        if status != 0:
+            return self.packRes(memcacheConstants.CMD_GETK, status=status)
+        return self.packRes(memcacheConstants.CMD_GETK, key=key,
+                            extraHeader=struct.pack(memcacheConstants.GET_RES_FMT, 0),
+                            val=val)
+
+    def sendHedgedGet(self):
+        """Gets a vbucket 0 key, which the master doesn't answer, so
+           that it's hedged to the replica.  Returns the master's and
+           the replica's session_idx"""
+        self.client_connect()
+
+        # A hedge only uses an idle conn to the replica, so first make
+        # one with a get that the replica server is the master for.
+        # Also replace the master conn, which went stale when the last
+        # test closed the mock sessions.
+        #
+        for key, vbucket, master in [(KEY_VB1, 1, g_replica_server),
+                                     (KEY_VB0, 0, self.mock_server())]:
+            self.client_send("get " + key + "\r\n")
+            server, k = self.mock_recv_either(self.getk(key, vbucket))
+            self.assertEqual(server, master)
+            server.sessions[k].client.send(
+                self.value(key, '', memcacheConstants.ERR_NOT_FOUND))
+            self.client_recv("END\r\n")
+
+        self.client_send("get " + KEY_VB0 + "\r\n")
+        server, m = self.mock_recv_either(self.getk(KEY_VB0))
+        self.assertEqual(server, self.mock_server())
+
+        server, r = self.mock_recv_either(self.getk(KEY_VB0))
+        self.assertEqual(server, g_replica_server)
+
+        return m, r
+
+    def testHedgeWins(self):
+        """Test the replica's reply to a hedge goes to the client"""
+        before = self.proxy_stats()
+
+        m, r = self.sendHedgedGet()
+
+        g_replica_server.sessions[r].client.send(self.value(KEY_VB0, 'fast'))
+        self.client_recv("VALUE " + KEY_VB0 + " 0 4\r\nfast\r\nEND\r\n")
+
+        after = self.proxy_stats()
+        self.assertEqual(int(after['tot_hedge_sent']) -
+                         int(before['tot_hedge_sent']), 1)
+        self.assertEqual(int(after['tot_hedge_won']) -
+                         int(before['tot_hedge_won']), 1)
+
+    def testHedgeRefusedWaitsForMaster(self):
+        """Test a hedge the replica refuses waits for the master"""
+        before = self.proxy_stats()
+
+        m, r = self.sendHedgedGet()
+
+        g_replica_server.sessions[r].client.send(
+            self.value(KEY_VB0, '', memcacheConstants.ERR_NOT_MY_VBUCKET))
+        time.sleep(0.1)
+
+        self.mock_send(self.value(KEY_VB0, 'slow'), m)
+        self.client_recv("VALUE " + KEY_VB0 + " 0 4\r\nslow\r\nEND\r\n")
+
+        after = self.proxy_stats()
+        self.assertEqual(int(after['tot_hedge_sent']) -
+                         int(before['tot_hedge_sent']), 1)
+        self.assertEqual(after['tot_hedge_won'], before['tot_hedge_won'])
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,149 @@
+import sys
+import string
+import socket
+import select
+import unittest
+import threading
+import time
+import re
+import struct
+
+from memcacheConstants import REQ_MAGIC_BYTE, RES_MAGIC_BYTE
+from memcacheConstants import REQ_PKT_FMT, RES_PKT_FMT, MIN_RECV_PACKET
+from memcacheConstants import SET_PKT_FMT, DEL_PKT_FMT, INCRDECR_RES_FMT
+
+import memcacheConstants
+
+import moxi_mock_server
+
+# Tests of hot key reads spread over vbucket replicas (hot_key_spec
+# and replica_reads), with ascii upstream and binary downstream.
+# The vbucket's master is the usual fake memcached server, and its
+# replica is a second fake memcached server.
+#
+# Before you run moxi_mock_hot_keys.py, start a moxi like...
+#
+#   ./moxi -z ./t/moxi_mock_replica.cfg -p 0 -U 0 -vvv -t 1 -O stderr
+#          -Z downstream_max=1,downstream_conn_max=0,downstream_protocol=binary,
+#             hot_key_spec=hot,hot_key_threshold=2,hot_key_window=60000,
+#             replica_reads=1
+#
+# Then...
+#
+#   python ./t/moxi_mock_hot_keys.py
+#
+# Run it with replica_reads=0 too, which should keep all the reads
+# on the master.
+#
+# ----------------------------------
+
+g_replica_server = moxi_mock_server.start_replica_server()
+
+class TestProxyHotKeys(moxi_mock_server.ProxyClientBase):
+    def __init__(self, x):
+        moxi_mock_server.ProxyClientBase.__init__(self, x)
+
+    def recv_get(self, key):
+        return self.mock_recv_either(self.packReq(memcacheConstants.CMD_GETK,
+                                                  key=key))
+
+    def reply_get(self, server, k, key, val):
+        server.sessions[k].client.send(
+            self.packRes(memcacheConstants.CMD_GETK, key=key,
+                         extraHeader=struct.pack(memcacheConstants.GET_RES_FMT, 0),
+                         val=val))
+
+    def get(self, key, val='hi'):
+        """Sends a get of a hot key, and answers it with a value.
+           Returns the server that served it"""
+        self.client_send("get " + key + "\r\n")
+        server, k = self.recv_get(key)
+        self.reply_get(server, k, key, val)
+        self.client_recv("VALUE " + key + " 0 " + str(len(val)) + "\r\n" +
+                         val + "\r\nEND\r\n")
+        return server
+
+    def testReadsSpreadOverReplicas(self):
+        """Test hot key reads alternate over the master and replica"""
+        if self.proxy_stats()['replica_reads'] != '1':
+            return
+
+        self.client_connect()
+        self.get('warmup')
+
+        # The first reads only make the key hot.  Later reads might
+        # also land on the master after a stale replica conn fails.
+        # A mock session only lasts for 10 reads, so keep it short.
+        #
+        before = self.proxy_stats()
+        servers = [self.get('hotSpread') for i in range(6)]
+        after = self.proxy_stats()
+
+        self.assertTrue(g_replica_server in servers)
+        self.assertEqual(servers[0], self.mock_server())
+        self.assertEqual(servers[1], self.mock_server())
+
+        replica_reads = (int(after['tot_hot_key_replica_reads']) -
+                         int(before['tot_hot_key_replica_reads']))
+        self.assertTrue(replica_reads >= 1)
+        self.assertTrue(replica_reads >= servers.count(g_replica_server))
+
+    def testReadsStayOnMasterWithoutReplicaReads(self):
+        """Test hot keys are only counted without replica_reads"""
+        if self.proxy_stats()['replica_reads'] != '0':
+            return
+
+        self.client_connect()
+        self.get('warmup')
+
+        before = self.proxy_stats()
+        servers = [self.get('hotMaster') for i in range(6)]
+        after = self.proxy_stats()
+
+        self.assertTrue(g_replica_server not in servers)
+
+        self.assertEqual(int(after['tot_hot_key_reads']) -
+                         int(before['tot_hot_key_reads']), 4)
+        self.assertEqual(after['tot_hot_key_replica_reads'],
+                         before['tot_hot_key_replica_reads'])
+
+    def testReplicaRejectsRead(self):
+        """Test a not-my-vbucket from a replica retries at the master,
+           and keeps the hot reads on the master for a while"""
+        if self.proxy_stats()['replica_reads'] != '1':
+            return
+
+        self.client_connect()
+
+        before = self.proxy_stats()
+
+        i = 0
+        while i < 6:
+            self.client_send("get hotReject\r\n")
+            server, k = self.recv_get('hotReject')
+            if server == g_replica_server:
+                break
+            self.reply_get(server, k, 'hotReject', 'hi')
+            self.client_recv("VALUE hotReject 0 2\r\nhi\r\nEND\r\n")
+            i = i + 1
+
+        self.assertEqual(server, g_replica_server)
+
+        server.sessions[k].client.send(
+            self.packRes(memcacheConstants.CMD_GETK,
+                         status=memcacheConstants.ERR_NOT_MY_VBUCKET))
+
+        server, k = self.recv_get('hotReject')
+        self.assertEqual(server, self.mock_server())
+        self.reply_get(server, k, 'hotReject', 'hi')
+        self.client_recv("VALUE hotReject 0 2\r\nhi\r\nEND\r\n")
+
+        servers = [self.get('hotReject') for i in range(2)]
+        self.assertTrue(g_replica_server not in servers)
+
+        after = self.proxy_stats()
+        self.assertEqual(int(after['tot_hot_key_replica_rejects']) -
+                         int(before['tot_hot_key_replica_rejects']), 1)
+
+if __name__ == '__main__':
+    unittest.main()
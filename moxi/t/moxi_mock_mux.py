@@ -0,0 +1,231 @@
+import sys
+import string
+import socket
+import select
+import unittest
+import threading
+import time
+import re
+import struct
+
+from memcacheConstants import REQ_MAGIC_BYTE, RES_MAGIC_BYTE
+from memcacheConstants import REQ_PKT_FMT, RES_PKT_FMT, MIN_RECV_PACKET
+from memcacheConstants import SET_PKT_FMT, DEL_PKT_FMT, INCRDECR_RES_FMT
+
+import memcacheConstants
+
+import moxi_mock_server
+
+# Tests of single-key requests multiplexed over one shared
+# downstream conn (downstream_conn_mux).
+#
+# Before you run moxi_mock_mux.py, start a moxi like...
+#
+#   ./moxi -z ./t/moxi_mock.cfg -p 0 -U 0 -vvv -t 1 -O stderr
+#          -Z downstream_max=1,downstream_protocol=binary,downstream_conn_mux=1,
+#             downstream_timeout=3000
+#
+# Then...
+#
+#   python ./t/moxi_mock_mux.py
+#
+# ----------------------------------
+
+class TestProxyMux(moxi_mock_server.ProxyClientBase):
+    def __init__(self, x):
+        moxi_mock_server.ProxyClientBase.__init__(self, x)
+
+    def doTestTwoClients(self, reply):
+        """Send a GETK from each of two clients, then reply to both
+           through the given reply function"""
+        self.client_connect(0)
+        self.client_connect(1)
+
+        self.client_send(self.packReq(memcacheConstants.CMD_GETK, key='muxA',
+                                      opaque=0x1111), 0)
+        self.wait(10)
+        self.client_send(self.packReq(memcacheConstants.CMD_GETK, key='muxB',
+                                      opaque=0x2222), 1)
+
+        # Both requests are pipelined on the same downstream conn,
+        # each with its own opaque.
+        #
+        a, b = self.mock_recv_packets(2)
+        self.assertEqual(len(self.mock_server().sessions), 1)
+        self.assertEqual(a[1], memcacheConstants.CMD_GETK)
+        self.assertEqual(a[10], 'muxA')
+        self.assertEqual(b[10], 'muxB')
+        self.assertNotEqual(a[7], b[7])
+
+        reply(self.packRes(memcacheConstants.CMD_GETK, key='muxA',
+                           val='valueA', opaque=a[7],
+                           extraHeader=struct.pack('>I', 0)),
+              self.packRes(memcacheConstants.CMD_GETK, key='muxB',
+                           val='valueB', opaque=b[7],
+                           extraHeader=struct.pack('>I', 0)))
+
+        # Each client sees its own reply, with its own opaque.
+        #
+        self.client_recv(self.packRes(memcacheConstants.CMD_GETK, key='muxA',
+                                      val='valueA', opaque=0x1111,
+                                      extraHeader=struct.pack('>I', 0)), 0)
+        self.client_recv(self.packRes(memcacheConstants.CMD_GETK, key='muxB',
+                                      val='valueB', opaque=0x2222,
+                                      extraHeader=struct.pack('>I', 0)), 1)
+
+    def testRepliesInOrder(self):
+        """Test two clients sharing one downstream conn"""
+        def reply(ra, rb):
+            self.mock_send(ra)
+            self.wait(10)
+            self.mock_send(rb)
+        self.doTestTwoClients(reply)
+
+    def testRepliesOutOfOrder(self):
+        """Test replies are matched to requests by opaque"""
+        def reply(ra, rb):
+            self.mock_send(rb)
+            self.wait(10)
+            self.mock_send(ra)
+        self.doTestTwoClients(reply)
+
+    def testRepliesInOneWrite(self):
+        """Test the reader handles a reply already buffered after another"""
+        def reply(ra, rb):
+            self.mock_send(rb + ra)
+        self.doTestTwoClients(reply)
+
+    def testSerialRequestsReuseConn(self):
+        """Test requests after a reply go over the same conn"""
+        self.client_connect()
+
+        for i in range(3):
+            self.client_send(self.packReq(memcacheConstants.CMD_GETK,
+                                          key='muxSerial', opaque=i))
+            r = self.mock_recv_packets(1)[0]
+            self.assertEqual(r[10], 'muxSerial')
+            self.mock_send(self.packRes(memcacheConstants.CMD_GETK,
+                                        status=memcacheConstants.ERR_NOT_FOUND,
+                                        key='muxSerial', opaque=r[7]))
+            self.client_recv(self.packRes(memcacheConstants.CMD_GETK,
+                                          status=memcacheConstants.ERR_NOT_FOUND,
+                                          key='muxSerial', opaque=i))
+
+        self.assertEqual(len(self.mock_server().sessions), 1)
+
+    def testConcurrentRequestsPastDownstreamMax(self):
+        """Test more concurrent requests than downstream_max are all
+           in flight at once, without waiting for a downstream"""
+        n = 4
+        before = self.proxy_stats()
+        self.assertTrue(int(before['downstream_max']) < n)
+
+        for i in range(n):
+            self.client_connect(i)
+            self.client_send(self.packReq(memcacheConstants.CMD_GETK,
+                                          key='muxMany%d' % i,
+                                          opaque=0x100 + i), i)
+            self.wait(10)
+
+        # Every request reaches the server before any reply.
+        #
+        reqs = self.mock_recv_packets(n)
+        self.assertEqual(len(self.mock_server().sessions), 1)
+        self.assertEqual(sorted([r[10] for r in reqs]),
+                         ['muxMany%d' % i for i in range(n)])
+
+        after = self.proxy_stats()
+        self.assertEqual(after['tot_downstream_max_reached'],
+                         before['tot_downstream_max_reached'])
+
+        for r in reqs:
+            self.mock_send(self.packRes(memcacheConstants.CMD_GETK,
+                                        key=r[10], val='v' + r[10],
+                                        opaque=r[7],
+                                        extraHeader=struct.pack('>I', 0)))
+        for i in range(n):
+            self.client_recv(self.packRes(memcacheConstants.CMD_GETK,
+                                          key='muxMany%d' % i,
+                                          val='vmuxMany%d' % i,
+                                          opaque=0x100 + i,
+                                          extraHeader=struct.pack('>I', 0)), i)
+
+    def doTestSlowReply(self, partial):
+        """Time out a request whose reply is slow, while requests from
+           other clients are in flight on the same conn, after the
+           first partial bytes of its reply"""
+        n = 4
+        before = self.proxy_stats()
+
+        self.client_connect(0)
+        self.client_send(self.packReq(memcacheConstants.CMD_GETK,
+                                      key='muxSlow', opaque=0x200), 0)
+        slow = self.mock_recv_packets(1)[0]
+        slow_res = self.packRes(memcacheConstants.CMD_GETK, key='muxSlow',
+                                val='slowValue', opaque=slow[7],
+                                extraHeader=struct.pack('>I', 0))
+        if partial > 0:
+            self.mock_send(slow_res[:partial])
+
+        # The others are sent well after, so they don't time out, too.
+        #
+        self.wait(100)
+        for i in range(1, n):
+            self.client_connect(i)
+            self.client_send(self.packReq(memcacheConstants.CMD_GETK,
+                                          key='muxFast%d' % i,
+                                          opaque=0x200 + i), i)
+        reqs = self.mock_recv_packets(n - 1)
+
+        # Only the slow request fails.
+        #
+        r = self.client_recv_packets(1, 0)[0]
+        self.assertEqual(r[5], memcacheConstants.ERR_EBUSY)
+        self.assertEqual(r[7], 0x200)
+
+        # The slow reply is eaten, and the others still come through
+        # on the same conn.
+        #
+        self.mock_send(slow_res[partial:])
+        for q in reqs:
+            self.mock_send(self.packRes(memcacheConstants.CMD_GETK,
+                                        key=q[10], val='v' + q[10],
+                                        opaque=q[7],
+                                        extraHeader=struct.pack('>I', 0)))
+        for i in range(1, n):
+            self.client_recv(self.packRes(memcacheConstants.CMD_GETK,
+                                          key='muxFast%d' % i,
+                                          val='vmuxFast%d' % i,
+                                          opaque=0x200 + i,
+                                          extraHeader=struct.pack('>I', 0)), i)
+
+        self.assertEqual(len(self.mock_server().sessions), 1)
+
+        after = self.proxy_stats()
+        self.assertEqual(int(after['tot_downstream_timeout']),
+                         int(before['tot_downstream_timeout']) + 1)
+        self.assertEqual(int(after['tot_downstream_mux_orphans']),
+                         int(before['tot_downstream_mux_orphans']) + 1)
+
+    def testSlowReplyNotStarted(self):
+        """Test a timed out request's late reply does not fail others"""
+        self.doTestSlowReply(0)
+
+    def testSlowReplyHalfRead(self):
+        """Test a timed out request's half-read reply does not fail others"""
+        self.doTestSlowReply(MIN_RECV_PACKET + 6)
+
+    def testQuietRequestsUseOwnConn(self):
+        """Test a multiget does not go over the shared conn"""
+        self.client_connect()
+
+        r = (self.packReq(memcacheConstants.CMD_GETKQ, key='muxQuiet0', opaque=4) +
+             self.packReq(memcacheConstants.CMD_GETKQ, key='muxQuiet1', opaque=13) +
+             self.packReq(memcacheConstants.CMD_NOOP))
+        self.client_send(r)
+        self.mock_recv(r)
+        self.mock_send(self.packRes(memcacheConstants.CMD_NOOP))
+        self.client_recv(self.packRes(memcacheConstants.CMD_NOOP))
+
+if __name__ == '__main__':
+    unittest.main()
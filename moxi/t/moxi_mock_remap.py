@@ -0,0 +1,183 @@
+import sys
+import string
+import socket
+import select
+import unittest
+import threading
+import time
+import re
+import struct
+import BaseHTTPServer
+
+from memcacheConstants import REQ_MAGIC_BYTE, RES_MAGIC_BYTE
+from memcacheConstants import REQ_PKT_FMT, RES_PKT_FMT, MIN_RECV_PACKET
+from memcacheConstants import SET_PKT_FMT, DEL_PKT_FMT, INCRDECR_RES_FMT
+
+import memcacheConstants
+
+import moxi_mock_server
+
+# Tests of an idle downstream that's updated in place when the REST
+# config's server list changes, keeping its downstream conns to the
+# servers that remain, with ascii upstream and binary downstream.
+# This test is its own REST server, so that it can change the config.
+#
+# Before you run moxi_mock_remap.py, start a moxi like...
+#
+#   ./moxi -z url=http://127.0.0.1:4567/pools/default/buckets/default
+#          -p 0 -U 0 -vvv -t 1 -O stderr
+#          -Z port_listen=11333,downstream_max=1,downstream_conn_max=0,
+#             downstream_protocol=binary
+#
+# Then...
+#
+#   python ./t/moxi_mock_remap.py
+#
+# ----------------------------------
+
+g_replica_server = moxi_mock_server.start_replica_server()
+
+# Keys that hash to vbucket 0 and vbucket 1.
+#
+KEY_VB0 = 'hedgeA'
+KEY_VB1 = 'hedgeB'
+
+def rest_config(servers, vbucket_map):
+    return ('{"name": "default",' +
+            ' "vBucketServerMap": {' +
+            ' "hashAlgorithm": "CRC", "numReplicas": 0,' +
+            ' "serverList": [' +
+            ', '.join(['"127.0.0.1:' + str(s) + '"' for s in servers]) +
+            '],' +
+            ' "vBucketMap": [' +
+            ', '.join(['[' + str(m) + ']' for m in vbucket_map]) +
+            ']}}')
+
+CONFIG_ONE = rest_config([11311], [0, 0])
+CONFIG_TWO = rest_config([11311, 11312], [0, 1])
+
+g_rest_config = CONFIG_ONE
+
+# A fake REST server, which moxi polls for the config.
+#
+class RestHandler(BaseHTTPServer.BaseHTTPRequestHandler):
+    def do_GET(self):
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.end_headers()
+        self.wfile.write(g_rest_config)
+
+    def log_message(self, format, *args):
+        pass
+
+g_rest_server = BaseHTTPServer.HTTPServer(('127.0.0.1', 4567), RestHandler)
+g_rest_thread = threading.Thread(target=g_rest_server.serve_forever)
+g_rest_thread.daemon = True
+g_rest_thread.start()
+
+class TestProxyRemap(moxi_mock_server.ProxyClientBase):
+    def __init__(self, x):
+        moxi_mock_server.ProxyClientBase.__init__(self, x)
+
+    def proxy_config(self):
+        """Returns the proxy's config, or None until moxi has gotten
+           a config and listens on the proxy port"""
+        try:
+            c = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            c.connect(("127.0.0.1", self.proxy_port))
+            c.send("stats proxy\r\n")
+            s = ''
+            while not s.endswith("END\r\n"):
+                s = s + c.recv(65536)
+            c.close()
+        except socket.error:
+            return None
+
+        m = re.search("STAT " + str(self.proxy_port) +
+                      ":default:info:config (.*)\r\n", s)
+        if m:
+            return m.group(1)
+        return None
+
+    def set_config(self, config):
+        """Serves the config and waits until moxi has polled it"""
+        global g_rest_config
+        g_rest_config = config
+
+        i = 0
+        while i < 50:
+            if self.proxy_config() == config:
+                # Let the worker thread pick it up too.
+                #
+                time.sleep(0.2)
+                return
+            time.sleep(0.1)
+            i = i + 1
+        self.fail("waiting too long for the config")
+
+    def getk(self, key, vbucket):
+        return self.packReq(memcacheConstants.CMD_GETK, key=key,
+                            reserved=vbucket, opaque=vbucket)
+
+    def get_miss(self, key, vbucket, auth=False):
+        """Sends a get that a server misses, over a new downstream
+           conn if auth is True.  Returns the server and the
+           session_idx that got it"""
+        self.client_send("get " + key + "\r\n")
+        if auth:
+            server, k = self.mock_recv_either(
+                self.packReq(memcacheConstants.CMD_SASL_AUTH,
+                             key='PLAIN', val="\0default\0"))
+            server.sessions[k].client.send(
+                self.packRes(memcacheConstants.CMD_SASL_AUTH,
+                             status=0, val='Authenticated'))
+        server, k = self.mock_recv_either(self.getk(key, vbucket))
+        server.sessions[k].client.send(
+            self.packRes(memcacheConstants.CMD_GETK,
+                         status=memcacheConstants.ERR_NOT_FOUND))
+        self.client_recv("END\r\n")
+        return server, k
+
+    def testServerListChangeKeepsDownstream(self):
+        """Test adding and removing a server updates the idle
+           downstream in place, and the pooled conn to the kept
+           server goes on being used"""
+        self.set_config(CONFIG_ONE)
+
+        self.client_connect()
+
+        server, m = self.get_miss(KEY_VB0, 0, True)
+        self.assertEqual(server, self.mock_server())
+        num_sessions = len(self.mock_server().sessions)
+
+        before = self.proxy_stats()
+
+        # Add a server, which takes over vbucket 1.
+        #
+        self.set_config(CONFIG_TWO)
+
+        server, k = self.get_miss(KEY_VB0, 0)
+        self.assertEqual(server, self.mock_server())
+        self.assertEqual(k, m)
+
+        server, k = self.get_miss(KEY_VB1, 1, True)
+        self.assertEqual(server, g_replica_server)
+
+        # Remove it again.
+        #
+        self.set_config(CONFIG_ONE)
+
+        server, k = self.get_miss(KEY_VB1, 1)
+        self.assertEqual(server, self.mock_server())
+        self.assertEqual(k, m)
+
+        self.assertEqual(len(self.mock_server().sessions), num_sessions)
+
+        after = self.proxy_stats()
+        self.assertEqual(int(after['tot_downstream_remap_frees_avoided']) -
+                         int(before['tot_downstream_remap_frees_avoided']), 2)
+        self.assertEqual(after['tot_downstream_freed'],
+                         before['tot_downstream_freed'])
+
+if __name__ == '__main__':
+    unittest.main()
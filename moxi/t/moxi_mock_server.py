@@ -136,6 +136,20 @@ g_mock_server = MockServer(g_mock_server_port)
 g_mock_server.start()
 time.sleep(1)
 
+# A second fake memcached server, which holds the vbucket replicas
+# for the tests that need one.
+#
+g_replica_server_port = 11312
+g_replica_server = None
+
+def start_replica_server():
+    global g_replica_server
+    if g_replica_server is None:
+        g_replica_server = MockServer(g_replica_server_port)
+        g_replica_server.start()
+        time.sleep(1)
+    return g_replica_server
+
 class ProxyClientBase(unittest.TestCase):
     vbucketId = 0
 
@@ -160,6 +174,8 @@ class ProxyClientBase(unittest.TestCase):
 
     def tearDown(self):
         self.mock_close()
+        if g_replica_server is not None:
+            g_replica_server.closeSessions()
         for k in self.clients:
             self.client_close(k)
         self.clients = []
@@ -231,6 +247,114 @@ class ProxyClientBase(unittest.TestCase):
         debug(1, "mock_recv actual: " + message);
         self.assertTrue(what == message or re.match(what, message) is not None)
 
+    def mock_recv_any(self, what):
+        # Like mock_recv(), but for whichever session receives first,
+        # such as when moxi had to reconnect.  Returns the session_idx.
+        wait_max = 5
+        i = 1
+        while i < wait_max:
+            sessions = self.mock_server().sessions
+            for k in sorted(sessions.keys()):
+                if len(sessions[k].received) > 0:
+                    self.mock_recv(what, k)
+                    return k
+            debug(1, "sleeping waiting for mock_recv_any " + str(i))
+            time.sleep(0.1 * i)
+            i = i + 0.1
+        self.fail("waiting too long for mock_recv_any")
+
+    def mock_recv_either(self, what):
+        # Waits for what at either the mock server or the replica
+        # server.  Returns the server and session_idx that has it.
+        i = 0
+        while i < 50:
+            for server in [self.mock_server(), g_replica_server]:
+                if server is None:
+                    continue
+                sessions = server.sessions
+                for k in sorted(sessions.keys()):
+                    if len(sessions[k].received) > 0:
+                        self.assertEqual(sessions[k].received.pop(0), what)
+                        return server, k
+            time.sleep(0.1)
+            i = i + 1
+        self.fail("waiting too long for mock_recv_either")
+
+    def proxy_stats(self):
+        # Returns the pstd_stats and behaviors of the proxy.  The
+        # per-thread stats are collected periodically, so let them
+        # catch up first.
+        time.sleep(0.2)
+
+        c = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        c.connect(("127.0.0.1", self.proxy_port))
+        c.send("stats proxy\r\n")
+        s = ''
+        while not s.endswith("END\r\n"):
+            s = s + c.recv(65536)
+        c.close()
+
+        rv = {}
+        for line in s.split("\r\n"):
+            m = re.match("STAT " + str(self.proxy_port) +
+                         ":default:(pstd_stats|behavior):(\S+) (\S+)", line)
+            if m:
+                rv[m.group(2)] = m.group(3)
+        return rv
+
+    def mock_all_quiet(self):
+        sessions = self.mock_server().sessions
+        for k in sessions.keys():
+            if len(sessions[k].received) > 0:
+                return False
+        return True
+
+    def mock_recv_packets(self, n, session_idx=0):
+        # Returns the next n binary packets received by the mock
+        # server, no matter how they were split up or combined.
+        data = ''
+        packets = []
+        while len(packets) < n:
+            message = self.mock_recv_message(session_idx)
+            self.assertTrue(len(message) > 0)
+            data = data + message
+            packets, rest = self.splitPackets(data, n)
+        if len(rest) > 0:
+            self.mock_session(session_idx).received.insert(0, rest)
+        return packets
+
+    def client_recv_packets(self, n, idx=0):
+        # Returns the next n binary packets received by a client.
+        data = ''
+        packets = []
+        while len(packets) < n:
+            s = self.clients[idx].recv(65536)
+            self.assertTrue(len(s) > 0)
+            data = data + s
+            packets, rest = self.splitPackets(data, n)
+        self.assertEqual(rest, '')
+        return packets
+
+    def splitPackets(self, data, n):
+        # Splits off up to n complete binary packets from data,
+        # returning the (magic, opcode, keylen, extlen, datatype,
+        # vbucket or status, bodylen, opaque, cas, extras, key, value)
+        # tuples and the rest of data.
+        packets = []
+        while len(packets) < n and len(data) >= MIN_RECV_PACKET:
+            header = struct.unpack(REQ_PKT_FMT, data[:MIN_RECV_PACKET])
+            bodylen = header[6]
+            if len(data) < MIN_RECV_PACKET + bodylen:
+                break
+            body = data[MIN_RECV_PACKET:MIN_RECV_PACKET + bodylen]
+            extlen = header[3]
+            keylen = header[2]
+            packets.append(header + (body[:extlen],
+                                     body[extlen:extlen + keylen],
+                                     body[extlen + keylen:]))
+            data = data[MIN_RECV_PACKET + bodylen:]
+        return packets, data
+
     def wait(self, x):
         debug(1, "wait " + str(x))
         time.sleep(0.01 * x)
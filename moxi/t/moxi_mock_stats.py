@@ -0,0 +1,113 @@
+import sys
+import string
+import socket
+import select
+import unittest
+import threading
+import time
+import re
+import struct
+
+import moxi_mock_server
+
+# Tests of the proxy stats that worker threads publish as snapshots,
+# and of "stats proxy delta".
+#
+# Before you run moxi_mock_stats.py, start a moxi like...
+#
+#   ./moxi -z ./t/moxi_mock.cfg -p 0 -U 0 -vvv -t 1 -O stderr
+#          -Z downstream_max=1,downstream_conn_max=0,downstream_protocol=ascii
+#
+# Then...
+#
+#   python ./t/moxi_mock_stats.py
+#
+# ----------------------------------
+
+PREFIX = str(11333) + ":default:"
+
+class TestProxyStats(moxi_mock_server.ProxyClientBase):
+    def __init__(self, x):
+        moxi_mock_server.ProxyClientBase.__init__(self, x)
+
+    def stats(self, cmd, idx=0):
+        """Sends a stats command and returns its stats as a dict"""
+        self.client_send(cmd + "\r\n", idx)
+
+        c = self.clients[idx]
+        s = ''
+        while not s.endswith("END\r\n"):
+            r = c.recv(65536)
+            self.assertTrue(len(r) > 0)
+            s = s + r
+
+        rv = {}
+        for line in s.split("\r\n"):
+            m = re.match("STAT (\S+) (\S+)", line)
+            if m:
+                rv[m.group(1)] = m.group(2)
+        return rv
+
+    def get_miss(self, key):
+        self.client_send("get " + key + "\r\n")
+        s = self.mock_recv_any("get " + key + "\r\n")
+        self.mock_send("END\r\n", s)
+        self.client_recv("END\r\n")
+
+    def testStatsProxySeesGet(self):
+        """Test stats proxy counts a get within a snapshot period"""
+        self.client_connect()
+
+        before = self.stats("stats proxy")
+        self.get_miss('statsKey')
+        time.sleep(0.2)
+        after = self.stats("stats proxy")
+
+        k = PREFIX + "pstd_stats_cmd:regular_get:seen"
+        self.assertEqual(int(after[k]) - int(before.get(k, '0')), 1)
+
+    def testStatsProxyDelta(self):
+        """Test stats proxy delta only has the stats that changed"""
+        self.client_connect()
+
+        # The first delta on a conn has every non-zero stat.
+        #
+        first = self.stats("stats proxy delta")
+        self.assertEqual(first["delta:interval_msec"], '0')
+        self.assertTrue(int(first[PREFIX + "pstd_stats:tot_upstream"]) > 0)
+
+        self.get_miss('deltaKey')
+        time.sleep(0.2)
+
+        second = self.stats("stats proxy delta")
+        self.assertTrue("delta:interval_msec" in second)
+        self.assertTrue(PREFIX + "pstd_stats_cmd:regular_get:seen" in second)
+        self.assertFalse(PREFIX + "pstd_stats:tot_upstream" in second)
+
+        time.sleep(0.5)
+
+        third = self.stats("stats proxy delta")
+        self.assertTrue(int(third["delta:interval_msec"]) > 0)
+        self.assertFalse(PREFIX + "pstd_stats_cmd:regular_get:seen" in third)
+        self.assertFalse(PREFIX + "pstd_stats:tot_upstream" in third)
+
+    def testStatsProxyDeltaPerConn(self):
+        """Test each conn has its own stats proxy delta baseline"""
+        self.client_connect(0)
+        self.client_connect(1)
+
+        self.stats("stats proxy delta", 0)
+        self.get_miss('deltaConn')
+        time.sleep(0.2)
+
+        # The other conn's first delta still has every non-zero stat.
+        #
+        other = self.stats("stats proxy delta", 1)
+        self.assertEqual(other["delta:interval_msec"], '0')
+        self.assertTrue(PREFIX + "pstd_stats:tot_upstream" in other)
+
+        again = self.stats("stats proxy delta", 0)
+        self.assertTrue(PREFIX + "pstd_stats_cmd:regular_get:seen" in again)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,184 @@
+import sys
+import string
+import socket
+import select
+import unittest
+import threading
+import time
+import re
+import struct
+
+from memcacheConstants import REQ_MAGIC_BYTE, RES_MAGIC_BYTE
+from memcacheConstants import REQ_PKT_FMT, RES_PKT_FMT, MIN_RECV_PACKET
+from memcacheConstants import SET_PKT_FMT, DEL_PKT_FMT, INCRDECR_RES_FMT
+
+import memcacheConstants
+
+import moxi_mock_server
+
+# Tests of binary responses written to the binary upstream straight
+# from the downstream read buffer, and of the responses that have to
+# be copied into an item instead.
+#
+# Before you run moxi_mock_write_through.py, start a moxi like...
+#
+#   ./moxi -z ./t/moxi_mock.cfg -p 0 -U 0 -vvv -t 1 -O stderr
+#          -Z downstream_max=1,downstream_conn_max=0,downstream_protocol=binary
+#
+# Then...
+#
+#   python ./t/moxi_mock_write_through.py
+#
+# ----------------------------------
+
+class TestProxyWriteThrough(moxi_mock_server.ProxyClientBase):
+    def __init__(self, x):
+        moxi_mock_server.ProxyClientBase.__init__(self, x)
+
+    def setUp(self):
+        # Replace the downstream conn that went stale when the last
+        # test closed the mock sessions, as a failed write of corked
+        # quiet commands isn't retried.
+        #
+        self.client_connect()
+        self.client_send(self.packReq(memcacheConstants.CMD_GETK, key='wtWarm'))
+        self.mock_recv_packets(1)
+        self.mock_send(self.packRes(memcacheConstants.CMD_GETK,
+                                    status=memcacheConstants.ERR_NOT_FOUND))
+        self.client_recv_packets(1)
+
+    def value(self, cmd, key, val, opaque=0):
+        return self.packRes(cmd, key=key, val=val, opaque=opaque,
+                            extraHeader=struct.pack(memcacheConstants.GET_RES_FMT, 0))
+
+    def assertBytes(self, before, after, direct, copied=None):
+        self.assertEqual(int(after['tot_b2b_bytes_direct']) -
+                         int(before['tot_b2b_bytes_direct']), direct)
+        if copied is not None:
+            self.assertEqual(int(after['tot_b2b_bytes_copied']) -
+                             int(before['tot_b2b_bytes_copied']), copied)
+
+    def testSmallValueDirect(self):
+        """Test a response already in the read buffer is not copied"""
+        before = self.proxy_stats()
+
+        self.client_send(self.packReq(memcacheConstants.CMD_GETK, key='wtSmall'))
+        self.mock_recv_packets(1)
+        r = self.value(memcacheConstants.CMD_GETK, 'wtSmall', '0123456789')
+        self.mock_send(r)
+
+        p = self.client_recv_packets(1)[0]
+        self.assertEqual(p[10], 'wtSmall')
+        self.assertEqual(p[11], '0123456789')
+
+        self.assertBytes(before, self.proxy_stats(), len(r), 0)
+
+    def testLargeValue(self):
+        """Test a response larger than the read buffer"""
+        before = self.proxy_stats()
+
+        val = ''.join([chr(ord('a') + i % 26) for i in range(200000)])
+
+        self.client_send(self.packReq(memcacheConstants.CMD_GETK, key='wtLarge'))
+        self.mock_recv_packets(1)
+        r = self.value(memcacheConstants.CMD_GETK, 'wtLarge', val)
+        self.mock_send(r)
+
+        p = self.client_recv_packets(1)[0]
+        self.assertEqual(p[10], 'wtLarge')
+        self.assertEqual(p[11], val)
+
+        # Whether it was all read at once and written through depends
+        # on timing, but no byte is counted twice.
+        #
+        after = self.proxy_stats()
+        self.assertTrue(int(after['tot_b2b_bytes_direct']) -
+                        int(before['tot_b2b_bytes_direct']) +
+                        int(after['tot_b2b_bytes_copied']) -
+                        int(before['tot_b2b_bytes_copied']) <= len(r))
+
+    def testLargeValueInPieces(self):
+        """Test a response larger than one read goes through an item"""
+        before = self.proxy_stats()
+
+        val = ''.join([chr(ord('a') + i % 26) for i in range(200000)])
+
+        self.client_send(self.packReq(memcacheConstants.CMD_GETK, key='wtPieces'))
+        self.mock_recv_packets(1)
+        r = self.value(memcacheConstants.CMD_GETK, 'wtPieces', val)
+        self.mock_send(r[0:100000])
+        self.wait(100)
+        self.mock_send(r[100000:])
+
+        p = self.client_recv_packets(1)[0]
+        self.assertEqual(p[10], 'wtPieces')
+        self.assertEqual(p[11], val)
+
+        # Only what was read before the rest of the value arrived is
+        # copied, the rest is read straight into the item.
+        #
+        self.assertBytes(before, self.proxy_stats(), 0, 100000)
+
+    def testSplitResponseCopied(self):
+        """Test a response that arrives in pieces goes through an item"""
+        before = self.proxy_stats()
+
+        self.client_send(self.packReq(memcacheConstants.CMD_GETK, key='wtSplit'))
+        self.mock_recv_packets(1)
+        r = self.value(memcacheConstants.CMD_GETK, 'wtSplit', '0123456789')
+        self.mock_send(r[0:30])
+        self.wait(10)
+        self.mock_send(r[30:])
+
+        p = self.client_recv_packets(1)[0]
+        self.assertEqual(p[10], 'wtSplit')
+        self.assertEqual(p[11], '0123456789')
+
+        self.assertBytes(before, self.proxy_stats(), 0, 30)
+
+    def testQuietResponseCopied(self):
+        """Test a quiet response and its NOOP go through items"""
+        before = self.proxy_stats()
+
+        self.client_send(self.packReq(memcacheConstants.CMD_GETKQ, key='wtQuiet',
+                                      opaque=4) +
+                         self.packReq(memcacheConstants.CMD_NOOP, opaque=5))
+        self.mock_recv_packets(2)
+        self.mock_send(self.value(memcacheConstants.CMD_GETKQ, 'wtQuiet', 'q',
+                                  opaque=4) +
+                       self.packRes(memcacheConstants.CMD_NOOP, opaque=5))
+
+        a, b = self.client_recv_packets(2)
+        self.assertEqual(a[1], memcacheConstants.CMD_GETKQ)
+        self.assertEqual(a[7], 4)
+        self.assertEqual(a[11], 'q')
+        self.assertEqual(b[1], memcacheConstants.CMD_NOOP)
+        self.assertEqual(b[7], 5)
+
+        self.assertBytes(before, self.proxy_stats(), 0)
+
+    def testPendingUpstreamWriteCopied(self):
+        """Test a response behind a quiet response that's still queued
+           for the upstream goes through an item, keeping the order"""
+        before = self.proxy_stats()
+
+        self.client_send(self.packReq(memcacheConstants.CMD_GETKQ, key='wtFirst',
+                                      opaque=6) +
+                         self.packReq(memcacheConstants.CMD_GETK, key='wtSecond',
+                                      opaque=7))
+        self.mock_recv_packets(2)
+        self.mock_send(self.value(memcacheConstants.CMD_GETKQ, 'wtFirst', '1',
+                                  opaque=6) +
+                       self.value(memcacheConstants.CMD_GETK, 'wtSecond', '2',
+                                  opaque=7))
+
+        a, b = self.client_recv_packets(2)
+        self.assertEqual(a[10], 'wtFirst')
+        self.assertEqual(a[11], '1')
+        self.assertEqual(b[10], 'wtSecond')
+        self.assertEqual(b[11], '2')
+
+        self.assertBytes(before, self.proxy_stats(), 0)
+
+if __name__ == '__main__':
+    unittest.main()
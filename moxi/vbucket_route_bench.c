@@ -0,0 +1,143 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+#include "config.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <libvbucket/vbucket.h>
+
+// Compares key routing through libvbucket's vbucket to master
+// lookup, which is what moxi used to do for every key, against a
+// flattened vbucket to server index table, which is what mcs.c does
+// now.  Both hash the key with libvbucket (libhashkit's CRC).
+//
+// usage: vbucket_route_bench [num_servers [num_vbuckets [num_keys]]]
+
+#define ROUNDS 20
+
+static char *mk_config(int num_servers, int num_vbuckets) {
+    size_t len = 200 + num_servers * 32 + num_vbuckets * 16;
+    char *buf = malloc(len);
+    assert(buf != NULL);
+
+    int n = snprintf(buf, len,
+                     "{\"hashAlgorithm\": \"CRC\", \"numReplicas\": 0, "
+                     "\"serverList\": [");
+    for (int i = 0; i < num_servers; i++) {
+        n += snprintf(buf + n, len - n, "%s\"127.0.0.1:%d\"",
+                      i > 0 ? ", " : "", 11211 + i);
+    }
+
+    n += snprintf(buf + n, len - n, "], \"vBucketMap\": [");
+    for (int i = 0; i < num_vbuckets; i++) {
+        n += snprintf(buf + n, len - n, "%s[%d]",
+                      i > 0 ? ", " : "", i % num_servers);
+    }
+
+    snprintf(buf + n, len - n, "]}");
+
+    return buf;
+}
+
+static double usecs(struct timeval *start, struct timeval *end) {
+    return (end->tv_sec - start->tv_sec) * 1000000.0 +
+        (end->tv_usec - start->tv_usec);
+}
+
+int main(int argc, char **argv) {
+    int num_servers  = argc > 1 ? atoi(argv[1]) : 16;
+    int num_vbuckets = argc > 2 ? atoi(argv[2]) : 1024;
+    int num_keys     = argc > 3 ? atoi(argv[3]) : 100000;
+
+    assert(num_servers > 0);
+    assert(num_vbuckets > 0);
+    assert((num_vbuckets & (num_vbuckets - 1)) == 0);
+    assert(num_keys > 0);
+
+    char *config = mk_config(num_servers, num_vbuckets);
+
+    VBUCKET_CONFIG_HANDLE vch = vbucket_config_parse_string(config);
+    if (vch == NULL) {
+        fprintf(stderr, "vbucket_config_parse_string failed: %s\n",
+                vbucket_get_error());
+        return 1;
+    }
+
+    int16_t *masters = calloc(num_vbuckets, sizeof(int16_t));
+    assert(masters != NULL);
+
+    for (int v = 0; v < num_vbuckets; v++) {
+        masters[v] = (int16_t) vbucket_get_master(vch, v);
+    }
+
+    // Keys of assorted lengths, like "user:1234:session".
+    //
+    char **keys = calloc(num_keys, sizeof(char *));
+    size_t *key_lens = calloc(num_keys, sizeof(size_t));
+    assert(keys != NULL && key_lens != NULL);
+
+    for (int i = 0; i < num_keys; i++) {
+        char buf[200];
+        int n = snprintf(buf, sizeof(buf), "user:%d:%.*s", i * 7919,
+                         i % 50, "sessionsessionsessionsessionsessionsession"
+                         "session");
+        keys[i] = strdup(buf);
+        key_lens[i] = n;
+    }
+
+    for (int i = 0; i < num_keys; i++) {
+        int v = vbucket_get_vbucket_by_key(vch, keys[i], key_lens[i]);
+        if (vbucket_get_master(vch, v) != masters[v]) {
+            fprintf(stderr, "mismatch for key %s: vbucket %d\n",
+                    keys[i], v);
+            return 1;
+        }
+    }
+
+    struct timeval start, end;
+    uint64_t sum = 0;
+
+    gettimeofday(&start, NULL);
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < num_keys; i++) {
+            int v = vbucket_get_vbucket_by_key(vch, keys[i], key_lens[i]);
+            sum += vbucket_get_master(vch, v);
+        }
+    }
+    gettimeofday(&end, NULL);
+
+    double libvbucket_usecs = usecs(&start, &end);
+
+    gettimeofday(&start, NULL);
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < num_keys; i++) {
+            int v = vbucket_get_vbucket_by_key(vch, keys[i], key_lens[i]);
+            sum += masters[v];
+        }
+    }
+    gettimeofday(&end, NULL);
+
+    double flat_usecs = usecs(&start, &end);
+
+    double n = (double) num_keys * ROUNDS;
+
+    printf("servers %d, vbuckets %d, keys %d, rounds %d (sum %llu)\n",
+           num_servers, num_vbuckets, num_keys, ROUNDS,
+           (unsigned long long) sum);
+    printf("libvbucket:  %8.2f ns/key\n", libvbucket_usecs * 1000.0 / n);
+    printf("flat table:  %8.2f ns/key\n", flat_usecs * 1000.0 / n);
+
+    for (int i = 0; i < num_keys; i++) {
+        free(keys[i]);
+    }
+    free(keys);
+    free(key_lens);
+    free(masters);
+    free(config);
+    vbucket_config_destroy(vch);
+
+    return 0;
+}
@@ -8,6 +8,9 @@
 #include <assert.h>
 #include <unistd.h>
 #include <event.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
 #include "work.h"
 #include "log.h"
 
@@ -33,11 +36,12 @@ bool work_queue_init(work_queue *m, struct event_base *event_base) {
     pthread_mutex_init(&m->work_lock, NULL);
 
     m->work_head = NULL;
-    m->work_tail = NULL;
+    m->notify_pending = 0;
 
     m->num_items = 0;
     m->tot_sends = 0;
     m->tot_recvs = 0;
+    m->tot_wakeups = 0;
 
     m->event_base = event_base;
     assert(m->event_base != NULL);
@@ -53,6 +57,12 @@ bool work_queue_init(work_queue *m, struct event_base *event_base) {
         fprintf(stderr, "Can't create notify pipe: %s", strerror(errno));
         return false;
     }
+#elif defined(HAVE_SYS_EVENTFD_H)
+    fds[0] = fds[1] = eventfd(0, 0);
+    if (fds[0] < 0) {
+        perror("Can't create notify eventfd");
+        return false;
+    }
 #else
     if (pipe(fds)) {
         perror("Can't create notify pipe");
@@ -89,6 +99,76 @@ bool work_queue_init(work_queue *m, struct event_base *event_base) {
     return false;
 }
 
+/* Pushes a work item onto the queue, returning true if the caller
+ * needs to wake up the receiving thread.
+ */
+static bool work_push(work_queue *m, work_item *w) {
+#ifdef HAVE_GCC_ATOMICS
+    work_item *head;
+    do {
+        head = m->work_head;
+        w->next = head;
+    } while (!__sync_bool_compare_and_swap(&m->work_head, head, w));
+
+    __sync_fetch_and_add(&m->num_items, 1);
+    __sync_fetch_and_add(&m->tot_sends, 1);
+
+    return __sync_bool_compare_and_swap(&m->notify_pending, 0, 1);
+#else
+    pthread_mutex_lock(&m->work_lock);
+
+    w->next = m->work_head;
+    m->work_head = w;
+
+    m->num_items++;
+    m->tot_sends++;
+
+    bool rv = (m->notify_pending == 0);
+    m->notify_pending = 1;
+
+    pthread_mutex_unlock(&m->work_lock);
+
+    return rv;
+#endif
+}
+
+/* Takes every queued work item, returned in the order they were
+ * sent.  The notify_pending flag is cleared first, so that any item
+ * pushed after the take wakes up the receiving thread again.
+ */
+static work_item *work_take(work_queue *m) {
+    work_item *head;
+
+#ifdef HAVE_GCC_ATOMICS
+    __sync_fetch_and_and(&m->notify_pending, 0);
+
+    do {
+        head = m->work_head;
+    } while (head != NULL &&
+             !__sync_bool_compare_and_swap(&m->work_head, head, NULL));
+#else
+    pthread_mutex_lock(&m->work_lock);
+
+    m->notify_pending = 0;
+
+    head = m->work_head;
+    m->work_head = NULL;
+
+    pthread_mutex_unlock(&m->work_lock);
+#endif
+
+    work_item *prev = NULL;
+
+    while (head != NULL) {
+        work_item *next = head->next;
+        head->next = prev;
+        prev = head;
+        head = next;
+    }
+
+    return prev;
+}
+
 /** Use work_send() to place work on another thread's work queue.
  *  The receiving thread will invoke the given function with
  *  the given callback data.
@@ -115,33 +195,31 @@ bool work_send(work_queue *m,
         w->data1 = data1;
         w->next  = NULL;
 
-        pthread_mutex_lock(&m->work_lock);
-
-        if (m->work_tail != NULL)
-            m->work_tail->next = w;
-        m->work_tail = w;
-        if (m->work_head == NULL)
-            m->work_head = w;
+        rv = true;
 
-        if (write(m->send_fd, "", 1) == 1) {
-            m->num_items++;
-            m->tot_sends++;
-
-#ifdef WORK_DEBUG
-            moxi_log_write("work_send %x %x %x %d %d %d %llu %llu\n",
-                    (int) pthread_self(),
-                    (int) m,
-                    (int) m->event_base,
-                    m->send_fd, m->recv_fd,
-                    m->work_head != NULL,
-                    m->num_items,
-                    m->tot_sends);
+        if (work_push(m, w)) {
+#ifdef HAVE_SYS_EVENTFD_H
+            uint64_t one = 1;
+            if (write(m->send_fd, &one, sizeof(one)) != sizeof(one)) {
+#else
+            if (write(m->send_fd, "", 1) != 1) {
 #endif
-
-            rv = true;
+                // Let the next sender try the wakeup again.
+                //
+                m->notify_pending = 0;
+            }
         }
 
-        pthread_mutex_unlock(&m->work_lock);
+#ifdef WORK_DEBUG
+        moxi_log_write("work_send %x %x %x %d %d %d %llu %llu\n",
+                (int) pthread_self(),
+                (int) m,
+                (int) m->event_base,
+                m->send_fd, m->recv_fd,
+                m->work_head != NULL,
+                m->num_items,
+                m->tot_sends);
+#endif
     }
 
     return rv;
@@ -159,19 +237,19 @@ void work_recv(int fd, short which, void *arg) {
     assert(m->send_fd >= 0);
     assert(m->event_base != NULL);
 
-    work_item *curr = NULL;
-    work_item *next = NULL;
-
-    char buf[1];
-
-    // The lock area includes the read() for safety,
-    // as the pipe acts like a cond variable.
+    // Senders only write after setting notify_pending, which
+    // work_take() clears, so there's usually a single wakeup to
+    // consume, no matter how many items were sent.
     //
-    pthread_mutex_lock(&m->work_lock);
+#ifdef HAVE_SYS_EVENTFD_H
+    uint64_t buf;
+#else
+    char buf[64];
+#endif
 
-    int readrv = read(fd, buf, 1);
-    assert(readrv == 1);
-    if (readrv != 1) {
+    int readrv = read(fd, &buf, sizeof(buf));
+    assert(readrv > 0);
+    if (readrv <= 0) {
 #ifdef WORK_DEBUG
         // Perhaps libevent called us in incorrect way.
         //
@@ -179,9 +257,10 @@ void work_recv(int fd, short which, void *arg) {
 #endif
     }
 
-    curr = m->work_head;
-    m->work_head = NULL;
-    m->work_tail = NULL;
+    m->tot_wakeups++;
+
+    work_item *curr = work_take(m);
+    work_item *next = NULL;
 
 #ifdef WORK_DEBUG
     moxi_log_write("work_recv %x %x %x %d %d %d %llu %llu %d\n",
@@ -195,8 +274,6 @@ void work_recv(int fd, short which, void *arg) {
             fd);
 #endif
 
-    pthread_mutex_unlock(&m->work_lock);
-
     uint64_t num_items = 0;
 
     while (curr != NULL) {
@@ -208,12 +285,15 @@ void work_recv(int fd, short which, void *arg) {
     }
 
     if (num_items > 0) {
-        pthread_mutex_lock(&m->work_lock);
-
         m->tot_recvs += num_items;
-        m->num_items -= num_items;
 
+#ifdef HAVE_GCC_ATOMICS
+        __sync_fetch_and_sub(&m->num_items, num_items);
+#else
+        pthread_mutex_lock(&m->work_lock);
+        m->num_items -= num_items;
         pthread_mutex_unlock(&m->work_lock);
+#endif
     }
 }
 
@@ -21,20 +21,26 @@ struct work_item {
 };
 
 struct work_queue {
-    int send_fd; // Pipe to notify thread.
-    int recv_fd;
-
+    int send_fd; // Pipe or eventfd to notify thread.
+    int recv_fd; // Same as send_fd for an eventfd.
+
+    // Senders push onto work_head, newest first, without a lock when
+    // HAVE_GCC_ATOMICS.  The receiving thread takes the whole list at
+    // once.  Only the sender that sets notify_pending writes to
+    // send_fd, so a burst of sends costs one wakeup.
+    //
     work_item *work_head;
-    work_item *work_tail;
+    int        notify_pending;
 
     uint64_t num_items; // Current number of items in queue.
     uint64_t tot_sends;
     uint64_t tot_recvs;
+    uint64_t tot_wakeups;
 
     struct event_base *event_base;
     struct event       event;
 
-    pthread_mutex_t work_lock;
+    pthread_mutex_t work_lock; // Only used without HAVE_GCC_ATOMICS.
 };
 
 struct work_collect {
@@ -0,0 +1,220 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+#include "config.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <event.h>
+
+#include "work.h"
+#include "log.h"
+
+// Measures the work queue that moxi's threads use to talk to each
+// other.  The first run floods one receiving thread from several
+// sending threads, like a stats or config fan-in does.  The second
+// run times single round trips, like a request retry that goes
+// through the work queue, while the other senders keep sending
+// bursts.
+//
+// usage: work_bench [num_senders [num_items_per_sender [num_round_trips]]]
+
+moxi_log *ml;
+
+volatile uint64_t msec_current_time;
+
+static work_queue queue;
+
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  done_cond = PTHREAD_COND_INITIALIZER;
+
+static uint64_t *flood_latency;
+static uint64_t  flood_expected;
+static uint64_t  flood_received;
+
+static volatile int flooding;
+
+static int num_items;
+
+static uint64_t usec_now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((uint64_t) tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+static int cmp_uint64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void flood_recv(void *data0, void *data1) {
+    (void) data1;
+
+    uint64_t sent = (uint64_t) (uintptr_t) data0;
+    uint64_t now = usec_now();
+
+    if (flood_latency != NULL && flood_received < flood_expected) {
+        flood_latency[flood_received] = now - sent;
+    }
+
+    flood_received++;
+}
+
+static void *flood_main(void *arg) {
+    (void) arg;
+
+    for (int i = 0; i < num_items || flooding; i++) {
+        bool rv = work_send(&queue, flood_recv,
+                            (void *) (uintptr_t) usec_now(), NULL);
+        assert(rv);
+
+        // While timing round trips, send in bursts, like a busy
+        // stats poller would, so the queue doesn't grow unbounded.
+        //
+        if (flooding && (i % 64) == 63) {
+            usleep(100);
+        }
+    }
+
+    return NULL;
+}
+
+static void round_trip_recv(void *data0, void *data1) {
+    (void) data1;
+
+    pthread_mutex_lock(&done_lock);
+    *(int *) data0 = 1;
+    pthread_cond_signal(&done_cond);
+    pthread_mutex_unlock(&done_lock);
+}
+
+static void *event_main(void *arg) {
+    struct event_base *base = arg;
+    event_base_loop(base, 0);
+    return NULL;
+}
+
+static void report(const char *name, uint64_t *latency, uint64_t n,
+                   uint64_t usecs) {
+    qsort(latency, n, sizeof(uint64_t), cmp_uint64);
+
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        sum += latency[i];
+    }
+
+    printf("%s: %llu items in %llu usecs, latency usecs"
+           " avg %.1f p50 %llu p99 %llu max %llu\n",
+           name,
+           (unsigned long long) n,
+           (unsigned long long) usecs,
+           n > 0 ? (double) sum / n : 0.0,
+           (unsigned long long) (n > 0 ? latency[n / 2] : 0),
+           (unsigned long long) (n > 0 ? latency[n * 99 / 100] : 0),
+           (unsigned long long) (n > 0 ? latency[n - 1] : 0));
+}
+
+int main(int argc, char **argv) {
+    int num_senders     = argc > 1 ? atoi(argv[1]) : 4;
+    num_items           = argc > 2 ? atoi(argv[2]) : 200000;
+    int num_round_trips = argc > 3 ? atoi(argv[3]) : 20000;
+
+    assert(num_senders > 0);
+    assert(num_items > 0);
+    assert(num_round_trips > 0);
+
+    ml = calloc(1, sizeof(moxi_log));
+    assert(ml != NULL);
+    ml->log_mode = ERRORLOG_STDERR;
+    ml->log_ident = "work_bench";
+    ml->log_level = 5;
+
+    log_error_open(ml);
+
+    struct event_base *base = event_init();
+    assert(base != NULL);
+
+    bool ok = work_queue_init(&queue, base);
+    assert(ok);
+
+    pthread_t event_thread;
+    pthread_create(&event_thread, NULL, event_main, base);
+
+    // Flood run.
+    //
+    flood_expected = (uint64_t) num_senders * num_items;
+    flood_latency = calloc(flood_expected, sizeof(uint64_t));
+    assert(flood_latency != NULL);
+
+    pthread_t *senders = calloc(num_senders, sizeof(pthread_t));
+    assert(senders != NULL);
+
+    uint64_t start = usec_now();
+
+    for (int i = 0; i < num_senders; i++) {
+        pthread_create(&senders[i], NULL, flood_main, NULL);
+    }
+    for (int i = 0; i < num_senders; i++) {
+        pthread_join(senders[i], NULL);
+    }
+
+    while (queue.num_items > 0) {
+        usleep(100);
+    }
+
+    report("flood", flood_latency, flood_expected, usec_now() - start);
+
+    printf("flood: %llu sends, %llu wakeups\n",
+           (unsigned long long) queue.tot_sends,
+           (unsigned long long) queue.tot_wakeups);
+
+    // Round trip run, with the other senders flooding.
+    //
+    uint64_t *rtt = calloc(num_round_trips, sizeof(uint64_t));
+    assert(rtt != NULL);
+
+    flooding = 1;
+    num_items = 0;
+
+    for (int i = 0; i < num_senders; i++) {
+        pthread_create(&senders[i], NULL, flood_main, NULL);
+    }
+
+    start = usec_now();
+
+    for (int i = 0; i < num_round_trips; i++) {
+        int done = 0;
+        uint64_t sent = usec_now();
+
+        bool rv = work_send(&queue, round_trip_recv, &done, NULL);
+        assert(rv);
+
+        pthread_mutex_lock(&done_lock);
+        while (done == 0) {
+            pthread_cond_wait(&done_cond, &done_lock);
+        }
+        pthread_mutex_unlock(&done_lock);
+
+        rtt[i] = usec_now() - sent;
+    }
+
+    uint64_t usecs = usec_now() - start;
+
+    flooding = 0;
+
+    for (int i = 0; i < num_senders; i++) {
+        pthread_join(senders[i], NULL);
+    }
+
+    report("round trip under flood", rtt, num_round_trips, usecs);
+
+    printf("total: %llu sends, %llu wakeups\n",
+           (unsigned long long) queue.tot_sends,
+           (unsigned long long) queue.tot_wakeups);
+
+    return 0;
+}
@@ -23,7 +23,9 @@
 #include <sstream>
 #include <iomanip>
 #include <cstring>
+#include <algorithm>
 #include <queue>
+#include <vector>
 #include <assert.h>
 #include <cerrno>
 #include <stdexcept>
@@ -31,14 +33,54 @@
 #include <memcached/protocol_binary.h>
 #include <memcached/vbucket.h>
 
+class MessagePool;
+
+/**
+ * A block of memory the pipes read from the network into. The messages
+ * read from it point straight into the block (rather than copying the
+ * bytes out), and hold a reference on it until they are sent.
+ */
+class MessageBuffer {
+public:
+    MessageBuffer(MessagePool *p, size_t sz) :
+        pool(p), size(sz), refcount(1)
+    {
+        data = new char[size];
+    }
+
+    ~MessageBuffer() {
+        delete []data;
+    }
+
+    void retain() {
+        ++refcount;
+    }
+
+    inline void release();
+
+    /**
+     * Is anyone but the current holder using this buffer?
+     */
+    bool isShared() const {
+        return refcount > 1;
+    }
+
+    MessagePool *pool;
+    char *data;
+    size_t size;
+
+private:
+    int refcount;
+};
+
 class BinaryMessage {
 public:
-    BinaryMessage() : size(0) {
+    BinaryMessage() : size(0), buffer(NULL), pool(NULL) {
         data.rawBytes = NULL;
     }
 
     BinaryMessage(const protocol_binary_request_header &h) throw (std::runtime_error)
-        : size(ntohl(h.request.bodylen) + sizeof(h.bytes))
+        : size(ntohl(h.request.bodylen) + sizeof(h.bytes)), buffer(NULL), pool(NULL)
     {
         // verify the internal
         if (h.request.magic != PROTOCOL_BINARY_REQ &&
@@ -51,9 +93,43 @@ public:
     }
 
     virtual ~BinaryMessage() {
-        delete []data.rawBytes;
+        if (buffer != NULL) {
+            buffer->release();
+        } else {
+            delete []data.rawBytes;
+        }
+    }
+
+    /**
+     * Let the message refer to bytes living in a buffer instead of
+     * owning a copy of them.
+     */
+    void attach(MessageBuffer *buf, char *bytes, size_t sz) {
+        assert(buffer == NULL && data.rawBytes == NULL);
+        buf->retain();
+        buffer = buf;
+        data.rawBytes = bytes;
+        size = sz;
     }
 
+    /**
+     * Drop the reference to the buffer backing this message
+     */
+    void detach() {
+        if (buffer != NULL) {
+            buffer->release();
+            buffer = NULL;
+            data.rawBytes = NULL;
+            size = 0;
+        }
+    }
+
+    /**
+     * Get rid of the message once you're done with it. Messages read
+     * from a pipe are recycled by the pipe's pool, others are deleted.
+     */
+    inline void release();
+
     uint16_t getVBucketId() const {
         assert(data.rawBytes != NULL);
         return ntohs(data.req->request.vbucket);
@@ -191,8 +267,99 @@ public:
         protocol_binary_response_get_vbucket *vg;
         char *rawBytes;
     } data;
+
+private:
+    friend class MessagePool;
+    MessageBuffer *buffer;
+    MessagePool *pool;
 };
 
+/**
+ * The free lists for the buffers and messages of a pipe, so that
+ * moving the data doesn't have to hit the allocator per message. The
+ * pool isn't locked; everything reading from and writing to the pipe
+ * using it must run in the same thread.
+ */
+class MessagePool {
+public:
+    MessagePool(size_t bufsz = 256 * 1024) : bufferSize(bufsz) {}
+
+    ~MessagePool() {
+        while (!buffers.empty()) {
+            delete buffers.back();
+            buffers.pop_back();
+        }
+        while (!messages.empty()) {
+            delete messages.back();
+            messages.pop_back();
+        }
+    }
+
+    /**
+     * Get a buffer big enough to hold at least sz bytes. The caller
+     * holds the only reference to it.
+     */
+    MessageBuffer *getBuffer(size_t sz = 0) {
+        if (sz <= bufferSize && !buffers.empty()) {
+            MessageBuffer *ret = buffers.back();
+            buffers.pop_back();
+            ret->retain();
+            return ret;
+        }
+        return new MessageBuffer(this, std::max(sz, bufferSize));
+    }
+
+    /**
+     * Get a message referring to sz bytes starting at bytes in buf
+     */
+    BinaryMessage *getMessage(MessageBuffer *buf, char *bytes, size_t sz) {
+        BinaryMessage *ret;
+        if (messages.empty()) {
+            ret = new BinaryMessage;
+            ret->pool = this;
+        } else {
+            ret = messages.back();
+            messages.pop_back();
+        }
+        ret->attach(buf, bytes, sz);
+        return ret;
+    }
+
+    void put(MessageBuffer *buf) {
+        if (buf->size == bufferSize) {
+            buffers.push_back(buf);
+        } else {
+            // Only the oversized buffers used for huge messages
+            delete buf;
+        }
+    }
+
+    void put(BinaryMessage *msg) {
+        msg->detach();
+        messages.push_back(msg);
+    }
+
+private:
+    size_t bufferSize;
+    std::vector<MessageBuffer*> buffers;
+    std::vector<BinaryMessage*> messages;
+};
+
+inline void MessageBuffer::release() {
+    assert(refcount > 0);
+    if (--refcount == 0) {
+        pool->put(this);
+    }
+}
+
+inline void BinaryMessage::release() {
+    if (pool != NULL) {
+        pool->put(this);
+    } else {
+        delete this;
+    }
+}
+
 class TapRequestBinaryMessage : public BinaryMessage {
 public:
     TapRequestBinaryMessage(const std::string &name, std::vector<uint16_t> buckets,
@@ -313,6 +480,23 @@ public:
     }
 };
 
+class NoopBinaryMessage : public BinaryMessage {
+public:
+    NoopBinaryMessage() : BinaryMessage() {
+        size = sizeof(data.req->bytes);
+        data.rawBytes = new char[size];
+        data.req->request.magic = PROTOCOL_BINARY_REQ;
+        data.req->request.opcode = PROTOCOL_BINARY_CMD_NOOP;
+        data.req->request.keylen = 0;
+        data.req->request.extlen = 0;
+        data.req->request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+        data.req->request.vbucket = 0;
+        data.req->request.bodylen = 0;
+        data.req->request.opaque = 0xcafecafe;
+        data.req->request.cas = 0;
+    }
+};
+
 class FlushBinaryMessage : public BinaryMessage {
 public:
     FlushBinaryMessage() : BinaryMessage() {
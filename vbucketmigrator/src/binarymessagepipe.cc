@@ -18,6 +18,7 @@
 #include "binarymessagepipe.h"
 
 void BinaryMessagePipe::step(short mask) {
+    ++steps;
     if ((mask & EV_WRITE) == EV_WRITE) {
         drainBuffers();
     }
@@ -27,96 +28,147 @@ void BinaryMessagePipe::step(short mask) {
     }
 }
 
+// Don't put too many iovecs on the stack
+static const int maxIovecs = IOV_MAX < 256 ? IOV_MAX : 256;
+
 bool BinaryMessagePipe::drainBuffers() {
-    if (sendptr != NULL || !queue.empty()) {
-        do {
-            if (sendptr == NULL) {
-                if (!queue.empty()) {
-                    sendptr = queue.front()->data.req->bytes;
-                    sendlen = (ssize_t)queue.front()->size;
-                } else {
-                    // no more data to send!
-                    return true;
+    while (!queue.empty()) {
+        struct iovec iov[maxIovecs];
+        int iovcnt = 0;
+        std::deque<BinaryMessage*>::iterator iter = queue.begin();
+        for (; iter != queue.end() && iovcnt < maxIovecs; ++iter, ++iovcnt) {
+            iov[iovcnt].iov_base = (*iter)->data.rawBytes;
+            iov[iovcnt].iov_len = (*iter)->size;
+        }
+        iov[0].iov_base = static_cast<char*>(iov[0].iov_base) + sendoff;
+        iov[0].iov_len -= sendoff;
+
+        ssize_t nw = writev(sock.getSocket(), iov, iovcnt);
+        if (nw == -1) {
+            switch (get_socket_errno()) {
+            case EINTR:
+                // retry
+                break;
+            case EWOULDBLOCK:
+                // no more could be sent at this time...
+                return false;
+            default:
+                {
+                    std::stringstream err;
+                    err << "Failed to write to stream: " << strerror(get_socket_errno());
+                    throw std::runtime_error(err.str());
                 }
             }
-
-            ssize_t nw;
-            nw = send(sock.getSocket(), (const char*)sendptr, sendlen, 0);
-            if (nw == -1) {
-                switch (get_socket_errno()) {
-                case EINTR:
-                    // retry
+        } else {
+            size_t left = static_cast<size_t>(nw);
+            while (left > 0) {
+                BinaryMessage *next = queue.front();
+                size_t remaining = next->size - sendoff;
+                if (left < remaining) {
+                    sendoff += left;
                     break;
-                case EWOULDBLOCK:
-                    // no more could be sent at this time...
-                    return false;
-                default:
-                    {
-                        std::stringstream err;
-                        err << "Failed to write to stream: " << strerror(get_socket_errno());
-                        throw std::runtime_error(err.str());
-                    }
                 }
-            } else if (nw == sendlen) {
-                BinaryMessage *next = queue.front();
-                queue.pop();
+                left -= remaining;
+                sendoff = 0;
+                queue.pop_front();
                 callback.messageSent(next);
-                delete next;
-                sendptr = NULL;
-            } else {
-                sendptr += nw;
-                sendlen -= nw;
+                next->release();
             }
-
-        } while (true);
+        }
     }
     return true;
 }
 
+/**
+ * Can a message start at this address? The message headers are
+ * accessed through the protocol structs, so on platforms that don't
+ * do unaligned loads the misaligned messages have to be copied out of
+ * the buffer.
+ */
+static inline bool isAligned(const char *ptr) {
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+    (void)ptr;
+    return true;
+#else
+    return (reinterpret_cast<uintptr_t>(ptr) & 7) == 0;
+#endif
+}
+
+void BinaryMessagePipe::makeRoom(size_t needed) {
+    if (inoff == inlen && !inbuf->isShared()) {
+        // Nobody is looking at the buffer, so start over
+        inoff = inlen = 0;
+    }
+
+    if (inoff + needed <= inbuf->size) {
+        return;
+    }
+
+    size_t partial = inlen - inoff;
+    if (inbuf->isShared() || needed > inbuf->size) {
+        // The messages we already read live in this buffer until
+        // they're sent, so move on to a new one
+        MessageBuffer *next = pool.getBuffer(needed);
+        memcpy(next->data, inbuf->data + inoff, partial);
+        inbuf->release();
+        inbuf = next;
+    } else {
+        memmove(inbuf->data, inbuf->data + inoff, partial);
+    }
+    inoff = 0;
+    inlen = partial;
+}
+
 bool BinaryMessagePipe::readMessage() {
     do {
-        char *dst;
-        size_t nbytes;
-        ssize_t nr = 0;
-
-        if (msg == NULL) {
-            dst = reinterpret_cast<char*>(&header) + avail;
-            nbytes = sizeof(header.bytes) - avail;
-        } else {
-            dst = msg->data.rawBytes + sizeof(header.bytes) + avail;
-            nbytes = ntohl(header.request.bodylen) - avail;
-        }
+        size_t nbytes = inlen - inoff;
+        protocol_binary_request_header header;
+
+        if (nbytes >= sizeof(header.bytes)) {
+            memcpy(header.bytes, inbuf->data + inoff, sizeof(header.bytes));
+            if (header.request.magic != PROTOCOL_BINARY_REQ &&
+                header.request.magic != PROTOCOL_BINARY_RES) {
+                throw std::runtime_error("Invalid package detected on the wire");
+            }
 
-        if (nbytes > 0) {
-            if ((nr = recv(sock.getSocket(), dst, nbytes, 0)) == -1) {
-                switch (get_socket_errno()) {
-                case EINTR:
-                    break;
-                case EWOULDBLOCK:
-                    return false;
-                default:
-                    {
-                        std::stringstream err;
-                        err << "Failed to read from stream: "
-                            << strerror(get_socket_errno());
-                        throw std::runtime_error(err.str());
-                    }
+            size_t needed = sizeof(header.bytes) + ntohl(header.request.bodylen);
+            if (nbytes >= needed) {
+                char *bytes = inbuf->data + inoff;
+                inoff += needed;
+                if (isAligned(bytes)) {
+                    msg = pool.getMessage(inbuf, bytes, needed);
+                } else {
+                    msg = new BinaryMessage(header);
+                    memcpy(msg->data.rawBytes, bytes, needed);
                 }
-            } else if (nr == 0) {
-                closed = true;
-                return false;
+                return true;
             }
+            makeRoom(needed);
+        } else {
+            makeRoom(sizeof(header.bytes));
         }
 
-        avail += nr;
-        if (nr == static_cast<ssize_t>(nbytes)) {
-            // we got everything..
-            avail = 0;
-            if (msg == NULL) {
-                msg = new BinaryMessage(header);
-            } else {
-                return true;
+        ssize_t nr = recv(sock.getSocket(), inbuf->data + inlen,
+                          inbuf->size - inlen, 0);
+        if (nr == -1) {
+            switch (get_socket_errno()) {
+            case EINTR:
+                break;
+            case EWOULDBLOCK:
+                return false;
+            default:
+                {
+                    std::stringstream err;
+                    err << "Failed to read from stream: "
+                        << strerror(get_socket_errno());
+                    throw std::runtime_error(err.str());
+                }
             }
+        } else if (nr == 0) {
+            closed = true;
+            return false;
+        } else {
+            inlen += nr;
         }
     } while (true);
 }
@@ -218,7 +270,7 @@ void BinaryMessagePipe::authenticate(const std::string &authname,
     memcpy(secret.secret.data, password.c_str(), password.length());
 
     BinaryMessage *message = new SaslListMechsBinaryMessage;
-    queue.push(message);
+    queue.push_back(message);
     if (!drainBuffers()) {
         throw std::runtime_error(std::string("Failed to send auth data"));
     }
@@ -237,7 +289,7 @@ void BinaryMessagePipe::authenticate(const std::string &authname,
 
     std::string mechs((char*)msg->data.res->bytes + sizeof(msg->data.res->bytes),
                       ntohl(msg->data.res->response.bodylen));
-    delete msg;
+    msg->release();
     msg = NULL;
 
     sasl_conn_t *conn;
@@ -262,7 +314,7 @@ void BinaryMessagePipe::authenticate(const std::string &authname,
     size_t clen = strlen(chosenmech);
     message = new SaslAuthBinaryMessage(clen, chosenmech, len, data);
     do {
-        queue.push(message);
+        queue.push_back(message);
         if (!drainBuffers()) {
             sasl_dispose(&conn);
             throw std::runtime_error(std::string("Failed to send auth data"));
@@ -289,7 +341,7 @@ void BinaryMessagePipe::authenticate(const std::string &authname,
                           blen - klen - msg->data.res->response.extlen);
 
         uint16_t stat = ntohs(msg->data.res->response.status);
-        delete msg;
+        msg->release();
         msg = NULL;
 
         switch (stat) {
@@ -325,13 +377,44 @@ void BinaryMessagePipe::authenticate(const std::string &authname,
 #endif
 }
 
+void BinaryMessagePipe::flush() {
+    // The flush is quiet, so follow it by a noop to know when it's done
+    queue.push_back(new FlushBinaryMessage);
+    queue.push_back(new NoopBinaryMessage);
+    if (!drainBuffers()) {
+        throw std::runtime_error(std::string("Failed to send flush"));
+    }
+
+    do {
+        if (!readMessage()) {
+            throw std::runtime_error(std::string("Failed to receive flush response"));
+        }
+
+        uint8_t opcode = msg->data.res->response.opcode;
+        uint16_t status = ntohs(msg->data.res->response.status);
+        msg->release();
+        msg = NULL;
+
+        if (opcode == PROTOCOL_BINARY_CMD_NOOP) {
+            return;
+        }
+
+        if (opcode == PROTOCOL_BINARY_CMD_FLUSHQ &&
+            status != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+            std::stringstream ss;
+            ss << "Failed to flush: " << status;
+            throw std::runtime_error(ss.str());
+        }
+    } while (true);
+}
+
 vbucket_state_t BinaryMessagePipe::getVBucketState(uint16_t bucket, int tmout) {
     sock.setBlockingMode(true);
     if (tmout > 0) {
         sock.setTimeout(tmout);
     }
     BinaryMessage *message = new GetVBucketStateBinaryMessage(bucket);
-    queue.push(message);
+    queue.push_back(message);
     if (!drainBuffers()) {
         throw std::runtime_error(std::string("Failed to send vbucket get state"));
     }
@@ -341,7 +424,7 @@ vbucket_state_t BinaryMessagePipe::getVBucketState(uint16_t bucket, int tmout) {
             throw std::runtime_error(std::string("Failed to receive vbucket state"));
         }
         if (msg->data.res->response.opcode == PROTOCOL_BINARY_CMD_NOOP) {
-            delete msg;
+            msg->release();
             msg = NULL;
         } else {
             break;
@@ -364,7 +447,7 @@ vbucket_state_t BinaryMessagePipe::getVBucketState(uint16_t bucket, int tmout) {
     vbucket_state_t state;
     memcpy(&state, &msg->data.vg->message.body.state, sizeof(state));
     state = (vbucket_state_t)ntohl(state);
-    delete msg;
+    msg->release();
     msg = NULL;
     return state;
 }
@@ -374,8 +457,8 @@ void BinaryMessagePipe::dumpMessages(std::ostream &out)
     BinaryMessage *next;
     while (!queue.empty()) {
         next = queue.front();
-        queue.pop();
+        queue.pop_front();
         out << "  " << next->toString() << std::endl;
-        delete next;
+        next->release();
     }
 }
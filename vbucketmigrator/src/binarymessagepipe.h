@@ -23,7 +23,7 @@
 #include "sockstream.h"
 #include <memcached/vbucket.h>
 #include <string>
-#include <queue>
+#include <deque>
 #include <event.h>
 
 #ifndef evutil_socket_t
@@ -37,7 +37,6 @@ public:
     virtual void messageSent(BinaryMessage *msg) { (void)msg; };
     virtual void abort() = 0;
     virtual void shutdown() {};
-    void markcomplete();
 };
 
 extern "C" {
@@ -48,13 +47,19 @@ class BinaryMessagePipe {
 public:
     BinaryMessagePipe(Socket &s, BinaryMessagePipeCallback &cb, struct event_base *b,
                       int tmout) :
-        sock(s), callback(cb), msg(NULL), avail(0), flags(0), base(b), timeout(tmout),
-        sendptr(NULL), sendlen(0), closed(false), doRead(true)
+        sock(s), callback(cb), msg(NULL), inbuf(NULL), inoff(0), inlen(0),
+        flags(0), base(b), timeout(tmout), sendoff(0), closed(false),
+        doRead(true), steps(0)
     {
+        inbuf = pool.getBuffer();
         updateEvent();
     }
 
     ~BinaryMessagePipe() {
+        if (msg != NULL) {
+            msg->release();
+        }
+        inbuf->release();
     }
 
     void abort() {
@@ -67,6 +72,12 @@ public:
 
     void authenticate(const std::string &authname, const std::string &password);
 
+    /**
+     * Flush all data on the other end, and wait for the flush to
+     * complete. The socket must be in blocking mode.
+     */
+    void flush();
+
     void plugInput(void) {
         doRead = false;
         updateEvent();
@@ -84,10 +95,10 @@ public:
      * This function transfer the ownership of the msg pointer
      *
      * @param msg the message to send. The message will be
-     *        deleted by calling delete when the message is transferred
+     *        released when the message is transferred
      */
     void sendMessage(BinaryMessage *message) {
-        queue.push(message);
+        queue.push_back(message);
         updateEvent();
     }
 
@@ -104,18 +115,32 @@ public:
 
     bool isClosed() const { return closed; }
 
+    /**
+     * Get the number of times this pipe has been stepped (used to
+     * see if anything is happening on it)
+     */
+    size_t getSteps() const { return steps; }
+
     void dumpMessages(std::ostream &out);
 
 protected:
 
     /**
-     * Read a message from the stream
+     * Read a message from the stream. The socket is read in big chunks
+     * into inbuf, so most of the time the message is already there.
      * @return true if a complete message is available in msg, false otherwise
      */
     bool readMessage();
 
     /**
-     * Write as much as possible from the message queue to the socket
+     * Make room in the input buffer for a message of the given size
+     * (including the part of it we already have)
+     */
+    void makeRoom(size_t needed);
+
+    /**
+     * Write as much as possible from the message queue to the socket,
+     * sending as many messages as possible in each call
      * @return true if all messages in the queue are successfully sent, false otherwise
      */
     bool drainBuffers();
@@ -128,20 +153,23 @@ protected:
     Socket &sock;
     BinaryMessagePipeCallback &callback;
     BinaryMessage *msg;
-    size_t bufsz;
-    protocol_binary_request_header header;
-    size_t avail;
+    MessagePool pool;
+    /** The buffer we're reading into, and the unparsed data in it */
+    MessageBuffer *inbuf;
+    size_t inoff;
+    size_t inlen;
     short flags;
     struct event_base *base;
     struct event ev;
     int timeout;
 
-    std::queue<BinaryMessage *> queue;
-    uint8_t *sendptr;
-    ssize_t sendlen;
+    std::deque<BinaryMessage *> queue;
+    /** The number of bytes of the first message in the queue already sent */
+    size_t sendoff;
 
     bool closed;
     bool doRead;
+    size_t steps;
 };
 
 #endif
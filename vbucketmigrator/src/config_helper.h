@@ -84,6 +84,24 @@ extern void initialize_sockets(void);
 #include <stdlib.h>
 #endif
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
+#if defined(WIN32) || defined(__WIN32__)
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+extern ssize_t writev(SOCKET s, const struct iovec *iov, int iovcnt);
+#endif
+
+#include <limits.h>
+#ifndef IOV_MAX
+/* The smallest value allowed by POSIX */
+#define IOV_MAX 16
+#endif
+
 #ifdef HAVE_SYSEXITS_H
 #include <sysexits.h>
 #endif
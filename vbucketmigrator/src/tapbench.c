@@ -0,0 +1,677 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2010 NorthScale, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Measure how fast vbucketmigrator moves data. tapbench plays both
+ * servers: a TAP producer streaming a fixed number of items for each
+ * vbucket asked for, and a sink swallowing (and counting) everything
+ * vbucketmigrator sends downstream. The servers run in-process so
+ * the numbers show the cost of the migrator and not of a real server.
+ * The sink checks every packet it gets against what the producer
+ * sent (with the expiry and flags -E and -f ask for), so a faster
+ * migrator that mangles data doesn't pass.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <memcached/protocol_binary.h>
+#include <memcached/vbucket.h>
+
+/* The expiry and flags the producer gives every item */
+#define ITEM_EXPIRY 3600
+#define ITEM_FLAGS 0xdeadbeef
+
+static int num_items = 10000;
+static int value_size = 512;
+static int buckets = 64;
+static char *item_value;
+static uint32_t expected_expiry = ITEM_EXPIRY;
+static uint32_t expected_flags = ITEM_FLAGS;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int sink_connections;
+static uint64_t sink_bytes;
+static uint64_t sink_messages;
+static uint64_t sink_errors;
+/* The number of items the sinks got for each vbucket */
+static uint32_t *sink_items;
+
+static void usage(void) {
+    fprintf(stderr, "Usage: tapbench [-n items] [-s size] [-b buckets]"
+            " [-E expiry] [-f flags] [-v vbucketmigrator] [-o options]\n");
+    exit(EXIT_FAILURE);
+}
+
+static int read_fully(int sock, void *buf, size_t len) {
+    char *ptr = buf;
+    while (len > 0) {
+        ssize_t nr = recv(sock, ptr, len, 0);
+        if (nr == -1 && errno == EINTR) {
+            continue;
+        }
+        if (nr <= 0) {
+            return -1;
+        }
+        ptr += nr;
+        len -= nr;
+    }
+    return 0;
+}
+
+static int write_fully(int sock, const void *buf, size_t len) {
+    const char *ptr = buf;
+    while (len > 0) {
+        ssize_t nw = send(sock, ptr, len, 0);
+        if (nw == -1 && errno == EINTR) {
+            continue;
+        }
+        if (nw <= 0) {
+            return -1;
+        }
+        ptr += nw;
+        len -= nw;
+    }
+    return 0;
+}
+
+/**
+ * Read a packet into buf (growing it as needed)
+ * @return the size of the body, or -1 on EOF / error
+ */
+static ssize_t read_packet(int sock, protocol_binary_request_header *header,
+                           char **buf, size_t *bufsz) {
+    if (read_fully(sock, header->bytes, sizeof(header->bytes)) == -1) {
+        return -1;
+    }
+
+    size_t bodylen = ntohl(header->request.bodylen);
+    if (bodylen > *bufsz) {
+        free(*buf);
+        *bufsz = bodylen;
+        if ((*buf = malloc(bodylen)) == NULL) {
+            return -1;
+        }
+    }
+    if (bodylen > 0 && read_fully(sock, *buf, bodylen) == -1) {
+        return -1;
+    }
+    return (ssize_t)bodylen;
+}
+
+static void init_header(protocol_binary_request_header *header,
+                        uint8_t magic, uint8_t opcode, uint16_t keylen,
+                        uint8_t extlen, uint16_t vbucket, uint32_t bodylen) {
+    memset(header, 0, sizeof(*header));
+    header->request.magic = magic;
+    header->request.opcode = opcode;
+    header->request.keylen = htons(keylen);
+    header->request.extlen = extlen;
+    header->request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    header->request.vbucket = htons(vbucket);
+    header->request.bodylen = htonl(bodylen);
+}
+
+struct output {
+    int sock;
+    char buffer[64 * 1024];
+    size_t used;
+};
+
+static int output_flush(struct output *out) {
+    int ret = write_fully(out->sock, out->buffer, out->used);
+    out->used = 0;
+    return ret;
+}
+
+static char *output_reserve(struct output *out, size_t len) {
+    if (out->used + len > sizeof(out->buffer)) {
+        if (output_flush(out) == -1) {
+            return NULL;
+        }
+    }
+    char *ret = out->buffer + out->used;
+    out->used += len;
+    return ret;
+}
+
+static int send_vbucket_set(struct output *out, uint16_t vbucket,
+                            vbucket_state_t state) {
+    protocol_binary_request_tap_vbucket_set req;
+    uint32_t val = htonl(state);
+    char *ptr = output_reserve(out, sizeof(req.bytes) + sizeof(val));
+    if (ptr == NULL) {
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    init_header(&req.message.header, PROTOCOL_BINARY_REQ,
+                PROTOCOL_BINARY_CMD_TAP_VBUCKET_SET, 0, 8, vbucket,
+                8 + sizeof(val));
+    memcpy(ptr, req.bytes, sizeof(req.bytes));
+    memcpy(ptr + sizeof(req.bytes), &val, sizeof(val));
+    return 0;
+}
+
+static int send_mutation(struct output *out, uint16_t vbucket, int item) {
+    protocol_binary_request_tap_mutation req;
+    char key[32];
+    int keylen = snprintf(key, sizeof(key), "key_%u_%d", vbucket, item);
+    size_t total = sizeof(req.bytes) + keylen + value_size;
+
+    char *ptr;
+    if (total > sizeof(out->buffer)) {
+        if (output_flush(out) == -1) {
+            return -1;
+        }
+        ptr = NULL;
+    } else if ((ptr = output_reserve(out, total)) == NULL) {
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    init_header(&req.message.header, PROTOCOL_BINARY_REQ,
+                PROTOCOL_BINARY_CMD_TAP_MUTATION, (uint16_t)keylen, 16,
+                vbucket, 16 + keylen + value_size);
+    req.message.body.item.flags = htonl(ITEM_FLAGS);
+    req.message.body.item.expiration = htonl(ITEM_EXPIRY);
+
+    if (ptr == NULL) {
+        // Too big for the buffer, send it straight away
+        if (write_fully(out->sock, req.bytes, sizeof(req.bytes)) == -1 ||
+            write_fully(out->sock, key, keylen) == -1 ||
+            write_fully(out->sock, item_value, value_size) == -1) {
+            return -1;
+        }
+        return 0;
+    }
+
+    memcpy(ptr, req.bytes, sizeof(req.bytes));
+    memcpy(ptr + sizeof(req.bytes), key, keylen);
+    memcpy(ptr + sizeof(req.bytes) + keylen, item_value, value_size);
+    return 0;
+}
+
+/**
+ * Serve a TAP connection: stream all the items for the vbuckets in
+ * the TAP_CONNECT (wrapped in the pending / active state changes if
+ * it's a takeover) and hang up.
+ */
+static void *producer(void *arg) {
+    int sock = (int)(intptr_t)arg;
+    protocol_binary_request_header header;
+    char *body = NULL;
+    size_t bodysz = 0;
+    struct output *out = NULL;
+
+    ssize_t len = read_packet(sock, &header, &body, &bodysz);
+    if (len == -1 || header.request.opcode != PROTOCOL_BINARY_CMD_TAP_CONNECT ||
+        header.request.extlen != 4) {
+        fprintf(stderr, "Expected a TAP_CONNECT\n");
+        goto done;
+    }
+
+    uint32_t flags;
+    memcpy(&flags, body, sizeof(flags));
+    flags = ntohl(flags);
+    if ((flags & TAP_CONNECT_FLAG_LIST_VBUCKETS) == 0) {
+        fprintf(stderr, "Expected a list of vbuckets\n");
+        goto done;
+    }
+
+    char *ptr = body + 4 + ntohs(header.request.keylen);
+    uint16_t count;
+    memcpy(&count, ptr, sizeof(count));
+    count = ntohs(count);
+    ptr += 2;
+
+    bool takeover = (flags & TAP_CONNECT_FLAG_TAKEOVER_VBUCKETS) != 0;
+    if ((out = malloc(sizeof(*out))) == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        goto done;
+    }
+    out->sock = sock;
+    out->used = 0;
+
+    for (int ii = 0; ii < count; ++ii) {
+        uint16_t vbucket;
+        memcpy(&vbucket, ptr + ii * 2, sizeof(vbucket));
+        vbucket = ntohs(vbucket);
+
+        if (takeover && send_vbucket_set(out, vbucket, vbucket_state_pending) == -1) {
+            goto done;
+        }
+        for (int jj = 0; jj < num_items; ++jj) {
+            if (send_mutation(out, vbucket, jj) == -1) {
+                goto done;
+            }
+        }
+        if (takeover && send_vbucket_set(out, vbucket, vbucket_state_active) == -1) {
+            goto done;
+        }
+    }
+    output_flush(out);
+
+ done:
+    free(out);
+    free(body);
+    close(sock);
+    return NULL;
+}
+
+/**
+ * Answer the NOOP and GET_VBUCKET requests vbucketmigrator use to
+ * check on the server
+ */
+static int respond(int sock, const protocol_binary_request_header *header) {
+    if (header->request.opcode == PROTOCOL_BINARY_CMD_NOOP) {
+        protocol_binary_response_header res;
+        init_header((protocol_binary_request_header*)&res, PROTOCOL_BINARY_RES,
+                    PROTOCOL_BINARY_CMD_NOOP, 0, 0, 0, 0);
+        res.response.opaque = header->request.opaque;
+        return write_fully(sock, res.bytes, sizeof(res.bytes));
+    } else if (header->request.opcode == PROTOCOL_BINARY_CMD_GET_VBUCKET) {
+        protocol_binary_response_get_vbucket res;
+        init_header((protocol_binary_request_header*)&res.message.header,
+                    PROTOCOL_BINARY_RES, PROTOCOL_BINARY_CMD_GET_VBUCKET,
+                    0, 0, 0, sizeof(res.message.body));
+        res.message.header.response.opaque = header->request.opaque;
+        res.message.body.state = htonl(vbucket_state_active);
+        return write_fully(sock, res.bytes, sizeof(res.bytes));
+    }
+    return 0;
+}
+
+/**
+ * Check a TAP_MUTATION against the one the producer sent
+ * @return NULL if it is intact, or what is wrong with it
+ */
+static const char *check_mutation(const char *packet, uint32_t *items) {
+    protocol_binary_request_tap_mutation req;
+    memcpy(req.bytes, packet, sizeof(req.bytes));
+
+    uint16_t vbucket = ntohs(req.message.header.request.vbucket);
+    uint16_t keylen = ntohs(req.message.header.request.keylen);
+    if (req.message.header.request.extlen != 16 ||
+        ntohl(req.message.header.request.bodylen) != 16u + keylen + value_size) {
+        return "bad mutation framing";
+    }
+    if (ntohs(req.message.body.tap.enginespecific_length) != 0) {
+        return "unexpected engine specific data";
+    }
+    if (ntohl(req.message.body.item.expiration) != expected_expiry) {
+        return "wrong expiry";
+    }
+    if (ntohl(req.message.body.item.flags) != expected_flags) {
+        return "wrong flags";
+    }
+
+    char key[32];
+    unsigned int keyvb;
+    int item, parsed = 0;
+    if (keylen >= sizeof(key)) {
+        return "bad key";
+    }
+    memcpy(key, packet + sizeof(req.bytes), keylen);
+    key[keylen] = '\0';
+    if (sscanf(key, "key_%u_%d%n", &keyvb, &item, &parsed) != 2 ||
+        parsed != keylen || keyvb != vbucket ||
+        item < 0 || item >= num_items) {
+        return "bad key";
+    }
+    if (vbucket >= buckets) {
+        return "mutation for a vbucket we didn't move";
+    }
+    if (memcmp(packet + sizeof(req.bytes) + keylen, item_value,
+               value_size) != 0) {
+        return "bad value";
+    }
+
+    ++items[vbucket];
+    return NULL;
+}
+
+/**
+ * Check a TAP_VBUCKET_SET for one of the vbuckets we move
+ * @return NULL if it is intact, or what is wrong with it
+ */
+static const char *check_vbucket_set(const char *packet) {
+    protocol_binary_request_tap_vbucket_set req;
+    uint32_t state;
+    memcpy(req.bytes, packet, sizeof(req.bytes));
+
+    if (req.message.header.request.extlen != 8 ||
+        req.message.header.request.keylen != 0 ||
+        ntohl(req.message.header.request.bodylen) != 8 + sizeof(state)) {
+        return "bad vbucket set framing";
+    }
+    if (ntohs(req.message.header.request.vbucket) >= buckets) {
+        return "vbucket set for a vbucket we didn't move";
+    }
+    memcpy(&state, packet + sizeof(req.bytes), sizeof(state));
+    state = ntohl(state);
+    if (state != vbucket_state_pending && state != vbucket_state_active) {
+        return "bad vbucket state";
+    }
+    return NULL;
+}
+
+/**
+ * Check a complete packet vbucketmigrator sent us
+ * @return NULL if it is one we expect, or what is wrong with it
+ */
+static const char *check_packet(const char *packet, uint32_t *items) {
+    protocol_binary_request_header header;
+    memcpy(header.bytes, packet, sizeof(header.bytes));
+
+    if (header.request.magic != PROTOCOL_BINARY_REQ) {
+        return "bad magic";
+    }
+
+    switch (header.request.opcode) {
+    case PROTOCOL_BINARY_CMD_TAP_MUTATION:
+        return check_mutation(packet, items);
+    case PROTOCOL_BINARY_CMD_TAP_VBUCKET_SET:
+        return check_vbucket_set(packet);
+    case PROTOCOL_BINARY_CMD_NOOP:
+    case PROTOCOL_BINARY_CMD_GET_VBUCKET:
+    case PROTOCOL_BINARY_CMD_FLUSHQ:
+        return NULL;
+    default:
+        return "unexpected opcode";
+    }
+}
+
+#define SINK_BUFFER_SIZE (256 * 1024)
+
+/**
+ * Swallow (and count) everything sent to us, checking each packet on
+ * the way. The sink reads in big chunks so it keeps up with the
+ * migrator, and grows its buffer for packets that don't fit.
+ */
+static void *sink(void *arg) {
+    int sock = (int)(intptr_t)arg;
+    size_t bufsz = SINK_BUFFER_SIZE;
+    char *buffer = malloc(bufsz);
+    uint32_t *items = calloc(buckets, sizeof(*items));
+    size_t used = 0;
+    uint64_t bytes = 0;
+    uint64_t messages = 0;
+    uint64_t errors = 0;
+
+    if (buffer == NULL || items == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        ++errors;
+        goto done;
+    }
+
+    while (true) {
+        ssize_t nr = recv(sock, buffer + used, bufsz - used, 0);
+        if (nr == -1 && errno == EINTR) {
+            continue;
+        }
+        if (nr <= 0) {
+            break;
+        }
+        bytes += nr;
+        used += nr;
+
+        size_t offset = 0;
+        while (used - offset >= sizeof(protocol_binary_request_header)) {
+            protocol_binary_request_header header;
+            memcpy(header.bytes, buffer + offset, sizeof(header.bytes));
+            size_t total = sizeof(header.bytes) + ntohl(header.request.bodylen);
+            if (used - offset < total) {
+                // wait for the rest of it
+                break;
+            }
+
+            ++messages;
+            const char *error = check_packet(buffer + offset, items);
+            if (error != NULL) {
+                if (errors++ == 0) {
+                    fprintf(stderr, "ERROR: packet %llu (opcode 0x%02x,"
+                            " vbucket %u): %s\n",
+                            (unsigned long long)messages,
+                            header.request.opcode,
+                            ntohs(header.request.vbucket), error);
+                }
+            }
+            if (respond(sock, &header) == -1) {
+                goto done;
+            }
+            offset += total;
+        }
+
+        memmove(buffer, buffer + offset, used - offset);
+        used -= offset;
+
+        if (used >= sizeof(protocol_binary_request_header)) {
+            protocol_binary_request_header header;
+            memcpy(header.bytes, buffer, sizeof(header.bytes));
+            size_t total = sizeof(header.bytes) + ntohl(header.request.bodylen);
+            if (total > bufsz) {
+                char *p = realloc(buffer, total);
+                if (p == NULL) {
+                    fprintf(stderr, "Failed to allocate memory\n");
+                    ++errors;
+                    goto done;
+                }
+                buffer = p;
+                bufsz = total;
+            }
+        }
+    }
+
+    if (used != 0) {
+        fprintf(stderr, "ERROR: %lu bytes of a partial packet at EOF\n",
+                (unsigned long)used);
+        ++errors;
+    }
+
+ done:
+    free(buffer);
+    close(sock);
+
+    pthread_mutex_lock(&mutex);
+    sink_bytes += bytes;
+    sink_messages += messages;
+    sink_errors += errors;
+    if (items != NULL) {
+        for (int ii = 0; ii < buckets; ++ii) {
+            sink_items[ii] += items[ii];
+        }
+    }
+    --sink_connections;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+    free(items);
+    return NULL;
+}
+
+struct server {
+    int sock;
+    void *(*handler)(void *);
+};
+
+static void *accept_loop(void *arg) {
+    struct server *server = arg;
+    do {
+        int client = accept(server->sock, NULL, NULL);
+        if (client == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "accept: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        if (server->handler == sink) {
+            pthread_mutex_lock(&mutex);
+            ++sink_connections;
+            pthread_mutex_unlock(&mutex);
+        }
+
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, server->handler,
+                           (void*)(intptr_t)client) != 0) {
+            fprintf(stderr, "Failed to create thread\n");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(tid);
+    } while (true);
+
+    return NULL;
+}
+
+/**
+ * Start a server on an ephemeral port on the loopback interface
+ * @return the port number
+ */
+static int start_server(struct server *server, void *(*handler)(void *)) {
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    int one = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    if ((server->sock = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+        setsockopt(server->sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1 ||
+        bind(server->sock, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+        listen(server->sock, 64) == -1 ||
+        getsockname(server->sock, (struct sockaddr*)&addr, &addrlen) == -1) {
+        fprintf(stderr, "Failed to start server: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    server->handler = handler;
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, accept_loop, server) != 0) {
+        fprintf(stderr, "Failed to create thread\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(tid);
+
+    return ntohs(addr.sin_port);
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    const char *vbucketmigrator = "./vbucketmigrator";
+    const char *options = "";
+    char reset[64] = "";
+
+    while ((c = getopt(argc, argv, "n:s:b:E:f:v:o:?")) != EOF) {
+        switch (c) {
+        case 'n': num_items = atoi(optarg); break;
+        case 's': value_size = atoi(optarg); break;
+        case 'b': buckets = atoi(optarg); break;
+        case 'E': expected_expiry = strtoul(optarg, NULL, 10); break;
+        case 'f': expected_flags = strtoul(optarg, NULL, 10); break;
+        case 'v': vbucketmigrator = optarg; break;
+        case 'o': options = optarg; break;
+        default:
+            usage();
+        }
+    }
+
+    if (num_items < 0 || value_size < 0 || buckets < 1 || buckets > 65536) {
+        usage();
+    }
+
+    if ((item_value = malloc(value_size)) == NULL ||
+        (sink_items = calloc(buckets, sizeof(*sink_items))) == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return EXIT_FAILURE;
+    }
+    memset(item_value, 'x', value_size);
+
+    if (expected_expiry != ITEM_EXPIRY) {
+        snprintf(reset, sizeof(reset), "-E %lu ",
+                 (unsigned long)expected_expiry);
+    }
+    if (expected_flags != ITEM_FLAGS) {
+        size_t len = strlen(reset);
+        snprintf(reset + len, sizeof(reset) - len, "-f %lu ",
+                 (unsigned long)expected_flags);
+    }
+
+    struct server upstream, downstream;
+    int upstream_port = start_server(&upstream, producer);
+    int downstream_port = start_server(&downstream, sink);
+
+    char cmd[1024];
+    snprintf(cmd, sizeof(cmd),
+             "%s -h 127.0.0.1:%d -d 127.0.0.1:%d -b [0,%d] -t %s%s > /dev/null",
+             vbucketmigrator, upstream_port, downstream_port, buckets - 1,
+             reset, options);
+
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    int ret = system(cmd);
+    gettimeofday(&end, NULL);
+    if (ret != 0) {
+        fprintf(stderr, "ERROR: vbucketmigrator failed with: %d\n", ret);
+        return EXIT_FAILURE;
+    }
+
+    // vbucketmigrator is gone, so the sinks are about to see EOF
+    pthread_mutex_lock(&mutex);
+    while (sink_connections > 0) {
+        pthread_cond_wait(&cond, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    for (int ii = 0; ii < buckets; ++ii) {
+        if (sink_items[ii] != (uint32_t)num_items) {
+            fprintf(stderr, "ERROR: got %u of the %d items in vbucket %d\n",
+                    sink_items[ii], num_items, ii);
+            ++sink_errors;
+        }
+    }
+    if (sink_errors != 0) {
+        fprintf(stderr, "ERROR: %llu bad packets or vbuckets\n",
+                (unsigned long long)sink_errors);
+        return EXIT_FAILURE;
+    }
+
+    double duration = (end.tv_sec - start.tv_sec) +
+        (end.tv_usec - start.tv_usec) / 1000000.0;
+    fprintf(stdout, "Moved %llu messages (%llu bytes) in %.3f seconds\n",
+            (unsigned long long)sink_messages,
+            (unsigned long long)sink_bytes, duration);
+    fprintf(stdout, "%.1f MB/s, %.0f messages/s\n",
+            sink_bytes / duration / (1024 * 1024),
+            sink_messages / duration);
+
+    return EXIT_SUCCESS;
+}
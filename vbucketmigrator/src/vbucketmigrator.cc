@@ -26,6 +26,7 @@
 #include <event.h>
 #include <pthread.h>
 #include <algorithm>
+#include <sys/time.h>
 #include <memcached/vbucket.h>
 
 #include "sockstream.h"
@@ -41,10 +42,6 @@ using namespace std;
 static uint8_t verbosity(0);
 static unsigned int timeout = 0;
 static int exit_code = EX_OK;
-static struct event timerev;
-static bool evtimer_active(false);
-
-static size_t packets(0);
 
 static void usage(std::string binary) {
     ssize_t idx = binary.find_last_of("/\\");
@@ -68,27 +65,26 @@ static void usage(std::string binary) {
          << "\t-V           Validate bucket takeover" << endl
          << "\t-E expiry    Reset the expiry of all items to 'expiry'." << endl
          << "\t-f flag      Reset the flag of all items to 'flag'." << endl
-         << "\t-r           Connect to the master as a registered TAP client" << endl;
+         << "\t-r           Connect to the master as a registered TAP client" << endl
+         << "\t-P #         Split the buckets over # parallel TAP streams" << endl
+         << "\t-j #         Run the TAP streams on # threads" << endl;
     exit(EX_USAGE);
 }
 
-void BinaryMessagePipeCallback::markcomplete() {
-    if (evtimer_active) {
-        evtimer_active = false;
-        evtimer_del(&timerev);
-    }
-}
+class Worker;
 
 const int PENDING_SEND_LO_WAT = 128;
 const int PENDING_SEND_HI_WAT = 512;
 
 class UpstreamController {
 public:
-    UpstreamController() :
-        upstream(0), pendingSendCount(0),
-        closed(false), inputPlugged(false), aborting(false)
+    UpstreamController(Worker *w) :
+        upstream(0), worker(w), pendingSendCount(0),
+        closed(false), inputPlugged(false), aborting(false),
+        completed(false), messages(0), bytes(0)
     {
-        // Empty
+        startTime.tv_sec = startTime.tv_usec = 0;
+        endTime = startTime;
     }
 
     void sendUpstreamMessage(BinaryMessage *msg) {
@@ -141,12 +137,53 @@ public:
         upstream->dumpMessages(out);
     }
 
+    void started() {
+        gettimeofday(&startTime, NULL);
+    }
+
+    /**
+     * Mark the stream as complete (it's ok to call this more than once)
+     */
+    void complete();
+
+    void messageForwarded(const BinaryMessage *msg) {
+        ++messages;
+        bytes += msg->size;
+    }
+
+    size_t getMessages() const {
+        return messages;
+    }
+
+    uint64_t getBytes() const {
+        return bytes;
+    }
+
+    /**
+     * Get the number of seconds the stream has been running (or ran
+     * until it completed)
+     */
+    double getDuration() const {
+        struct timeval end = endTime;
+        if (!completed) {
+            gettimeofday(&end, NULL);
+        }
+        return (end.tv_sec - startTime.tv_sec) +
+            (end.tv_usec - startTime.tv_usec) / 1000000.0;
+    }
+
 private:
     BinaryMessagePipe *upstream;
+    Worker *worker;
     int pendingSendCount;
     bool closed;
     bool inputPlugged;
     bool aborting;
+    bool completed;
+    size_t messages;
+    uint64_t bytes;
+    struct timeval startTime;
+    struct timeval endTime;
 };
 
 class DownstreamBinaryMessagePipeCallback : public BinaryMessagePipeCallback {
@@ -160,7 +197,7 @@ public:
     void messageReceived(BinaryMessage *msg) {
         if (msg->data.req->request.opcode == PROTOCOL_BINARY_CMD_NOOP) {
             // Ignore NOOP responses
-            delete msg;
+            msg->release();
         } else {
             upstream->sendUpstreamMessage(msg);
             if (verbosity > 1) {
@@ -181,16 +218,21 @@ public:
                 memcpy(&state, msg->data.rawBytes + sizeof(msg->data.vs->bytes),
                        sizeof(state));
                 state = static_cast<vbucket_state_t>(ntohl(state));
+                // Format the line first so the lines from the streams
+                // running in other threads don't get mixed up
+                std::stringstream ss;
                 if (state == vbucket_state_pending) {
-                    cout << "Starting to move bucket "
-                         << msg->getVBucketId()
-                         << endl;
+                    ss << "Starting to move bucket "
+                       << msg->getVBucketId()
+                       << endl;
+                    cout << ss.str();
                     cout.flush();
                 } else if (state == vbucket_state_active) {
                     ++moved;
-                    cout << "Bucket "
-                         << msg->getVBucketId()
-                         << " moved to the next server" << endl;
+                    ss << "Bucket "
+                       << msg->getVBucketId()
+                       << " moved to the next server" << endl;
+                    cout << ss.str();
                     cout.flush();
                 } else if (!is_valid_vbucket_state_t(state)) {
                     cerr << "Illegal vbucket state received: "
@@ -207,14 +249,14 @@ public:
         if (!aborting) {
             aborting = true;
             cerr << "An error occured on the downstream connection.." << endl;
-            markcomplete();
+            upstream->complete();
             upstream->abort();
         }
     }
 
     void shutdown() {
         aborting = true;
-        markcomplete();
+        upstream->complete();
         upstream->abort();
     }
 
@@ -269,9 +311,10 @@ public:
                       << "Received a message for a bucket I didn't request:"
                       << msg->toString()
                       << std::endl;
-            delete msg;
+            msg->release();
         } else {
             controller->incrementPendingDownstream();
+            controller->messageForwarded(msg);
             fixMessage(msg);
             downstream->sendMessage(msg);
         }
@@ -301,7 +344,7 @@ public:
     }
 
     void completeMe() {
-        markcomplete();
+        controller->complete();
         controller->close();
     }
 
@@ -330,6 +373,122 @@ private:
     uint32_t flags;
 };
 
+class Stream;
+
+/**
+ * A thread running an event loop for one or more of the TAP streams
+ */
+class Worker {
+public:
+    Worker(struct event_base *b) :
+        base(b), timerActive(false), running(0),
+        previousSteps(0), numSame(0)
+    {
+        // Empty
+    }
+
+    void addStream(Stream *stream) {
+        streams.push_back(stream);
+        ++running;
+    }
+
+    void streamCompleted() {
+        // Let the event loop terminate when the last stream is done
+        if (--running == 0 && timerActive) {
+            timerActive = false;
+            evtimer_del(&timer);
+        }
+    }
+
+    void startTimer();
+    void tick();
+
+    void run() {
+        event_base_loop(base, 0);
+    }
+
+    void stop() {
+        event_base_loopbreak(base);
+    }
+
+    struct event_base *getBase() {
+        return base;
+    }
+
+    pthread_t thread;
+
+private:
+    size_t getSteps() const;
+
+    struct event_base *base;
+    struct event timer;
+    bool timerActive;
+    size_t running;
+    std::vector<Stream*> streams;
+    size_t previousSteps;
+    unsigned int numSame;
+};
+
+static vector<Worker*> workers;
+
+void UpstreamController::complete() {
+    if (!completed) {
+        completed = true;
+        gettimeofday(&endTime, NULL);
+        worker->streamCompleted();
+    }
+}
+
+/**
+ * A TAP stream moving a subset of the buckets, with its own upstream
+ * and downstream connection
+ */
+class Stream {
+public:
+    Stream(size_t i, const vector<uint16_t> &b, Worker *w) :
+        id(i), buckets(b), controller(w),
+        upstream(&controller, buckets), downstream(&controller),
+        upstreamPipe(NULL), downstreamPipe(NULL)
+    {
+        // Empty
+    }
+
+    void report(std::ostream &out) const {
+        double duration = controller.getDuration();
+        out << "Stream " << id << " (" << buckets.size() << " vbuckets): "
+            << controller.getMessages() << " messages, "
+            << controller.getBytes() << " bytes in "
+            << duration << "s";
+        if (duration > 0) {
+            out << " (" << controller.getBytes() / duration / (1024 * 1024)
+                << " MB/s)";
+        }
+        out << endl;
+    }
+
+    size_t id;
+    vector<uint16_t> buckets;
+    UpstreamController controller;
+    UpstreamBinaryMessagePipeCallback upstream;
+    DownstreamBinaryMessagePipeCallback downstream;
+    BinaryMessagePipe *upstreamPipe;
+    BinaryMessagePipe *downstreamPipe;
+};
+
+size_t Worker::getSteps() const {
+    size_t ret = 0;
+    std::vector<Stream*>::const_iterator iter;
+    for (iter = streams.begin(); iter != streams.end(); ++iter) {
+        if ((*iter)->upstreamPipe) {
+            ret += (*iter)->upstreamPipe->getSteps();
+        }
+        if ((*iter)->downstreamPipe) {
+            ret += (*iter)->downstreamPipe->getSteps();
+        }
+    }
+    return ret;
+}
+
 extern "C" {
     void event_handler(evutil_socket_t fd, short which, void *arg) {
         (void)fd;
@@ -341,8 +500,6 @@ extern "C" {
             exit(EXIT_FAILURE);
         }
 
-        ++packets;
-
         try {
             pipe->step(which);
         } catch (std::exception& e) {
@@ -356,34 +513,48 @@ extern "C" {
     static void timer_handler(evutil_socket_t fd, short which, void *arg) {
         (void)fd;
         (void)which;
-        (void)arg;
-
-        // A hack follows.
-        static size_t previousPackets(0);
-        static unsigned int numSame(0);
-
-        if (previousPackets == packets) {
-            if (timeout > 0 && ++numSame > timeout + 3) {
-                // numSame == number of seconds the packet counter
-                // hasn't moved, so this is an alternate view on
-                // timeouts.  Added 3 to the timeout just to make this
-                // more of a safety net and less of a race against the
-                // normal timeout.
-                std::cerr << "Safety net timed out" << std::endl;
-                exit(EXIT_FAILURE);
-            }
-        } else {
-            numSame = 0;
-            previousPackets = packets;
-        }
+        reinterpret_cast<Worker*>(arg)->tick();
+    }
 
-        // reschedule
-        struct timeval tv = {1, 0};
-        int event_add_rv = event_add(&timerev, &tv);
-        assert(event_add_rv != -1);
+    static void *worker_main(void *arg) {
+        reinterpret_cast<Worker*>(arg)->run();
+        return NULL;
     }
 }
 
+void Worker::startTimer() {
+    evtimer_set(&timer, timer_handler, this);
+    event_base_set(base, &timer);
+    struct timeval tv = {1, 0};
+    int event_add_rv = event_add(&timer, &tv);
+    timerActive = true;
+    assert(event_add_rv != -1);
+}
+
+void Worker::tick() {
+    // A hack follows.
+    size_t steps = getSteps();
+    if (previousSteps == steps) {
+        if (timeout > 0 && ++numSame > timeout + 3) {
+            // numSame == number of seconds the packet counter
+            // hasn't moved, so this is an alternate view on
+            // timeouts.  Added 3 to the timeout just to make this
+            // more of a safety net and less of a race against the
+            // normal timeout.
+            std::cerr << "Safety net timed out" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        numSame = 0;
+        previousSteps = steps;
+    }
+
+    // reschedule
+    struct timeval tv = {1, 0};
+    int event_add_rv = event_add(&timer, &tv);
+    assert(event_add_rv != -1);
+}
+
 static BinaryMessagePipe *getServer(const string &destination,
                                     BinaryMessagePipeCallback &cb,
                                     struct event_base *b,
@@ -411,10 +582,12 @@ static BinaryMessagePipe *getServer(const string &destination,
                 cout << "Authenticated towards: " << *sock << endl;
             }
         }
-        sock->setNonBlocking();
         if (flush) {
-            ret->sendMessage(new FlushBinaryMessage);
+            // Wait for it, so that none of the streams can get data
+            // in before the flush
+            ret->flush();
         }
+        sock->setNonBlocking();
         ret->updateEvent();
 
     } catch (std::string &e) {
@@ -458,7 +631,7 @@ extern "C" {
 
 static void* check_stdin_thread(void* arg)
 {
-    struct event_base *evbase = (struct event_base*)arg;
+    (void)arg;
 
     while (!feof(stdin)) {
         getc(stdin);
@@ -466,26 +639,27 @@ static void* check_stdin_thread(void* arg)
 
     fprintf(stderr, "EOF on stdin.  Exiting\n");
     exit_code = EX_OSERR;
-    event_base_loopbreak(evbase);
+    vector<Worker*>::iterator iter;
+    for (iter = workers.begin(); iter != workers.end(); ++iter) {
+        (*iter)->stop();
+    }
     return NULL;
 }
 
-static void stdin_check(struct event_base *evbase) {
+static void stdin_check(void) {
     pthread_t t;
     pthread_attr_t attr;
 
-    // Ask for a periodic timer to fire so we *can* actually break out
-    // if something happens.
-    evtimer_set(&timerev, timer_handler, NULL);
-    event_base_set(evbase, &timerev);
-    struct timeval tv = {1, 0};
-    int event_add_rv = event_add(&timerev, &tv);
-    evtimer_active = true;
-    assert(event_add_rv != -1);
+    // Ask for a periodic timer to fire in every event loop so we
+    // *can* actually break out if something happens.
+    vector<Worker*>::iterator iter;
+    for (iter = workers.begin(); iter != workers.end(); ++iter) {
+        (*iter)->startTimer();
+    }
 
     if (pthread_attr_init(&attr) != 0 ||
         pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED) != 0 ||
-        pthread_create(&t, &attr, check_stdin_thread, (void*)evbase) != 0)
+        pthread_create(&t, &attr, check_stdin_thread, NULL) != 0)
     {
         perror("couldn't create stdin checking thread.");
         exit(EX_OSERR);
@@ -511,8 +685,10 @@ int main(int argc, char **argv)
     bool registeredTapClient = false;
     string expiryResetValue;
     string flagResetValue;
+    size_t numStreams = 1;
+    size_t numThreads = 0;
 
-    while ((cmd = getopt(argc, argv, "N:Aa:h:b:d:tvFT:e?VE:rf:")) != EOF) {
+    while ((cmd = getopt(argc, argv, "N:Aa:h:b:d:tvFT:e?VE:rf:P:j:")) != EOF) {
         switch (cmd) {
         case 'E':
             expiryResetValue.assign(optarg);
@@ -564,6 +740,16 @@ int main(int argc, char **argv)
         case 'r':
             registeredTapClient = true;
             break;
+        case 'P':
+            numStreams = atoi(optarg);
+            if (numStreams == 0) {
+                cerr << "The number of streams must be at least 1" << endl;
+                return EX_USAGE;
+            }
+            break;
+        case 'j':
+            numThreads = atoi(optarg);
+            break;
         case '?': /* FALLTHROUGH */
         default:
             usage(argv[0]);
@@ -622,64 +808,139 @@ int main(int argc, char **argv)
     }
 
     sort(buckets.begin(), buckets.end());
-    struct event_base *evbase = event_init();
-    if (evbase == NULL) {
-        cerr << "Failed to initialize libevent" << endl;
-        return EX_IOERR;
+    buckets.erase(unique(buckets.begin(), buckets.end()), buckets.end());
+
+    if (numStreams > buckets.size()) {
+        numStreams = buckets.size();
+    }
+    if (numThreads == 0 || numThreads > numStreams) {
+        numThreads = numStreams;
     }
 
-    if (erlang) {
-        stdin_check(evbase);
+    for (size_t ii = 0; ii < numThreads; ++ii) {
+        struct event_base *evbase = (ii == 0) ? event_init() : event_base_new();
+        if (evbase == NULL) {
+            cerr << "Failed to initialize libevent" << endl;
+            return EX_IOERR;
+        }
+        workers.push_back(new Worker(evbase));
     }
 
-    UpstreamController controller;
-    UpstreamBinaryMessagePipeCallback upstream(&controller, buckets);
-    DownstreamBinaryMessagePipeCallback downstream(&controller);
-    BinaryMessagePipe *downstreamPipe;
-    BinaryMessagePipe *upstreamPipe;
+    if (erlang) {
+        stdin_check();
+    }
 
-    if (expiryResetValue.length() != 0) {
-        uint32_t expiry = strtoul(expiryResetValue.c_str(), NULL, 10);
-        upstream.resetExpiry(expiry);
+    // Deal the buckets out round robin, so every stream gets its share
+    // of a range
+    vector<vector<uint16_t> > parts(numStreams);
+    for (size_t ii = 0; ii < buckets.size(); ++ii) {
+        parts[ii % numStreams].push_back(buckets[ii]);
     }
 
-    if (flagResetValue.length() != 0) {
-        uint32_t flags = strtoul(flagResetValue.c_str(), NULL, 10);
-        upstream.resetFlags(flags);
+    vector<Stream*> streams;
+    for (size_t ii = 0; ii < numStreams; ++ii) {
+        Worker *worker = workers[ii % numThreads];
+        Stream *stream = new Stream(ii, parts[ii], worker);
+        worker->addStream(stream);
+        streams.push_back(stream);
+
+        if (expiryResetValue.length() != 0) {
+            uint32_t expiry = strtoul(expiryResetValue.c_str(), NULL, 10);
+            stream->upstream.resetExpiry(expiry);
+        }
+
+        if (flagResetValue.length() != 0) {
+            uint32_t flags = strtoul(flagResetValue.c_str(), NULL, 10);
+            stream->upstream.resetFlags(flags);
+        }
     }
 
     try {
-        downstreamPipe = getServer(destination, downstream, evbase,
-                                   auth, passwd, flush);
-        upstreamPipe = getServer(host, upstream, evbase,
-                                 auth, passwd, false);
+        for (size_t ii = 0; ii < numStreams; ++ii) {
+            Stream *stream = streams[ii];
+            struct event_base *evbase = workers[ii % numThreads]->getBase();
+            // Only the first stream flush, and it's done before the
+            // other streams connect
+            stream->downstreamPipe = getServer(destination, stream->downstream,
+                                               evbase, auth, passwd,
+                                               flush && ii == 0);
+            stream->upstreamPipe = getServer(host, stream->upstream, evbase,
+                                             auth, passwd, false);
+        }
     } catch (std::string &e) {
         cerr << "Failed to connect to host: " << e.c_str() << endl;
         return EX_CONFIG;
     }
 
-    upstreamPipe->sendMessage(new TapRequestBinaryMessage(name, buckets, takeover,
-                                                          tapAck, registeredTapClient));
-    upstreamPipe->updateEvent();
-    upstream.setDownstream(downstreamPipe);
-    controller.setUpstream(upstreamPipe);
+    for (size_t ii = 0; ii < numStreams; ++ii) {
+        Stream *stream = streams[ii];
+        string tapName(name);
+        if (!tapName.empty() && numStreams > 1) {
+            // Each stream needs a name of its own
+            stringstream ss;
+            ss << name << "_" << ii;
+            tapName = ss.str();
+        }
 
-    if (flush) {
-        controller.incrementPendingDownstream();
+        stream->upstreamPipe->sendMessage(new TapRequestBinaryMessage(tapName,
+                                                                      stream->buckets,
+                                                                      takeover,
+                                                                      tapAck,
+                                                                      registeredTapClient));
+        stream->upstreamPipe->updateEvent();
+        stream->upstream.setDownstream(stream->downstreamPipe);
+        stream->controller.setUpstream(stream->upstreamPipe);
+        stream->controller.started();
+    }
+
+    // The first worker runs in this thread
+    for (size_t ii = 1; ii < numThreads; ++ii) {
+        if (pthread_create(&workers[ii]->thread, NULL, worker_main,
+                           workers[ii]) != 0) {
+            perror("Failed to create worker thread");
+            return EX_OSERR;
+        }
     }
+    workers[0]->run();
+    for (size_t ii = 1; ii < numThreads; ++ii) {
+        pthread_join(workers[ii]->thread, NULL);
+    }
+
+    size_t moved = 0;
+    size_t messages = 0;
+    uint64_t bytes = 0;
+    double duration = 0;
+    for (size_t ii = 0; ii < numStreams; ++ii) {
+        Stream *stream = streams[ii];
+        moved += stream->downstream.getMoved();
+        messages += stream->controller.getMessages();
+        bytes += stream->controller.getBytes();
+        duration = max(duration, stream->controller.getDuration());
+
+        if (stream->controller.getPendingSendCount() != 0) {
+            cerr << "Had " << stream->controller.getPendingSendCount()
+                 << " pending messages at exit." << endl;
+            stream->controller.dumpMessages(cerr);
+            exit_code = exit_code == 0 ? EX_SOFTWARE : exit_code;
+        }
 
-    event_base_loop(evbase, 0);
+        if (numStreams > 1 || verbosity) {
+            stream->report(cout);
+        }
+    }
 
-    if (takeover && downstream.getMoved() != buckets.size()) {
-        cerr << "Did not move enough vbuckets in takeover: "
-             << downstream.getMoved() << "/" << buckets.size() << endl;
-        exit_code = exit_code == 0 ? EX_SOFTWARE : exit_code;
+    if (numStreams > 1) {
+        cout << "Total: " << messages << " messages, " << bytes
+             << " bytes in " << duration << "s";
+        if (duration > 0) {
+            cout << " (" << bytes / duration / (1024 * 1024) << " MB/s)";
+        }
+        cout << endl;
     }
 
-    if (controller.getPendingSendCount() != 0) {
-        cerr << "Had " << controller.getPendingSendCount()
-             << " pending messages at exit." << endl;
-        controller.dumpMessages(cerr);
+    if (takeover && moved != buckets.size()) {
+        cerr << "Did not move enough vbuckets in takeover: "
+             << moved << "/" << buckets.size() << endl;
         exit_code = exit_code == 0 ? EX_SOFTWARE : exit_code;
     }
 
@@ -690,11 +951,13 @@ int main(int argc, char **argv)
         }
 
         unsigned int numSuccess = 0;
-        vector<uint16_t>::iterator iter;
-        for (iter = buckets.begin(); iter != buckets.end(); ++iter) {
+        for (size_t ii = 0; ii < buckets.size(); ++ii) {
+            uint16_t bucket = buckets[ii];
+            // The buckets were dealt out to the streams round robin
+            BinaryMessagePipe *downstreamPipe = streams[ii % numStreams]->downstreamPipe;
 
             if (downstreamPipe->isClosed()) {
-                cerr << "\t" << *iter
+                cerr << "\t" << bucket
                      << " Failed to verify, pipe to "
                      << downstreamPipe->toString() << " is closed!" << endl;
                 continue ;
@@ -702,17 +965,17 @@ int main(int argc, char **argv)
 
             std::string msg;
             try {
-                vbucket_state_t state = downstreamPipe->getVBucketState(*iter,
+                vbucket_state_t state = downstreamPipe->getVBucketState(bucket,
                                                                         timeout * 1000);
                 if (state == vbucket_state_active) {
                     ++numSuccess;
                 }
                 if (state != vbucket_state_active) {
-                    cerr << "Incorrect state for " << *iter
+                    cerr << "Incorrect state for " << bucket
                          << " at "
                          << downstreamPipe->toString() << ": " << state << endl;
                 } else if (verbosity) {
-                    cout << "\t" << *iter << " ok" << endl;
+                    cout << "\t" << bucket << " ok" << endl;
                 }
             } catch (std::string &e) {
                 msg = e;
@@ -723,7 +986,7 @@ int main(int argc, char **argv)
             }
 
             if (msg.length()) {
-                cerr << "\t" << *iter << " Failed to verify: "
+                cerr << "\t" << bucket << " Failed to verify: "
                      << msg.c_str() << endl;
             }
         }
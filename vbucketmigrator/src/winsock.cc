@@ -24,3 +24,20 @@ void initialize_sockets(void) {
       throw std::runtime_error("WSAStartup failed");
    }
 }
+
+ssize_t writev(SOCKET s, const struct iovec *iov, int iovcnt) {
+    WSABUF bufs[IOV_MAX];
+    if (iovcnt > IOV_MAX) {
+        iovcnt = IOV_MAX;
+    }
+    for (int ii = 0; ii < iovcnt; ++ii) {
+        bufs[ii].buf = static_cast<char*>(iov[ii].iov_base);
+        bufs[ii].len = static_cast<ULONG>(iov[ii].iov_len);
+    }
+
+    DWORD nw;
+    if (WSASend(s, bufs, iovcnt, &nw, 0, NULL, NULL) == SOCKET_ERROR) {
+        return -1;
+    }
+    return static_cast<ssize_t>(nw);
+}